@@ -46,29 +46,53 @@ E-mail: paolo.tosco@unito.it
 #endif
 
 
-double score_alignment(O3Data *od, ConfInfo *template_conf, ConfInfo *fitted_conf, AtomPair *sdm, int pairs)
+double score_alignment(LAPInfo *li, ConfInfo *template_conf, ConfInfo *fitted_conf, AtomPair *sdm, int pairs)
 {
   int i;
+  int padded_pairs;
   /*
   int not_fitted;
   int size_diff;
   double  penalty;
   */
   double score;
-  double dist;
-  double charge_diff;
-  double charge_sum;
+  double *pref;
+  double *dist;
   
-  for (i = 0, score = 0.0; i < pairs; ++i) {
-    dist = squared_euclidean_distance
+  
+  /*
+  charge-dependent prefactors were computed once per
+  (template, candidate) pair by compute_h_cost_matrix();
+  here they are gathered together with squared distances
+  into contiguous arrays, zero-padded to a multiple of
+  SIMD_WIDTH, so that exp() can be vectorized
+  */
+  padded_pairs = (pairs + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+  pref = li->score_buf;
+  dist = &(li->score_buf[padded_pairs]);
+  for (i = 0; i < pairs; ++i) {
+    pref[i] = li->score_pref[template_conf->heavy_index[sdm[i].a[0]]]
+      [fitted_conf->heavy_index[sdm[i].a[1]]];
+    dist[i] = squared_euclidean_distance
       (&(template_conf->coord[sdm[i].a[0] * 3]),
       &(fitted_conf->coord[sdm[i].a[1] * 3]));
-    charge_diff = fabs(template_conf->atom[sdm[i].a[0]]->charge
-      - fitted_conf->atom[sdm[i].a[1]]->charge);
-    charge_sum = fabs(template_conf->atom[sdm[i].a[0]]->charge
-      + fitted_conf->atom[sdm[i].a[1]]->charge);
-    score += ((O3_SCORING_FUNCTION_ALPHA + (1.0 + O3_CHARGE_COEFF * charge_sum)
-      / (1.0 + charge_diff)) * exp(-O3_SCORING_FUNCTION_BETA * dist));
+  }
+  for (; i < padded_pairs; ++i) {
+    pref[i] = 0.0;
+    dist[i] = 0.0;
+  }
+  switch (get_simd_level()) {
+    #ifdef O3_AVX512_KERNELS
+    case SIMD_AVX512:
+    return score_sum_avx512(pref, dist, padded_pairs);
+    #endif
+    #ifdef O3_AVX2_KERNELS
+    case SIMD_AVX2:
+    return score_sum_avx2(pref, dist, padded_pairs);
+    #endif
+  }
+  for (i = 0, score = 0.0; i < pairs; ++i) {
+    score += (pref[i] * exp(-O3_SCORING_FUNCTION_BETA * dist[i]));
   }
   /*
   not_fitted = fitted_conf->n_heavy_atoms - pairs;
@@ -84,65 +108,139 @@ double score_alignment(O3Data *od, ConfInfo *template_conf, ConfInfo *fitted_con
 }
 
 
+double score_alignment_bound(LAPInfo *li, ConfInfo *template_conf, ConfInfo *moved_conf)
+{
+  int y;
+  int x;
+  double max_pref;
+  double bound[2];
+  
+  
+  /*
+  upper bound to any score_alignment() value for this
+  (template, candidate) pair: since exp(-beta * dist) <= 1
+  and each heavy atom can be matched at most once, the
+  score cannot exceed the sum over the heavy atoms of either
+  molecule of their largest prefactor
+  */
+  for (y = 0, bound[0] = 0.0; y < template_conf->n_heavy_atoms; ++y) {
+    for (x = 0, max_pref = 0.0; x < moved_conf->n_heavy_atoms; ++x) {
+      if (li->score_pref[y][x] > max_pref) {
+        max_pref = li->score_pref[y][x];
+      }
+    }
+    bound[0] += max_pref;
+  }
+  for (x = 0, bound[1] = 0.0; x < moved_conf->n_heavy_atoms; ++x) {
+    for (y = 0, max_pref = 0.0; y < template_conf->n_heavy_atoms; ++y) {
+      if (li->score_pref[y][x] > max_pref) {
+        max_pref = li->score_pref[y][x];
+      }
+    }
+    bound[1] += max_pref;
+  }
+  /*
+  the slack absorbs rounding differences due to the
+  different summation order and to the vectorized exp()
+  */
+  
+  return ((bound[0] < bound[1]) ? bound[0] : bound[1]) * (1.0 + SCORE_BOUND_SLACK);
+}
+
+
+static int get_score_index_type(O3Data *od)
+{
+  return ((od->align.type & ALIGN_PHARAO_BIT)
+    ? SCORE_INDEX_PHARAO : SCORE_INDEX_O3A);
+}
+
+
+static void set_best_template_object_num(O3Data *od, int *best_template_object_num)
+{
+  if ((*best_template_object_num > 0)
+    && (*best_template_object_num <= od->grid.object_num)) {
+    --(*best_template_object_num);
+  }
+  else {
+    *best_template_object_num = -1;
+  }
+}
+
+
 int get_alignment_score(O3Data *od, FileDescriptor *fd, int object_num,
   double *score, int *best_template_object_num)
 {
   char buffer[BUF_LEN];
   int found;
-  int pos;
+  int64_t pos;
+  ScoreIndexEntry entry;
+  SdfStream *ss;
   
   
+  /*
+  the score index next to the SDF file is
+  looked up first; the SDF file is only
+  scanned as text if no index can be built
+  */
+  if (!get_score_index_entry(fd->name,
+    get_score_index_type(od), object_num, &entry)) {
+    if (score) {
+      if (!(entry.has_score)) {
+        O3_ERROR_LOCATE(&(od->task));
+        O3_ERROR_STRING(&(od->task), fd->name);
+        return CANNOT_READ_TEMP_FILE;
+      }
+      *score = entry.score;
+    }
+    if (best_template_object_num) {
+      *best_template_object_num = entry.best_template_id;
+      set_best_template_object_num(od, best_template_object_num);
+    }
+    return 0;
+  }
   memset(buffer, 0, BUF_LEN);
-  if (!(fd->handle = fopen(fd->name, "rb"))) {
+  if (!(ss = open_sdf_stream(fd->name, "rb", NULL))) {
     O3_ERROR_LOCATE(&(od->task));
     O3_ERROR_STRING(&(od->task), fd->name);
     return CANNOT_READ_TEMP_FILE;
   }
-  if (find_conformation_in_sdf(fd->handle, NULL, object_num)) {
+  if (skip_sdf_stream_records(ss, object_num)) {
     O3_ERROR_LOCATE(&(od->task));
     O3_ERROR_STRING(&(od->task), fd->name);
-    fclose(fd->handle);
+    close_sdf_stream(ss);
     return CANNOT_READ_TEMP_FILE;
   }
-  pos = ftell(fd->handle);
+  pos = tell_sdf_stream(ss);
   found = 0;
   if (score) {
-    while ((!found) && fgets(buffer, BUF_LEN, fd->handle)) {
-      buffer[BUF_LEN - 1] = '\0';
+    while ((!found) && sdf_stream_gets(buffer, BUF_LEN, ss)) {
       found = (strstr(buffer, ((od->align.type & ALIGN_PHARAO_BIT)
         ? "PHARAO_TANIMOTO" : "O3A_SCORE")) ? 1 : 0);
     }
-    if ((!found) || (!fgets(buffer, BUF_LEN, fd->handle))) {
+    if ((!found) || (!sdf_stream_gets(buffer, BUF_LEN, ss))) {
       O3_ERROR_LOCATE(&(od->task));
       O3_ERROR_STRING(&(od->task), fd->name);
-      fclose(fd->handle);
+      close_sdf_stream(ss);
       return CANNOT_READ_TEMP_FILE;
     }
     sscanf(buffer, "%lf", score);
-    fseek(fd->handle, pos, SEEK_SET);
+    seek_sdf_stream(ss, pos);
   }
   if (best_template_object_num) {
     found = 0;
-    while ((!found) && fgets(buffer, BUF_LEN, fd->handle)) {
-      buffer[BUF_LEN - 1] = '\0';
+    while ((!found) && sdf_stream_gets(buffer, BUF_LEN, ss)) {
       found = (strstr(buffer, "BEST_TEMPLATE_ID") ? 1 : 0);
     }
-    if ((!found) || (!fgets(buffer, BUF_LEN, fd->handle))) {
+    if ((!found) || (!sdf_stream_gets(buffer, BUF_LEN, ss))) {
       *best_template_object_num = -1;
     }
     else {
       buffer[BUF_LEN - 1] = '\0';
       sscanf(buffer, "%d", best_template_object_num);
-      if ((*best_template_object_num > 0)
-        && (*best_template_object_num <= od->grid.object_num)) {
-        --(*best_template_object_num);
-      }
-      else {
-        *best_template_object_num = -1;
-      }
+      set_best_template_object_num(od, best_template_object_num);
     }
   }
-  fclose(fd->handle);
+  close_sdf_stream(ss);
 
   return 0;
 }
@@ -151,6 +249,7 @@ int get_alignment_score(O3Data *od, FileDescriptor *fd, int object_num,
 int align_random(O3Data *od)
 {
   char buffer[BUF_LEN];
+  char *pose = NULL;
   int i;
   int j;
   int x;
@@ -166,16 +265,30 @@ int align_random(O3Data *od)
   double rt_mat[RT_MAT_SIZE];
   double t_vec1[RT_VEC_SIZE];
   double t_vec2[RT_VEC_SIZE];
-  FileDescriptor mol_fd;
+  double *coord = NULL;
   FileDescriptor out_sdf_fd;
   AtomInfo **atom = NULL;
+  MolTemplate *mt;
   
   
-  memset(buffer, 0, BUF_LEN);
-  memset(&mol_fd, 0, sizeof(FileDescriptor));
   memset(&out_sdf_fd, 0, sizeof(FileDescriptor));
-  if (!(atom = (AtomInfo **)alloc_array
-    (od->field.max_n_atoms + 1, sizeof(AtomInfo)))) {
+  if ((result = load_mol_templates(od, od->field.mol_dir, NULL))) {
+    return result;
+  }
+  atom = (AtomInfo **)alloc_array(od->field.max_n_atoms + 1, sizeof(AtomInfo));
+  coord = (double *)malloc((od->field.max_n_atoms + 1) * 3 * sizeof(double));
+  pose = (char *)malloc(od->mel.mol_template->max_size + 1);
+  if (!atom || !coord || !pose) {
+    if (atom) {
+      free(atom);
+    }
+    if (coord) {
+      free(coord);
+    }
+    if (pose) {
+      free(pose);
+    }
+    free_mol_templates(od);
     O3_ERROR_LOCATE(&(od->task));
     return OUT_OF_MEMORY;
   }
@@ -186,6 +299,9 @@ int align_random(O3Data *od)
     od->al.mol_info[od->grid.object_num - 1]->object_id);
   if (!(out_sdf_fd.handle = fopen(out_sdf_fd.name, "wb"))) {
     free(atom);
+    free(coord);
+    free(pose);
+    free_mol_templates(od);
     O3_ERROR_LOCATE(&(od->task));
     O3_ERROR_STRING(&(od->task), out_sdf_fd.name);
     return CANNOT_WRITE_ALIGNED_SDF;
@@ -195,23 +311,6 @@ int align_random(O3Data *od)
     if (result) {
       return result;
     }
-    sprintf(mol_fd.name, "%s%c%04d.mol", od->field.mol_dir,
-      SEPARATOR, od->al.mol_info[object_num]->object_id);
-    if (!(mol_fd.handle = fopen(mol_fd.name, "rb"))) {
-      O3_ERROR_LOCATE(&(od->task));
-      O3_ERROR_STRING(&(od->task), mol_fd.name);
-      fclose(out_sdf_fd.handle);
-      free(atom);
-      return CANNOT_READ_ORIGINAL_SDF;
-    }
-    if (find_conformation_in_sdf(mol_fd.handle, out_sdf_fd.handle, 0)) {
-      O3_ERROR_LOCATE(&(od->task));
-      O3_ERROR_STRING(&(od->task), mol_fd.name);
-      fclose(mol_fd.handle);
-      fclose(out_sdf_fd.handle);
-      free(atom);
-      return CANNOT_READ_ORIGINAL_SDF;
-    }
     memset(centroid, 0, 3 * sizeof(double));
     /*
     compute centroid, random rotation and random translation
@@ -266,35 +365,32 @@ int align_random(O3Data *od)
       cblas_dgemv(CblasColMajor, CblasNoTrans,
         RT_VEC_SIZE, RT_VEC_SIZE, 1.0, rt_mat, RT_VEC_SIZE,
         t_vec1, 1, 0.0, t_vec2, 1);
-      if (!fgets(buffer, BUF_LEN, mol_fd.handle)) {
-        O3_ERROR_LOCATE(&(od->task));
-        O3_ERROR_STRING(&(od->task), mol_fd.name);
-        fclose(mol_fd.handle);
-        fclose(out_sdf_fd.handle);
-        return CANNOT_READ_ORIGINAL_SDF;
-      }
-      buffer[BUF_LEN - 1] = '\0';
-      remove_newline(buffer);
-      if (replace_coord(od->al.mol_info[object_num]->sdf_version, buffer, t_vec2)) {
-        O3_ERROR_LOCATE(&(od->task));
-        O3_ERROR_STRING(&(od->task), mol_fd.name);
-        fclose(mol_fd.handle);
-        fclose(out_sdf_fd.handle);
-        free(atom);
-        return CANNOT_READ_ORIGINAL_SDF;
-      }
-      fprintf(out_sdf_fd.handle, "%s\n", buffer);
+      cblas_dcopy(3, t_vec2, 1, &coord[i * 3], 1);
     }
-    while (fgets(buffer, BUF_LEN, mol_fd.handle)) {
-      buffer[BUF_LEN - 1] = '\0';
-      remove_newline(buffer);
-      fprintf(out_sdf_fd.handle, "%s\n", buffer);
+    /*
+    the randomized pose is written from the
+    MOL template loaded for this object
+    */
+    mt = &(od->mel.mol_template->mol[object_num]);
+    if (write_mol_template(mt, coord, pose, out_sdf_fd.handle)) {
+      O3_ERROR_LOCATE(&(od->task));
+      sprintf(buffer, "%s%c%04d.mol", od->field.mol_dir,
+        SEPARATOR, od->al.mol_info[object_num]->object_id);
+      O3_ERROR_STRING(&(od->task), buffer);
+      fclose(out_sdf_fd.handle);
+      free(atom);
+      free(coord);
+      free(pose);
+      free_mol_templates(od);
+      return CANNOT_READ_ORIGINAL_SDF;
     }
     fprintf(out_sdf_fd.handle, SDF_DELIMITER"\n");
-    fclose(mol_fd.handle);
   }
   fclose(out_sdf_fd.handle);
   free(atom);
+  free(coord);
+  free(pose);
+  free_mol_templates(od);
 
   return 0;
 }
@@ -472,6 +568,7 @@ int align_iterative(O3Data *od)
   FileDescriptor temp_fd;
   FileDescriptor best_fd;
   FileDescriptor *comp_fd[2];
+  SdfStream *ss;
   
   
   memset(buffer, 0, BUF_LEN);
@@ -908,29 +1005,29 @@ int align_iterative(O3Data *od)
           od->al.mol_info[0]->object_id,
           od->al.mol_info[od->grid.object_num - 1]->object_id,
           od->al.mol_info[best_template_object_num]->object_id);
-        if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
+        if (!(ss = open_sdf_stream(temp_fd.name, "rb", NULL))) {
           O3_ERROR_LOCATE(&(od->task));
           O3_ERROR_STRING(&(od->task), temp_fd.name);
           fclose(best_fd.handle);
           return CANNOT_READ_ORIGINAL_SDF;
         }
-        if (find_conformation_in_sdf(temp_fd.handle, best_fd.handle, object_num)) {
+        if (find_aligned_conformation(ss, temp_fd.name,
+          get_score_index_type(od), object_num)) {
           O3_ERROR_LOCATE(&(od->task));
           O3_ERROR_STRING(&(od->task), temp_fd.name);
           fclose(best_fd.handle);
-          fclose(temp_fd.handle);
+          close_sdf_stream(ss);
           return CANNOT_READ_TEMP_FILE;
         }
         found = 0;
-        while ((!found) && fgets(buffer, BUF_LEN, temp_fd.handle)) {
-          buffer[BUF_LEN - 1] = '\0';
+        while ((!found) && sdf_stream_gets(buffer, BUF_LEN, ss)) {
           remove_newline(buffer);
           found = (!strncmp(buffer, SDF_DELIMITER, 4));
           if (!found) {
             fprintf(best_fd.handle, "%s\n", buffer);
           }
         }
-        fclose(temp_fd.handle);
+        close_sdf_stream(ss);
         if (!found) {
           O3_ERROR_LOCATE(&(od->task));
           O3_ERROR_STRING(&(od->task), temp_fd.name);
@@ -944,6 +1041,7 @@ int align_iterative(O3Data *od)
           best_template_object_num + 1);
       }
       fclose(best_fd.handle);
+      build_score_index(best_fd.name, get_score_index_type(od));
     }
     if ((iter > 1) && (!conv)) {
       /*
@@ -1052,6 +1150,7 @@ int align_iterative(O3Data *od)
             od->al.mol_info[od->grid.object_num - 1]->object_id,
             od->al.mol_info[object_num]->object_id);
           remove(temp_fd.name);
+          remove_score_index(temp_fd.name);
           /*
           if this object is also included in the best_template_object_list
           then add it to OBJECT_LIST, since the pose database corresponding
@@ -1152,6 +1251,11 @@ int align_iterative(O3Data *od)
       return CANNOT_WRITE_ALIGNED_SDF;
     }
   }
+  else if (od->mel.sdf_import[CANDIDATE_DB]) {
+    if ((result = join_sdf_import(od, CANDIDATE_DB, &temp_fd))) {
+      return result;
+    }
+  }
   else {
     if ((result = join_mol_to_sdf(od, &(od->task),
       &temp_fd, od->align.candidate_dir))) {
@@ -1182,6 +1286,44 @@ int align_iterative(O3Data *od)
 }
 
 
+static void free_conf_stores(O3Data *od)
+{
+  int i;
+  
+  
+  for (i = 0; i < 2; ++i) {
+    if (od->mel.conf_store[i]) {
+      free_conf_store(od->mel.conf_store[i]);
+      od->mel.conf_store[i] = NULL;
+    }
+  }
+}
+
+
+void merge_worker_task_info(O3Data *od, int n_threads)
+{
+  int i;
+  int slot;
+  TaskInfo *task_info;
+  
+  
+  /*
+  copy the status of the tasks which failed in each
+  thread into the task list entry of their candidate,
+  unless a failure was already recorded there
+  */
+  for (i = 0; i < n_threads; ++i) {
+    task_info = &(od->mel.worker_info[i]->task_info);
+    slot = task_info->data[MOVED_OBJECT_NUM];
+    if (task_info->code && (slot >= 0) && (slot < od->align.n_tasks)
+      && (!(od->al.task_list[slot]->code))) {
+      memcpy(od->al.task_list[slot], task_info, sizeof(TaskInfo));
+    }
+    memset(task_info, 0, sizeof(TaskInfo));
+  }
+}
+
+
 int align(O3Data *od)
 {
   char buffer[BUF_LEN];
@@ -1207,25 +1349,34 @@ int align(O3Data *od)
   int done_array_pos;
   int result;
   int n_threads;
+  int n_shards;
+  int n_starts;
+  int n_pruned_starts;
+  int n_pruned_thresholds;
+  int memo_hits;
+  int memo_misses;
+  int n_stolen_tasks;
   double score;
   double best_score;
   double overall_score;
+  double *task_cost = NULL;
   FileDescriptor mol_fd;
   FileDescriptor temp_fd;
   FileDescriptor best_fd;
-  #ifndef WIN32
-  pthread_attr_t thread_attr;
-  #endif
-  ThreadInfo **ti;
+  SdfStream *ss;
+  SdfStream *best_ss;
+  SdfCompressor *best_sc = NULL;
+  WorkerInfo **ti;
   void *align_func = NULL;
 
 
-  ti = od->mel.thread_info;
+  ti = od->mel.worker_info;
   memset(buffer, 0, BUF_LEN);
   memset(template_conf_string, 0, MAX_NAME_LEN);
   memset(&mol_fd, 0, sizeof(FileDescriptor));
   memset(&temp_fd, 0, sizeof(FileDescriptor));
   memset(&best_fd, 0, sizeof(FileDescriptor));
+  free_sdf_imports(od);
   for (i = 0; i < 2; ++i) {
     first_char = (i ? od->align.candidate_file[0] : od->align.template_file[0]);
     temp_dir_name = (i ? od->align.candidate_dir : od->align.template_dir);
@@ -1233,7 +1384,8 @@ int align(O3Data *od)
     if (first_char && (!(od->align.type & bit[i]))) {
       /*
       if an external SDF file is supplied and a single template/candidate
-      is present for each object, then break the SDF file in multiple MOL files
+      is present for each object, then its records are imported in memory;
+      they are only written to multiple MOL files if Pharao needs them
       */
       sprintf(temp_dir_name, "%s%c%s",
         od->align.align_scratch, SEPARATOR, temp_dir_suffix[i]);
@@ -1248,8 +1400,11 @@ int align(O3Data *od)
       if (result) {
         return CANNOT_CREATE_DIRECTORY;
       }
-      strcpy(temp_fd.name, filename);
-      if ((result = break_sdf_to_mol(od, &(od->task), &temp_fd, temp_dir_name))) {
+      if ((result = import_sdf(od, i, filename))) {
+        return result;
+      }
+      if ((od->align.type & (ALIGN_PHARAO_BIT | ALIGN_MIXED_BIT))
+        && (result = write_sdf_import_mol(od, i, temp_dir_name))) {
         return result;
       }
     }
@@ -1271,8 +1426,9 @@ int align(O3Data *od)
       then concatenate all MOL files of currently loaded
       objects into a single SDF file as needed by Pharao
       */
-      if ((result = join_mol_to_sdf(od, &(od->task),
-        &temp_fd, od->align.candidate_dir))) {
+      if ((result = (od->mel.sdf_import[CANDIDATE_DB]
+        ? join_sdf_import(od, CANDIDATE_DB, &temp_fd)
+        : join_mol_to_sdf(od, &(od->task), &temp_fd, od->align.candidate_dir)))) {
         return result;
       }
     }
@@ -1289,7 +1445,7 @@ int align(O3Data *od)
       O3_ERROR_LOCATE(&(od->task));
       return OUT_OF_MEMORY;
     }
-    n_threads = fill_thread_info(od, od->align.n_tasks);
+    n_threads = fill_worker_info(od, NULL, od->align.n_tasks);
     /*
     evenly distribute Pharao templates among threads
     */
@@ -1325,53 +1481,14 @@ int align(O3Data *od)
       type was chosen, then the first step will be to
       extract pharmacophores from templates with Pharao
       */
-      #ifndef WIN32
-      pthread_attr_init(&thread_attr);
-      pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
-      #endif
-      for (i = 0; i < n_threads; ++i) {
-        /*
-        create the i-th thread
-        */
-        #ifndef WIN32
-        od->error_code = pthread_create(&(od->thread_id[i]),
-          &thread_attr, (void *(*)(void *))phar_extract_thread, ti[i]);
-        if (od->error_code) {
-          O3_ERROR_LOCATE(&(od->task));
-          return CANNOT_CREATE_THREAD;
-        }
-        #else
-        od->hThreadArray[i] = CreateThread(NULL, 0,
-          (LPTHREAD_START_ROUTINE)phar_extract_thread,
-          ti[i], 0, &(od->dwThreadIdArray[i]));
-        if (!(od->hThreadArray[i])) {
-          O3_ERROR_LOCATE(&(od->task));
-          return CANNOT_CREATE_THREAD;
-        }
-        #endif
-      }
-      #ifndef WIN32
-      /*
-      free the pthread attribute memory
-      */
-      pthread_attr_destroy(&thread_attr);
       /*
-      wait for all threads to have finished
+      start the threads and wait for all of them to have finished
       */
-      for (i = 0; i < n_threads; ++i) {
-        od->error_code = pthread_join(od->thread_id[i],
-          &(od->thread_result[i]));
-        if (od->error_code) {
-          O3_ERROR_LOCATE(&(od->task));
-          return CANNOT_JOIN_THREAD;
-        }
-      }
-      #else
-      WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-      for (i = 0; i < n_threads; ++i) {
-        CloseHandle(od->hThreadArray[i]);
+      result = run_workers(od, "phar_extract", n_threads, (void *)phar_extract_thread);
+      if (result) {
+        O3_ERROR_LOCATE(&(od->task));
+        return result;
       }
-      #endif
       for (i = 0; (i < od->align.n_tasks)
         && (!(od->al.task_list[i]->code)); ++i);
       /*
@@ -1405,6 +1522,32 @@ int align(O3Data *od)
       return OUT_OF_MEMORY;
     }
     /*
+    Pharao threads claim moved objects through an
+    atomic counter for each template conformation
+    */
+    if ((od->align.type & ALIGN_PHARAO_BIT)
+      && (!(od->mel.task_queue = alloc_task_queue(template_num, od->grid.object_num)))) {
+      O3_ERROR_LOCATE(&(od->task));
+      return OUT_OF_MEMORY;
+    }
+    if ((!(od->align.type & ALIGN_PHARAO_BIT)) && (!(od->mel.ordered_writer =
+      alloc_ordered_writer(template_num, od->grid.object_num)))) {
+      O3_ERROR_LOCATE(&(od->task));
+      return OUT_OF_MEMORY;
+    }
+    if (od->mel.ordered_writer) {
+      od->mel.ordered_writer->score_type = SCORE_INDEX_O3A;
+      /*
+      the writer thread is helped by a couple of
+      compressor threads at most, which would
+      otherwise compete with the alignment ones
+      */
+      if (od->align.compression) {
+        od->mel.ordered_writer->n_compressors = ((od->n_proc
+          < SDF_STREAM_MAX_COMPRESSORS) ? od->n_proc : SDF_STREAM_MAX_COMPRESSORS);
+      }
+    }
+    /*
     done_array_pos ranges from 0 to the overall number of
     template conformations (computed over all template objects)
     done_objects is a (done_array_pos, object_num) byte matrix
@@ -1416,12 +1559,17 @@ int align(O3Data *od)
         if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
           sprintf(template_conf_string, "_%06d", template_conf_num + 1);
         }
-        sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf",
+        sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf%s",
           od->align.align_dir, SEPARATOR,
           od->al.mol_info[0]->object_id,
           od->al.mol_info[od->grid.object_num - 1]->object_id,
           od->al.mol_info[template_object_num]->object_id,
-          template_conf_string);
+          template_conf_string, get_sdf_stream_ext(od->align.compression));
+        if (od->mel.ordered_writer && set_ordered_writer_name
+          (od->mel.ordered_writer, done_array_pos, temp_fd.name)) {
+          O3_ERROR_LOCATE(&(od->task));
+          return OUT_OF_MEMORY;
+        }
         if (alignment_exists(od, &temp_fd)) {
           for (i = 0; i < od->grid.object_num; ++i) {
             od->al.done_objects[done_array_pos][i] =
@@ -1464,72 +1612,185 @@ int align(O3Data *od)
         od->field.max_n_heavy_atoms = od->al.mol_info[i]->n_heavy_atoms;
       }
     }
+    /*
+    each (template conformation, candidate object) pair
+    is a task, whose cost is estimated as the number of
+    candidate conformations times the product of template
+    and candidate heavy atoms; tasks are run longest-first
+    across all template conformations, and pairs which were
+    already aligned are not scheduled at all. Aligned poses
+    are streamed in object order to the SDF file of their
+    template conformation by the ordered writer thread
+    */
+    if (!(task_cost = (double *)malloc(done_array_pos * od->grid.object_num * sizeof(double)))) {
+      O3_ERROR_LOCATE(&(od->task));
+      return OUT_OF_MEMORY;
+    }
+    for (template_num = 0, j = 0; template_num < od->pel.numberlist[OBJECT_LIST]->size; ++template_num) {
+      template_object_num = od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
+      for (template_conf_num = 0; template_conf_num < ((od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT)
+        ? od->pel.conf_population[TEMPLATE_DB]->pe[template_object_num] : 1); ++template_conf_num, ++j) {
+        for (i = 0; i < od->grid.object_num; ++i) {
+          task_cost[j * od->grid.object_num + i] = (od->al.done_objects[j][i] ? -1.0
+            : (double)((od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+            ? od->pel.conf_population[CANDIDATE_DB]->pe[i] : 1)
+            * (double)(od->al.mol_info[template_object_num]->n_heavy_atoms)
+            * (double)(od->al.mol_info[i]->n_heavy_atoms));
+        }
+      }
+    }
+    od->mel.task_scheduler = alloc_task_scheduler(od->n_proc,
+      done_array_pos * od->grid.object_num, task_cost);
+    free(task_cost);
+    if (!(od->mel.task_scheduler)) {
+      O3_ERROR_LOCATE(&(od->task));
+      return OUT_OF_MEMORY;
+    }
+    /*
+    multi-conformational databases are parsed only once
+    into read-only stores shared by all threads and shards
+    */
+    reset_sdf_reader_stats();
+    for (i = 0; i < 2; ++i) {
+      if ((od->align.type & bit[i]) && (result = load_conf_store
+        (od, (i ? od->align.candidate_conf_dir : od->align.template_conf_dir), i))) {
+        free_conf_stores(od);
+        return result;
+      }
+    }
+    /*
+    aligned poses are written from candidate MOL
+    templates loaded once, rather than by reopening
+    a MOL file for each of them
+    */
+    if ((result = load_mol_templates(od, od->align.candidate_dir,
+      od->mel.sdf_import[CANDIDATE_DB]))) {
+      free_conf_stores(od);
+      return result;
+    }
     align_func = (void *)align_atombased_thread;
   }
-  n_threads = fill_thread_info(od, od->align.n_tasks);
+  n_threads = fill_worker_info(od, NULL, od->align.n_tasks);
+  for (i = 0; i < n_threads; ++i) {
+    memset(ti[i]->data, 0, MAX_DATA_FIELDS * sizeof(int));
+  }
+  /*
+  atom-based alignment tasks may be split among
+  several processes; there is no point in starting
+  more of them than there are tasks to carry out
+  */
+  n_shards = 1;
+  #ifndef WIN32
+  if (od->align.type & ALIGN_ATOMBASED_BIT) {
+    n_shards = od->align.n_shards;
+    if (n_shards > od->mel.task_scheduler->n_tasks) {
+      n_shards = od->mel.task_scheduler->n_tasks;
+    }
+    if (n_shards < 1) {
+      n_shards = 1;
+    }
+  }
+  #endif
+  if ((od->align.type & ALIGN_ATOMBASED_BIT) && (n_shards == 1)) {
+    deal_scheduled_tasks(od->mel.task_scheduler, n_threads);
+  }
+  if (od->mel.ordered_writer && (n_shards == 1)
+    && (result = start_ordered_writer(od->mel.ordered_writer))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return result;
+  }
+  reset_sdm_memo_stats();
+  reset_arena_stats();
   #ifndef WIN32
   pthread_mutex_init(od->mel.mutex, NULL);
-  pthread_attr_init(&thread_attr);
-  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
   #else
   if (!(*(od->mel.mutex) = CreateMutex(NULL, FALSE, NULL))) {
     O3_ERROR_LOCATE(&(od->task));
     return CANNOT_CREATE_THREAD;
   }
   #endif
-  for (i = 0; i < n_threads; ++i) {
-    /*
-    create the i-th thread
-    */
-    #ifndef WIN32
-    od->error_code = pthread_create(&(od->thread_id[i]),
-      &thread_attr, (void *(*)(void *))align_func, ti[i]);
-    if (od->error_code) {
-      O3_ERROR_LOCATE(&(od->task));
-      return CANNOT_CREATE_THREAD;
-    }
-    #else
-    od->hThreadArray[i] = CreateThread(NULL, 0,
-      (LPTHREAD_START_ROUTINE)align_func,
-      ti[i], 0, &(od->dwThreadIdArray[i]));
-    if (!(od->hThreadArray[i])) {
-      O3_ERROR_LOCATE(&(od->task));
-      return CANNOT_CREATE_THREAD;
-    }
-    #endif
-  }
-  #ifndef WIN32
-  /*
-  free the pthread attribute memory
-  */
-  pthread_attr_destroy(&thread_attr);
   /*
-  wait for all threads to have finished
+  start the threads and wait for all of them to have finished;
+  with multiple shards, the threads are run by forked processes
+  and this one merges their aligned poses and task outcomes
   */
-  for (i = 0; i < n_threads; ++i) {
-    od->error_code = pthread_join(od->thread_id[i],
-      &(od->thread_result[i]));
-    if (od->error_code) {
-      O3_ERROR_LOCATE(&(od->task));
-      return CANNOT_JOIN_THREAD;
-    }
+  #ifndef WIN32
+  if (n_shards > 1) {
+    result = run_align_shards(od, n_shards, n_threads, align_func);
+  }
+  else {
+    result = run_workers(od, "align", n_threads, align_func);
   }
+  #else
+  result = run_workers(od, "align", n_threads, align_func);
+  #endif
+  merge_worker_task_info(od, n_threads);
+  #ifndef WIN32
   pthread_mutex_destroy(od->mel.mutex);
   #else
-  WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-  for (i = 0; i < n_threads; ++i) {
-    CloseHandle(od->hThreadArray[i]);
-  }
   CloseHandle(*(od->mel.mutex));
   #endif
+  /*
+  wait for the ordered writer to flush all aligned
+  poses; if a file could not be written, the failure
+  is reported on the object whose pose was lost
+  */
+  if (od->mel.ordered_writer && stop_ordered_writer(od->mel.ordered_writer)
+    && (!(od->al.task_list[od->mel.ordered_writer->error_slot]->code))) {
+    O3_ERROR_LOCATE(od->al.task_list[od->mel.ordered_writer->error_slot]);
+    O3_ERROR_STRING(od->al.task_list[od->mel.ordered_writer->error_slot],
+      od->mel.ordered_writer->name[od->mel.ordered_writer->error_group]);
+    od->al.task_list[od->mel.ordered_writer->error_slot]->code = FL_CANNOT_WRITE_SDF_FILE;
+  }
+  if (result) {
+    O3_ERROR_LOCATE(&(od->task));
+    free_conf_stores(od);
+    return result;
+  }
   for (i = 0; (i < od->align.n_tasks)
     && (!(od->al.task_list[i]->code)); ++i);
   /*
   if errors occurred
   */
   if (i != od->align.n_tasks) {
+    free_conf_stores(od);
     return ERROR_IN_ALIGNMENT;
   }
+  if (od->align.type & ALIGN_ATOMBASED_BIT) {
+    for (i = 0, n_starts = 0, n_pruned_starts = 0, n_pruned_thresholds = 0,
+      n_stolen_tasks = 0; i < n_threads; ++i) {
+      n_starts += ti[i]->data[DATA_N_STARTS];
+      n_pruned_starts += ti[i]->data[DATA_N_PRUNED_STARTS];
+      n_pruned_thresholds += ti[i]->data[DATA_N_PRUNED_THRESHOLDS];
+      n_stolen_tasks += ti[i]->data[DATA_N_STOLEN_TASKS];
+    }
+    if (n_shards > 1) {
+      tee_printf(od, "Alignment tasks were split among %d processes "
+        "running %d threads each.\n", n_shards, n_threads);
+    }
+    tee_printf(od, "%d out of %d starting points and %d SDM threshold passes "
+      "were pruned by the score upper bound.\n",
+      n_pruned_starts, n_starts, n_pruned_thresholds);
+    tee_printf(od, "%d out of %d alignment tasks were stolen by idle threads.\n",
+      n_stolen_tasks, od->mel.task_scheduler->n_tasks);
+    tee_printf(od, "Up to %d aligned poses were held in the reorder buffer.\n",
+      od->mel.ordered_writer->max_n_buffered);
+    if (od->mel.ordered_writer->n_spilled_total) {
+      tee_printf(od, "%d aligned poses were spilled to disk while waiting "
+        "to be written.\n", od->mel.ordered_writer->n_spilled_total);
+    }
+    get_sdm_memo_stats(&memo_hits, &memo_misses);
+    tee_printf(od, "%d out of %d SDM refinements were taken from the "
+      "memo table.\n", memo_hits, memo_hits + memo_misses);
+    for (i = 0; i < 2; ++i) {
+      if (od->mel.conf_store[i]) {
+        print_conf_store_stats(od, od->mel.conf_store[i], temp_dir_suffix[i]);
+      }
+    }
+    print_sdf_reader_stats(od);
+    print_arena_stats(od);
+    tee_printf(od, "\n");
+  }
   if ((od->align.type & ALIGN_ATOMBASED_BIT)
     || ((od->align.type & ALIGN_PHARAO_BIT) && (od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT))) {
     for (i = 0; i < od->grid.object_num; ++i) {
@@ -1538,6 +1799,14 @@ int align(O3Data *od)
     }
     free_array(od->al.done_objects);
     od->al.done_objects = NULL;
+    free_task_queue(od->mel.task_queue);
+    od->mel.task_queue = NULL;
+    free_task_scheduler(od->mel.task_scheduler);
+    od->mel.task_scheduler = NULL;
+    free_ordered_writer(od->mel.ordered_writer);
+    od->mel.ordered_writer = NULL;
+    free_conf_stores(od);
+    free_mol_templates(od);
   }
   if (!(od->align.type & ALIGN_ITERATIVE_TEMPLATE_BIT)) {
     tee_printf(od, "%8s%8s%16s%20s\n%s",
@@ -1560,12 +1829,12 @@ int align(O3Data *od)
         if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
           sprintf(template_conf_string, "_%06d", template_conf_num + 1);
         }
-        sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf",
+        sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf%s",
           od->align.align_dir, SEPARATOR,
           od->al.mol_info[0]->object_id,
           od->al.mol_info[od->grid.object_num - 1]->object_id,
           od->al.mol_info[template_object_num]->object_id,
-          template_conf_string);
+          template_conf_string, get_sdf_stream_ext(od->align.compression));
         for (object_num = 0, overall_score = 0.0; object_num < od->grid.object_num; ++object_num) {
           if ((result = get_alignment_score(od, &temp_fd, object_num, &score, NULL))) {
             return result;
@@ -1580,11 +1849,20 @@ int align(O3Data *od)
     tee_printf(od, "%s\n", dashed_line);
   }
   if (od->align.type & ALIGN_KEEP_BEST_TEMPLATE_BIT) {
-    sprintf(best_fd.name, "%s%c%04d-%04d_on_best_template.sdf",
+    sprintf(best_fd.name, "%s%c%04d-%04d_on_best_template.sdf%s",
       od->align.align_dir,
       SEPARATOR, od->al.mol_info[0]->object_id,
-      od->al.mol_info[od->grid.object_num - 1]->object_id);
-    if (!(best_fd.handle = fopen(best_fd.name, "wb"))) {
+      od->al.mol_info[od->grid.object_num - 1]->object_id,
+      get_sdf_stream_ext(od->align.compression));
+    /*
+    all other threads are idle by now,
+    so they can compress the output
+    */
+    if (od->align.compression && (od->n_proc > 1)) {
+      best_sc = alloc_sdf_compressor(od->n_proc - 1);
+    }
+    if (!(best_ss = open_sdf_stream(best_fd.name, "wb", best_sc))) {
+      free_sdf_compressor(best_sc);
       O3_ERROR_LOCATE(&(od->task));
       O3_ERROR_STRING(&(od->task), best_fd.name);
       return CANNOT_WRITE_ALIGNED_SDF;
@@ -1600,14 +1878,15 @@ int align(O3Data *od)
           if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
             sprintf(template_conf_string, "_%06d", template_conf_num + 1);
           }
-          sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf",
+          sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf%s",
             od->align.align_dir, SEPARATOR,
             od->al.mol_info[0]->object_id,
             od->al.mol_info[od->grid.object_num - 1]->object_id,
             od->al.mol_info[template_object_num]->object_id,
-            template_conf_string);
+            template_conf_string, get_sdf_stream_ext(od->align.compression));
           if ((result = get_alignment_score(od, &temp_fd, object_num, &score, NULL))) {
-            fclose(best_fd.handle);
+            close_sdf_stream(best_ss);
+            free_sdf_compressor(best_sc);
             return result;
           }
           if ((best_template_object_num == -1) || ((score - best_score) > ALMOST_ZERO)) {
@@ -1623,52 +1902,62 @@ int align(O3Data *od)
       if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
         sprintf(template_conf_string, "_%06d", best_template_conf_num + 1);
       }
-      sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf",
+      sprintf(temp_fd.name, "%s%c%04d-%04d_on_%04d%s.sdf%s",
         od->align.align_dir, SEPARATOR,
         od->al.mol_info[0]->object_id,
         od->al.mol_info[od->grid.object_num - 1]->object_id,
         od->al.mol_info[best_template_object_num]->object_id,
-        template_conf_string);
-      if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
+        template_conf_string, get_sdf_stream_ext(od->align.compression));
+      if (!(ss = open_sdf_stream(temp_fd.name, "rb", NULL))) {
         O3_ERROR_LOCATE(&(od->task));
         O3_ERROR_STRING(&(od->task), temp_fd.name);
-        fclose(best_fd.handle);
+        close_sdf_stream(best_ss);
+        free_sdf_compressor(best_sc);
         return CANNOT_READ_TEMP_FILE;
       }
-      if (find_conformation_in_sdf(temp_fd.handle, best_fd.handle, object_num)) {
+      if (find_aligned_conformation(ss, temp_fd.name,
+        get_score_index_type(od), object_num)) {
         O3_ERROR_LOCATE(&(od->task));
         O3_ERROR_STRING(&(od->task), temp_fd.name);
-        fclose(best_fd.handle);
-        fclose(temp_fd.handle);
+        close_sdf_stream(best_ss);
+        free_sdf_compressor(best_sc);
+        close_sdf_stream(ss);
         return CANNOT_READ_TEMP_FILE;
       }
       found = 0;
-      while ((!found) && fgets(buffer, BUF_LEN, temp_fd.handle)) {
-        buffer[BUF_LEN - 1] = '\0';
+      while ((!found) && sdf_stream_gets(buffer, BUF_LEN, ss)) {
         remove_newline(buffer);
         found = (!strncmp(buffer, SDF_DELIMITER, 4));
         if (!found) {
-          fprintf(best_fd.handle, "%s\n", buffer);
+          sdf_stream_printf(best_ss, "%s\n", buffer);
         }
       }
-      fprintf(best_fd.handle, ">  <BEST_TEMPLATE_ID>\n"
+      sdf_stream_printf(best_ss, ">  <BEST_TEMPLATE_ID>\n"
         "%d\n\n", best_template_object_num + 1);
       if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
-        fprintf(best_fd.handle, ">  <BEST_TEMPLATE_CONF>\n"
+        sdf_stream_printf(best_ss, ">  <BEST_TEMPLATE_CONF>\n"
           "%d\n\n", best_template_conf_num + 1);
       }
-      fprintf(best_fd.handle, SDF_DELIMITER"\n");
-      fclose(temp_fd.handle);
+      sdf_stream_printf(best_ss, SDF_DELIMITER"\n");
+      close_sdf_stream(ss);
       if (!found) {
         O3_ERROR_LOCATE(&(od->task));
         O3_ERROR_STRING(&(od->task), temp_fd.name);
-        fclose(best_fd.handle);
+        close_sdf_stream(best_ss);
+        free_sdf_compressor(best_sc);
         return CANNOT_READ_TEMP_FILE;
       }
     }
     tee_printf(od, "%-25s%20.2lf\n\n",
       "Best template combination score:", overall_score);
-    fclose(best_fd.handle);
+    result = close_sdf_stream(best_ss);
+    free_sdf_compressor(best_sc);
+    if (result) {
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), best_fd.name);
+      return CANNOT_WRITE_ALIGNED_SDF;
+    }
+    build_score_index(best_fd.name, get_score_index_type(od));
   }
   
   return 0;
@@ -1686,48 +1975,95 @@ int align(O3Data *od)
 #define O3_GLOBAL      9
 
 
+static double get_score_incumbent(double *score, int level, int multiconf)
+{
+  int i;
+  double incumbent;
+  
+  
+  /*
+  score[0..level] are the incumbents of the nested
+  options/coeff/start/threshold loops; score[O3_GLOBAL]
+  is an incumbent only across multiple candidate
+  conformations, otherwise it is unconditionally replaced
+  */
+  incumbent = (multiconf ? score[O3_GLOBAL] : 0.0);
+  for (i = 0; i <= level; ++i) {
+    if (score[i] > incumbent) {
+      incumbent = score[i];
+    }
+  }
+  
+  return incumbent;
+}
+
+
 int alignment_exists(O3Data *od, FileDescriptor *sdf_fd)
 {
   char buffer[BUF_LEN];
+  char *record = NULL;
+  char *temp;
+  char *atom_block;
   int object_num;
-  int line;
   int result;
+  size_t len;
+  size_t size;
+  size_t max_size;
   MolInfo temp_mol_info;
+  SdfStream *ss;
 
 
+  /*
+  each record is gathered in memory, possibly
+  from a compressed file, and its atom and bond
+  counts are checked against those of its object
+  */
   memset(buffer, 0, BUF_LEN);
   memset(&temp_mol_info, 0, sizeof(MolInfo));
   result = 1;
   if (fexist(sdf_fd->name)) {
-    if ((sdf_fd->handle = fopen(sdf_fd->name, "rb"))) {
+    if ((ss = open_sdf_stream(sdf_fd->name, "rb", NULL))) {
       object_num = 0;
-      line = 0;
+      size = 0;
+      max_size = 0;
       result = 0;
-      while ((!result) && fgets(buffer, BUF_LEN, sdf_fd->handle)) {
-        ++line;
-        buffer[BUF_LEN - 1] = '\0';
-        if (line == 4) {
-          if (get_n_atoms_bonds(&temp_mol_info, sdf_fd->handle, buffer)) {
+      while ((!result) && sdf_stream_gets(buffer, BUF_LEN, ss)) {
+        if (!strncmp(buffer, SDF_DELIMITER, 4)) {
+          if (object_num >= od->grid.object_num) {
+            result = N_ATOM_BOND_MISMATCH;
+          }
+          else if (get_sdf_record_counts(record, record + size, &temp_mol_info, &atom_block)) {
             result = PREMATURE_EOF;
           }
           else if ((temp_mol_info.n_atoms != od->al.mol_info[object_num]->n_atoms)
             || (temp_mol_info.n_bonds != od->al.mol_info[object_num]->n_bonds)) {
             result = N_ATOM_BOND_MISMATCH;
           }
+          size = 0;
+          ++object_num;
+          continue;
         }
-        else if (line > 4) {
-          if (!strncmp(buffer, SDF_DELIMITER, 4)) {
-            line = 0;
-            ++object_num;
+        len = strlen(buffer);
+        if ((size + len) > max_size) {
+          max_size = (size + len) * 2;
+          if (!(temp = (char *)realloc(record, max_size))) {
+            result = OUT_OF_MEMORY;
+            continue;
           }
+          record = temp;
         }
+        memcpy(&record[size], buffer, len);
+        size += len;
       }
       result = ((!result) && (object_num != od->grid.object_num));
-      fclose(sdf_fd->handle);
-      sdf_fd->handle = NULL;
+      close_sdf_stream(ss);
+      if (record) {
+        free(record);
+      }
     }
     if (result) {
       remove(sdf_fd->name);
+      remove_score_index(sdf_fd->name);
     }
   }
   
@@ -1735,11 +2071,57 @@ int alignment_exists(O3Data *od, FileDescriptor *sdf_fd)
 }
 
 
-int join_aligned_files(O3Data *od, int done_array_pos, char *error_filename)
+int copy_aligned_files(O3Data *od, int template_object_num,
+  int template_conf_num, char *error_filename)
 {
   char buffer[BUF_LEN];
   char buffer2[BUF_LEN];
   char template_conf_string[MAX_NAME_LEN];
+  int i;
+
+
+  /*
+  concatenate the aligned SDF files of all objects
+  on this template conformation into a single file;
+  returns the number of the object whose file could
+  not be read, or -1 if all went fine; the
+  score index of the joined file is built
+  right away, so that later score lookups
+  do not need to scan it
+  */
+  memset(buffer, 0, BUF_LEN);
+  memset(buffer2, 0, BUF_LEN);
+  memset(template_conf_string, 0, MAX_NAME_LEN);
+  if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+    sprintf(template_conf_string, "_%06d", template_conf_num + 1);
+  }
+  sprintf(buffer, "%s%c%04d-%04d_on_%04d%s.sdf",
+    od->align.align_dir, SEPARATOR,
+    od->al.mol_info[0]->object_id,
+    od->al.mol_info[od->grid.object_num - 1]->object_id,
+    od->al.mol_info[template_object_num]->object_id,
+    template_conf_string);
+  for (i = 0; i < od->grid.object_num; ++i) {
+    sprintf(buffer2, "%s%c%04d%c%04d_on_%04d%s.sdf",
+      od->align.align_scratch, SEPARATOR,
+      od->al.mol_info[i]->object_id, SEPARATOR,
+      od->al.mol_info[i]->object_id,
+      od->al.mol_info[template_object_num]->object_id,
+      template_conf_string);
+    if (!fcopy(buffer2, buffer, (i ? "ab" : "wb"))) {
+      strcpy(error_filename, buffer2);
+      return i;
+    }
+    remove(buffer2);
+  }
+  build_score_index(buffer, get_score_index_type(od));
+  
+  return -1;
+}
+
+
+int join_aligned_files(O3Data *od, int done_array_pos, char *error_filename)
+{
   int i = -1;
   int error = 0;
   int template_num;
@@ -1750,9 +2132,6 @@ int join_aligned_files(O3Data *od, int done_array_pos, char *error_filename)
   int assigned = 0;
 
 
-  memset(buffer, 0, BUF_LEN);
-  memset(buffer2, 0, BUF_LEN);
-  memset(template_conf_string, 0, MAX_NAME_LEN);
   for (template_num = 0, temp_done_array_pos = 0; (!error) && (temp_done_array_pos <= done_array_pos)
     && (template_num < od->pel.numberlist[OBJECT_LIST]->size); ++template_num) {
     template_object_num = od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
@@ -1779,29 +2158,9 @@ int join_aligned_files(O3Data *od, int done_array_pos, char *error_filename)
         ReleaseMutex(*(od->mel.mutex));
         #endif
         if (assigned) {
-          if (od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
-            sprintf(template_conf_string, "_%06d", template_conf_num + 1);
-          }
-          sprintf(buffer, "%s%c%04d-%04d_on_%04d%s.sdf",
-            od->align.align_dir, SEPARATOR,
-            od->al.mol_info[0]->object_id,
-            od->al.mol_info[od->grid.object_num - 1]->object_id,
-            od->al.mol_info[template_object_num]->object_id,
-            template_conf_string);
-          for (i = 0; i < od->grid.object_num; ++i) {
-            sprintf(buffer2, "%s%c%04d%c%04d_on_%04d%s.sdf",
-              od->align.align_scratch, SEPARATOR,
-              od->al.mol_info[i]->object_id, SEPARATOR,
-              od->al.mol_info[i]->object_id,
-              od->al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            if (!fcopy(buffer2, buffer, (i ? "ab" : "wb"))) {
-              error = 1;
-              strcpy(error_filename, buffer2);
-              break;
-            }
-            remove(buffer2);
-          }
+          i = copy_aligned_files(od, template_object_num,
+            template_conf_num, error_filename);
+          error = (i != -1);
         }
       }
       ++temp_done_array_pos;
@@ -1812,6 +2171,30 @@ int join_aligned_files(O3Data *od, int done_array_pos, char *error_filename)
 }
 
 
+static void get_template_conf(O3Data *od, int done_array_pos,
+  int *template_object_num, int *template_conf_num)
+{
+  int template_num;
+  int n_conf;
+  
+  
+  /*
+  map a row of the done_objects matrix back
+  to its template object and conformation
+  */
+  for (template_num = 0; template_num < od->pel.numberlist[OBJECT_LIST]->size; ++template_num) {
+    *template_object_num = od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
+    n_conf = ((od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT)
+      ? od->pel.conf_population[TEMPLATE_DB]->pe[*template_object_num] : 1);
+    if (done_array_pos < n_conf) {
+      break;
+    }
+    done_array_pos -= n_conf;
+  }
+  *template_conf_num = done_array_pos;
+}
+
+
 #ifndef WIN32
 void *align_atombased_thread(void *pointer)
 #else
@@ -1819,17 +2202,15 @@ DWORD align_atombased_thread(void *pointer)
 #endif
 {
   char *used[2];
+  char *pose = NULL;
   char buffer[BUF_LEN];
   char template_conf_string[MAX_NAME_LEN];
   int i;
   int k;
   int error;
-  int conf_found = 0;
-  int conf_file_error = 0;
   int moved_object_num;
-  int template_num;
-  int template_object_num;
-  int template_conf_num;
+  int template_object_num = 0;
+  int template_conf_num = 0;
   int moved_conf_num;
   int best_conf_num;
   int iter;
@@ -1842,8 +2223,13 @@ DWORD align_atombased_thread(void *pointer)
   int pid;
   int sdm_threshold_iter;
   int alloc_fail = 0;
-  int assigned = 0;
+  int template_fail = 0;
   int done_array_pos = 0;
+  int loaded_array_pos;
+  int task;
+  int stolen;
+  int slot;
+  int n_batch;
   int pairs[O3_MAX_SLOT];
   int best_weight[O3_MAX_SLOT];
   double rt_mat[RT_MAT_SIZE];
@@ -1852,27 +2238,37 @@ DWORD align_atombased_thread(void *pointer)
   double score[O3_MAX_SLOT];
   double original_heavy_msd;
   double sdm_threshold_dist;
+  int memo_slot;
+  int memo_store;
+  double score_bound = 0.0;
+  double incumbent;
   double centroid[2][3];
-  FileDescriptor mol_fd;
-  FileDescriptor out_sdf_fd;
   FileDescriptor moved_fd;
   FileDescriptor pharao_sdf_fd;
   FileDescriptor phar_fd;
   FileDescriptor scores_fd;
   FileDescriptor temp_fd;
   LAPInfo li;
+  SDMMemo memo;
+  ConfBatch batch;
   AtomInfo **template_atom = NULL;
   AtomInfo **moved_atom = NULL;
   ConfInfo *conf[O3_MAX_SLOT];
   AtomPair *sdm[O3_MAX_SLOT];
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  OrderedRecord *record = NULL;
+  Arena *arena;
+  TaskInfo *task_info;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
+  task_info = &(ti->task_info);
+  memset(task_info, 0, sizeof(TaskInfo));
   memset(buffer, 0, BUF_LEN);
   memset(template_conf_string, 0, MAX_NAME_LEN);
   memset(pairs, 0, O3_MAX_SLOT * sizeof(int));
+  memset(best_weight, 0, O3_MAX_SLOT * sizeof(int));
   memset(score, 0, O3_MAX_SLOT * sizeof(double));
   memset(conf, 0, O3_MAX_SLOT * sizeof(ConfInfo *));
   memset(sdm, 0, O3_MAX_SLOT * sizeof(AtomPair *));
@@ -1881,51 +2277,63 @@ DWORD align_atombased_thread(void *pointer)
   memset(&phar_fd, 0, sizeof(FileDescriptor));
   memset(&scores_fd, 0, sizeof(FileDescriptor));
   memset(&temp_fd, 0, sizeof(FileDescriptor));
-  memset(&mol_fd, 0, sizeof(FileDescriptor));
-  memset(&out_sdf_fd, 0, sizeof(FileDescriptor));
   memset(&moved_fd, 0, sizeof(FileDescriptor));
   memset(&li, 0, sizeof(LAPInfo));
+  memset(&batch, 0, sizeof(ConfBatch));
   /*
-  allocate two char vectors to store
-  already used pairs
+  the LAP scratch space, conformations, SDM matrices,
+  H histograms and used pair vectors of this thread
+  are all carved from a single arena, which is
+  released at once when the thread is done
   */
-  if (alloc_lap_info(&li, ti->od.field.max_n_heavy_atoms)) {
+  if ((!(arena = alloc_arena(ARENA_BLOCK_SIZE)))
+    || arena_alloc_lap_info(arena, &li, ti->od->field.max_n_heavy_atoms)) {
     alloc_fail = 1;
   }
-  for (i = 0; i < O3_MAX_SLOT; ++i) {
+  if (alloc_sdm_memo(&memo, ti->od->field.max_n_heavy_atoms, ti->od->field.max_n_atoms)) {
+    alloc_fail = 1;
+  }
+  for (i = 0; arena && (i < O3_MAX_SLOT); ++i) {
     /*
     allocate MAX_SLOT conformations and SDM matrices
     */
-    if (!(conf[i] = alloc_conf(ti->od.field.max_n_atoms))) {
+    if (!(conf[i] = arena_alloc_conf(arena, ti->od->field.max_n_atoms))) {
       alloc_fail = 1;
     }
-    if ((sdm[i] = (AtomPair *)malloc(square(ti->od.field.max_n_heavy_atoms) * sizeof(AtomPair)))) {
-      memset(sdm[i], 0, square(ti->od.field.max_n_heavy_atoms) * sizeof(AtomPair));
-    }
-    else {
+    if (!(sdm[i] = (AtomPair *)arena_alloc(arena,
+      square(ti->od->field.max_n_heavy_atoms) * sizeof(AtomPair)))) {
       alloc_fail = 1;
     }
   }
-  for (i = 0; i < 2; ++i) {
+  for (i = 0; arena && (i < 2); ++i) {
     if (conf[i]) {
       /*
       for the first two conformations, allocate a
       (max_n_heavy_atoms, MAX_H_BINS) int matrix
       and also a (max_n_heavy_atoms) byte vector
       */
-      if (!(conf[i]->h = (int **)alloc_array
-        (ti->od.field.max_n_heavy_atoms, MAX_H_BINS * sizeof(int)))) {
+      if (!(conf[i]->h = (int **)arena_alloc_array(arena,
+        ti->od->field.max_n_heavy_atoms, MAX_H_BINS * sizeof(int)))) {
         alloc_fail = 1;
       }
     }
-    if (!(used[i] = malloc(ti->od.field.max_n_atoms))) {
+    if (!(used[i] = (char *)arena_alloc(arena, ti->od->field.max_n_atoms))) {
       alloc_fail = 1;
     }
   }
-  if (ti->od.align.type & ALIGN_MIXED_BIT) {
-    prog_exe_info.exedir = ti->od.align.pharao_exe_path;
+  if (arena && (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+    && arena_alloc_conf_batch(arena, &batch, ti->od->field.max_n_atoms,
+    ti->od->field.max_n_heavy_atoms)) {
+    alloc_fail = 1;
+  }
+  if (arena && (!(pose = (char *)arena_alloc(arena,
+    ti->od->mel.mol_template->max_size)))) {
+    alloc_fail = 1;
+  }
+  if (ti->od->align.type & ALIGN_MIXED_BIT) {
+    prog_exe_info.exedir = ti->od->align.pharao_exe_path;
     if (!(prog_exe_info.proc_env = fill_env
-      (&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0))) {
+      (ti->od, babel_env, ti->od->align.pharao_exe_path, 0))) {
       alloc_fail = 1;
     }
     prog_exe_info.stdout_fd = &temp_fd;
@@ -1933,66 +2341,73 @@ DWORD align_atombased_thread(void *pointer)
     prog_exe_info.sep_proc_grp = 1;
   }
   /*
-  loop over all template objects
+  run the tasks handed out by the scheduler, the most
+  expensive first; the template conformation is only
+  reloaded when it differs from that of the previous task
   */
-  for (template_num = 0, done_array_pos = 0, error = 0; (!error)
-    && (template_num < ti->od.pel.numberlist[OBJECT_LIST]->size); ++template_num) {
-    template_object_num = ti->od.pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
-    template_atom = ti->od.al.mol_info[template_object_num]->atom;
-    if (conf[O3_TEMPLATE]) {
-      conf[O3_TEMPLATE]->atom = template_atom;
-      conf[O3_TEMPLATE]->n_atoms = ti->od.al.mol_info[template_object_num]->n_atoms;
-      conf[O3_TEMPLATE]->n_heavy_atoms = ti->od.al.mol_info[template_object_num]->n_heavy_atoms;
-    }
-    /*
-    loop over conformations of this template object
-    */
-    for (template_conf_num = 0; (!error) && (template_conf_num < ((ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT)
-      ? ti->od.pel.conf_population[TEMPLATE_DB]->pe[template_object_num] : 1)); ++template_conf_num) {
-      if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+  error = 0;
+  loaded_array_pos = -1;
+  while ((!error) && ((task = next_scheduled_task(ti->od->mel.task_scheduler,
+    ti->thread_num, &stolen)) != -1)) {
+    ti->data[DATA_N_STOLEN_TASKS] += stolen;
+    done_array_pos = task / ti->od->grid.object_num;
+    moved_object_num = task % ti->od->grid.object_num;
+    if (done_array_pos != loaded_array_pos) {
+      loaded_array_pos = done_array_pos;
+      get_template_conf(ti->od, done_array_pos, &template_object_num, &template_conf_num);
+      template_atom = ti->od->al.mol_info[template_object_num]->atom;
+      if (conf[O3_TEMPLATE]) {
+        set_conf_atoms(conf[O3_TEMPLATE], template_atom,
+          ti->od->al.mol_info[template_object_num]->n_atoms);
+      }
+      if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
         sprintf(template_conf_string, "_%06d", template_conf_num + 1);
       }
-      conf_found = 0;
       if (conf[O3_TEMPLATE]) {
-        if ((ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) || (ti->od.align.template_file[0])) {
-          if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
-            sprintf(temp_fd.name, "%s%c%04d.sdf", ti->od.align.template_conf_dir, SEPARATOR,
-              ti->od.al.mol_info[template_object_num]->object_id);
-          }
-          else {
-            sprintf(temp_fd.name, "%s%c%04d.mol", ti->od.align.template_dir, SEPARATOR,
-              ti->od.al.mol_info[template_object_num]->object_id);
-          }
-          conf_file_error = 0;
+        if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+          /*
+          take the template conformation coordinates
+          from the shared conformational database store
+          */
+          cblas_dcopy(ti->od->al.mol_info[template_object_num]->n_atoms * 3,
+            get_store_conf(ti->od->mel.conf_store[TEMPLATE_DB],
+            template_object_num, template_conf_num), 1, conf[O3_TEMPLATE]->coord, 1);
+        }
+        else if (ti->od->mel.sdf_import[TEMPLATE_DB]) {
+          /*
+          read template conformation coordinates in place
+          from the imported external file
+          */
+          template_fail = get_sdf_import_coord(ti->od->mel.sdf_import[TEMPLATE_DB],
+            template_object_num, ti->od->al.mol_info[template_object_num]->n_atoms,
+            conf[O3_TEMPLATE]->coord);
+        }
+        else if (ti->od->align.template_file[0]) {
+          sprintf(temp_fd.name, "%s%c%04d.mol", ti->od->align.template_dir, SEPARATOR,
+            ti->od->al.mol_info[template_object_num]->object_id);
           /*
-          Read template conformation coordinates from a file,
-          either an external file (for single-conformation template aligment)
-          or a SDF conformational database (for multi-conformation template aligment)
+          Read template conformation coordinates from
+          an external file (for single-conformation template aligment)
           */
           if ((temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-            conf_found = (!find_conformation_in_sdf(temp_fd.handle, NULL, template_conf_num));
-            if (conf_found) {
+            if (!find_conformation_in_sdf(temp_fd.handle, NULL, template_conf_num)) {
               i = 0;
-              while ((i < ti->od.al.mol_info[template_object_num]->n_atoms)
+              while ((i < ti->od->al.mol_info[template_object_num]->n_atoms)
                 && fgets(buffer, BUF_LEN, temp_fd.handle)) {
                 buffer[BUF_LEN - 1] = '\0';
-                parse_sdf_coord_line(ti->od.al.mol_info[template_object_num]->sdf_version,
+                parse_sdf_coord_line(ti->od->al.mol_info[template_object_num]->sdf_version,
                   buffer, NULL, &(conf[O3_TEMPLATE]->coord[i * 3]), NULL);
                 ++i;
               }
-              conf_found = (i == ti->od.al.mol_info[template_object_num]->n_atoms);
             }
             fclose(temp_fd.handle);
           }
-          else {
-            conf_file_error = 1;
-          }
         }
         else {
           /*
           read coordinates from the currently loaded structure
           */
-          for (i = 0; i < ti->od.al.mol_info[template_object_num]->n_atoms; ++i) {
+          for (i = 0; i < ti->od->al.mol_info[template_object_num]->n_atoms; ++i) {
             cblas_dcopy(3, template_atom[i]->coord, 1, &(conf[O3_TEMPLATE]->coord[i * 3]), 1);
           }
         }
@@ -2000,562 +2415,396 @@ DWORD align_atombased_thread(void *pointer)
         compute H array for the template
         */
         compute_conf_h(conf[O3_TEMPLATE]);
+        /*
+        bin template heavy atoms into cells for sdm_algorithm;
+        if this fails, sdm_algorithm falls back to a full scan
+        */
+        build_cell_list(conf[O3_TEMPLATE], SDM_CELL_SIZE);
       }
-      assigned = 1;
-      /*
-      loop over all objects and find one not already assigned to some thread
-      */
-      while ((!error) && assigned) {
-        moved_object_num = 0;
-        assigned = 0;
-        while ((!assigned) && (moved_object_num < ti->od.grid.object_num)) {
-          if (!(ti->od.al.done_objects[done_array_pos][moved_object_num])) {
-            sprintf(buffer, "%s%c%04d%c%04d_on_%04d%s.sdf",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            #ifndef WIN32
-            pthread_mutex_lock(ti->od.mel.mutex);
-            #else
-            WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-            #endif
-            if (!(ti->od.al.done_objects[done_array_pos][moved_object_num])) {
-              ti->od.al.done_objects[done_array_pos][moved_object_num] = OBJECT_ASSIGNED;
-              assigned = 1;
-            }
-            #ifndef WIN32
-            pthread_mutex_unlock(ti->od.mel.mutex);
-            #else
-            ReleaseMutex(ti->od.mel.mutex);
-            #endif
-          }
-          if (!assigned) {
-            ++moved_object_num;
-          }
-        }
+    }
+    /*
+    tasks on the same candidate for different template
+    conformations may run at the same time, so their
+    status is kept by the thread and only merged into
+    the shared task list after all threads are joined
+    */
+    memset(task_info, 0, sizeof(TaskInfo));
+    task_info->data[TEMPLATE_OBJECT_NUM] = template_object_num;
+    task_info->data[TEMPLATE_CONF_NUM] = -1;
+    task_info->data[MOVED_OBJECT_NUM] = moved_object_num;
+    task_info->data[MOVED_CONF_NUM] = -1;
+    if (alloc_fail) {
+      O3_ERROR_LOCATE(task_info);
+      task_info->code = FL_OUT_OF_MEMORY;
+      error = 1;
+      continue;
+    }
+    /*
+    if it is a multi-conformational template
+    */
+    if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+      task_info->data[TEMPLATE_CONF_NUM] = template_conf_num;
+    }
+    if (template_fail) {
+      O3_ERROR_LOCATE(task_info);
+      O3_ERROR_STRING(task_info,
+        ti->od->mel.sdf_import[TEMPLATE_DB]->name);
+      task_info->code = FL_CANNOT_READ_SDF_FILE;
+      error = 1;
+      continue;
+    }
+    /*
+    if this is a mixed alignment
+    */
+    if (ti->od->align.type & ALIGN_MIXED_BIT) {
+      if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
         /*
-        if no object is left, stop searching
+        align the conformational database of object "moved_object_num"
+        on the current template object,conformation pair
         */
-        if (!assigned)  {
-          break;
-        }
-        ti->od.al.task_list[moved_object_num]->code = 0;
-        ti->od.al.task_list[moved_object_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
-        ti->od.al.task_list[moved_object_num]->data[TEMPLATE_CONF_NUM] = -1;
-        ti->od.al.task_list[moved_object_num]->data[MOVED_CONF_NUM] = -1;
-        if (alloc_fail) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          ti->od.al.task_list[moved_object_num]->code = FL_OUT_OF_MEMORY;
+        sprintf(temp_fd.name, "%s%c%04d_on_%04d%s.log",
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
+          template_conf_string);
+        sprintf(pharao_sdf_fd.name, "%s%c%04d_on_%04d%s_pharao.sdf",
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
+          template_conf_string);
+        sprintf(phar_fd.name, "%s%c%04d%s.phar",
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[template_object_num]->object_id,
+          template_conf_string);
+        sprintf(scores_fd.name, "%s%c%04d_on_%04d%s.scores",
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
+          template_conf_string);
+        sprintf(prog_exe_info.command_line,
+          "%s -q %s %s -r %s --refType PHAR "
+          "-d %s%c%04d.sdf --dbType MOL -s %s -o %s",
+          ti->od->align.pharao_exe,
+          ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+          ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+          phar_fd.name, ti->od->align.candidate_conf_dir, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          scores_fd.name, pharao_sdf_fd.name);
+        pid = ext_program_exe(&prog_exe_info, &(task_info->code));
+        ext_program_wait(&prog_exe_info, pid);
+        /*
+        check if the Pharao computation was OK
+        */
+        if (task_info->code) {
+          O3_ERROR_LOCATE(task_info);
           error = 1;
           continue;
         }
-        /*
-        if it is a multi-conformational template
-        */
-        if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
-          ti->od.al.task_list[moved_object_num]->data[TEMPLATE_CONF_NUM] = template_conf_num;
-          if (conf_file_error) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-            /*
-            sprintf(temp_fd.name, "%s%c%04d.sdf", ti->od.align.template_conf_dir, SEPARATOR,
-              ti->od.al.mol_info[template_object_num]->object_id);
-            */
-            O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], temp_fd.name);
-            ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_SDF_FILE;
-            error = 1;
-            continue;
-          }
-          if (!conf_found) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-            /*
-            sprintf(temp_fd.name, "%s%c%04d.sdf", ti->od.align.template_conf_dir, SEPARATOR,
-              ti->od.al.mol_info[template_object_num]->object_id);
-            */
-            O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], temp_fd.name);
-            ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
+        if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
+          O3_ERROR_LOCATE(task_info);
+          O3_ERROR_STRING(task_info, temp_fd.name);
+          task_info->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+          error = 1;
+        }
+        else if (fgrep(temp_fd.handle, buffer, "Error")) {
+          O3_ERROR_LOCATE(task_info);
+          O3_ERROR_STRING(task_info, temp_fd.name);
+          task_info->code = FL_PHARAO_ERROR;
+          error = 1;
+        }
+        if (temp_fd.handle) {
+          fclose(temp_fd.handle);
+          temp_fd.handle = NULL;
+        }
+        if (!error) {
+          if (!(pharao_sdf_fd.handle = fopen(pharao_sdf_fd.name, "rb"))) {
+            O3_ERROR_LOCATE(task_info);
+            O3_ERROR_STRING(task_info, pharao_sdf_fd.name);
+            task_info->code = FL_CANNOT_READ_PHARAO_OUTPUT;
             error = 1;
-            continue;
-          }
+          }  
         }
-        /*
-        if this is a mixed alignment
-        */
-        if (ti->od.align.type & ALIGN_MIXED_BIT) {
-          if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-            /*
-            align the conformational database of object "moved_object_num"
-            on the current template object,conformation pair
-            */
-            sprintf(temp_fd.name, "%s%c%04d_on_%04d%s.log",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            sprintf(pharao_sdf_fd.name, "%s%c%04d_on_%04d%s_pharao.sdf",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            sprintf(phar_fd.name, "%s%c%04d%s.phar",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            sprintf(scores_fd.name, "%s%c%04d_on_%04d%s.scores",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            sprintf(prog_exe_info.command_line,
-              "%s -q %s %s -r %s --refType PHAR "
-              "-d %s%c%04d.sdf --dbType MOL -s %s -o %s",
-              ti->od.align.pharao_exe,
-              ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-              ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
-              phar_fd.name, ti->od.align.candidate_conf_dir, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id,
-              scores_fd.name, pharao_sdf_fd.name);
-            pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[moved_object_num]->code));
-            ext_program_wait(&prog_exe_info, pid);
-            /*
-            check if the Pharao computation was OK
-            */
-            if (ti->od.al.task_list[moved_object_num]->code) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              error = 1;
-              continue;
-            }
-            if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], temp_fd.name);
-              ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
-              error = 1;
-            }
-            else if (fgrep(temp_fd.handle, buffer, "Error")) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], temp_fd.name);
-              ti->od.al.task_list[moved_object_num]->code = FL_PHARAO_ERROR;
-              error = 1;
-            }
-            if (temp_fd.handle) {
-              fclose(temp_fd.handle);
-              temp_fd.handle = NULL;
-            }
-            if (!error) {
-              if (!(pharao_sdf_fd.handle = fopen(pharao_sdf_fd.name, "rb"))) {
-                O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-                O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-                ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
-                error = 1;
-              }  
-            }
-            if (error) {
-              continue;
-            }
-            remove(temp_fd.name);
-            remove(scores_fd.name);
-          }
-          else {
-            sprintf(pharao_sdf_fd.name, "%s%c%04d-%04d_on_%04d%s_pharao%c%04d.sdf",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[0]->object_id,
-              ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string,
-              SEPARATOR, ti->od.al.mol_info[moved_object_num]->object_id);
-            if (!(pharao_sdf_fd.handle = fopen(pharao_sdf_fd.name, "rb"))) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-              ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
-              error = 1;
-            }
-            if (error) {
-              continue;
-            }
-          }
+        if (error) {
+          continue;
         }
-        /*
-        create a scratch folder for the object currently assigned to this thread
-        */
-        sprintf(buffer, "%s%c%04d", ti->od.align.align_scratch, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id);
-        if (!dexist(buffer)) {
-          #ifndef WIN32
-          error = mkdir(buffer, S_IRWXU | S_IRGRP | S_IROTH);
-          #else
-          error = mkdir(buffer);
-          #endif
+        remove(temp_fd.name);
+        remove(scores_fd.name);
+      }
+      else {
+        sprintf(pharao_sdf_fd.name, "%s%c%04d-%04d_on_%04d%s_pharao%c%04d.sdf",
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[0]->object_id,
+          ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
+          template_conf_string,
+          SEPARATOR, ti->od->al.mol_info[moved_object_num]->object_id);
+        if (!(pharao_sdf_fd.handle = fopen(pharao_sdf_fd.name, "rb"))) {
+          O3_ERROR_LOCATE(task_info);
+          O3_ERROR_STRING(task_info, pharao_sdf_fd.name);
+          task_info->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+          error = 1;
         }
         if (error) {
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_CREATE_SCRDIR;
-          if (pharao_sdf_fd.handle) {
-            fclose(pharao_sdf_fd.handle);
-            pharao_sdf_fd.handle = NULL;
-          }
           continue;
         }
+      }
+    }
+    /*
+    the aligned pose is built in memory and handed to the
+    ordered writer, which streams it into the SDF file of
+    this template conformation in object order
+    */
+    if (!(record = open_ordered_record(done_array_pos, moved_object_num))) {
+      O3_ERROR_LOCATE(task_info);
+      task_info->code = FL_OUT_OF_MEMORY;
+      error = 1;
+      if (pharao_sdf_fd.handle) {
+        fclose(pharao_sdf_fd.handle);
+        pharao_sdf_fd.handle = NULL;
+      }
+      continue;
+    }
+    /*
+    get AtomInfo for the candidate object
+    */
+    moved_atom = ti->od->al.mol_info[moved_object_num]->atom;
+    for (i = 1; i <= 5; ++i) {
+      set_conf_atoms(conf[i], moved_atom,
+        ti->od->al.mol_info[moved_object_num]->n_atoms);
+    }
+    if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+      /*
+      charge terms of the cost matrix and the best
+      achievable score only depend on atoms, so they
+      are shared by all candidate conformations
+      */
+      compute_charge_cost_matrix(&li, conf[O3_MOVED], conf[O3_TEMPLATE]);
+      score_bound = score_alignment_bound(&li, conf[O3_TEMPLATE], conf[O3_MOVED]);
+    }
+    /*
+    loop over conformations of the candidate object
+    */
+    for (moved_conf_num = 0, best_conf_num = 0, score[O3_GLOBAL] = 0.0, pairs[O3_GLOBAL] = 0;
+      (!error) && (moved_conf_num < ((ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+      ? ti->od->pel.conf_population[CANDIDATE_DB]->pe[moved_object_num] : 1)); ++moved_conf_num) {
+      /*
+      if the candidate has multiple conformations, get the relevant one
+      from the shared conformational database store
+      */
+      if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
         /*
-        open in the scratch folder a SDF file for the assigned object,
-        which will be aligned on the current template
+        conformations are read CONF_BATCH_SIZE at a time and
+        packed side by side, so that their distances, H arrays
+        and histogram costs are computed at once by vector
+        kernels; then they are aligned one by one
         */
-        sprintf(out_sdf_fd.name, "%s%c%04d_on_%04d%s.sdf",
-          buffer, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id,
-          ti->od.al.mol_info[template_object_num]->object_id,
-          template_conf_string);
-        if (!(out_sdf_fd.handle = fopen(out_sdf_fd.name, "wb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], out_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_WRITE_SDF_FILE;
-          error = 1;
-          if (pharao_sdf_fd.handle) {
-            fclose(pharao_sdf_fd.handle);
-            pharao_sdf_fd.handle = NULL;
+        slot = moved_conf_num % CONF_BATCH_SIZE;
+        if (!slot) {
+          n_batch = ti->od->pel.conf_population[CANDIDATE_DB]->pe[moved_object_num] - moved_conf_num;
+          if (n_batch > CONF_BATCH_SIZE) {
+            n_batch = CONF_BATCH_SIZE;
           }
-          continue;
+          for (k = 0; k < n_batch; ++k) {
+            pack_conf_batch(&batch, k, conf[O3_MOVED], get_store_conf
+              (ti->od->mel.conf_store[CANDIDATE_DB], moved_object_num, moved_conf_num + k));
+          }
+          compute_conf_batch_h(&batch);
+          compute_conf_batch_h_cost(&batch, conf[O3_TEMPLATE], MAX_H_BINS);
         }
+        task_info->data[MOVED_CONF_NUM] = moved_conf_num;
+        unpack_conf_batch(&batch, slot, conf[O3_MOVED], &li);
+      }
+      else {
         /*
-        if we are dealing with a multi-conformational candidate
+        if the candidate has a single conformations, retrieve it from
+        the candidate file (if supplied by the user), which
+        was imported in memory unless Pharao is involved
         */
-        if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-          /*
-          find where the conformational database for this candidate object
-          is stored and open it
-          */
-          sprintf(moved_fd.name, "%s%c%04d.sdf", ti->od.align.candidate_conf_dir,
-            SEPARATOR, ti->od.al.mol_info[moved_object_num]->object_id);
+        if (ti->od->mel.sdf_import[CANDIDATE_DB]) {
+          if (get_sdf_import_coord(ti->od->mel.sdf_import[CANDIDATE_DB], moved_object_num,
+            ti->od->al.mol_info[moved_object_num]->n_atoms, conf[O3_MOVED]->coord)) {
+            O3_ERROR_LOCATE(task_info);
+            O3_ERROR_STRING(task_info,
+              ti->od->mel.sdf_import[CANDIDATE_DB]->name);
+            task_info->code = FL_CANNOT_READ_SDF_FILE;
+            error = 1;
+            if (pharao_sdf_fd.handle) {
+              fclose(pharao_sdf_fd.handle);
+              pharao_sdf_fd.handle = NULL;
+            }
+            discard_ordered_record(record);
+            record = NULL;
+            continue;
+          }
+        }
+        else if (ti->od->align.candidate_file[0]) {
+          sprintf(moved_fd.name, "%s%c%04d.mol",
+            ti->od->align.candidate_dir, SEPARATOR,
+            ti->od->al.mol_info[moved_object_num]->object_id);
           if (!(moved_fd.handle = fopen(moved_fd.name, "rb"))) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-            O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], moved_fd.name);
-            ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_SDF_FILE;
+            O3_ERROR_LOCATE(task_info);
+            O3_ERROR_STRING(task_info, moved_fd.name);
+            task_info->code = FL_CANNOT_READ_SDF_FILE;
+            error = 1;
+            if (pharao_sdf_fd.handle) {
+              fclose(pharao_sdf_fd.handle);
+              pharao_sdf_fd.handle = NULL;
+            }
+            discard_ordered_record(record);
+            record = NULL;
+            continue;
+          }
+          task_info->code =
+            find_conformation_in_sdf(moved_fd.handle, NULL, 0);
+          if (task_info->code) {
+            O3_ERROR_LOCATE(task_info);
+            O3_ERROR_STRING(task_info, moved_fd.name);
+            error = 1;
+            fclose(moved_fd.handle);
+            moved_fd.handle = NULL;
+            if (pharao_sdf_fd.handle) {
+              fclose(pharao_sdf_fd.handle);
+              pharao_sdf_fd.handle = NULL;
+            }
+            discard_ordered_record(record);
+            record = NULL;
+            continue;
+          }
+          k = 0;
+          while ((k < ti->od->al.mol_info[moved_object_num]->n_atoms)
+            && fgets(buffer, BUF_LEN, moved_fd.handle)) {
+            buffer[BUF_LEN - 1] = '\0';
+            parse_sdf_coord_line(ti->od->al.mol_info[moved_object_num]->sdf_version,
+              buffer, NULL, &(conf[O3_MOVED]->coord[k * 3]), NULL);
+            ++k;
+          }
+          fclose(moved_fd.handle);
+          moved_fd.handle = NULL;
+          if (k != ti->od->al.mol_info[moved_object_num]->n_atoms) {
+            O3_ERROR_LOCATE(task_info);
+            O3_ERROR_STRING(task_info, moved_fd.name);
+            task_info->code =  FL_CANNOT_READ_SDF_FILE;
             error = 1;
             if (pharao_sdf_fd.handle) {
               fclose(pharao_sdf_fd.handle);
               pharao_sdf_fd.handle = NULL;
             }
-            fclose(out_sdf_fd.handle);
-            out_sdf_fd.handle = NULL;
+            discard_ordered_record(record);
+            record = NULL;
             continue;
           }
         }
+        else {
+          /*
+          otherwise just get coordinates from the currently loaded objects
+          */
+          for (i = 0; i < ti->od->al.mol_info[moved_object_num]->n_atoms; ++i) {
+            cblas_dcopy(3, moved_atom[i]->coord, 1, &(conf[O3_MOVED]->coord[i * 3]), 1);
+          }
+        }
+      }
+      if (!(ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)) {
         /*
-        get AtomInfo for the candidate object
+        compute the H array for the candidate conformation
         */
-        moved_atom = ti->od.al.mol_info[moved_object_num]->atom;
-        for (i = 1; i <= 5; ++i) {
-          conf[i]->atom = moved_atom;
-          conf[i]->n_atoms = ti->od.al.mol_info[moved_object_num]->n_atoms;
-          conf[i]->n_heavy_atoms = ti->od.al.mol_info[moved_object_num]->n_heavy_atoms;
-        }
+        compute_conf_h(conf[O3_MOVED]);
+        /*
+        histogram distances and charge differences do not
+        depend on options/coeff, so they are computed only
+        once for this (template, candidate) conformation pair
+        */
+        compute_h_cost_matrix(&li, conf[O3_MOVED], conf[O3_TEMPLATE], MAX_H_BINS);
+        /*
+        the best achievable score only depends on heavy atom
+        charges, so it is computed once per conformation pair
+        */
+        score_bound = score_alignment_bound(&li, conf[O3_TEMPLATE], conf[O3_MOVED]);
+      }
+      reset_sdm_memo(&memo);
+      for (options = 0, pairs[0] = 0, score[0] = 0.0, best_weight[0] = 0;
+        options <= (ti->od->align.type & ALIGN_TOGGLE_LOOP_BIT ? 0 : 1); ++options) {
         /*
-        loop over conformations of the candidate object
+        get object on which we are going to align
+        the portion of dataset assigned to this thread
         */
-        for (moved_conf_num = 0, best_conf_num = 0, score[O3_GLOBAL] = 0.0, pairs[O3_GLOBAL] = 0;
-          (!error) && (moved_conf_num < ((ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
-          ? ti->od.pel.conf_population[CANDIDATE_DB]->pe[moved_object_num] : 1)); ++moved_conf_num) {
+        for (coeff = (ti->od->align.type & ALIGN_TOGGLE_LOOP_BIT ? 5 : 0), pairs[1] = 0,
+          score[1] = 0.0, best_weight[1] = 0;
+          coeff < (ti->od->align.type & ALIGN_TOGGLE_LOOP_BIT ? 6 : 5); ++coeff) {
+          weight = (options ? coeff : 0);
           /*
-          if the candidate has multiple conformations, get the relevant one
-          from the SDF conformational database
+          compute the cost matrix for matching candidate to template
           */
-          if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-            ti->od.al.task_list[moved_object_num]->data[MOVED_CONF_NUM] = moved_conf_num;
-            ti->od.al.task_list[moved_object_num]->code =
-              find_conformation_in_sdf(moved_fd.handle, NULL, 0);
-            if (ti->od.al.task_list[moved_object_num]->code) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], moved_fd.name);
-              error = 1;
-              fclose(moved_fd.handle);
-              moved_fd.handle = NULL;
-              if (pharao_sdf_fd.handle) {
-                fclose(pharao_sdf_fd.handle);
-                pharao_sdf_fd.handle = NULL;
-              }
-              fclose(out_sdf_fd.handle);
-              out_sdf_fd.handle = NULL;
-              continue;
-            }
-            k = 0;
-            while ((k < ti->od.al.mol_info[moved_object_num]->n_atoms)
-              && fgets(buffer, BUF_LEN, moved_fd.handle)) {
-              buffer[BUF_LEN - 1] = '\0';
-              parse_sdf_coord_line(ti->od.al.mol_info[moved_object_num]->sdf_version,
-                buffer, NULL, &(conf[O3_MOVED]->coord[k * 3]), NULL);
-              ++k;
-            }
-            if (k != ti->od.al.mol_info[moved_object_num]->n_atoms) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], moved_fd.name);
-              ti->od.al.task_list[moved_object_num]->code =  FL_CANNOT_READ_SDF_FILE;
-              error = 1;
-              fclose(moved_fd.handle);
-              moved_fd.handle = NULL;
-              if (pharao_sdf_fd.handle) {
-                fclose(pharao_sdf_fd.handle);
-                pharao_sdf_fd.handle = NULL;
-              }
-              fclose(out_sdf_fd.handle);
-              out_sdf_fd.handle = NULL;
-              continue;
-            }
-            /*
-            skip to the beginning of the next conformation
-            */
-            i = 0;
-            while ((!i) && fgets(buffer, BUF_LEN, moved_fd.handle)) {
-              i = (!strncmp(buffer, SDF_DELIMITER, 4));
-            }
-          }
-          else {
-            /*
-            if the candidate has a single conformations, retrieve it from
-            the candidate file (if supplied by the user)
-            */
-            if (ti->od.align.candidate_file[0]) {
-              sprintf(moved_fd.name, "%s%c%04d.mol",
-                ti->od.align.candidate_dir, SEPARATOR,
-                ti->od.al.mol_info[moved_object_num]->object_id);
-              if (!(moved_fd.handle = fopen(moved_fd.name, "rb"))) {
-                O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-                O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], moved_fd.name);
-                ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_SDF_FILE;
-                error = 1;
-                if (pharao_sdf_fd.handle) {
-                  fclose(pharao_sdf_fd.handle);
-                  pharao_sdf_fd.handle = NULL;
-                }
-                fclose(out_sdf_fd.handle);
-                out_sdf_fd.handle = NULL;
-                continue;
-              }
-              ti->od.al.task_list[moved_object_num]->code =
-                find_conformation_in_sdf(moved_fd.handle, NULL, 0);
-              if (ti->od.al.task_list[moved_object_num]->code) {
-                O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-                O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], moved_fd.name);
-                error = 1;
-                fclose(moved_fd.handle);
-                moved_fd.handle = NULL;
-                if (pharao_sdf_fd.handle) {
-                  fclose(pharao_sdf_fd.handle);
-                  pharao_sdf_fd.handle = NULL;
-                }
-                fclose(out_sdf_fd.handle);
-                out_sdf_fd.handle = NULL;
-                continue;
-              }
-              k = 0;
-              while ((k < ti->od.al.mol_info[moved_object_num]->n_atoms)
-                && fgets(buffer, BUF_LEN, moved_fd.handle)) {
-                buffer[BUF_LEN - 1] = '\0';
-                parse_sdf_coord_line(ti->od.al.mol_info[moved_object_num]->sdf_version,
-                  buffer, NULL, &(conf[O3_MOVED]->coord[k * 3]), NULL);
-                ++k;
-              }
-              fclose(moved_fd.handle);
-              moved_fd.handle = NULL;
-              if (k != ti->od.al.mol_info[moved_object_num]->n_atoms) {
-                O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-                O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], moved_fd.name);
-                ti->od.al.task_list[moved_object_num]->code =  FL_CANNOT_READ_SDF_FILE;
-                error = 1;
-                if (pharao_sdf_fd.handle) {
-                  fclose(pharao_sdf_fd.handle);
-                  pharao_sdf_fd.handle = NULL;
-                }
-                fclose(out_sdf_fd.handle);
-                out_sdf_fd.handle = NULL;
-                continue;
-              }
-            }
-            else {
-              /*
-              otherwise just get coordinates from the currently loaded objects
-              */
-              for (i = 0; i < ti->od.al.mol_info[moved_object_num]->n_atoms; ++i) {
-                cblas_dcopy(3, moved_atom[i]->coord, 1, &(conf[O3_MOVED]->coord[i * 3]), 1);
-              }
-            }
-          }
+          largest_n_heavy_atoms = combine_cost_matrix(&li, conf[O3_MOVED], conf[O3_TEMPLATE],
+            coeff, (options ? MATCH_ATOM_TYPES_BIT : 0));
+          /*
+          find the lowest cost atom matching
+          */
+          lap(&li, largest_n_heavy_atoms);
+          calc_conf_centroid(conf[O3_TEMPLATE], centroid[O3_TEMPLATE]);
+          calc_conf_centroid(conf[O3_MOVED], centroid[O3_MOVED]);
+          /*
+          copy coordinates from O3_MOVED to O3_CAND
+          */
+          cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_CAND]->coord, 1);
           /*
-          compute the H array for the candidate conformation
+          filter the solution vector keeping only the safest n_equiv matches;
+          conf[O3_MOVED] is passed since it carries the cached distances
           */
-          compute_conf_h(conf[O3_MOVED]);
-          for (options = 0, pairs[0] = 0, score[0] = 0.0, best_weight[0] = 0;
-            options <= (ti->od.align.type & ALIGN_TOGGLE_LOOP_BIT ? 0 : 1); ++options) {
+          n_equiv = filter_sol_vector(&li, conf[O3_MOVED], conf[O3_TEMPLATE], sdm[O3_TEMP2], sdm[O3_TEMP1]);
+          /*
+          remove highest scores, keeping at least 3 superposition points
+          */
+          for (i = 3, pairs[2] = 0, score[2] = 0.0; i < n_equiv; ++i) {
             /*
-            get object on which we are going to align
-            the portion of dataset assigned to this thread
+            branch and bound: if the best achievable score cannot
+            beat by more than ALMOST_ZERO any of the incumbents
+            (which is what it would take to be accepted at any
+            level), the remaining starting points are skipped;
+            since nothing they could produce would be kept,
+            results are unaffected
             */
-            for (coeff = (ti->od.align.type & ALIGN_TOGGLE_LOOP_BIT ? 5 : 0), pairs[1] = 0,
-              score[1] = 0.0, best_weight[1] = 0;
-              coeff < (ti->od.align.type & ALIGN_TOGGLE_LOOP_BIT ? 6 : 5); ++coeff) {
-              weight = (options ? coeff : 0);
-              /*
-              compute the cost matrix for matching candidate to template
-              */
-              largest_n_heavy_atoms = compute_cost_matrix(&li, conf[O3_MOVED], conf[O3_TEMPLATE],
-                MAX_H_BINS, coeff, (options ? MATCH_ATOM_TYPES_BIT : 0));
-              /*
-              find the lowest cost atom matching
-              */
-              lap(&li, largest_n_heavy_atoms);
-              calc_conf_centroid(conf[O3_TEMPLATE], centroid[O3_TEMPLATE]);
-              calc_conf_centroid(conf[O3_MOVED], centroid[O3_MOVED]);
-              /*
-              copy coordinates from O3_MOVED to O3_CAND
-              */
-              cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_CAND]->coord, 1);
-              /*
-              filter the solution vector keeping only the safest n_equiv matches
-              */
-              n_equiv = filter_sol_vector(&li, conf[O3_CAND], conf[O3_TEMPLATE], sdm[O3_TEMP2], sdm[O3_TEMP1]);
-              /*
-              remove highest scores, keeping at least 3 superposition points
-              */
-              for (i = 3, pairs[2] = 0, score[2] = 0.0; i < n_equiv; ++i) {
-                /*
-                conf[O3_MOVED] is fitted on conf[O3_TEMPLATE]; fitted coordinates
-                are placed in conf[O3_CAND]. If rms_algorithm fails, then
-                fitted coordinates are not produced, hence candidate coordinates
-                translated on the template centroid are copied in to fitted coordinates
-                (better than nothing)
-                */
-                if (rms_algorithm(weight, sdm[O3_TEMP1], i,
-                  conf[O3_MOVED], conf[O3_TEMPLATE], conf[O3_CAND], rt_mat, &n_equiv_heavy_msd, NULL)) {
-                  cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_CAND]->coord, 1);
-                  for (k = 0; k < conf[O3_MOVED]->n_atoms; ++k) {
-                    cblas_daxpy(3, -1.0, centroid[O3_MOVED], 1, &(conf[O3_CAND]->coord[k * 3]), 1);
-                    cblas_daxpy(3, 1.0, centroid[O3_TEMPLATE], 1, &(conf[O3_CAND]->coord[k * 3]), 1);
-                  }
-                }
-                for (sdm_threshold_iter = (ti->od.align.type & ALIGN_TOGGLE_LOOP_BIT ? 2 : 0),
-                  pairs[3] = 0, score[3] = 0.0; sdm_threshold_iter < 3; ++sdm_threshold_iter) {
-                  pairs[4] = 0;
-                  pairs_heavy_msd[4] = MAX_CUTOFF;
-                  flag = 1;
-                  iter = 0;
-                  cblas_dcopy(conf[O3_CAND]->n_atoms * 3, conf[O3_CAND]->coord, 1, conf[O3_PROGRESS]->coord, 1);
-                  while (flag && (iter < MAX_SDM_ITERATIONS)) {
-                    /*
-                    call sdm_algorithm
-                    */
-                    sdm_threshold_dist = SDM_THRESHOLD_START + (double)sdm_threshold_iter * SDM_THRESHOLD_STEP;
-                    pairs[5] = sdm_algorithm(sdm[O3_TEMP2], conf[O3_PROGRESS], conf[O3_TEMPLATE], used, 0, sdm_threshold_dist);
-                    if (pairs[5] < 3) {
-                      break;
-                    }
-                    /*
-                    call rms_algorithm
-                    */
-                    if (rms_algorithm(weight, sdm[O3_TEMP2], pairs[5],
-                      conf[O3_PROGRESS], conf[O3_TEMPLATE], conf[O3_FITTED],
-                      rt_mat, &pairs_heavy_msd[5], NULL)) {
-                      cblas_dcopy(conf[O3_PROGRESS]->n_atoms * 3, conf[O3_PROGRESS]->coord, 1, conf[O3_FITTED]->coord, 1);
-                      break;
-                    }
-                    /*
-                    keep looping until:
-                    1) it is possible to increase the number of fitted pairs
-                    2) it is not possible to increase the number of fitted pairs
-                       anymore, but the msd is improved compared to the previous one
-                    */
-                    flag = ((pairs[5] > pairs[4]) || ((pairs[5] == pairs[4])
-                      && ((!iter) || ((pairs_heavy_msd[4] - pairs_heavy_msd[5]) > MSD_THRESHOLD))));
-                    if (flag) {
-                      pairs[4] = pairs[5];
-                      pairs_heavy_msd[4] = pairs_heavy_msd[5];
-                      memcpy(sdm[4], sdm[O3_TEMP2], pairs[4] * sizeof(AtomPair));
-                      cblas_dcopy(conf[O3_FITTED]->n_atoms * 3, conf[O3_FITTED]->coord, 1, conf[O3_PROGRESS]->coord, 1);
-                    }
-                    ++iter;
-                  }
-                  score[4] = ((pairs[4] >= 3) ? score_alignment(&(ti->od), conf[O3_TEMPLATE],
-                    conf[O3_FITTED], sdm[4], pairs[4]) : 0.0);
-                  if ((score[4] - score[3]) > ALMOST_ZERO) {
-                    pairs[3] = pairs[4];
-                    score[3] = score[4];
-                    memcpy(sdm[3], sdm[4], pairs[3] * sizeof(AtomPair));
-                  }
-                }
-                if ((score[3] - score[2]) > ALMOST_ZERO) {
-                  pairs[2] = pairs[3];
-                  score[2] = score[3];
-                  memcpy(sdm[2], sdm[3], pairs[2] * sizeof(AtomPair));
-                }
-              }
-              if ((pairs[2] < 3) && (n_equiv >= 3)) {
-                pairs[2] = n_equiv;
-                memcpy(sdm[2], sdm[O3_TEMP1], pairs[2] * sizeof(AtomPair));
-                score[2] = score_alignment(&(ti->od), conf[O3_TEMPLATE],
-                  conf[O3_FITTED], sdm[2], pairs[2]);
-              }
-              if ((score[2] - score[1]) > ALMOST_ZERO) {
-                score[1] = score[2];
-                pairs[1] = pairs[2];
-                best_weight[1] = weight;
-                memcpy(sdm[1], sdm[2], pairs[1] * sizeof(AtomPair));
-              }
-            }
-            if ((score[1] - score[0]) > ALMOST_ZERO) {
-              score[0] = score[1];
-              pairs[0] = pairs[1];
-              best_weight[0] = best_weight[1];
-              memcpy(sdm[0], sdm[1], pairs[0] * sizeof(AtomPair));
+            ++(ti->data[DATA_N_STARTS]);
+            incumbent = get_score_incumbent(score, 2,
+              (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT));
+            if ((score_bound - incumbent) <= ALMOST_ZERO) {
+              ti->data[DATA_N_STARTS] += n_equiv - i - 1;
+              ti->data[DATA_N_PRUNED_STARTS] += n_equiv - i;
+              break;
             }
-          }
-          if (ti->od.align.type & ALIGN_MIXED_BIT) {
             /*
-            align moved_object on template_object
+            conf[O3_MOVED] is fitted on conf[O3_TEMPLATE]; fitted coordinates
+            are placed in conf[O3_CAND]. If rms_algorithm fails, then
+            fitted coordinates are not produced, hence candidate coordinates
+            translated on the template centroid are copied in to fitted coordinates
+            (better than nothing)
             */
-            ti->od.al.task_list[moved_object_num]->code =
-              find_conformation_in_sdf(pharao_sdf_fd.handle, NULL, 0);
-            if (ti->od.al.task_list[moved_object_num]->code) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-              error = 1;
-              if (moved_fd.handle) {
-                fclose(moved_fd.handle);
-                moved_fd.handle = NULL;
+            if (rms_algorithm(weight, sdm[O3_TEMP1], i,
+              conf[O3_MOVED], conf[O3_TEMPLATE], conf[O3_CAND], rt_mat, &n_equiv_heavy_msd, NULL)) {
+              cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_CAND]->coord, 1);
+              for (k = 0; k < conf[O3_MOVED]->n_atoms; ++k) {
+                cblas_daxpy(3, -1.0, centroid[O3_MOVED], 1, &(conf[O3_CAND]->coord[k * 3]), 1);
+                cblas_daxpy(3, 1.0, centroid[O3_TEMPLATE], 1, &(conf[O3_CAND]->coord[k * 3]), 1);
               }
-              fclose(pharao_sdf_fd.handle);
-              pharao_sdf_fd.handle = NULL;
-              fclose(out_sdf_fd.handle);
-              out_sdf_fd.handle = NULL;
-              continue;
-            }
-            i = 0;
-            while ((i < ti->od.al.mol_info[moved_object_num]->n_atoms)
-              && fgets(buffer, BUF_LEN, pharao_sdf_fd.handle)) {
-              buffer[BUF_LEN - 1] = '\0';
-              parse_sdf_coord_line(ti->od.al.mol_info[moved_object_num]->sdf_version,
-                buffer, NULL, &(conf[O3_CAND]->coord[i * 3]), NULL);
-              ++i;
             }
-            if (i != ti->od.al.mol_info[moved_object_num]->n_atoms) {
-              O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-              O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-              ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_MOL_FILE;
-              error = 1;
-              if (moved_fd.handle) {
-                fclose(moved_fd.handle);
-                moved_fd.handle = NULL;
+            for (sdm_threshold_iter = (ti->od->align.type & ALIGN_TOGGLE_LOOP_BIT ? 2 : 0),
+              pairs[3] = 0, score[3] = 0.0; sdm_threshold_iter < 3; ++sdm_threshold_iter) {
+              /*
+              the same applies to the remaining SDM thresholds,
+              where score[3] is a further incumbent
+              */
+              if ((score_bound - get_score_incumbent(score, 3,
+                (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT))) <= ALMOST_ZERO) {
+                ti->data[DATA_N_PRUNED_THRESHOLDS] += 3 - sdm_threshold_iter;
+                break;
               }
-              fclose(pharao_sdf_fd.handle);
-              pharao_sdf_fd.handle = NULL;
-              fclose(out_sdf_fd.handle);
-              out_sdf_fd.handle = NULL;
-              continue;
-            }
-            for (sdm_threshold_iter = 0, pairs[3] = 0, score[3] = 0.0; sdm_threshold_iter < 3; ++sdm_threshold_iter) {
               pairs[4] = 0;
               pairs_heavy_msd[4] = MAX_CUTOFF;
               flag = 1;
               iter = 0;
+              memo_slot = -1;
+              memo_store = 0;
               cblas_dcopy(conf[O3_CAND]->n_atoms * 3, conf[O3_CAND]->coord, 1, conf[O3_PROGRESS]->coord, 1);
               while (flag && (iter < MAX_SDM_ITERATIONS)) {
-                ++iter;
                 /*
                 call sdm_algorithm
                 */
@@ -2565,6 +2814,21 @@ DWORD align_atombased_thread(void *pointer)
                   break;
                 }
                 /*
+                the superposition computed from a given pair set
+                does not depend on the starting pose, hence
+                from here on the refinement is entirely determined
+                by the first pair set; if the same set was already
+                refined for this conformation pair, the cached
+                score, pairs and pose are taken instead
+                */
+                if (!iter) {
+                  memo_slot = lookup_sdm_memo(&memo, sdm[O3_TEMP2],
+                    pairs[5], weight, sdm_threshold_iter);
+                  if (memo_slot != -1) {
+                    break;
+                  }
+                }
+                /*
                 call rms_algorithm
                 */
                 if (rms_algorithm(weight, sdm[O3_TEMP2], pairs[5],
@@ -2574,183 +2838,257 @@ DWORD align_atombased_thread(void *pointer)
                   break;
                 }
                 /*
+                if the very first superposition fails the fitted
+                pose depends on the starting pose, so the result
+                is not stored
+                */
+                if (!iter) {
+                  memo_store = 1;
+                }
+                /*
                 keep looping until:
                 1) it is possible to increase the number of fitted pairs
                 2) it is not possible to increase the number of fitted pairs
                    anymore, but the msd is improved compared to the previous one
                 */
                 flag = ((pairs[5] > pairs[4]) || ((pairs[5] == pairs[4])
-                  && ((pairs_heavy_msd[4] - pairs_heavy_msd[5]) > MSD_THRESHOLD)));
+                  && ((!iter) || ((pairs_heavy_msd[4] - pairs_heavy_msd[5]) > MSD_THRESHOLD))));
                 if (flag) {
                   pairs[4] = pairs[5];
                   pairs_heavy_msd[4] = pairs_heavy_msd[5];
                   memcpy(sdm[4], sdm[O3_TEMP2], pairs[4] * sizeof(AtomPair));
-                  cblas_dcopy(conf[O3_CAND]->n_atoms * 3, conf[O3_FITTED]->coord, 1, conf[O3_PROGRESS]->coord, 1);
+                  cblas_dcopy(conf[O3_FITTED]->n_atoms * 3, conf[O3_FITTED]->coord, 1, conf[O3_PROGRESS]->coord, 1);
+                }
+                ++iter;
+              }
+              if (memo_slot != -1) {
+                score[4] = memo.score[memo_slot];
+                pairs[4] = memo.n_pairs[memo_slot];
+                memcpy(sdm[4], memo.sdm[memo_slot], pairs[4] * sizeof(AtomPair));
+                cblas_dcopy(conf[O3_FITTED]->n_atoms * 3, memo.coord[memo_slot], 1, conf[O3_FITTED]->coord, 1);
+              }
+              else {
+                score[4] = ((pairs[4] >= 3) ? score_alignment(&li, conf[O3_TEMPLATE],
+                  conf[O3_FITTED], sdm[4], pairs[4]) : 0.0);
+                if (memo_store) {
+                  store_sdm_memo(&memo, weight, sdm_threshold_iter,
+                    score[4], sdm[4], pairs[4], conf[O3_FITTED]);
                 }
               }
-              score[4] = ((pairs[4] >= 3) ? score_alignment(&(ti->od), conf[O3_TEMPLATE],
-                conf[O3_FITTED], sdm[4], pairs[4]) : 0.0);
               if ((score[4] - score[3]) > ALMOST_ZERO) {
-                score[3] = score[4];
                 pairs[3] = pairs[4];
+                score[3] = score[4];
                 memcpy(sdm[3], sdm[4], pairs[3] * sizeof(AtomPair));
               }
             }
-            if ((score[3] - score[0]) > 0.1) {
-              score[0] = score[3];
-              pairs[0] = pairs[3];
-              memcpy(sdm[0], sdm[3], pairs[0] * sizeof(AtomPair));
+            if ((score[3] - score[2]) > ALMOST_ZERO) {
+              pairs[2] = pairs[3];
+              score[2] = score[3];
+              memcpy(sdm[2], sdm[3], pairs[2] * sizeof(AtomPair));
+            }
+          }
+          if ((pairs[2] < 3) && (n_equiv >= 3)) {
+            pairs[2] = n_equiv;
+            memcpy(sdm[2], sdm[O3_TEMP1], pairs[2] * sizeof(AtomPair));
+            /*
+            conf[O3_FITTED] may hold a pose left over from another
+            start, or from a previous coeff/options loop if all
+            starts were pruned, so it is fitted again on the
+            pairs being scored
+            */
+            if (rms_algorithm(weight, sdm[2], pairs[2], conf[O3_MOVED],
+              conf[O3_TEMPLATE], conf[O3_FITTED], rt_mat, &n_equiv_heavy_msd, NULL)) {
+              cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_FITTED]->coord, 1);
+              for (k = 0; k < conf[O3_MOVED]->n_atoms; ++k) {
+                cblas_daxpy(3, -1.0, centroid[O3_MOVED], 1, &(conf[O3_FITTED]->coord[k * 3]), 1);
+                cblas_daxpy(3, 1.0, centroid[O3_TEMPLATE], 1, &(conf[O3_FITTED]->coord[k * 3]), 1);
+              }
             }
+            score[2] = score_alignment(&li, conf[O3_TEMPLATE],
+              conf[O3_FITTED], sdm[2], pairs[2]);
           }
-          if (((score[0] - score[O3_GLOBAL]) > ALMOST_ZERO)
-            || (!(ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT))) {
-            score[O3_GLOBAL] = score[0];
-            pairs[O3_GLOBAL] = pairs[0];
-            best_weight[O3_GLOBAL] = best_weight[0];
-            best_conf_num = moved_conf_num;
-            cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_BEST]->coord, 1);
-            memcpy(sdm[O3_GLOBAL], sdm[0], pairs[O3_GLOBAL] * sizeof(AtomPair));
+          if ((score[2] - score[1]) > ALMOST_ZERO) {
+            score[1] = score[2];
+            pairs[1] = pairs[2];
+            best_weight[1] = weight;
+            memcpy(sdm[1], sdm[2], pairs[1] * sizeof(AtomPair));
           }
         }
-        if (error) {
-          continue;
+        if ((score[1] - score[0]) > ALMOST_ZERO) {
+          score[0] = score[1];
+          pairs[0] = pairs[1];
+          best_weight[0] = best_weight[1];
+          memcpy(sdm[0], sdm[1], pairs[0] * sizeof(AtomPair));
         }
-        if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-          fclose(moved_fd.handle);
-          moved_fd.handle = NULL;
-          cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_BEST]->coord, 1, conf[O3_MOVED]->coord, 1);
-        }
-        rms_algorithm(best_weight[O3_GLOBAL], sdm[O3_GLOBAL], pairs[O3_GLOBAL], conf[O3_MOVED],
-          conf[O3_TEMPLATE], conf[O3_FITTED], rt_mat, &pairs_heavy_msd[O3_GLOBAL],
-          &original_heavy_msd);
-        sprintf(mol_fd.name, "%s%c%04d.mol", ti->od.align.candidate_dir,
-          SEPARATOR, ti->od.al.mol_info[moved_object_num]->object_id);
-        if (!(mol_fd.handle = fopen(mol_fd.name, "rb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], mol_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_MOL_FILE;
-          fclose(out_sdf_fd.handle);
-          out_sdf_fd.handle = NULL;
+      }
+      if (ti->od->align.type & ALIGN_MIXED_BIT) {
+        /*
+        align moved_object on template_object
+        */
+        task_info->code =
+          find_conformation_in_sdf(pharao_sdf_fd.handle, NULL, 0);
+        if (task_info->code) {
+          O3_ERROR_LOCATE(task_info);
+          O3_ERROR_STRING(task_info, pharao_sdf_fd.name);
           error = 1;
+          if (moved_fd.handle) {
+            fclose(moved_fd.handle);
+            moved_fd.handle = NULL;
+          }
+          fclose(pharao_sdf_fd.handle);
+          pharao_sdf_fd.handle = NULL;
+          discard_ordered_record(record);
+          record = NULL;
           continue;
         }
-        ti->od.al.task_list[moved_object_num]->code =
-          find_conformation_in_sdf(mol_fd.handle, out_sdf_fd.handle, 0);
-        if (ti->od.al.task_list[moved_object_num]->code) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], mol_fd.name);
-          fclose(mol_fd.handle);
-          mol_fd.handle = NULL;
-          fclose(out_sdf_fd.handle);
-          out_sdf_fd.handle = NULL;
+        i = 0;
+        while ((i < ti->od->al.mol_info[moved_object_num]->n_atoms)
+          && fgets(buffer, BUF_LEN, pharao_sdf_fd.handle)) {
+          buffer[BUF_LEN - 1] = '\0';
+          parse_sdf_coord_line(ti->od->al.mol_info[moved_object_num]->sdf_version,
+            buffer, NULL, &(conf[O3_CAND]->coord[i * 3]), NULL);
+          ++i;
+        }
+        if (i != ti->od->al.mol_info[moved_object_num]->n_atoms) {
+          O3_ERROR_LOCATE(task_info);
+          O3_ERROR_STRING(task_info, pharao_sdf_fd.name);
+          task_info->code = FL_CANNOT_READ_MOL_FILE;
           error = 1;
+          if (moved_fd.handle) {
+            fclose(moved_fd.handle);
+            moved_fd.handle = NULL;
+          }
+          fclose(pharao_sdf_fd.handle);
+          pharao_sdf_fd.handle = NULL;
+          discard_ordered_record(record);
+          record = NULL;
           continue;
         }
-        k = 0;
-        while (fgets(buffer, BUF_LEN, mol_fd.handle)) {
-          buffer[BUF_LEN - 1] = '\0';
-          remove_newline(buffer);
-          if (k < conf[O3_FITTED]->n_atoms) {
-            if (replace_coord(ti->od.al.mol_info[moved_object_num]->sdf_version,
-              buffer, &(conf[O3_FITTED]->coord[k * 3]))) {
+        for (sdm_threshold_iter = 0, pairs[3] = 0, score[3] = 0.0; sdm_threshold_iter < 3; ++sdm_threshold_iter) {
+          pairs[4] = 0;
+          pairs_heavy_msd[4] = MAX_CUTOFF;
+          flag = 1;
+          iter = 0;
+          cblas_dcopy(conf[O3_CAND]->n_atoms * 3, conf[O3_CAND]->coord, 1, conf[O3_PROGRESS]->coord, 1);
+          while (flag && (iter < MAX_SDM_ITERATIONS)) {
+            ++iter;
+            /*
+            call sdm_algorithm
+            */
+            sdm_threshold_dist = SDM_THRESHOLD_START + (double)sdm_threshold_iter * SDM_THRESHOLD_STEP;
+            pairs[5] = sdm_algorithm(sdm[O3_TEMP2], conf[O3_PROGRESS], conf[O3_TEMPLATE], used, 0, sdm_threshold_dist);
+            if (pairs[5] < 3) {
               break;
             }
-            ++k;
+            /*
+            call rms_algorithm
+            */
+            if (rms_algorithm(weight, sdm[O3_TEMP2], pairs[5],
+              conf[O3_PROGRESS], conf[O3_TEMPLATE], conf[O3_FITTED],
+              rt_mat, &pairs_heavy_msd[5], NULL)) {
+              cblas_dcopy(conf[O3_PROGRESS]->n_atoms * 3, conf[O3_PROGRESS]->coord, 1, conf[O3_FITTED]->coord, 1);
+              break;
+            }
+            /*
+            keep looping until:
+            1) it is possible to increase the number of fitted pairs
+            2) it is not possible to increase the number of fitted pairs
+               anymore, but the msd is improved compared to the previous one
+            */
+            flag = ((pairs[5] > pairs[4]) || ((pairs[5] == pairs[4])
+              && ((pairs_heavy_msd[4] - pairs_heavy_msd[5]) > MSD_THRESHOLD)));
+            if (flag) {
+              pairs[4] = pairs[5];
+              pairs_heavy_msd[4] = pairs_heavy_msd[5];
+              memcpy(sdm[4], sdm[O3_TEMP2], pairs[4] * sizeof(AtomPair));
+              cblas_dcopy(conf[O3_CAND]->n_atoms * 3, conf[O3_FITTED]->coord, 1, conf[O3_PROGRESS]->coord, 1);
+            }
           }
-          fprintf(out_sdf_fd.handle, "%s\n", buffer);
-        }
-        if (k < conf[O3_MOVED]->n_atoms) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], mol_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_SDF_FILE;
-          fclose(mol_fd.handle);
-          mol_fd.handle = NULL;
-          fclose(out_sdf_fd.handle);
-          out_sdf_fd.handle = NULL;
-          error = 1;
-          continue;
-        }
-        while (fgets(buffer, BUF_LEN, mol_fd.handle)) {
-          buffer[BUF_LEN - 1] = '\0';
-          remove_newline(buffer);
-          fprintf(out_sdf_fd.handle, "%s\n", buffer);
-        }
-        fclose(mol_fd.handle);
-        fprintf(out_sdf_fd.handle, "\n"
-          ">  <O3A_SCORE>\n"
-          "%.4lf\n\n", score[O3_GLOBAL]);
-        fprintf(out_sdf_fd.handle,
-          ">  <O3A_ORIGINAL_SCORE>\n"
-          "%.4lf\n\n", score_alignment(&(ti->od), conf[O3_TEMPLATE],
-          conf[O3_MOVED],sdm[O3_GLOBAL], pairs[O3_GLOBAL]));
-        if (ti->od.align.type & ALIGN_PRINT_RMSD_BIT) {
-          fprintf(out_sdf_fd.handle,
-            ">  <ORIGINAL_RMSD>\n"
-            "%.4lf\n\n"
-            ">  <ALIGNED_RMSD>\n"
-            "%.4lf\n\n",
-            sqrt(original_heavy_msd),
-            sqrt(pairs_heavy_msd[O3_GLOBAL]));
-        }
-        if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-          fprintf(out_sdf_fd.handle, ">  <BEST_CANDIDATE_CONF>\n%d\n\n", best_conf_num + 1);
-        }
-        fprintf(out_sdf_fd.handle, SDF_DELIMITER"\n");
-        if (out_sdf_fd.handle) {
-          fclose(out_sdf_fd.handle);
-          out_sdf_fd.handle = NULL;
-        }
-        if (pharao_sdf_fd.handle) {
-          fclose(pharao_sdf_fd.handle);
-          pharao_sdf_fd.handle = NULL;
-          if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-            remove(pharao_sdf_fd.name);
+          score[4] = ((pairs[4] >= 3) ? score_alignment(&li, conf[O3_TEMPLATE],
+            conf[O3_FITTED], sdm[4], pairs[4]) : 0.0);
+          if ((score[4] - score[3]) > ALMOST_ZERO) {
+            score[3] = score[4];
+            pairs[3] = pairs[4];
+            memcpy(sdm[3], sdm[4], pairs[3] * sizeof(AtomPair));
           }
         }
-        #ifndef WIN32
-        pthread_mutex_lock(ti->od.mel.mutex);
-        #else
-        WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-        #endif
-        ti->od.al.done_objects[done_array_pos][moved_object_num] |= OBJECT_FINISHED;
-        #ifndef WIN32
-        pthread_mutex_unlock(ti->od.mel.mutex);
-        #else
-        ReleaseMutex(ti->od.mel.mutex);
-        #endif
-      }
-      if (error) {
-        continue;
-      }
-      i = join_aligned_files(&(ti->od), done_array_pos, buffer);
-      if (i != -1) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[i]);
-        O3_ERROR_STRING(ti->od.al.task_list[i], buffer);
-        ti->od.al.task_list[i]->code = FL_CANNOT_READ_SDF_FILE;
-        error = 1;
+        if ((score[3] - score[0]) > 0.1) {
+          score[0] = score[3];
+          pairs[0] = pairs[3];
+          memcpy(sdm[0], sdm[3], pairs[0] * sizeof(AtomPair));
+        }
       }
-      if (!error) {
-        ++done_array_pos;
+      if (((score[0] - score[O3_GLOBAL]) > ALMOST_ZERO)
+        || (!(ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT))) {
+        score[O3_GLOBAL] = score[0];
+        pairs[O3_GLOBAL] = pairs[0];
+        best_weight[O3_GLOBAL] = best_weight[0];
+        best_conf_num = moved_conf_num;
+        cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_MOVED]->coord, 1, conf[O3_BEST]->coord, 1);
+        memcpy(sdm[O3_GLOBAL], sdm[0], pairs[O3_GLOBAL] * sizeof(AtomPair));
       }
     }
-  }
-  for (i = 0; i < 2; ++i) {
-    free_array(conf[i]->h);
-    if (used[i]) {
-      free(used[i]);
+    if (error) {
+      continue;
     }
-  }
-  for (i = 0; i < O3_MAX_SLOT; ++i) {
-    free_conf(conf[i]);
-    if (sdm[i]) {
-      free(sdm[i]);
+    if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+      cblas_dcopy(conf[O3_MOVED]->n_atoms * 3, conf[O3_BEST]->coord, 1, conf[O3_MOVED]->coord, 1);
+    }
+    rms_algorithm(best_weight[O3_GLOBAL], sdm[O3_GLOBAL], pairs[O3_GLOBAL], conf[O3_MOVED],
+      conf[O3_TEMPLATE], conf[O3_FITTED], rt_mat, &pairs_heavy_msd[O3_GLOBAL],
+      &original_heavy_msd);
+    /*
+    the aligned pose is the candidate MOL template
+    with fitted coordinates formatted in place
+    */
+    if (write_mol_template(&(ti->od->mel.mol_template->mol[moved_object_num]),
+      conf[O3_FITTED]->coord, pose, record->handle)) {
+      O3_ERROR_LOCATE(task_info);
+      O3_ERROR_STRING(task_info,
+        ti->od->mel.sdf_import[CANDIDATE_DB]
+        ? ti->od->mel.sdf_import[CANDIDATE_DB]->name : ti->od->align.candidate_dir);
+      task_info->code = FL_CANNOT_READ_SDF_FILE;
+      discard_ordered_record(record);
+      record = NULL;
+      error = 1;
+      continue;
+    }
+    fprintf(record->handle, "\n"
+      ">  <O3A_SCORE>\n"
+      "%.4lf\n\n", score[O3_GLOBAL]);
+    fprintf(record->handle,
+      ">  <O3A_ORIGINAL_SCORE>\n"
+      "%.4lf\n\n", score_alignment(&li, conf[O3_TEMPLATE],
+      conf[O3_MOVED],sdm[O3_GLOBAL], pairs[O3_GLOBAL]));
+    if (ti->od->align.type & ALIGN_PRINT_RMSD_BIT) {
+      fprintf(record->handle,
+        ">  <ORIGINAL_RMSD>\n"
+        "%.4lf\n\n"
+        ">  <ALIGNED_RMSD>\n"
+        "%.4lf\n\n",
+        sqrt(original_heavy_msd),
+        sqrt(pairs_heavy_msd[O3_GLOBAL]));
+    }
+    if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+      fprintf(record->handle, ">  <BEST_CANDIDATE_CONF>\n%d\n\n", best_conf_num + 1);
+    }
+    fprintf(record->handle, SDF_DELIMITER"\n");
+    submit_ordered_record(ti->od->mel.ordered_writer, record);
+    record = NULL;
+    if (pharao_sdf_fd.handle) {
+      fclose(pharao_sdf_fd.handle);
+      pharao_sdf_fd.handle = NULL;
+      if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+        remove(pharao_sdf_fd.name);
+      }
     }
   }
-  free_lap_info(&li);
+  free_arena(arena);
+  free_sdm_memo(&memo);
   free_proc_env(prog_exe_info.proc_env);
   
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
@@ -2781,10 +3119,10 @@ DWORD align_single_pharao_thread(void *pointer)
   FileDescriptor inp_sdf_fd;
   FileDescriptor out_sdf_fd;
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(buffer, 0, BUF_LEN);
   memset(buffer2, 0, BUF_LEN);
   memset(template_conf_string, 0, MAX_NAME_LEN);
@@ -2794,8 +3132,8 @@ DWORD align_single_pharao_thread(void *pointer)
   memset(&temp_fd, 0, sizeof(FileDescriptor));
   memset(&inp_sdf_fd, 0, sizeof(FileDescriptor));
   memset(&out_sdf_fd, 0, sizeof(FileDescriptor));
-  prog_exe_info.exedir = ti->od.align.pharao_exe_path;
-  prog_exe_info.proc_env = fill_env(&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0);
+  prog_exe_info.exedir = ti->od->align.pharao_exe_path;
+  prog_exe_info.proc_env = fill_env(ti->od, babel_env, ti->od->align.pharao_exe_path, 0);
   prog_exe_info.stdout_fd = &temp_fd;
   prog_exe_info.stderr_fd = &temp_fd;
   prog_exe_info.sep_proc_grp = 1;
@@ -2803,10 +3141,10 @@ DWORD align_single_pharao_thread(void *pointer)
   loop over all tasks
   */
   for (task_num = ti->start, error = 0; (!error) && (task_num <= ti->end); ++task_num) {
-    ti->od.al.task_list[task_num]->code = 0;
+    ti->od->al.task_list[task_num]->code = 0;
     if (!(prog_exe_info.proc_env)) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      ti->od.al.task_list[task_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      ti->od->al.task_list[task_num]->code = FL_OUT_OF_MEMORY;
       error = 1;
       continue;
     }
@@ -2814,41 +3152,41 @@ DWORD align_single_pharao_thread(void *pointer)
     get object on which we are going
     to align the dataset
     */
-    template_object_num = ti->od.al.task_list[task_num]->data[TEMPLATE_OBJECT_NUM];
-    template_conf_num = ti->od.al.task_list[task_num]->data[TEMPLATE_CONF_NUM];
+    template_object_num = ti->od->al.task_list[task_num]->data[TEMPLATE_OBJECT_NUM];
+    template_conf_num = ti->od->al.task_list[task_num]->data[TEMPLATE_CONF_NUM];
     sprintf(buffer, "%04d-%04d_on_%04d",
-      ti->od.al.mol_info[0]->object_id,
-      ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id,
-      ti->od.al.mol_info[template_object_num]->object_id);
-    sprintf(db_name, "%s%c%04d-%04d.sdf", ti->od.align.align_scratch,
-      SEPARATOR, ti->od.al.mol_info[0]->object_id,
-      ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id);
-    if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+      ti->od->al.mol_info[0]->object_id,
+      ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id,
+      ti->od->al.mol_info[template_object_num]->object_id);
+    sprintf(db_name, "%s%c%04d-%04d.sdf", ti->od->align.align_scratch,
+      SEPARATOR, ti->od->al.mol_info[0]->object_id,
+      ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id);
+    if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
       sprintf(template_conf_string, "_%06d", template_conf_num + 1);
-      sprintf(inp_sdf_fd.name, "%s%c%04d.sdf", ti->od.align.template_conf_dir, SEPARATOR,
-        ti->od.al.mol_info[template_object_num]->object_id);
+      sprintf(inp_sdf_fd.name, "%s%c%04d.sdf", ti->od->align.template_conf_dir, SEPARATOR,
+        ti->od->al.mol_info[template_object_num]->object_id);
       if (!(inp_sdf_fd.handle = fopen(inp_sdf_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], inp_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], inp_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         error = 1;
         continue;
       }
-      sprintf(temp_fd.name, "%s%c%04d_%06d.mol", ti->od.align.template_dir,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
+      sprintf(temp_fd.name, "%s%c%04d_%06d.mol", ti->od->align.template_dir,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_num + 1);
       if (!(temp_fd.handle = fopen(temp_fd.name, "wb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
         fclose(inp_sdf_fd.handle);
         error = 1;
         continue;
       }
       if (find_conformation_in_sdf(inp_sdf_fd.handle, temp_fd.handle, template_conf_num)) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], inp_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_FIND_CONF;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], inp_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_FIND_CONF;
         fclose(temp_fd.handle);
         fclose(inp_sdf_fd.handle);
         error = 1;
@@ -2866,29 +3204,29 @@ DWORD align_single_pharao_thread(void *pointer)
       fclose(temp_fd.handle);
       fclose(inp_sdf_fd.handle);
     }
-    sprintf(out_sdf_fd.name, "%s%c%s%s.sdf", ti->od.align.align_dir,
+    sprintf(out_sdf_fd.name, "%s%c%s%s.sdf", ti->od->align.align_dir,
       SEPARATOR, buffer, template_conf_string);
-    sprintf(temp_fd.name, "%s%c%s%s.log", ti->od.align.align_scratch,
+    sprintf(temp_fd.name, "%s%c%s%s.log", ti->od->align.align_scratch,
       SEPARATOR, buffer, template_conf_string);
     sprintf(prog_exe_info.command_line,
       "%s -q %s %s -r %s%c%04d%s.mol --refType MOL "
       "-d %s --dbType MOL "
       "-s %s%c%s%s.scores -o %s%c%s%s_pharao.sdf",
-      ti->od.align.pharao_exe,
-      ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-      ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
-      ti->od.align.template_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id,
+      ti->od->align.pharao_exe,
+      ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+      ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+      ti->od->align.template_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id,
       template_conf_string, db_name,
-      ti->od.align.align_scratch, SEPARATOR, buffer, template_conf_string,
-      ti->od.align.align_scratch, SEPARATOR, buffer, template_conf_string);
+      ti->od->align.align_scratch, SEPARATOR, buffer, template_conf_string,
+      ti->od->align.align_scratch, SEPARATOR, buffer, template_conf_string);
     /*
     align objects on the current template
     */
-    pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[task_num]->code));
+    pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[task_num]->code));
     ext_program_wait(&prog_exe_info, pid);
-    if (ti->od.al.task_list[task_num]->code) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
+    if (ti->od->al.task_list[task_num]->code) {
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
       error = 1;
       continue;
     }
@@ -2896,24 +3234,24 @@ DWORD align_single_pharao_thread(void *pointer)
     check if the Pharao computation was OK
     */
     if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
-      ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
+      ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
       error = 1;
       continue;
     }
     if (fgrep(temp_fd.handle, buffer2, "Error")) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
-      ti->od.al.task_list[task_num]->code = FL_PHARAO_ERROR;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
+      ti->od->al.task_list[task_num]->code = FL_PHARAO_ERROR;
     }
     fclose(temp_fd.handle);
-    if (ti->od.al.task_list[task_num]->code) {
+    if (ti->od->al.task_list[task_num]->code) {
       error = 1;
       continue;
     }
     sprintf(pharao_temp_dir, "%s%c%s%s_pharao",
-      ti->od.align.align_scratch, SEPARATOR, buffer, template_conf_string);
+      ti->od->align.align_scratch, SEPARATOR, buffer, template_conf_string);
     if (!dexist(pharao_temp_dir)) {
       #ifndef WIN32
       result = mkdir(pharao_temp_dir, S_IRWXU | S_IRGRP | S_IROTH);
@@ -2922,63 +3260,63 @@ DWORD align_single_pharao_thread(void *pointer)
       #endif
     }
     if (result) {
-      ti->od.al.task_list[task_num]->code = FL_CANNOT_CREATE_SCRDIR;
+      ti->od->al.task_list[task_num]->code = FL_CANNOT_CREATE_SCRDIR;
       error = 1;
       continue;
     }
     sprintf(temp_fd.name, "%s.sdf", pharao_temp_dir);
-    if ((ti->od.al.task_list[task_num]->code = break_sdf_to_sdf
-      (&(ti->od), ti->od.al.task_list[task_num], &temp_fd, pharao_temp_dir))) {
+    if ((ti->od->al.task_list[task_num]->code = break_sdf_to_sdf
+      (ti->od, ti->od->al.task_list[task_num], &temp_fd, pharao_temp_dir))) {
       error = 1;
       continue;
     }
     if (!(out_sdf_fd.handle = fopen(out_sdf_fd.name, "wb"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[task_num], out_sdf_fd.name);
-      ti->od.al.task_list[task_num]->code = FL_CANNOT_WRITE_SDF_FILE;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[task_num], out_sdf_fd.name);
+      ti->od->al.task_list[task_num]->code = FL_CANNOT_WRITE_SDF_FILE;
       error = 1;
       continue;
     }
-    for (object_num = 0; (!(ti->od.al.task_list[task_num]->code))
-      && (object_num < ti->od.grid.object_num); ++object_num) {
+    for (object_num = 0; (!(ti->od->al.task_list[task_num]->code))
+      && (object_num < ti->od->grid.object_num); ++object_num) {
       sprintf(inp_sdf_fd.name, "%s%c%04d.mol",
-        ti->od.align.candidate_dir, SEPARATOR,
-        ti->od.al.mol_info[object_num]->object_id);
+        ti->od->align.candidate_dir, SEPARATOR,
+        ti->od->al.mol_info[object_num]->object_id);
       if (!(inp_sdf_fd.handle = fopen(inp_sdf_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], inp_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], inp_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         continue;
       }
       sprintf(temp_fd.name, "%s%c%04d.sdf", pharao_temp_dir,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id);
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id);
       if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         fclose(inp_sdf_fd.handle);
         continue;
       }
-      ti->od.al.task_list[task_num]->code = find_conformation_in_sdf
+      ti->od->al.task_list[task_num]->code = find_conformation_in_sdf
         (inp_sdf_fd.handle, out_sdf_fd.handle, 0);
-      if (ti->od.al.task_list[task_num]->code) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], inp_sdf_fd.name);
+      if (ti->od->al.task_list[task_num]->code) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], inp_sdf_fd.name);
         fclose(inp_sdf_fd.handle);
         fclose(temp_fd.handle);
         continue;
       }
-      ti->od.al.task_list[task_num]->code = find_conformation_in_sdf
+      ti->od->al.task_list[task_num]->code = find_conformation_in_sdf
         (temp_fd.handle, NULL, 0);
-      if (ti->od.al.task_list[task_num]->code) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
+      if (ti->od->al.task_list[task_num]->code) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
         fclose(inp_sdf_fd.handle);
         fclose(temp_fd.handle);
         continue;
       }
       i = 0;
-      while ((i < ti->od.al.mol_info[object_num]->n_atoms)
+      while ((i < ti->od->al.mol_info[object_num]->n_atoms)
         && fgets(buffer, BUF_LEN, inp_sdf_fd.handle)) {
         buffer[BUF_LEN - 1] = '\0';
         if (!fgets(buffer2, BUF_LEN, temp_fd.handle)) {
@@ -2989,10 +3327,10 @@ DWORD align_single_pharao_thread(void *pointer)
         fprintf(out_sdf_fd.handle, "%s\n", buffer2);
         ++i;
       }
-      if (i < ti->od.al.mol_info[object_num]->n_atoms) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], inp_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+      if (i < ti->od->al.mol_info[object_num]->n_atoms) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], inp_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         fclose(inp_sdf_fd.handle);
         fclose(temp_fd.handle);
         continue;
@@ -3005,9 +3343,9 @@ DWORD align_single_pharao_thread(void *pointer)
         found = (!strncmp(buffer, MOL_DELIMITER, 4));
       }
       if (!found) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], inp_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], inp_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         fclose(inp_sdf_fd.handle);
         fclose(temp_fd.handle);
         continue;
@@ -3019,18 +3357,18 @@ DWORD align_single_pharao_thread(void *pointer)
         found = (!strncasecmp(buffer2, ">  <PHARAO_TANIMOTO>", 20));
       }
       if (!found) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         fclose(inp_sdf_fd.handle);
         fclose(temp_fd.handle);
         continue;
       }
       fprintf(out_sdf_fd.handle, "%s\n", buffer2);
       if (!fgets(buffer2, BUF_LEN, temp_fd.handle)) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], temp_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], temp_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         fclose(inp_sdf_fd.handle);
         fclose(temp_fd.handle);
         continue;
@@ -3047,7 +3385,7 @@ DWORD align_single_pharao_thread(void *pointer)
   free_proc_env(prog_exe_info.proc_env);
   
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
@@ -3075,10 +3413,10 @@ DWORD phar_extract_thread(void *pointer)
   FileDescriptor single_conf_mol_fd;
   FileDescriptor pharao_sdf_fd;
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(buffer, 0, BUF_LEN);
   memset(template_conf_string, 0, MAX_NAME_LEN);
   memset(pharao_temp_dir, 0, BUF_LEN);
@@ -3087,46 +3425,46 @@ DWORD phar_extract_thread(void *pointer)
   memset(&multi_conf_sdf_fd, 0, sizeof(FileDescriptor));
   memset(&single_conf_mol_fd, 0, sizeof(FileDescriptor));
   memset(&prog_exe_info, 0, sizeof(ProgExeInfo));
-  prog_exe_info.exedir = ti->od.align.pharao_exe_path;
-  prog_exe_info.proc_env = fill_env(&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0);
+  prog_exe_info.exedir = ti->od->align.pharao_exe_path;
+  prog_exe_info.proc_env = fill_env(ti->od, babel_env, ti->od->align.pharao_exe_path, 0);
   prog_exe_info.stdout_fd = &log_fd;
   prog_exe_info.stderr_fd = &log_fd;
   prog_exe_info.sep_proc_grp = 1;
   for (task_num = ti->start, error = 0; (!error) && (task_num <= ti->end); ++task_num) {
-    ti->od.al.task_list[task_num]->code = 0;
+    ti->od->al.task_list[task_num]->code = 0;
     if (!(prog_exe_info.proc_env)) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      ti->od.al.task_list[task_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      ti->od->al.task_list[task_num]->code = FL_OUT_OF_MEMORY;
       error = 1;
       continue;
     }
-    template_object_num = ti->od.al.task_list[task_num]->data[TEMPLATE_OBJECT_NUM];
-    template_conf_num = ti->od.al.task_list[task_num]->data[TEMPLATE_CONF_NUM];
-    if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
-      sprintf(multi_conf_sdf_fd.name, "%s%c%04d.sdf", ti->od.align.template_conf_dir,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id);
+    template_object_num = ti->od->al.task_list[task_num]->data[TEMPLATE_OBJECT_NUM];
+    template_conf_num = ti->od->al.task_list[task_num]->data[TEMPLATE_CONF_NUM];
+    if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+      sprintf(multi_conf_sdf_fd.name, "%s%c%04d.sdf", ti->od->align.template_conf_dir,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id);
       if (!(multi_conf_sdf_fd.handle = fopen(multi_conf_sdf_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], multi_conf_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], multi_conf_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         error = 1;
         continue;
       }
-      sprintf(single_conf_mol_fd.name, "%s%c%04d_%06d.mol", ti->od.align.align_scratch,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id, template_conf_num + 1);
+      sprintf(single_conf_mol_fd.name, "%s%c%04d_%06d.mol", ti->od->align.align_scratch,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id, template_conf_num + 1);
       if (!(single_conf_mol_fd.handle = fopen(single_conf_mol_fd.name, "wb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], single_conf_mol_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], single_conf_mol_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
         fclose(multi_conf_sdf_fd.handle);
         error = 1;
         continue;
       }
-      ti->od.al.task_list[task_num]->code = find_conformation_in_sdf
+      ti->od->al.task_list[task_num]->code = find_conformation_in_sdf
         (multi_conf_sdf_fd.handle, single_conf_mol_fd.handle, template_conf_num);
-      if (ti->od.al.task_list[task_num]->code) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], multi_conf_sdf_fd.name);
+      if (ti->od->al.task_list[task_num]->code) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], multi_conf_sdf_fd.name);
         fclose(multi_conf_sdf_fd.handle);
         fclose(single_conf_mol_fd.handle);
         error = 1;
@@ -3144,102 +3482,102 @@ DWORD phar_extract_thread(void *pointer)
       fclose(multi_conf_sdf_fd.handle);
       fclose(single_conf_mol_fd.handle);
       if (!eof) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], multi_conf_sdf_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], multi_conf_sdf_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_SDF_FILE;
         error = 1;
         continue;
       }
-      sprintf(log_fd.name, "%s%c%04d_%06d_phar.log", ti->od.align.align_scratch,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
+      sprintf(log_fd.name, "%s%c%04d_%06d_phar.log", ti->od->align.align_scratch,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_num + 1);
       sprintf(prog_exe_info.command_line,
-        "%s -q %s %s -d %s --dbType MOL -p %s%c%04d_%06d.phar", ti->od.align.pharao_exe,
-        ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-        ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
-        single_conf_mol_fd.name, ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[template_object_num]->object_id, template_conf_num + 1);
+        "%s -q %s %s -d %s --dbType MOL -p %s%c%04d_%06d.phar", ti->od->align.pharao_exe,
+        ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+        ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+        single_conf_mol_fd.name, ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[template_object_num]->object_id, template_conf_num + 1);
     }
     else {
-      sprintf(log_fd.name, "%s%c%04d_phar.log", ti->od.align.align_scratch,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id);
+      sprintf(log_fd.name, "%s%c%04d_phar.log", ti->od->align.align_scratch,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id);
       sprintf(prog_exe_info.command_line,
-        "%s -q %s %s -d %s%c%04d.mol --dbType MOL -p %s%c%04d.phar", ti->od.align.pharao_exe,
-        ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-        ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
-        ti->od.align.template_dir, SEPARATOR,
-        ti->od.al.mol_info[template_object_num]->object_id,
-        ti->od.align.align_scratch, SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id);
-    }
-    pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[task_num]->code));
+        "%s -q %s %s -d %s%c%04d.mol --dbType MOL -p %s%c%04d.phar", ti->od->align.pharao_exe,
+        ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+        ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+        ti->od->align.template_dir, SEPARATOR,
+        ti->od->al.mol_info[template_object_num]->object_id,
+        ti->od->align.align_scratch, SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id);
+    }
+    pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[task_num]->code));
     ext_program_wait(&prog_exe_info, pid);
-    if (ti->od.al.task_list[task_num]->code) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
+    if (ti->od->al.task_list[task_num]->code) {
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
       error = 1;
       continue;
     }
-    if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+    if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
       remove(single_conf_mol_fd.name);
     }
     if (!(log_fd.handle = fopen(log_fd.name, "rb"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[task_num], log_fd.name);
-      ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[task_num], log_fd.name);
+      ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
       error = 1;
       continue;
     }
     if (fgrep(log_fd.handle, buffer, "Error")) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[task_num], log_fd.name);
-      ti->od.al.task_list[task_num]->code = FL_PHARAO_ERROR;
+      O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[task_num], log_fd.name);
+      ti->od->al.task_list[task_num]->code = FL_PHARAO_ERROR;
     }
     fclose(log_fd.handle);
-    if (ti->od.al.task_list[task_num]->code) {
+    if (ti->od->al.task_list[task_num]->code) {
       error = 1;
       continue;
     }
     remove(log_fd.name);
-    if ((ti->od.align.type & ALIGN_MIXED_BIT)
-      && (!(ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT))) {
+    if ((ti->od->align.type & ALIGN_MIXED_BIT)
+      && (!(ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT))) {
       sprintf(buffer, "%s%c%04d-%04d.sdf",
-        ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[0]->object_id,
-        ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id);
-      if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+        ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[0]->object_id,
+        ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id);
+      if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
         sprintf(template_conf_string, "_%06d", template_conf_num + 1);
       }
       sprintf(log_fd.name, "%s%c%04d-%04d_on_%04d%s.log",
-        ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[0]->object_id,
-        ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id,
-        ti->od.al.mol_info[template_object_num]->object_id,
+        ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[0]->object_id,
+        ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id,
+        ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_string);
       sprintf(pharao_temp_dir, "%s%c%04d-%04d_on_%04d%s_pharao",
-        ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[0]->object_id,
-        ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id,
-        ti->od.al.mol_info[template_object_num]->object_id,
+        ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[0]->object_id,
+        ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id,
+        ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_string);
       sprintf(pharao_sdf_fd.name, "%s.sdf", pharao_temp_dir);
       sprintf(prog_exe_info.command_line,
         "%s -q %s %s -r %s%c%04d%s.phar --refType PHAR "
         "-d %s --dbType MOL "
         "-s %s%c%04d-%04d_on_%04d%s.scores -o %s",
-        ti->od.align.pharao_exe,
-        ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-        ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
-        ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[template_object_num]->object_id,
+        ti->od->align.pharao_exe,
+        ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+        ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+        ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_string, buffer,
-        ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[0]->object_id,
-        ti->od.al.mol_info[ti->od.grid.object_num - 1]->object_id,
-        ti->od.al.mol_info[template_object_num]->object_id,
+        ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[0]->object_id,
+        ti->od->al.mol_info[ti->od->grid.object_num - 1]->object_id,
+        ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_string, pharao_sdf_fd.name);
-      pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[task_num]->code));
+      pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[task_num]->code));
       ext_program_wait(&prog_exe_info, pid);
-      if (ti->od.al.task_list[task_num]->code) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
+      if (ti->od->al.task_list[task_num]->code) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
         error = 1;
         continue;
       }
@@ -3247,19 +3585,19 @@ DWORD phar_extract_thread(void *pointer)
       check if the Pharao computation was OK
       */
       if (!(log_fd.handle = fopen(log_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], log_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], log_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
         error = 1;
         continue;
       }
       if (fgrep(log_fd.handle, buffer, "Error")) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[task_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[task_num], log_fd.name);
-        ti->od.al.task_list[task_num]->code = FL_PHARAO_ERROR;
+        O3_ERROR_LOCATE(ti->od->al.task_list[task_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[task_num], log_fd.name);
+        ti->od->al.task_list[task_num]->code = FL_PHARAO_ERROR;
       }
       fclose(log_fd.handle);
-      if (ti->od.al.task_list[task_num]->code) {
+      if (ti->od->al.task_list[task_num]->code) {
         error = 1;
         continue;
       }
@@ -3271,12 +3609,12 @@ DWORD phar_extract_thread(void *pointer)
         #endif
       }
       if (result) {
-        ti->od.al.task_list[task_num]->code = FL_CANNOT_CREATE_SCRDIR;
+        ti->od->al.task_list[task_num]->code = FL_CANNOT_CREATE_SCRDIR;
         error = 1;
         continue;
       }
-      if ((ti->od.al.task_list[task_num]->code = break_sdf_to_sdf
-        (&(ti->od), ti->od.al.task_list[task_num], &pharao_sdf_fd, pharao_temp_dir))) {
+      if ((ti->od->al.task_list[task_num]->code = break_sdf_to_sdf
+        (ti->od, ti->od->al.task_list[task_num], &pharao_sdf_fd, pharao_temp_dir))) {
         error = 1;
         continue;
       }
@@ -3286,7 +3624,7 @@ DWORD phar_extract_thread(void *pointer)
   free_proc_env(prog_exe_info.proc_env);
   
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
@@ -3309,7 +3647,6 @@ DWORD align_multi_pharao_thread(void *pointer)
   int moved_object_num;
   int best_conf_num;
   int found = 0;
-  int assigned = 0;
   int done_array_pos = 0;
   int error;
   int pid;
@@ -3322,10 +3659,10 @@ DWORD align_multi_pharao_thread(void *pointer)
   FileDescriptor phar_fd;
   FileDescriptor scores_fd;
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(buffer, 0, BUF_LEN);
   memset(buffer2, 0, BUF_LEN);
   memset(template_conf_string, 0, MAX_NAME_LEN);
@@ -3336,70 +3673,42 @@ DWORD align_multi_pharao_thread(void *pointer)
   memset(&pharao_sdf_fd, 0, sizeof(FileDescriptor));
   memset(&phar_fd, 0, sizeof(FileDescriptor));
   memset(&scores_fd, 0, sizeof(FileDescriptor));
-  prog_exe_info.exedir = ti->od.align.pharao_exe_path;
-  prog_exe_info.proc_env = fill_env(&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0);
+  prog_exe_info.exedir = ti->od->align.pharao_exe_path;
+  prog_exe_info.proc_env = fill_env(ti->od, babel_env, ti->od->align.pharao_exe_path, 0);
   prog_exe_info.stdout_fd = &log_fd;
   prog_exe_info.stderr_fd = &log_fd;
   prog_exe_info.sep_proc_grp = 1;
   for (template_num = 0, done_array_pos = 0, error = 0; (!error)
-    && (template_num < ti->od.pel.numberlist[OBJECT_LIST]->size); ++template_num) {
+    && (template_num < ti->od->pel.numberlist[OBJECT_LIST]->size); ++template_num) {
     /*
     loop over all templates
     */
-    template_object_num = ti->od.pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
-    for (template_conf_num = 0; (!error) && (template_conf_num < ((ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT)
-      ? ti->od.pel.conf_population[TEMPLATE_DB]->pe[template_object_num] : 1)); ++template_conf_num) {
-      if (ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
+    template_object_num = ti->od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
+    for (template_conf_num = 0; (!error) && (template_conf_num < ((ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT)
+      ? ti->od->pel.conf_population[TEMPLATE_DB]->pe[template_object_num] : 1)); ++template_conf_num) {
+      if (ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) {
         sprintf(template_conf_string, "_%06d", template_conf_num + 1);
       }
       /*
       loop over all conformations available
       for the current template
       */
-      assigned = 1;
-      while ((!error) && assigned) {
-        moved_object_num = 0;
-        assigned = 0;
-        while ((!assigned) && (moved_object_num < ti->od.grid.object_num)) {
-          if (!(ti->od.al.done_objects[done_array_pos][moved_object_num])) {
-            sprintf(buffer, "%s%c%04d%c%04d_on_%04d%s.sdf",
-              ti->od.align.align_scratch, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id, SEPARATOR,
-              ti->od.al.mol_info[moved_object_num]->object_id,
-              ti->od.al.mol_info[template_object_num]->object_id,
-              template_conf_string);
-            #ifndef WIN32
-            pthread_mutex_lock(ti->od.mel.mutex);
-            #else
-            WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-            #endif
-            if (!(ti->od.al.done_objects[done_array_pos][moved_object_num])) {
-              ti->od.al.done_objects[done_array_pos][moved_object_num] = OBJECT_ASSIGNED;
-              assigned = 1;
-            }
-            #ifndef WIN32
-            pthread_mutex_unlock(ti->od.mel.mutex);
-            #else
-            ReleaseMutex(ti->od.mel.mutex);
-            #endif
-          }
-          if (!assigned) {
-            ++moved_object_num;
-          }
-        }
-        if (!assigned)  {
+      while (!error) {
+        while (((moved_object_num = claim_task(ti->od->mel.task_queue, done_array_pos)) != -1)
+          && ti->od->al.done_objects[done_array_pos][moved_object_num]);
+        if (moved_object_num == -1)  {
           break;
         }
-        ti->od.al.task_list[moved_object_num]->code = 0;
+        ti->od->al.task_list[moved_object_num]->code = 0;
         if (!(prog_exe_info.proc_env)) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          ti->od.al.task_list[moved_object_num]->code = FL_OUT_OF_MEMORY;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          ti->od->al.task_list[moved_object_num]->code = FL_OUT_OF_MEMORY;
           error = 1;
           continue;
         }
-        ti->od.al.task_list[moved_object_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
-        sprintf(buffer, "%s%c%04d", ti->od.align.align_scratch, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id);
+        ti->od->al.task_list[moved_object_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
+        sprintf(buffer, "%s%c%04d", ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id);
         if (!dexist(buffer)) {
           #ifndef WIN32
           error = mkdir(buffer, S_IRWXU | S_IRGRP | S_IROTH);
@@ -3408,61 +3717,61 @@ DWORD align_multi_pharao_thread(void *pointer)
           #endif
         }
         if (error) {
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_CREATE_SCRDIR;
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_CREATE_SCRDIR;
           continue;
         }
         sprintf(out_sdf_fd.name, "%s%c%04d_on_%04d%s.sdf",
           buffer, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id,
-          ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
           template_conf_string);
         if (!(out_sdf_fd.handle = fopen(out_sdf_fd.name, "wb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], out_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_WRITE_SDF_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], out_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_WRITE_SDF_FILE;
           error = 1;
           continue;
         }
         sprintf(conf_sdf_fd.name, "%s%c%04d.sdf",
-          ti->od.align.candidate_conf_dir, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id);
-        ti->od.al.task_list[moved_object_num]->data[TEMPLATE_CONF_NUM] =
-          ((ti->od.align.type & ALIGN_MULTICONF_TEMPLATE_BIT) ? template_conf_num : -1);
+          ti->od->align.candidate_conf_dir, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id);
+        ti->od->al.task_list[moved_object_num]->data[TEMPLATE_CONF_NUM] =
+          ((ti->od->align.type & ALIGN_MULTICONF_TEMPLATE_BIT) ? template_conf_num : -1);
         /*
         align the conformational database of object "moved_object_num"
         on the current object,conformation pair
         */
         sprintf(log_fd.name, "%s%c%04d_on_%04d%s.log",
-          ti->od.align.align_scratch, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id,
-          ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
           template_conf_string);
         sprintf(pharao_sdf_fd.name, "%s%c%04d_on_%04d%s_pharao.sdf",
-          ti->od.align.align_scratch, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id,
-          ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
           template_conf_string);
         sprintf(phar_fd.name, "%s%c%04d%s.phar",
-          ti->od.align.align_scratch, SEPARATOR,
-          ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[template_object_num]->object_id,
           template_conf_string);
         sprintf(scores_fd.name, "%s%c%04d_on_%04d%s.scores",
-          ti->od.align.align_scratch, SEPARATOR,
-          ti->od.al.mol_info[moved_object_num]->object_id,
-          ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->align.align_scratch, SEPARATOR,
+          ti->od->al.mol_info[moved_object_num]->object_id,
+          ti->od->al.mol_info[template_object_num]->object_id,
           template_conf_string);
         sprintf(prog_exe_info.command_line,
           "%s -q %s %s -r %s --refType PHAR "
           "-d %s --dbType MOL -s %s -o %s",
-          ti->od.align.pharao_exe,
-          ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-          ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+          ti->od->align.pharao_exe,
+          ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+          ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
           phar_fd.name, conf_sdf_fd.name,
           scores_fd.name, pharao_sdf_fd.name);
-        pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[moved_object_num]->code));
+        pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[moved_object_num]->code));
         ext_program_wait(&prog_exe_info, pid);
-        if (ti->od.al.task_list[moved_object_num]->code) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
+        if (ti->od->al.task_list[moved_object_num]->code) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
           fclose(out_sdf_fd.handle);
           error = 1;
           continue;
@@ -3471,32 +3780,32 @@ DWORD align_multi_pharao_thread(void *pointer)
         check if the Pharao computation was OK
         */
         if (!(log_fd.handle = fopen(log_fd.name, "rb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], log_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], log_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
           fclose(out_sdf_fd.handle);
           error = 1;
           continue;
         }
         if (fgrep(log_fd.handle, buffer2, "Error")) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], log_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_PHARAO_ERROR;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], log_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_PHARAO_ERROR;
           fclose(out_sdf_fd.handle);
           error = 1;
         }
         fclose(log_fd.handle);
         remove(log_fd.name);
-        if (ti->od.al.task_list[moved_object_num]->code) {
+        if (ti->od->al.task_list[moved_object_num]->code) {
           continue;
         }
         /*
         find the best scoring conformation for object "object_num"
         */
         if (!(scores_fd.handle = fopen(scores_fd.name, "rb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], scores_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], scores_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
           fclose(out_sdf_fd.handle);
           error = 1;
           continue;
@@ -3518,9 +3827,9 @@ DWORD align_multi_pharao_thread(void *pointer)
         read Pharao SDF output
         */
         if (!(pharao_sdf_fd.handle = fopen(pharao_sdf_fd.name, "rb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_SDF_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], pharao_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_READ_SDF_FILE;
           fclose(out_sdf_fd.handle);
           error = 1;
           continue;
@@ -3528,11 +3837,11 @@ DWORD align_multi_pharao_thread(void *pointer)
         /*
         look for the conformation having the best Tanimoto score
         */
-        ti->od.al.task_list[moved_object_num]->code =
+        ti->od->al.task_list[moved_object_num]->code =
           find_conformation_in_sdf(pharao_sdf_fd.handle, NULL, best_conf_num);
-        if (ti->od.al.task_list[moved_object_num]->code) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
+        if (ti->od->al.task_list[moved_object_num]->code) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], pharao_sdf_fd.name);
           fclose(pharao_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
           error = 1;
@@ -3542,19 +3851,19 @@ DWORD align_multi_pharao_thread(void *pointer)
         open the conformational SDF database
         */
         if (!(conf_sdf_fd.handle = fopen(conf_sdf_fd.name, "rb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], conf_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_READ_CONF_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], conf_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_READ_CONF_FILE;
           fclose(pharao_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
           error = 1;
           continue;
         }
-        ti->od.al.task_list[moved_object_num]->code = find_conformation_in_sdf
+        ti->od->al.task_list[moved_object_num]->code = find_conformation_in_sdf
           (conf_sdf_fd.handle, out_sdf_fd.handle, best_conf_num);
-        if (ti->od.al.task_list[moved_object_num]->code) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], conf_sdf_fd.name);
+        if (ti->od->al.task_list[moved_object_num]->code) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], conf_sdf_fd.name);
           fclose(pharao_sdf_fd.handle);
           fclose(conf_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
@@ -3562,7 +3871,7 @@ DWORD align_multi_pharao_thread(void *pointer)
           continue;
         }
         i = 0;
-        while ((i < ti->od.al.mol_info[moved_object_num]->n_atoms)
+        while ((i < ti->od->al.mol_info[moved_object_num]->n_atoms)
           && fgets(buffer, BUF_LEN, conf_sdf_fd.handle)) {
           buffer[BUF_LEN - 1] = '\0';
           if (!fgets(buffer2, BUF_LEN, pharao_sdf_fd.handle)) {
@@ -3573,10 +3882,10 @@ DWORD align_multi_pharao_thread(void *pointer)
           fprintf(out_sdf_fd.handle, "%s\n", buffer2);
           ++i;
         }
-        if (i < ti->od.al.mol_info[moved_object_num]->n_atoms) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], conf_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
+        if (i < ti->od->al.mol_info[moved_object_num]->n_atoms) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], conf_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
           fclose(pharao_sdf_fd.handle);
           fclose(conf_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
@@ -3592,9 +3901,9 @@ DWORD align_multi_pharao_thread(void *pointer)
           }
         }
         if (!found) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], conf_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], conf_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
           fclose(pharao_sdf_fd.handle);
           fclose(conf_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
@@ -3608,9 +3917,9 @@ DWORD align_multi_pharao_thread(void *pointer)
           found = (!strncasecmp(buffer2, ">  <PHARAO_TANIMOTO>", 20));
         }
         if (!found) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], pharao_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
           fclose(pharao_sdf_fd.handle);
           fclose(conf_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
@@ -3619,9 +3928,9 @@ DWORD align_multi_pharao_thread(void *pointer)
         }
         fprintf(out_sdf_fd.handle, "%s\n", buffer2);
         if (!fgets(buffer2, BUF_LEN, pharao_sdf_fd.handle)) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[moved_object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[moved_object_num], pharao_sdf_fd.name);
-          ti->od.al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
+          O3_ERROR_LOCATE(ti->od->al.task_list[moved_object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[moved_object_num], pharao_sdf_fd.name);
+          ti->od->al.task_list[moved_object_num]->code = FL_CANNOT_FIND_CONF;
           fclose(pharao_sdf_fd.handle);
           fclose(conf_sdf_fd.handle);
           fclose(out_sdf_fd.handle);
@@ -3630,7 +3939,7 @@ DWORD align_multi_pharao_thread(void *pointer)
         }
         buffer2[BUF_LEN - 1] = '\0';
         fprintf(out_sdf_fd.handle, "%s\n", buffer2);
-        if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+        if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
           fprintf(out_sdf_fd.handle, ">  <BEST_CANDIDATE_CONF>\n%d\n\n", best_conf_num + 1);
         }
         fprintf(out_sdf_fd.handle, SDF_DELIMITER"\n");
@@ -3639,22 +3948,22 @@ DWORD align_multi_pharao_thread(void *pointer)
         fclose(conf_sdf_fd.handle);
         fclose(out_sdf_fd.handle);
         #ifndef WIN32
-        pthread_mutex_lock(ti->od.mel.mutex);
+        pthread_mutex_lock(ti->od->mel.mutex);
         #else
-        WaitForSingleObject(ti->od.mel.mutex, INFINITE);
+        WaitForSingleObject(ti->od->mel.mutex, INFINITE);
         #endif
-        ti->od.al.done_objects[done_array_pos][moved_object_num] |= OBJECT_FINISHED;
+        ti->od->al.done_objects[done_array_pos][moved_object_num] |= (OBJECT_ASSIGNED | OBJECT_FINISHED);
         #ifndef WIN32
-        pthread_mutex_unlock(ti->od.mel.mutex);
+        pthread_mutex_unlock(ti->od->mel.mutex);
         #else
-        ReleaseMutex(ti->od.mel.mutex);
+        ReleaseMutex(ti->od->mel.mutex);
         #endif
       }
-      i = join_aligned_files(&(ti->od), done_array_pos, buffer);
+      i = join_aligned_files(ti->od, done_array_pos, buffer);
       if (i != -1) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[i]);
-        O3_ERROR_STRING(ti->od.al.task_list[i], buffer);
-        ti->od.al.task_list[i]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[i]);
+        O3_ERROR_STRING(ti->od->al.task_list[i], buffer);
+        ti->od->al.task_list[i]->code = FL_CANNOT_READ_SDF_FILE;
         error = 1;
       }
       else {
@@ -3665,7 +3974,7 @@ DWORD align_multi_pharao_thread(void *pointer)
   free_proc_env(prog_exe_info.proc_env);
   
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
@@ -0,0 +1,320 @@
+/*
+
+arena.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+
+/*
+process-wide arena statistics, merged by each
+arena when it is freed; they are protected by a lock
+*/
+static long arena_n_allocs = 0;
+static long arena_n_blocks = 0;
+static long arena_n_resets = 0;
+static size_t arena_peak = 0;
+#ifndef WIN32
+static pthread_mutex_t arena_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+#else
+static volatile LONG arena_stats_lock = 0;
+#endif
+
+
+static void lock_arena_stats(void)
+{
+  #ifndef WIN32
+  pthread_mutex_lock(&arena_stats_mutex);
+  #else
+  while (InterlockedExchange(&arena_stats_lock, 1)) {
+    Sleep(0);
+  }
+  #endif
+}
+
+
+static void unlock_arena_stats(void)
+{
+  #ifndef WIN32
+  pthread_mutex_unlock(&arena_stats_mutex);
+  #else
+  InterlockedExchange(&arena_stats_lock, 0);
+  #endif
+}
+
+
+void reset_arena_stats(void)
+{
+  lock_arena_stats();
+  arena_n_allocs = 0;
+  arena_n_blocks = 0;
+  arena_n_resets = 0;
+  arena_peak = 0;
+  unlock_arena_stats();
+}
+
+
+void add_arena_stats(long n_allocs, long n_blocks, long n_resets, size_t peak)
+{
+  lock_arena_stats();
+  arena_n_allocs += n_allocs;
+  arena_n_blocks += n_blocks;
+  arena_n_resets += n_resets;
+  if (peak > arena_peak) {
+    arena_peak = peak;
+  }
+  unlock_arena_stats();
+}
+
+
+void get_arena_stats(long *n_allocs, long *n_blocks, long *n_resets, size_t *peak)
+{
+  lock_arena_stats();
+  *n_allocs = arena_n_allocs;
+  *n_blocks = arena_n_blocks;
+  *n_resets = arena_n_resets;
+  *peak = arena_peak;
+  unlock_arena_stats();
+}
+
+
+void print_arena_stats(O3Data *od)
+{
+  long n_allocs;
+  long n_blocks;
+  long n_resets;
+  size_t peak;
+  
+  
+  get_arena_stats(&n_allocs, &n_blocks, &n_resets, &peak);
+  tee_printf(od, "%ld scratch allocations were served by %ld arena blocks "
+    "over %ld arena resets; the largest arena peaked at %.1f kB.\n",
+    n_allocs, n_blocks, n_resets, (double)peak / 1024.0);
+}
+
+
+Arena *alloc_arena(size_t block_size)
+{
+  Arena *ar;
+  
+  
+  if (!(ar = (Arena *)malloc(sizeof(Arena)))) {
+    return NULL;
+  }
+  memset(ar, 0, sizeof(Arena));
+  ar->block_size = block_size;
+  
+  return ar;
+}
+
+
+static void release_arena_confs(Arena *ar)
+{
+  ArenaConf *ac;
+  
+  
+  /*
+  conformations carved from the arena may still
+  own a distance matrix and a cell list, which
+  live on the heap
+  */
+  for (ac = ar->conf_head; ac; ac = ac->next) {
+    free_conf_cache(&(ac->conf));
+  }
+  ar->conf_head = NULL;
+}
+
+
+static void free_arena_blocks(Arena *ar)
+{
+  ArenaBlock *block;
+  
+  
+  release_arena_confs(ar);
+  while ((block = ar->head)) {
+    ar->head = block->next;
+    free(block);
+  }
+}
+
+
+void free_arena(Arena *ar)
+{
+  if (ar) {
+    free_arena_blocks(ar);
+    add_arena_stats(ar->n_allocs, ar->n_blocks, ar->n_resets, ar->peak);
+    free(ar);
+  }
+}
+
+
+static ArenaBlock *alloc_arena_block(Arena *ar, size_t size)
+{
+  ArenaBlock *block;
+  
+  
+  if (size < ar->block_size) {
+    size = ar->block_size;
+  }
+  if (!(block = (ArenaBlock *)malloc(ARENA_HEADER_SIZE + size))) {
+    return NULL;
+  }
+  block->size = size;
+  block->used = 0;
+  block->next = ar->head;
+  ar->head = block;
+  ++(ar->n_blocks);
+  
+  return block;
+}
+
+
+void *arena_alloc(Arena *ar, size_t size)
+{
+  void *p;
+  ArenaBlock *block;
+  
+  
+  /*
+  bump allocation from the most recent block;
+  a new block is chained when this is full.
+  Memory is zeroed, like alloc_conf() and
+  alloc_array() do
+  */
+  size = (size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  block = ar->head;
+  if ((!block) || ((block->used + size) > block->size)) {
+    if (!(block = alloc_arena_block(ar, size))) {
+      return NULL;
+    }
+  }
+  p = (char *)block + ARENA_HEADER_SIZE + block->used;
+  block->used += size;
+  ar->used += size;
+  if (ar->used > ar->peak) {
+    ar->peak = ar->used;
+  }
+  ++(ar->n_allocs);
+  memset(p, 0, size);
+  
+  return p;
+}
+
+
+void reset_arena(Arena *ar)
+{
+  /*
+  everything allocated since the last reset is
+  released at once; if the arena grew beyond
+  one block, the blocks are replaced by a single
+  one as large as the peak, so that later tasks
+  of similar size do not hit malloc() at all
+  */
+  if (ar->head && ar->head->next) {
+    free_arena_blocks(ar);
+    alloc_arena_block(ar, ar->peak);
+  }
+  else {
+    release_arena_confs(ar);
+    if (ar->head) {
+      ar->head->used = 0;
+    }
+  }
+  ar->used = 0;
+  ++(ar->n_resets);
+}
+
+
+void **arena_alloc_array(Arena *ar, int n, size_t size)
+{
+  int i;
+  size_t header;
+  char *data;
+  void **array;
+  
+  
+  /*
+  same layout as alloc_array(): a vector of
+  n row pointers followed by n rows of size bytes
+  */
+  header = ((n + 1) * sizeof(void *) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+  if (!(array = (void **)arena_alloc(ar, header + n * size))) {
+    return NULL;
+  }
+  data = (char *)array + header;
+  for (i = 0; i < n; ++i) {
+    array[i] = data + i * size;
+  }
+  
+  return array;
+}
+
+
+ConfInfo *arena_alloc_conf(Arena *ar, int n_atoms)
+{
+  ArenaConf *ac;
+  ConfInfo *conf;
+  
+  
+  /*
+  same as alloc_conf(), but the conformation is
+  released with the arena rather than by free_conf()
+  */
+  if (!(ac = (ArenaConf *)arena_alloc(ar, sizeof(ArenaConf)))) {
+    return NULL;
+  }
+  conf = &(ac->conf);
+  if (!(conf->coord = (double *)arena_alloc(ar, n_atoms * 3 * sizeof(double)))) {
+    return NULL;
+  }
+  if (!(conf->heavy_atom = (int *)arena_alloc(ar, n_atoms * sizeof(int)))) {
+    return NULL;
+  }
+  if (!(conf->heavy_index = (int *)arena_alloc(ar, n_atoms * sizeof(int)))) {
+    return NULL;
+  }
+  if (!(conf->element = (int *)arena_alloc(ar, n_atoms * sizeof(int)))) {
+    return NULL;
+  }
+  ac->next = ar->conf_head;
+  ar->conf_head = ac;
+  
+  return conf;
+}
@@ -59,20 +59,17 @@ int compare(O3Data *od, O3Data *od_comp, int type, int verbose)
   ConfInfo *template_conf = NULL;
   ConfInfo *fitted_conf = NULL;
   FileDescriptor mol_comp_fd;
-  #ifndef WIN32
-  pthread_attr_t thread_attr;
-  #endif
-  ThreadInfo **ti;
+  WorkerInfo **ti;
 
 
-  ti = od->mel.thread_info;
   memset(&mol_comp_fd, 0, sizeof(FileDescriptor));
   memset(buffer, 0, BUF_LEN);
   memset(t_vec1, 0, RT_VEC_SIZE * sizeof(double));
   t_vec1[3] = 1.0;
-  if (alloc_threads(od)) {
+  if (alloc_workers(od)) {
     return OUT_OF_MEMORY;
   }
+  ti = od->mel.worker_info;
   if (!(od->al.task_list = (TaskInfo **)alloc_array(od->grid.object_num, sizeof(TaskInfo)))) {
     return OUT_OF_MEMORY;
   }
@@ -108,55 +105,17 @@ int compare(O3Data *od, O3Data *od_comp, int type, int verbose)
     }
   }
   od_comp->al.task_list = od->al.task_list;
-  #ifndef WIN32
-  pthread_attr_init(&thread_attr);
-  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
-  #endif
-  n_threads = fill_thread_info(od, od->grid.object_num);
+  n_threads = fill_worker_info(od, od_comp, od->grid.object_num);
   for (i = 0; i < n_threads; ++i) {
-    memcpy(&(ti[i]->od), od, sizeof(O3Data));
-    memcpy(&(ti[i]->od_comp), od_comp, sizeof(O3Data));
     ti[i]->model_type = type;
-    ti[i]->thread_num = i;
-    /*
-    create the i-th thread
-    */
-    #ifndef WIN32
-    od->error_code = pthread_create(&(od->thread_id[i]),
-      &thread_attr, (void *(*)(void *))compare_thread, ti[i]);
-    if (od->error_code) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #else
-    od->hThreadArray[i] = CreateThread(NULL, 0,
-      (LPTHREAD_START_ROUTINE)compare_thread,
-      ti[i], 0, &(od->dwThreadIdArray[i]));
-    if (!(od->hThreadArray[i])) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #endif
   }
-  #ifndef WIN32
-  /*
-  free the pthread attribute memory
-  */
-  pthread_attr_destroy(&thread_attr);
   /*
-  wait for all threads to have finished
+  start the threads and wait for all of them to have finished
   */
-  for (i = 0; i < n_threads; ++i) {
-    od->error_code = pthread_join(od->thread_id[i],
-      &(od->thread_result[i]));
-    if (od->error_code) {
-      return CANNOT_JOIN_THREAD;
-    }
-  }
-  #else
-  WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-  for (i = 0; i < n_threads; ++i) {
-    CloseHandle(od->hThreadArray[i]);
+  result = run_workers(od, "compare", n_threads, (void *)compare_thread);
+  if (result) {
+    return result;
   }
-  #endif
   for (i = 0; (i < od->grid.object_num) && (!(od->al.task_list[i]->code)); ++i);
   /*
   if errors did not occur
@@ -171,12 +130,10 @@ int compare(O3Data *od, O3Data *od_comp, int type, int verbose)
     }
     rms_algorithm_multi(od, od_comp, rt_mat, &ave_heavy_msd);
     for (object_num = 0; object_num < od->grid.object_num; ++object_num) {
-      template_conf->atom = od->al.mol_info[object_num]->atom;
-      template_conf->n_atoms = od->al.mol_info[object_num]->n_atoms;
-      template_conf->n_heavy_atoms = od_comp->al.mol_info[object_num]->n_heavy_atoms;
-      fitted_conf->atom = od->al.mol_info[object_num]->atom;
-      fitted_conf->n_atoms = od_comp->al.mol_info[object_num]->n_atoms;
-      fitted_conf->n_heavy_atoms = od_comp->al.mol_info[object_num]->n_heavy_atoms;
+      set_conf_atoms(template_conf, od->al.mol_info[object_num]->atom,
+        od->al.mol_info[object_num]->n_atoms);
+      set_conf_atoms(fitted_conf, od->al.mol_info[object_num]->atom,
+        od_comp->al.mol_info[object_num]->n_atoms);
       for (i = 0, heavy_msd = 0.0; i < od_comp->al.mol_info[object_num]->n_atoms; ++i) {
         /*
         apply the rotation/translation matrix to comp coordinates
@@ -334,49 +291,45 @@ DWORD compare_thread(void *pointer)
   AtomPair *best_sdm = NULL;
   ConfInfo *conf[O3_MAX_CONF] = { NULL, NULL, NULL, NULL, NULL, NULL };
   ConfInfo *fitted_conf = NULL;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
 
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   for (i = 0; i < O3_MAX_CONF; ++i) {
-    if (!(conf[i] = alloc_conf(ti->od.field.max_n_atoms))) {
+    if (!(conf[i] = alloc_conf(ti->od->field.max_n_atoms))) {
       alloc_fail = 1;
     }
   }
-  if (alloc_lap_info(&li, ti->od.field.max_n_atoms)) {
+  if (alloc_lap_info(&li, ti->od->field.max_n_atoms)) {
     alloc_fail = 1;
   }
   for (i = 0; i < O3_MAX_SDM; ++i) {
-    if ((sdm[i] = (AtomPair *)malloc(square(ti->od.field.max_n_atoms) * sizeof(AtomPair)))) {
-      memset(sdm[i], 0, square(ti->od.field.max_n_atoms) * sizeof(AtomPair));
+    if ((sdm[i] = (AtomPair *)malloc(square(ti->od->field.max_n_atoms) * sizeof(AtomPair)))) {
+      memset(sdm[i], 0, square(ti->od->field.max_n_atoms) * sizeof(AtomPair));
     }
     else {
       alloc_fail = 1;
     }
   }
   for (i = 0; i < 2; ++i) {
-    if (!(used[i] = malloc(ti->od.field.max_n_atoms))) {
+    if (!(used[i] = malloc(ti->od->field.max_n_atoms))) {
       alloc_fail = 1;
     }
-    if (!(h[i] = (int **)alloc_array(ti->od.field.max_n_atoms, MAX_H_BINS * sizeof(int)))) {
+    if (!(h[i] = (int **)alloc_array(ti->od->field.max_n_atoms, MAX_H_BINS * sizeof(int)))) {
       alloc_fail = 1;
     }
   }
   for (object_num = ti->start; (!error) && (object_num <= ti->end); ++object_num) {
     if (alloc_fail) {
-      ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
-      O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
+      ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
       error = 1;
       continue;
     }
-    conf[O3_TEMPLATE]->atom = ti->od.al.mol_info[object_num]->atom;
-    n_atoms = ti->od.al.mol_info[object_num]->n_atoms;
+    n_atoms = ti->od->al.mol_info[object_num]->n_atoms;
     for (i = 0; i < O3_MAX_CONF; ++i) {
-      if (i) {
-        conf[i]->atom = ti->od_comp.al.mol_info[object_num]->atom;
-      }
-      conf[i]->n_atoms = n_atoms;
-      conf[i]->n_heavy_atoms = ti->od.al.mol_info[object_num]->n_heavy_atoms;
+      set_conf_atoms(conf[i], (i ? ti->od_comp->al.mol_info[object_num]->atom
+        : ti->od->al.mol_info[object_num]->atom), n_atoms);
     }
     for (j = 0; j < n_atoms; ++j) {
       cblas_dcopy(3, conf[O3_TEMPLATE]->atom[j]->coord, 1, &(conf[O3_TEMPLATE]->coord[j * 3]), 1);
@@ -398,32 +351,32 @@ DWORD compare_thread(void *pointer)
     overall_msd(sdm[O3_BEST_SDM_LAP], pairs_lap,
       conf[O3_FITTED_LAP], conf[O3_TEMPLATE], &msd_lap);
     if ((msd_syst - msd_lap) > MSD_THRESHOLD) {
-      ti->od.vel.heavy_msd_list->ve[object_num] = msd_lap;
+      ti->od->vel.heavy_msd_list->ve[object_num] = msd_lap;
       best_sdm = sdm[O3_BEST_SDM_LAP];
       pairs = pairs_lap;
       fitted_conf = conf[O3_FITTED_LAP];
     }
     else {
-      ti->od.vel.heavy_msd_list->ve[object_num] = msd_syst;
+      ti->od->vel.heavy_msd_list->ve[object_num] = msd_syst;
       best_sdm = sdm[O3_BEST_SDM_SYST];
       pairs = pairs_syst;
       fitted_conf = conf[O3_FITTED_SYST];
     }
     if (ti->model_type & BLOCK_COMPARE) {
-       if (!(ti->od.al.rt_list[object_num]->sdm =
+       if (!(ti->od->al.rt_list[object_num]->sdm =
          (AtomPair *)malloc(pairs * sizeof(AtomPair)))) {
-         ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
+         ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
         error = 1;
         continue;
       }
-      memcpy(ti->od.al.rt_list[object_num]->sdm, best_sdm, pairs * sizeof(AtomPair));
-      ti->od.al.rt_list[object_num]->pairs = pairs;
+      memcpy(ti->od->al.rt_list[object_num]->sdm, best_sdm, pairs * sizeof(AtomPair));
+      ti->od->al.rt_list[object_num]->pairs = pairs;
     }
-    if (ti->od.file[ASCII_IN]->name[0]) {
+    if (ti->od->file[ASCII_IN]->name[0]) {
       if (!(ti->model_type & BLOCK_COMPARE)) {
-        if ((ti->od.al.task_list[object_num]->code = write_aligned_mol
-          (&(ti->od), &(ti->od_comp), ti->od.al.task_list[object_num],
+        if ((ti->od->al.task_list[object_num]->code = write_aligned_mol
+          (ti->od, ti->od_comp, ti->od->al.task_list[object_num],
           fitted_conf, object_num))) {
           error = 1;
         }
@@ -447,7 +400,7 @@ DWORD compare_thread(void *pointer)
   free_lap_info(&li);
 
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
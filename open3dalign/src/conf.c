@@ -41,6 +41,91 @@ E-mail: paolo.tosco@unito.it
 #include <include/o3header.h>
 
 
+/*
+process-wide budget for cached intra-molecular
+distance matrices, expressed as number of doubles,
+and SDM memo table statistics; they are shared by
+all threads, hence they are protected by a lock
+*/
+static long dist_cache_limit = (long)DIST_CACHE_DEFAULT_MB * (1048576 / sizeof(double));
+static long dist_cache_used = 0;
+static int sdm_memo_hits = 0;
+static int sdm_memo_misses = 0;
+#ifndef WIN32
+static pthread_mutex_t conf_stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+#else
+static volatile LONG conf_stats_lock = 0;
+#endif
+
+
+static void lock_conf_stats(void)
+{
+  #ifndef WIN32
+  pthread_mutex_lock(&conf_stats_mutex);
+  #else
+  while (InterlockedExchange(&conf_stats_lock, 1)) {
+    Sleep(0);
+  }
+  #endif
+}
+
+
+static void unlock_conf_stats(void)
+{
+  #ifndef WIN32
+  pthread_mutex_unlock(&conf_stats_mutex);
+  #else
+  InterlockedExchange(&conf_stats_lock, 0);
+  #endif
+}
+
+
+void set_dist_cache_limit(int mb)
+{
+  lock_conf_stats();
+  dist_cache_limit = (long)mb * (1048576 / sizeof(double));
+  unlock_conf_stats();
+}
+
+
+int alloc_conf_dist(ConfInfo *conf)
+{
+  int size;
+  int extra;
+  double *dist;
+  
+  
+  /*
+  the packed lower triangle of heavy atom distances
+  is (re)allocated only if it needs to grow; the
+  extra room is reserved against the global budget
+  before the actual allocation takes place
+  */
+  size = conf->n_heavy_atoms * (conf->n_heavy_atoms - 1) / 2;
+  if (size <= conf->dist_size) {
+    return 0;
+  }
+  extra = size - conf->dist_size;
+  lock_conf_stats();
+  if ((dist_cache_used + extra) > dist_cache_limit) {
+    unlock_conf_stats();
+    return OUT_OF_MEMORY;
+  }
+  dist_cache_used += extra;
+  unlock_conf_stats();
+  if (!(dist = (double *)realloc(conf->dist, size * sizeof(double)))) {
+    lock_conf_stats();
+    dist_cache_used -= extra;
+    unlock_conf_stats();
+    return OUT_OF_MEMORY;
+  }
+  conf->dist = dist;
+  conf->dist_size = size;
+  
+  return 0;
+}
+
+
 ConfInfo *alloc_conf(int n_atoms)
 {
   ConfInfo *conf;
@@ -56,29 +141,135 @@ ConfInfo *alloc_conf(int n_atoms)
     return NULL;
   }
   memset(conf->coord, 0, n_atoms * 3 * sizeof(double));
+  if (!(conf->heavy_atom = (int *)malloc(n_atoms * sizeof(int)))) {
+    free_conf(conf);
+    return NULL;
+  }
+  memset(conf->heavy_atom, 0, n_atoms * sizeof(int));
+  if (!(conf->heavy_index = (int *)malloc(n_atoms * sizeof(int)))) {
+    free_conf(conf);
+    return NULL;
+  }
+  memset(conf->heavy_index, 0, n_atoms * sizeof(int));
+  if (!(conf->element = (int *)malloc(n_atoms * sizeof(int)))) {
+    free_conf(conf);
+    return NULL;
+  }
+  memset(conf->element, 0, n_atoms * sizeof(int));
   
   return conf;
 }
 
 
-int alloc_lap_info(LAPInfo *li, int max_n_atoms)
+int element_code(char *element)
 {
   int i;
+  int code;
+  
+  
+  /*
+  pack the (at most three-character) element
+  symbol into an integer, so that elements can be
+  compared without calling strcmp()
+  */
+  for (i = 0, code = 0; (i < 3) && element[i]; ++i) {
+    code |= ((int)(unsigned char)element[i] << (i * 8));
+  }
+  
+  return code;
+}
+
+
+void set_conf_atoms(ConfInfo *conf, AtomInfo **atom, int n_atoms)
+{
+  int i;
+  
+  
+  /*
+  fill element codes and the packed array
+  of heavy atom indexes once per object, so that
+  superposition kernels do not need to look
+  at element names anymore
+  */
+  conf->atom = atom;
+  conf->n_atoms = n_atoms;
+  conf->dist_valid = 0;
+  for (i = 0, conf->n_heavy_atoms = 0; i < n_atoms; ++i) {
+    conf->element[i] = element_code(atom[i]->element);
+    conf->heavy_index[i] = -1;
+    if (conf->element[i] != H_ELEMENT_CODE) {
+      conf->heavy_index[i] = conf->n_heavy_atoms;
+      conf->heavy_atom[conf->n_heavy_atoms] = i;
+      ++(conf->n_heavy_atoms);
+    }
+  }
+}
+
+
+static void *alloc_lap_vector(Arena *ar, size_t size)
+{
+  void *p;
+  
+  
+  if (ar) {
+    return arena_alloc(ar, size);
+  }
+  if ((p = malloc(size))) {
+    memset(p, 0, size);
+  }
+  
+  return p;
+}
+
+
+static void *alloc_lap_matrix(Arena *ar, int n, size_t size)
+{
+  return (ar ? (void *)arena_alloc_array(ar, n, size) : alloc_array(n, size));
+}
+
+
+static int fill_lap_info(Arena *ar, LAPInfo *li, int max_n_atoms)
+{
+  int i;
+  int padded_n_atoms;
   int alloc_fail = 0;
 
 
   for (i = 0; i < O3_MAX_SLOT; ++i) {
-    if ((li->array[i] = (int *)malloc(max_n_atoms * sizeof(int)))) {
-      memset(li->array[i], 0, max_n_atoms * sizeof(int));
-    }
-    else {
+    if (!(li->array[i] = (int *)alloc_lap_vector(ar, max_n_atoms * sizeof(int)))) {
       alloc_fail = 1;
     }
   }
-  if (!(li->cost = (int **)alloc_array(max_n_atoms, max_n_atoms * sizeof(int)))) {
+  if (!(li->cost = (int **)alloc_lap_matrix(ar, max_n_atoms, max_n_atoms * sizeof(int)))) {
     alloc_fail = 1;
   }
-  if (!(li->diff = (double **)alloc_array(max_n_atoms, max_n_atoms * sizeof(double)))) {
+  if (!(li->diff = (double **)alloc_lap_matrix(ar, max_n_atoms, max_n_atoms * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  if (!(li->h_cost = (double **)alloc_lap_matrix(ar, max_n_atoms, max_n_atoms * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  if (!(li->charge_diff = (double **)alloc_lap_matrix(ar, max_n_atoms, max_n_atoms * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  if (!(li->score_pref = (double **)alloc_lap_matrix(ar, max_n_atoms, max_n_atoms * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  /*
+  scratch space for vectorized histogram comparison,
+  padded to a multiple of SIMD_WIDTH
+  */
+  padded_n_atoms = (max_n_atoms + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+  if (!(li->h_t = (double *)alloc_lap_vector(ar, MAX_H_BINS * padded_n_atoms * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  if (!(li->h_sum = (double *)alloc_lap_vector(ar, padded_n_atoms * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  /*
+  gathered score prefactors and squared distances
+  */
+  if (!(li->score_buf = (double *)alloc_lap_vector(ar, 2 * padded_n_atoms * sizeof(double)))) {
     alloc_fail = 1;
   }
   
@@ -86,17 +277,215 @@ int alloc_lap_info(LAPInfo *li, int max_n_atoms)
 }
 
 
+int alloc_lap_info(LAPInfo *li, int max_n_atoms)
+{
+  return fill_lap_info(NULL, li, max_n_atoms);
+}
+
+
+int arena_alloc_lap_info(Arena *ar, LAPInfo *li, int max_n_atoms)
+{
+  /*
+  the LAPInfo buffers are released with
+  the arena rather than by free_lap_info()
+  */
+  return fill_lap_info(ar, li, max_n_atoms);
+}
+
+
+void free_conf_cache(ConfInfo *conf)
+{
+  /*
+  release the cell list and the cached distance
+  matrix, which are allocated on demand
+  */
+  free_cell_list(conf->cell_list);
+  conf->cell_list = NULL;
+  if (conf->dist) {
+    lock_conf_stats();
+    dist_cache_used -= conf->dist_size;
+    unlock_conf_stats();
+    free(conf->dist);
+    conf->dist = NULL;
+  }
+  conf->dist_size = 0;
+  conf->dist_valid = 0;
+}
+
+
 void free_conf(ConfInfo *conf)
 {
   if (conf) {
     if (conf->coord) {
       free(conf->coord);
     }
+    if (conf->heavy_atom) {
+      free(conf->heavy_atom);
+    }
+    if (conf->heavy_index) {
+      free(conf->heavy_index);
+    }
+    if (conf->element) {
+      free(conf->element);
+    }
+    free_conf_cache(conf);
     free(conf);
   }
 }
 
+
+void free_cell_list(CellList *cl)
+{
+  if (cl) {
+    if (cl->cell_start) {
+      free(cl->cell_start);
+    }
+    if (cl->cell_atom) {
+      free(cl->cell_atom);
+    }
+    if (cl->bucket) {
+      free(cl->bucket);
+    }
+    if (cl->accepted) {
+      free(cl->accepted);
+    }
+    free(cl);
+  }
+}
+
     
+int alloc_sdm_memo(SDMMemo *memo, int max_n_heavy_atoms, int max_n_atoms)
+{
+  int alloc_fail = 0;
+  
+  
+  memset(memo, 0, sizeof(SDMMemo));
+  if (!(memo->query = (int *)malloc(2 * max_n_heavy_atoms * sizeof(int)))) {
+    alloc_fail = 1;
+  }
+  if ((memo->slot_generation = (int *)malloc(SDM_MEMO_SIZE * sizeof(int)))) {
+    memset(memo->slot_generation, 0, SDM_MEMO_SIZE * sizeof(int));
+  }
+  else {
+    alloc_fail = 1;
+  }
+  if (!(memo->n_key = (int *)malloc(SDM_MEMO_SIZE * sizeof(int)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->n_pairs = (int *)malloc(SDM_MEMO_SIZE * sizeof(int)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->weight = (int *)malloc(SDM_MEMO_SIZE * sizeof(int)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->threshold_iter = (int *)malloc(SDM_MEMO_SIZE * sizeof(int)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->hash = (unsigned int *)malloc(SDM_MEMO_SIZE * sizeof(unsigned int)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->score = (double *)malloc(SDM_MEMO_SIZE * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->key = (int **)alloc_array(SDM_MEMO_SIZE, 2 * max_n_heavy_atoms * sizeof(int)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->sdm = (AtomPair **)alloc_array(SDM_MEMO_SIZE, max_n_heavy_atoms * sizeof(AtomPair)))) {
+    alloc_fail = 1;
+  }
+  if (!(memo->coord = (double **)alloc_array(SDM_MEMO_SIZE, max_n_atoms * 3 * sizeof(double)))) {
+    alloc_fail = 1;
+  }
+  /*
+  slot generations start from 0, so that
+  all slots are initially empty
+  */
+  memo->generation = 1;
+  
+  return alloc_fail;
+}
+
+
+void free_sdm_memo(SDMMemo *memo)
+{
+  if (memo) {
+    /*
+    fold per-thread statistics into the
+    process-wide counters
+    */
+    lock_conf_stats();
+    sdm_memo_hits += memo->hits;
+    sdm_memo_misses += memo->misses;
+    unlock_conf_stats();
+    if (memo->query) {
+      free(memo->query);
+    }
+    if (memo->slot_generation) {
+      free(memo->slot_generation);
+    }
+    if (memo->n_key) {
+      free(memo->n_key);
+    }
+    if (memo->n_pairs) {
+      free(memo->n_pairs);
+    }
+    if (memo->weight) {
+      free(memo->weight);
+    }
+    if (memo->threshold_iter) {
+      free(memo->threshold_iter);
+    }
+    if (memo->hash) {
+      free(memo->hash);
+    }
+    if (memo->score) {
+      free(memo->score);
+    }
+    if (memo->key) {
+      free(memo->key);
+    }
+    if (memo->sdm) {
+      free(memo->sdm);
+    }
+    if (memo->coord) {
+      free(memo->coord);
+    }
+    memset(memo, 0, sizeof(SDMMemo));
+  }
+}
+
+
+void reset_sdm_memo_stats(void)
+{
+  lock_conf_stats();
+  sdm_memo_hits = 0;
+  sdm_memo_misses = 0;
+  unlock_conf_stats();
+}
+
+
+void get_sdm_memo_stats(int *hits, int *misses)
+{
+  lock_conf_stats();
+  *hits = sdm_memo_hits;
+  *misses = sdm_memo_misses;
+  unlock_conf_stats();
+}
+
+
+void add_sdm_memo_stats(int hits, int misses)
+{
+  /*
+  merge the counters of an alignment
+  shard which ran in another process
+  */
+  lock_conf_stats();
+  sdm_memo_hits += hits;
+  sdm_memo_misses += misses;
+  unlock_conf_stats();
+}
+
+
 void free_lap_info(LAPInfo *li)
 {
   int i;
@@ -116,6 +505,24 @@ void free_lap_info(LAPInfo *li)
     if (li->diff) {
       free(li->diff);
     }
+    if (li->h_cost) {
+      free(li->h_cost);
+    }
+    if (li->charge_diff) {
+      free(li->charge_diff);
+    }
+    if (li->score_pref) {
+      free(li->score_pref);
+    }
+    if (li->h_t) {
+      free(li->h_t);
+    }
+    if (li->h_sum) {
+      free(li->h_sum);
+    }
+    if (li->score_buf) {
+      free(li->score_buf);
+    }
   }
 }
 
@@ -155,20 +562,21 @@ void free_node(NodeInfo *fnode, int **path, RingInfo **ring, int n_atoms)
 
 int check_conf_db(O3Data *od, char *conf_dir, int type, int *wrong_object_num, int *wrong_conf_num)
 {
-  char buffer[BUF_LEN];
+  char name[BUF_LEN];
   int i;
   int object_num;
-  int line;
   int conf_num;
   int found = 0;
   int result = 0;
-  FileDescriptor multi_conf_sdf_fd;
   MolInfo temp_mol_info;
+  SdfReader sdf_reader;
   
   
-  memset(&multi_conf_sdf_fd, 0, sizeof(FileDescriptor));
+  if (is_conf_db(conf_dir)) {
+    return check_conf_db_file(od, conf_dir, type, wrong_object_num, wrong_conf_num);
+  }
   memset(&temp_mol_info, 0, sizeof(MolInfo));
-  memset(buffer, 0, BUF_LEN);
+  memset(name, 0, BUF_LEN);
   for (object_num = 0; object_num < od->grid.object_num; ++object_num) {
     if (type == TEMPLATE_DB) {
       for (i = 0, found = 0; (!found) && (i < od->pel.numberlist[OBJECT_LIST]->size); ++i) {
@@ -178,48 +586,39 @@ int check_conf_db(O3Data *od, char *conf_dir, int type, int *wrong_object_num, i
         continue;
       }
     }
-    sprintf(multi_conf_sdf_fd.name, "%s%c%04d.sdf", conf_dir,
+    sprintf(name, "%s%c%04d.sdf", conf_dir,
       SEPARATOR, od->al.mol_info[object_num]->object_id);
-    if (!(multi_conf_sdf_fd.handle = fopen(multi_conf_sdf_fd.name, "rb"))) {
+    if (open_sdf_reader(&sdf_reader, name)) {
       if (type != ANY_DB) {
         *wrong_object_num = object_num;
         O3_ERROR_LOCATE(&(od->task));
-        O3_ERROR_STRING(&(od->task), multi_conf_sdf_fd.name);
+        O3_ERROR_STRING(&(od->task), name);
         return CANNOT_READ_ORIGINAL_SDF;
       }
       else {
         continue;
       }
     }
-    line = 0;
     conf_num = 0;
-    while ((!result) && fgets(buffer, BUF_LEN, multi_conf_sdf_fd.handle)) {
-      ++line;
-      buffer[BUF_LEN - 1] = '\0';
-      if (line == 4) {
+    found = 1;
+    while ((!result) && found) {
+      if (read_sdf_reader_counts(&sdf_reader, &temp_mol_info, &found)) {
+        O3_ERROR_LOCATE(&(od->task));
+        O3_ERROR_STRING(&(od->task), name);
+        result = PREMATURE_EOF;
+      }
+      else if (found) {
         ++conf_num;
-        if (get_n_atoms_bonds(&temp_mol_info,
-          multi_conf_sdf_fd.handle, buffer)) {
-          O3_ERROR_LOCATE(&(od->task));
-          O3_ERROR_STRING(&(od->task), multi_conf_sdf_fd.name);
-          result = PREMATURE_EOF;
-        }
-        else if ((temp_mol_info.n_atoms != od->al.mol_info[object_num]->n_atoms)
+        if ((temp_mol_info.n_atoms != od->al.mol_info[object_num]->n_atoms)
           || (temp_mol_info.n_bonds != od->al.mol_info[object_num]->n_bonds)) {
           *wrong_conf_num = conf_num;
           O3_ERROR_LOCATE(&(od->task));
-          O3_ERROR_STRING(&(od->task), multi_conf_sdf_fd.name);
+          O3_ERROR_STRING(&(od->task), name);
           result = N_ATOM_BOND_MISMATCH;
         }
       }
-      else if (line > 4) {
-        if (!strncmp(buffer, SDF_DELIMITER, 4)) {
-          line = 0;
-        }
-      }
     }
-    fclose(multi_conf_sdf_fd.handle);
-    multi_conf_sdf_fd.handle = NULL;
+    close_sdf_reader(&sdf_reader);
     if (result) {
       *wrong_object_num = object_num;
       return result;
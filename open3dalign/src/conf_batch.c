@@ -0,0 +1,244 @@
+/*
+
+conf_batch.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+/*
+up to CONF_BATCH_SIZE conformations of the same molecule
+are stored side by side (structure of arrays): element
+e of conformation k is found at [e * CONF_BATCH_SIZE + k],
+so that vector kernels process several conformations
+at a time with contiguous loads and no gathers. Elements
+are atom coordinates (atom * 3 + xyz), packed heavy atom
+distances (as in compute_conf_h()), H arrays as doubles
+(heavy_atom * MAX_H_BINS + bin) and histogram costs
+(template_heavy_atom * n_heavy_atoms + heavy_atom)
+*/
+int arena_alloc_conf_batch(Arena *ar, ConfBatch *cb, int max_n_atoms, int max_n_heavy_atoms)
+{
+  memset(cb, 0, sizeof(ConfBatch));
+  if ((!(cb->coord = (double *)arena_alloc(ar, max_n_atoms * 3
+    * CONF_BATCH_SIZE * sizeof(double))))
+    || (!(cb->dist = (double *)arena_alloc(ar, (max_n_heavy_atoms
+    * (max_n_heavy_atoms - 1) / 2 + 1) * CONF_BATCH_SIZE * sizeof(double))))
+    || (!(cb->h = (double *)arena_alloc(ar, max_n_heavy_atoms * MAX_H_BINS
+    * CONF_BATCH_SIZE * sizeof(double))))
+    || (!(cb->h_cost = (double *)arena_alloc(ar, max_n_heavy_atoms
+    * max_n_heavy_atoms * CONF_BATCH_SIZE * sizeof(double))))) {
+    return OUT_OF_MEMORY;
+  }
+  
+  return 0;
+}
+
+
+void pack_conf_batch(ConfBatch *cb, int k, ConfInfo *conf, double *coord)
+{
+  int i;
+  
+  
+  /*
+  all conformations in a batch share the atoms
+  of conf, hence only their coordinates differ
+  */
+  cb->n_atoms = conf->n_atoms;
+  cb->n_heavy_atoms = conf->n_heavy_atoms;
+  cb->heavy_atom = conf->heavy_atom;
+  for (i = 0; i < conf->n_atoms * 3; ++i) {
+    cb->coord[i * CONF_BATCH_SIZE + k] = coord[i];
+  }
+  cb->n_k = k + 1;
+}
+
+
+void compute_conf_batch_h(ConfBatch *cb)
+{
+  int i;
+  int j;
+  int k;
+  int y;
+  int z;
+  int bin;
+  int heavy;
+  double d;
+  double dist;
+  double *ci;
+  double *cj;
+  
+  
+  /*
+  same as compute_conf_h() for all conformations in the
+  batch; heavy atom distances are stored as they are met
+  while histogramming, and results are identical to those
+  of the one-at-a-time code
+  */
+  switch (get_simd_level()) {
+    #ifdef O3_AVX512_KERNELS
+    case SIMD_AVX512:
+    compute_conf_batch_h_avx512(cb);
+    return;
+    #endif
+    #ifdef O3_AVX2_KERNELS
+    case SIMD_AVX2:
+    compute_conf_batch_h_avx2(cb);
+    return;
+    #endif
+  }
+  for (y = 0; y < cb->n_heavy_atoms; ++y) {
+    i = cb->heavy_atom[y];
+    memset(&(cb->h[y * MAX_H_BINS * CONF_BATCH_SIZE]), 0,
+      MAX_H_BINS * CONF_BATCH_SIZE * sizeof(double));
+    ci = &(cb->coord[i * 3 * CONF_BATCH_SIZE]);
+    for (j = 0, z = 0; j < cb->n_atoms; ++j) {
+      cj = &(cb->coord[j * 3 * CONF_BATCH_SIZE]);
+      heavy = ((z < cb->n_heavy_atoms) && (cb->heavy_atom[z] == j));
+      for (k = 0; k < cb->n_k; ++k) {
+        d = ci[k] - cj[k];
+        dist = d * d;
+        d = ci[CONF_BATCH_SIZE + k] - cj[CONF_BATCH_SIZE + k];
+        dist += d * d;
+        d = ci[2 * CONF_BATCH_SIZE + k] - cj[2 * CONF_BATCH_SIZE + k];
+        dist += d * d;
+        dist = sqrt(dist);
+        if (heavy && (z < y)) {
+          cb->dist[(y * (y - 1) / 2 + z) * CONF_BATCH_SIZE + k] = dist;
+        }
+        bin = (int)dist;
+        if (bin < MAX_H_BINS) {
+          cb->h[(y * MAX_H_BINS + bin) * CONF_BATCH_SIZE + k] += 1.0;
+        }
+      }
+      if (heavy) {
+        ++z;
+      }
+    }
+  }
+}
+
+
+void compute_conf_batch_h_cost(ConfBatch *cb, ConfInfo *template_conf, int n_bins)
+{
+  int b;
+  int k;
+  int x;
+  int y;
+  double t;
+  double m;
+  double h_sum;
+  double *h;
+  
+  
+  /*
+  histogram term of the cost matrix of each conformation
+  in the batch against template_conf, as computed by
+  compute_h_cost_matrix()
+  */
+  cb->n_template_heavy_atoms = template_conf->n_heavy_atoms;
+  switch (get_simd_level()) {
+    #ifdef O3_AVX512_KERNELS
+    case SIMD_AVX512:
+    compute_conf_batch_h_cost_avx512(cb, template_conf, n_bins);
+    return;
+    #endif
+    #ifdef O3_AVX2_KERNELS
+    case SIMD_AVX2:
+    compute_conf_batch_h_cost_avx2(cb, template_conf, n_bins);
+    return;
+    #endif
+  }
+  for (y = 0; y < template_conf->n_heavy_atoms; ++y) {
+    for (x = 0; x < cb->n_heavy_atoms; ++x) {
+      h = &(cb->h[x * MAX_H_BINS * CONF_BATCH_SIZE]);
+      for (k = 0; k < cb->n_k; ++k) {
+        for (b = 0, h_sum = 0.0; b < n_bins; ++b) {
+          t = (double)(template_conf->h[y][b]);
+          m = h[b * CONF_BATCH_SIZE + k];
+          if ((t + m) == 0.0) {
+            continue;
+          }
+          h_sum += (square(t - m) / (t + m));
+        }
+        cb->h_cost[(y * cb->n_heavy_atoms + x) * CONF_BATCH_SIZE + k] = h_sum;
+      }
+    }
+  }
+}
+
+
+void unpack_conf_batch(ConfBatch *cb, int k, ConfInfo *conf, LAPInfo *li)
+{
+  int b;
+  int i;
+  int x;
+  int y;
+  int n_dist;
+  
+  
+  /*
+  give conf the coordinates, distance cache and H arrays
+  of conformation k; if li is not NULL, its histogram costs
+  are copied into li->h_cost, while charge terms are left
+  alone since they are the same for all conformations
+  (see compute_charge_cost_matrix())
+  */
+  for (i = 0; i < cb->n_atoms * 3; ++i) {
+    conf->coord[i] = cb->coord[i * CONF_BATCH_SIZE + k];
+  }
+  conf->dist_valid = 0;
+  if (!alloc_conf_dist(conf)) {
+    n_dist = cb->n_heavy_atoms * (cb->n_heavy_atoms - 1) / 2;
+    for (i = 0; i < n_dist; ++i) {
+      conf->dist[i] = cb->dist[i * CONF_BATCH_SIZE + k];
+    }
+    conf->dist_valid = 1;
+  }
+  for (y = 0; y < cb->n_heavy_atoms; ++y) {
+    for (b = 0; b < MAX_H_BINS; ++b) {
+      conf->h[y][b] = (int)(cb->h[(y * MAX_H_BINS + b) * CONF_BATCH_SIZE + k]);
+    }
+  }
+  if (li) {
+    for (y = 0; y < cb->n_template_heavy_atoms; ++y) {
+      for (x = 0; x < cb->n_heavy_atoms; ++x) {
+        li->h_cost[y][x] = cb->h_cost[(y * cb->n_heavy_atoms + x) * CONF_BATCH_SIZE + k];
+      }
+    }
+  }
+}
@@ -0,0 +1,577 @@
+/*
+
+conf_db.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+
+static uint64_t align_conf_db_offset(uint64_t offset)
+{
+  return ((offset + CONF_DB_ALIGN - 1) / CONF_DB_ALIGN) * CONF_DB_ALIGN;
+}
+
+
+static int pad_conf_db(FILE *handle, uint64_t *pos, uint64_t offset)
+{
+  char zero[CONF_DB_ALIGN];
+  size_t n;
+  
+  
+  memset(zero, 0, CONF_DB_ALIGN);
+  while (*pos < offset) {
+    n = (size_t)(((offset - *pos) < CONF_DB_ALIGN) ? (offset - *pos) : CONF_DB_ALIGN);
+    if (fwrite(zero, 1, n, handle) != n) {
+      return CANNOT_WRITE_CONF_DB;
+    }
+    *pos += n;
+  }
+  
+  return 0;
+}
+
+
+static int compare_conf_db_object_id(const void *a, const void *b)
+{
+  ConfDbObject *object1;
+  ConfDbObject *object2;
+  
+  
+  object1 = *((ConfDbObject **)a);
+  object2 = *((ConfDbObject **)b);
+  
+  return ((object1->object_id > object2->object_id)
+    - (object1->object_id < object2->object_id));
+}
+
+
+int is_conf_db(char *name)
+{
+  char magic[sizeof(CONF_DB_MAGIC)];
+  int found = 0;
+  FILE *handle;
+  
+  
+  /*
+  a binary conformational database is a regular file
+  starting with CONF_DB_MAGIC, while an SDF one is
+  a directory holding one SDF file per object
+  */
+  if (dexist(name) || (!(handle = fopen(name, "rb")))) {
+    return 0;
+  }
+  found = ((fread(magic, 1, sizeof(CONF_DB_MAGIC), handle) == sizeof(CONF_DB_MAGIC))
+    && (!memcmp(magic, CONF_DB_MAGIC, sizeof(CONF_DB_MAGIC))));
+  fclose(handle);
+  
+  return found;
+}
+
+
+int open_conf_db(ConfDb *db, char *name)
+{
+  int i;
+  uint64_t n;
+  uint64_t n_coord_bytes;
+  ConfDbHeader *header;
+  #ifndef WIN32
+  int fd;
+  struct stat file_stat;
+  #else
+  LARGE_INTEGER file_size;
+  #endif
+  
+  
+  /*
+  the whole file is mapped read-only and then
+  validated, so that later accesses through the
+  index need no bounds checking; returns
+  CANNOT_READ_ORIGINAL_SDF if the file cannot be
+  mapped, WRONG_DATA_FORMAT if it is corrupted,
+  OUT_OF_MEMORY if its lookup table cannot be built
+  */
+  memset(db, 0, sizeof(ConfDb));
+  if (strlen(name) >= BUF_LEN) {
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  strncpy(db->name, name, BUF_LEN - 1);
+  #ifndef WIN32
+  if ((fd = open(name, O_RDONLY)) == -1) {
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if (fstat(fd, &file_stat) || (file_stat.st_size < (off_t)sizeof(ConfDbHeader))) {
+    close(fd);
+    return WRONG_DATA_FORMAT;
+  }
+  db->size = (size_t)(file_stat.st_size);
+  db->base = (char *)mmap(NULL, db->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if ((void *)(db->base) == MAP_FAILED) {
+    db->base = NULL;
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  #else
+  db->hFile = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (db->hFile == INVALID_HANDLE_VALUE) {
+    db->hFile = NULL;
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if ((!GetFileSizeEx(db->hFile, &file_size))
+    || (file_size.QuadPart < (LONGLONG)sizeof(ConfDbHeader))) {
+    close_conf_db(db);
+    return WRONG_DATA_FORMAT;
+  }
+  db->size = (size_t)(file_size.QuadPart);
+  if ((!(db->hMapHandle = CreateFileMapping(db->hFile, NULL, PAGE_READONLY, 0, 0, NULL)))
+    || (!(db->base = (char *)MapViewOfFile(db->hMapHandle, FILE_MAP_READ, 0, 0, 0)))) {
+    close_conf_db(db);
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  #endif
+  header = (ConfDbHeader *)(db->base);
+  if (memcmp(header->magic, CONF_DB_MAGIC, sizeof(CONF_DB_MAGIC))
+    || (header->version != CONF_DB_VERSION)
+    || ((header->coord_size != sizeof(double)) && (header->coord_size != sizeof(float)))
+    || (header->size != (uint64_t)(db->size))
+    || (header->object_offset % CONF_DB_ALIGN) || (header->index_offset % CONF_DB_ALIGN)
+    || (header->object_offset + (uint64_t)(header->n_objects)
+    * sizeof(ConfDbObject) > header->index_offset)
+    || (header->index_offset + header->n_confs * sizeof(uint64_t) > header->coord_offset)
+    || (header->coord_offset > header->size)) {
+    close_conf_db(db);
+    return WRONG_DATA_FORMAT;
+  }
+  db->header = header;
+  db->object = (ConfDbObject *)(db->base + header->object_offset);
+  db->index = (uint64_t *)(db->base + header->index_offset);
+  for (i = 0; i < (int)(header->n_objects); ++i) {
+    if ((db->object[i].n_atoms < 0) || (db->object[i].n_conf < 0)
+      || (db->object[i].first_conf + (uint64_t)(db->object[i].n_conf) > header->n_confs)) {
+      close_conf_db(db);
+      return WRONG_DATA_FORMAT;
+    }
+    n_coord_bytes = (uint64_t)(db->object[i].n_atoms) * 3 * header->coord_size;
+    for (n = 0; n < (uint64_t)(db->object[i].n_conf); ++n) {
+      if ((db->index[db->object[i].first_conf + n] < header->coord_offset)
+        || (db->index[db->object[i].first_conf + n] % header->coord_size)
+        || (db->index[db->object[i].first_conf + n] + n_coord_bytes > header->size)) {
+        close_conf_db(db);
+        return WRONG_DATA_FORMAT;
+      }
+    }
+  }
+  /*
+  objects are looked up by binary search on their
+  ID; the object table is written in object order,
+  which is normally sorted by ID, otherwise a sorted
+  array of pointers to its entries is built
+  */
+  for (i = 1; (i < (int)(header->n_objects))
+    && (db->object[i - 1].object_id < db->object[i].object_id); ++i);
+  if (i < (int)(header->n_objects)) {
+    if (!(db->sorted = (ConfDbObject **)malloc
+      (header->n_objects * sizeof(ConfDbObject *)))) {
+      close_conf_db(db);
+      return OUT_OF_MEMORY;
+    }
+    for (i = 0; i < (int)(header->n_objects); ++i) {
+      db->sorted[i] = &(db->object[i]);
+    }
+    qsort(db->sorted, header->n_objects, sizeof(ConfDbObject *),
+      compare_conf_db_object_id);
+  }
+  
+  return 0;
+}
+
+
+void close_conf_db(ConfDb *db)
+{
+  #ifndef WIN32
+  if (db->base) {
+    munmap(db->base, db->size);
+  }
+  #else
+  if (db->base) {
+    UnmapViewOfFile(db->base);
+  }
+  if (db->hMapHandle) {
+    CloseHandle(db->hMapHandle);
+  }
+  if (db->hFile) {
+    CloseHandle(db->hFile);
+  }
+  db->hMapHandle = NULL;
+  db->hFile = NULL;
+  #endif
+  if (db->sorted) {
+    free(db->sorted);
+  }
+  db->base = NULL;
+  db->header = NULL;
+  db->object = NULL;
+  db->sorted = NULL;
+  db->index = NULL;
+}
+
+
+ConfDbObject *find_conf_db_object(ConfDb *db, int object_id)
+{
+  int low;
+  int high;
+  int mid;
+  ConfDbObject *object;
+  
+  
+  low = 0;
+  high = (int)(db->header->n_objects) - 1;
+  while (low <= high) {
+    mid = (low + high) / 2;
+    object = (db->sorted ? db->sorted[mid] : &(db->object[mid]));
+    if (object->object_id == object_id) {
+      return object;
+    }
+    if (object->object_id < object_id) {
+      low = mid + 1;
+    }
+    else {
+      high = mid - 1;
+    }
+  }
+  
+  return NULL;
+}
+
+
+void get_conf_db_coord(ConfDb *db, ConfDbObject *object, int conf_num, double *coord)
+{
+  int i;
+  float *coord_float;
+  
+  
+  /*
+  conformer conf_num of object is found
+  through the index in constant time
+  */
+  if (db->header->coord_size == sizeof(double)) {
+    memcpy(coord, db->base + db->index[object->first_conf + conf_num],
+      object->n_atoms * 3 * sizeof(double));
+  }
+  else {
+    coord_float = (float *)(db->base + db->index[object->first_conf + conf_num]);
+    for (i = 0; i < object->n_atoms * 3; ++i) {
+      coord[i] = (double)coord_float[i];
+    }
+  }
+}
+
+
+int check_conf_db_file(O3Data *od, char *name, int type, int *wrong_object_num, int *wrong_conf_num)
+{
+  char buffer[BUF_LEN];
+  int i;
+  int object_num;
+  int found = 0;
+  int result;
+  ConfDb db;
+  ConfDbObject *object;
+  
+  
+  /*
+  same as check_conf_db(), but conformer counts
+  and atom/bond numbers are taken from the object
+  table rather than by scanning SDF files
+  */
+  if ((result = open_conf_db(&db, name))) {
+    O3_ERROR_LOCATE(&(od->task));
+    O3_ERROR_STRING(&(od->task), name);
+    return result;
+  }
+  for (object_num = 0; object_num < od->grid.object_num; ++object_num) {
+    if (type == TEMPLATE_DB) {
+      for (i = 0, found = 0; (!found) && (i < od->pel.numberlist[OBJECT_LIST]->size); ++i) {
+        found = (object_num == (od->pel.numberlist[OBJECT_LIST]->pe[i] - 1));
+      }
+      if (!found) {
+        continue;
+      }
+    }
+    if (!(object = find_conf_db_object(&db, od->al.mol_info[object_num]->object_id))) {
+      if (type != ANY_DB) {
+        *wrong_object_num = object_num;
+        sprintf(buffer, "%s (object ID %d)", name, od->al.mol_info[object_num]->object_id);
+        O3_ERROR_LOCATE(&(od->task));
+        O3_ERROR_STRING(&(od->task), buffer);
+        close_conf_db(&db);
+        return CANNOT_READ_ORIGINAL_SDF;
+      }
+      od->pel.conf_population[type]->pe[object_num] = 0;
+      continue;
+    }
+    if ((object->n_atoms != od->al.mol_info[object_num]->n_atoms)
+      || (object->n_bonds != od->al.mol_info[object_num]->n_bonds)) {
+      *wrong_object_num = object_num;
+      *wrong_conf_num = 1;
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), name);
+      close_conf_db(&db);
+      return N_ATOM_BOND_MISMATCH;
+    }
+    od->pel.conf_population[type]->pe[object_num] = object->n_conf;
+  }
+  close_conf_db(&db);
+  
+  return 0;
+}
+
+
+static int write_conf_db_coord(O3Data *od, FILE *handle, char *conf_dir,
+  ConfDbObject *object, uint64_t *index, int coord_size, int *wrong_object_num)
+{
+  int i;
+  int j;
+  int object_num;
+  int conf_num;
+  int result = 0;
+  uint64_t pos;
+  uint64_t n_coord_bytes;
+  double *coord;
+  float *coord_float;
+  FileDescriptor conf_fd;
+  SdfReader sdf_reader;
+  
+  
+  memset(&conf_fd, 0, sizeof(FileDescriptor));
+  coord = (double *)malloc((od->field.max_n_atoms + 1) * 3 * sizeof(double));
+  coord_float = (float *)malloc((od->field.max_n_atoms + 1) * 3 * sizeof(float));
+  if ((!coord) || (!coord_float)) {
+    O3_ERROR_LOCATE(&(od->task));
+    result = OUT_OF_MEMORY;
+  }
+  pos = index[0];
+  for (object_num = 0, i = 0; (!result) && (object_num < od->grid.object_num); ++object_num) {
+    if (!(od->pel.conf_population[ANY_DB]->pe[object_num])) {
+      continue;
+    }
+    sprintf(conf_fd.name, "%s%c%04d.sdf", conf_dir,
+      SEPARATOR, od->al.mol_info[object_num]->object_id);
+    if (open_sdf_reader(&sdf_reader, conf_fd.name)) {
+      *wrong_object_num = object_num;
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), conf_fd.name);
+      result = CANNOT_READ_ORIGINAL_SDF;
+      break;
+    }
+    n_coord_bytes = (uint64_t)(object[i].n_atoms) * 3 * coord_size;
+    for (conf_num = 0; (!result) && (conf_num < object[i].n_conf); ++conf_num) {
+      if (read_sdf_reader_conf(&sdf_reader, od->al.mol_info[object_num], coord)) {
+        *wrong_object_num = object_num;
+        O3_ERROR_LOCATE(&(od->task));
+        O3_ERROR_STRING(&(od->task), conf_fd.name);
+        result = PREMATURE_EOF;
+        break;
+      }
+      if (coord_size == sizeof(float)) {
+        for (j = 0; j < object[i].n_atoms * 3; ++j) {
+          coord_float[j] = (float)coord[j];
+        }
+      }
+      if (pad_conf_db(handle, &pos, index[object[i].first_conf + conf_num])
+        || (fwrite(((coord_size == sizeof(float)) ? (void *)coord_float : (void *)coord),
+        1, (size_t)n_coord_bytes, handle) != (size_t)n_coord_bytes)) {
+        result = CANNOT_WRITE_CONF_DB;
+      }
+      pos += n_coord_bytes;
+    }
+    close_sdf_reader(&sdf_reader);
+    ++i;
+  }
+  if (coord) {
+    free(coord);
+  }
+  if (coord_float) {
+    free(coord_float);
+  }
+  
+  return result;
+}
+
+
+int write_conf_db(O3Data *od, char *conf_dir, char *name, int coord_size, int *wrong_object_num, int *wrong_conf_num)
+{
+  int i;
+  int object_num;
+  int conf_num;
+  int result;
+  uint64_t pos;
+  uint64_t offset;
+  uint64_t *index = NULL;
+  ConfDbHeader header;
+  ConfDbObject *object = NULL;
+  FileDescriptor db_fd;
+  
+  
+  /*
+  conformers are counted and checked against the
+  currently loaded objects, then the header, the
+  object table and the index are laid out before
+  the coordinates are streamed to the file object
+  by object, so that each SDF file is read just once
+  */
+  memset(&db_fd, 0, sizeof(FileDescriptor));
+  memset(&header, 0, sizeof(ConfDbHeader));
+  if (strlen(name) >= BUF_LEN) {
+    O3_ERROR_LOCATE(&(od->task));
+    return CANNOT_WRITE_CONF_DB;
+  }
+  if (!(od->pel.conf_population[ANY_DB] = int_perm_resize
+    (od->pel.conf_population[ANY_DB], od->grid.object_num))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  memset(od->pel.conf_population[ANY_DB]->pe, 0, od->grid.object_num * sizeof(int));
+  if ((result = check_conf_db(od, conf_dir, ANY_DB, wrong_object_num, wrong_conf_num))) {
+    return result;
+  }
+  memcpy(header.magic, CONF_DB_MAGIC, sizeof(CONF_DB_MAGIC));
+  header.version = CONF_DB_VERSION;
+  header.coord_size = coord_size;
+  for (object_num = 0; object_num < od->grid.object_num; ++object_num) {
+    if (od->pel.conf_population[ANY_DB]->pe[object_num]) {
+      ++(header.n_objects);
+      header.n_confs += od->pel.conf_population[ANY_DB]->pe[object_num];
+    }
+  }
+  header.object_offset = align_conf_db_offset(sizeof(ConfDbHeader));
+  header.index_offset = align_conf_db_offset(header.object_offset
+    + (uint64_t)(header.n_objects) * sizeof(ConfDbObject));
+  header.coord_offset = align_conf_db_offset(header.index_offset
+    + header.n_confs * sizeof(uint64_t));
+  object = (ConfDbObject *)calloc(header.n_objects + 1, sizeof(ConfDbObject));
+  index = (uint64_t *)malloc((header.n_confs + 1) * sizeof(uint64_t));
+  if ((!object) || (!index)) {
+    if (object) {
+      free(object);
+    }
+    if (index) {
+      free(index);
+    }
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  /*
+  the conformers of each object are contiguous
+  and each object starts on an aligned boundary
+  */
+  for (object_num = 0, i = 0, pos = 0, offset = header.coord_offset;
+    object_num < od->grid.object_num; ++object_num) {
+    if (!(od->pel.conf_population[ANY_DB]->pe[object_num])) {
+      continue;
+    }
+    object[i].object_id = od->al.mol_info[object_num]->object_id;
+    object[i].n_atoms = od->al.mol_info[object_num]->n_atoms;
+    object[i].n_bonds = od->al.mol_info[object_num]->n_bonds;
+    object[i].n_conf = od->pel.conf_population[ANY_DB]->pe[object_num];
+    object[i].first_conf = pos;
+    for (conf_num = 0; conf_num < object[i].n_conf; ++conf_num, ++pos) {
+      index[pos] = offset;
+      offset += (uint64_t)(object[i].n_atoms) * 3 * coord_size;
+    }
+    offset = align_conf_db_offset(offset);
+    ++i;
+  }
+  /*
+  index[n_confs] is not written; it only tells
+  write_conf_db_coord() where coordinates start
+  when there are no conformers at all
+  */
+  index[header.n_confs] = header.coord_offset;
+  header.size = offset;
+  strncpy(db_fd.name, name, BUF_LEN - 1);
+  if (!(db_fd.handle = fopen(db_fd.name, "wb"))) {
+    result = CANNOT_WRITE_CONF_DB;
+  }
+  else {
+    pos = sizeof(ConfDbHeader);
+    if ((fwrite(&header, sizeof(ConfDbHeader), 1, db_fd.handle) != 1)
+      || pad_conf_db(db_fd.handle, &pos, header.object_offset)
+      || (fwrite(object, sizeof(ConfDbObject), header.n_objects,
+      db_fd.handle) != header.n_objects)) {
+      result = CANNOT_WRITE_CONF_DB;
+    }
+    pos += (uint64_t)(header.n_objects) * sizeof(ConfDbObject);
+    if ((!result) && (pad_conf_db(db_fd.handle, &pos, header.index_offset)
+      || (fwrite(index, sizeof(uint64_t), header.n_confs,
+      db_fd.handle) != header.n_confs))) {
+      result = CANNOT_WRITE_CONF_DB;
+    }
+    pos += header.n_confs * sizeof(uint64_t);
+    if ((!result) && pad_conf_db(db_fd.handle, &pos, header.coord_offset)) {
+      result = CANNOT_WRITE_CONF_DB;
+    }
+    if (!result) {
+      result = write_conf_db_coord(od, db_fd.handle, conf_dir,
+        object, index, coord_size, wrong_object_num);
+    }
+    if ((!result) && (header.n_confs)) {
+      pos = index[header.n_confs - 1] + (uint64_t)(object[header.n_objects - 1].n_atoms)
+        * 3 * coord_size;
+      if (pad_conf_db(db_fd.handle, &pos, header.size)) {
+        result = CANNOT_WRITE_CONF_DB;
+      }
+    }
+    if (fclose(db_fd.handle) && (!result)) {
+      result = CANNOT_WRITE_CONF_DB;
+    }
+    db_fd.handle = NULL;
+  }
+  if (result == CANNOT_WRITE_CONF_DB) {
+    O3_ERROR_LOCATE(&(od->task));
+    O3_ERROR_STRING(&(od->task), db_fd.name);
+  }
+  if (result) {
+    remove(db_fd.name);
+  }
+  free(object);
+  free(index);
+  
+  return result;
+}
@@ -0,0 +1,404 @@
+/*
+
+conf_store.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+
+/*
+conformational databases larger than this are not
+kept in RAM but in a memory-mapped page file
+*/
+static size_t conf_store_limit = (size_t)CONF_STORE_DEFAULT_MB * 1048576;
+
+
+void set_conf_store_limit(int mb)
+{
+  conf_store_limit = (size_t)mb * 1048576;
+}
+
+
+int read_sdf_conf(FILE *handle, MolInfo *mol_info, double *coord)
+{
+  char buffer[BUF_LEN];
+  int i;
+  int result;
+  
+  
+  /*
+  read the coordinates of the next conformation
+  in a conformational database, then skip to the
+  beginning of the following one
+  */
+  memset(buffer, 0, BUF_LEN);
+  if ((result = find_conformation_in_sdf(handle, NULL, 0))) {
+    return result;
+  }
+  i = 0;
+  while ((i < mol_info->n_atoms) && fgets(buffer, BUF_LEN, handle)) {
+    buffer[BUF_LEN - 1] = '\0';
+    parse_sdf_coord_line(mol_info->sdf_version,
+      buffer, NULL, &coord[i * 3], NULL);
+    ++i;
+  }
+  if (i != mol_info->n_atoms) {
+    return PREMATURE_EOF;
+  }
+  i = 0;
+  while ((!i) && fgets(buffer, BUF_LEN, handle)) {
+    i = (!strncmp(buffer, SDF_DELIMITER, 4));
+  }
+  
+  return 0;
+}
+
+
+static int map_conf_store(O3Data *od, ConfStore *cs, size_t size)
+{
+  #ifndef WIN32
+  int fd;
+  #else
+  DWORD size_high;
+  DWORD size_low;
+  #endif
+  
+  
+  /*
+  the page file is unlinked (or deleted on close)
+  straight away, so that it does not outlive the run;
+  its pages are written back to disk and dropped
+  by the kernel as needed
+  */
+  #ifndef WIN32
+  sprintf(cs->name, "%s%co3a_conf_store_XXXXXX", od->temp_dir, SEPARATOR);
+  if ((fd = mkstemp(cs->name)) == -1) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  unlink(cs->name);
+  if (ftruncate(fd, (off_t)size)) {
+    close(fd);
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  cs->coord = (double *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (cs->coord == MAP_FAILED) {
+    cs->coord = NULL;
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  #else
+  if (!GetTempFileName(od->temp_dir, "o3a", 0, cs->name)) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  cs->hFile = CreateFile(cs->name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+  if (cs->hFile == INVALID_HANDLE_VALUE) {
+    cs->hFile = NULL;
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  size_high = (DWORD)((uint64_t)size >> 32);
+  size_low = (DWORD)((uint64_t)size & 0xFFFFFFFF);
+  if (!(cs->hMapHandle = CreateFileMapping(cs->hFile, NULL,
+    PAGE_READWRITE, size_high, size_low, NULL))) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  if (!(cs->coord = (double *)MapViewOfFile(cs->hMapHandle,
+    FILE_MAP_ALL_ACCESS, 0, 0, size))) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  #endif
+  cs->mapped = 1;
+  
+  return 0;
+}
+
+
+static int map_conf_db_store(O3Data *od, ConfStore *cs)
+{
+  int object_num;
+  int conf_num;
+  uint64_t n_coord_bytes;
+  ConfDbObject *object;
+  
+  
+  /*
+  if coordinates are stored as float64 and the conformers
+  of each object are contiguous, as write_conf_db() lays
+  them out, the store can point straight into the mapped
+  binary database and nothing needs to be copied
+  */
+  if (cs->db->header->coord_size != sizeof(double)) {
+    return 0;
+  }
+  for (object_num = 0; object_num < cs->n_objects; ++object_num) {
+    if (!(cs->n_conf[object_num])) {
+      continue;
+    }
+    if ((!(object = find_conf_db_object(cs->db, od->al.mol_info[object_num]->object_id)))
+      || (object->n_conf < cs->n_conf[object_num])) {
+      return 0;
+    }
+    n_coord_bytes = (uint64_t)(object->n_atoms) * 3 * sizeof(double);
+    for (conf_num = 1; conf_num < cs->n_conf[object_num]; ++conf_num) {
+      if (cs->db->index[object->first_conf + conf_num]
+        != (cs->db->index[object->first_conf] + (uint64_t)conf_num * n_coord_bytes)) {
+        return 0;
+      }
+    }
+  }
+  for (object_num = 0; object_num < cs->n_objects; ++object_num) {
+    if (cs->n_conf[object_num]) {
+      object = find_conf_db_object(cs->db, od->al.mol_info[object_num]->object_id);
+      cs->offset[object_num] = (size_t)(cs->db->index[object->first_conf] / sizeof(double));
+    }
+  }
+  cs->coord = (double *)(cs->db->base);
+  cs->size = cs->db->size;
+  
+  return 1;
+}
+
+
+int load_conf_store(O3Data *od, char *conf_dir, int type)
+{
+  int i;
+  int found;
+  int object_num;
+  int conf_num;
+  int result;
+  size_t n;
+  ConfStore *cs;
+  ConfDbObject *object;
+  FileDescriptor conf_fd;
+  SdfReader sdf_reader;
+  
+  
+  /*
+  the conformational database of each object is parsed
+  once and its coordinates are stored back to back in
+  a single array, which all threads (and shard processes)
+  then read from; objects with no conformations listed
+  in conf_population are skipped. Binary databases
+  are mapped and either used in place or read
+  through their conformer index
+  */
+  memset(&conf_fd, 0, sizeof(FileDescriptor));
+  if (!(cs = (ConfStore *)malloc(sizeof(ConfStore)))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  memset(cs, 0, sizeof(ConfStore));
+  od->mel.conf_store[type] = cs;
+  cs->n_objects = od->grid.object_num;
+  cs->offset = (size_t *)malloc((cs->n_objects + 1) * sizeof(size_t));
+  cs->n_atoms = (int *)malloc((cs->n_objects + 1) * sizeof(int));
+  cs->n_conf = (int *)malloc((cs->n_objects + 1) * sizeof(int));
+  if ((!(cs->offset)) || (!(cs->n_atoms)) || (!(cs->n_conf))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  for (object_num = 0, n = 0; object_num < cs->n_objects; ++object_num) {
+    cs->offset[object_num] = n;
+    cs->n_atoms[object_num] = od->al.mol_info[object_num]->n_atoms;
+    /*
+    as in check_conf_db(), only the objects in
+    OBJECT_LIST have a template database
+    */
+    cs->n_conf[object_num] = od->pel.conf_population[type]->pe[object_num];
+    if (type == TEMPLATE_DB) {
+      for (i = 0, found = 0; (!found) && (i < od->pel.numberlist[OBJECT_LIST]->size); ++i) {
+        found = (object_num == (od->pel.numberlist[OBJECT_LIST]->pe[i] - 1));
+      }
+      if (!found) {
+        cs->n_conf[object_num] = 0;
+      }
+    }
+    n += (size_t)(cs->n_conf[object_num]) * (size_t)(cs->n_atoms[object_num]) * 3;
+  }
+  cs->offset[cs->n_objects] = n;
+  if (is_conf_db(conf_dir)) {
+    if (!(cs->db = (ConfDb *)malloc(sizeof(ConfDb)))) {
+      O3_ERROR_LOCATE(&(od->task));
+      return OUT_OF_MEMORY;
+    }
+    if (open_conf_db(cs->db, conf_dir)) {
+      free(cs->db);
+      cs->db = NULL;
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), conf_dir);
+      return CANNOT_READ_ORIGINAL_SDF;
+    }
+    if (map_conf_db_store(od, cs)) {
+      return 0;
+    }
+  }
+  cs->size = (n ? n : 1) * sizeof(double);
+  if (cs->size > conf_store_limit) {
+    if ((result = map_conf_store(od, cs, cs->size))) {
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), cs->name);
+      return result;
+    }
+  }
+  else if (!(cs->coord = (double *)malloc(cs->size))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  for (object_num = 0; object_num < cs->n_objects; ++object_num) {
+    if (!(cs->n_conf[object_num])) {
+      continue;
+    }
+    if (cs->db) {
+      if ((!(object = find_conf_db_object(cs->db, od->al.mol_info[object_num]->object_id)))
+        || (object->n_conf < cs->n_conf[object_num])) {
+        O3_ERROR_LOCATE(&(od->task));
+        O3_ERROR_STRING(&(od->task), conf_dir);
+        return CANNOT_READ_ORIGINAL_SDF;
+      }
+      for (conf_num = 0; conf_num < cs->n_conf[object_num]; ++conf_num) {
+        get_conf_db_coord(cs->db, object, conf_num, get_store_conf(cs, object_num, conf_num));
+      }
+      continue;
+    }
+    sprintf(conf_fd.name, "%s%c%04d.sdf", conf_dir,
+      SEPARATOR, od->al.mol_info[object_num]->object_id);
+    if (open_sdf_reader(&sdf_reader, conf_fd.name)) {
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), conf_fd.name);
+      return CANNOT_READ_ORIGINAL_SDF;
+    }
+    for (conf_num = 0, result = 0; (!result)
+      && (conf_num < cs->n_conf[object_num]); ++conf_num) {
+      result = read_sdf_reader_conf(&sdf_reader, od->al.mol_info[object_num],
+        get_store_conf(cs, object_num, conf_num));
+    }
+    close_sdf_reader(&sdf_reader);
+    if (result) {
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), conf_fd.name);
+      return CANNOT_READ_ORIGINAL_SDF;
+    }
+  }
+  if (cs->db) {
+    close_conf_db(cs->db);
+    free(cs->db);
+    cs->db = NULL;
+  }
+  /*
+  from now on the store is read-only
+  */
+  #ifndef WIN32
+  if (cs->mapped) {
+    mprotect(cs->coord, cs->size, PROT_READ);
+  }
+  #endif
+  
+  return 0;
+}
+
+
+double *get_store_conf(ConfStore *cs, int object_num, int conf_num)
+{
+  return &(cs->coord[cs->offset[object_num]
+    + (size_t)conf_num * (size_t)(cs->n_atoms[object_num]) * 3]);
+}
+
+
+void print_conf_store_stats(O3Data *od, ConfStore *cs, char *db_name)
+{
+  if (cs->db) {
+    tee_printf(od, "The %s conformational database (%.1f MB) was used "
+      "in place from its memory-mapped binary file.\n",
+      db_name, (double)(cs->size) / 1048576.0);
+  }
+  else {
+    tee_printf(od, "The %s conformational database (%.1f MB) was parsed once "
+      "and kept %s.\n", db_name, (double)(cs->size) / 1048576.0,
+      (cs->mapped ? "in a memory-mapped page file" : "in RAM"));
+  }
+}
+
+
+void free_conf_store(ConfStore *cs)
+{
+  if (cs) {
+    if (cs->db) {
+      /*
+      coord may point inside the binary database
+      mapping, which is released here
+      */
+      if (cs->coord == (double *)(cs->db->base)) {
+        cs->coord = NULL;
+      }
+      close_conf_db(cs->db);
+      free(cs->db);
+    }
+    if (cs->coord) {
+      if (cs->mapped) {
+        #ifndef WIN32
+        munmap(cs->coord, cs->size);
+        #else
+        UnmapViewOfFile(cs->coord);
+        #endif
+      }
+      else {
+        free(cs->coord);
+      }
+    }
+    #ifdef WIN32
+    if (cs->hMapHandle) {
+      CloseHandle(cs->hMapHandle);
+    }
+    if (cs->hFile) {
+      CloseHandle(cs->hFile);
+    }
+    #endif
+    if (cs->offset) {
+      free(cs->offset);
+    }
+    if (cs->n_atoms) {
+      free(cs->n_atoms);
+    }
+    if (cs->n_conf) {
+      free(cs->n_conf);
+    }
+    free(cs);
+  }
+}
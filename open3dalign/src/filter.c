@@ -46,7 +46,7 @@ E-mail: paolo.tosco@unito.it
 #endif
 
 
-int filter(O3Data *od)
+static int run_filter(O3Data *od)
 {
   char buffer[BUF_LEN];
   int i;
@@ -64,16 +64,13 @@ int filter(O3Data *od)
   int old_template_object_num;
   int template_conf_num;
   int n_threads;
+  int result;
   FileDescriptor temp_fd;
   FileDescriptor sdf_fd;
   FileDescriptor filter_log_fd;
-  #ifndef WIN32
-  pthread_attr_t thread_attr;
-  #endif
-  ThreadInfo **ti;
+  WorkerInfo **ti;
 
 
-  ti = od->mel.thread_info;
   memset(buffer, 0, BUF_LEN);
   memset(&temp_fd, 0, sizeof(FileDescriptor));
   memset(&sdf_fd, 0, sizeof(FileDescriptor));
@@ -93,9 +90,10 @@ int filter(O3Data *od)
   if (i == od->pel.numberlist[OBJECT_LIST]->size) {
     return NOTHING_TO_DO_FILTER;
   }
-  if (alloc_threads(od)) {
+  if (alloc_workers(od)) {
     return OUT_OF_MEMORY;
   }
+  ti = od->mel.worker_info;
   od->align.n_tasks = od->pel.numberlist[OBJECT_LIST]->size;
   if (!(od->al.task_list = (TaskInfo **)alloc_array(od->align.n_tasks, sizeof(TaskInfo)))) {
     return OUT_OF_MEMORY;
@@ -121,7 +119,10 @@ int filter(O3Data *od)
       ++n_conf_overall;
     }
   }
-  n_threads = fill_thread_info(od, od->align.n_tasks);
+  if (!(od->mel.task_queue = alloc_task_queue(1, od->align.n_tasks))) {
+    return OUT_OF_MEMORY;
+  }
+  n_threads = fill_worker_info(od, NULL, od->align.n_tasks);
   for (i = 0; i < od->pel.numberlist[OBJECT_LIST]->size; ++i) {
     od->al.task_list[i]->data[TEMPLATE_OBJECT_NUM] =
       od->pel.numberlist[OBJECT_LIST]->pe[i] - 1;
@@ -131,55 +132,24 @@ int filter(O3Data *od)
   }
   #ifndef WIN32
   pthread_mutex_init(od->mel.mutex, NULL);
-  pthread_attr_init(&thread_attr);
-  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
   #else
   if (!(*(od->mel.mutex) = CreateMutex(NULL, FALSE, NULL))) {
     return CANNOT_CREATE_THREAD;
   }
   #endif
-  for (i = 0; i < n_threads; ++i) {
-    /*
-    create the i-th thread
-    */
-    #ifndef WIN32
-    od->error_code = pthread_create(&(od->thread_id[i]),
-      &thread_attr, (void *(*)(void *))filter_extract_split_phar_thread, ti[i]);
-    if (od->error_code) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #else
-    od->hThreadArray[i] = CreateThread(NULL, 0,
-      (LPTHREAD_START_ROUTINE)filter_extract_split_phar_thread,
-      ti[i], 0, &(od->dwThreadIdArray[i]));
-    if (!(od->hThreadArray[i])) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #endif
-  }
-  #ifndef WIN32
   /*
-  free the pthread attribute memory
+  start the threads and wait for all of them to have finished
   */
-  pthread_attr_destroy(&thread_attr);
-  /*
-  wait for all threads to have finished
-  */
-  for (i = 0; i < n_threads; ++i) {
-    od->error_code = pthread_join(od->thread_id[i],
-      &(od->thread_result[i]));
-    if (od->error_code) {
-      return CANNOT_JOIN_THREAD;
-    }
-  }
+  result = run_workers(od, "filter_extract", n_threads, (void *)filter_extract_split_phar_thread);
+  #ifndef WIN32
   pthread_mutex_destroy(od->mel.mutex);
   #else
-  WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-  for (i = 0; i < n_threads; ++i) {
-    CloseHandle(od->hThreadArray[i]);
-  }
   CloseHandle(*(od->mel.mutex));
   #endif
+  if (result) {
+    O3_ERROR_LOCATE(&(od->task));
+    return result;
+  }
   for (i = 0; (i < od->align.n_tasks)
     && (!(od->al.task_list[i]->code)); ++i);
   if (i != od->align.n_tasks) {
@@ -202,57 +172,27 @@ int filter(O3Data *od)
     }
   }
   if (od->align.filter_type & FILTER_INTRA_CONF_DB_BIT) {
+    reset_task_queue(od->mel.task_queue);
     #ifndef WIN32
     pthread_mutex_init(od->mel.mutex, NULL);
-    pthread_attr_init(&thread_attr);
-    pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
     #else
     if (!(*(od->mel.mutex) = CreateMutex(NULL, FALSE, NULL))) {
       return CANNOT_CREATE_THREAD;
     }
     #endif
-    for (i = 0; i < n_threads; ++i) {
-      /*
-      create the i-th thread
-      */
-      #ifndef WIN32
-      od->error_code = pthread_create(&(od->thread_id[i]),
-        &thread_attr, (void *(*)(void *))filter_intra_thread, ti[i]);
-      if (od->error_code) {
-        return CANNOT_CREATE_THREAD;
-      }
-      #else
-      od->hThreadArray[i] = CreateThread(NULL, 0,
-        (LPTHREAD_START_ROUTINE)filter_intra_thread,
-        ti[i], 0, &(od->dwThreadIdArray[i]));
-      if (!(od->hThreadArray[i])) {
-        return CANNOT_CREATE_THREAD;
-      }
-      #endif
-    }
-    #ifndef WIN32
-    /*
-    free the pthread attribute memory
-    */
-    pthread_attr_destroy(&thread_attr);
     /*
-    wait for all threads to have finished
+    start the threads and wait for all of them to have finished
     */
-    for (i = 0; i < n_threads; ++i) {
-      od->error_code = pthread_join(od->thread_id[i],
-        &(od->thread_result[i]));
-      if (od->error_code) {
-        return CANNOT_JOIN_THREAD;
-      }
-    }
+    result = run_workers(od, "filter_intra", n_threads, (void *)filter_intra_thread);
+    #ifndef WIN32
     pthread_mutex_destroy(od->mel.mutex);
     #else
-    WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-    for (i = 0; i < n_threads; ++i) {
-      CloseHandle(od->hThreadArray[i]);
-    }
     CloseHandle(*(od->mel.mutex));
     #endif
+    if (result) {
+      O3_ERROR_LOCATE(&(od->task));
+      return result;
+    }
     for (i = 0; (i < od->align.n_tasks)
       && (!(od->al.task_list[i]->code)); ++i);
     if (i != od->align.n_tasks) {
@@ -327,54 +267,19 @@ int filter(O3Data *od)
           ++n_retained_conf;
         }
       }
-      n_threads = fill_thread_info(od, n_retained_conf);
+      n_threads = fill_worker_info(od, NULL, n_retained_conf);
       od->align.n_tasks = n_threads;
-      #ifndef WIN32
-      pthread_attr_init(&thread_attr);
-      pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
-      #endif
       for (i = 0; i < n_threads; ++i) {
         ti[i]->data[DATA_N_CONF] = n_conf;
         ti[i]->data[DATA_N_CONF_OVERALL] = n_conf_overall;
-        /*
-        create the i-th thread
-        */
-        #ifndef WIN32
-        od->error_code = pthread_create(&(od->thread_id[i]),
-          &thread_attr, (void *(*)(void *))filter_inter_thread, ti[i]);
-        if (od->error_code) {
-          return CANNOT_CREATE_THREAD;
-        }
-        #else
-        od->hThreadArray[i] = CreateThread(NULL, 0,
-          (LPTHREAD_START_ROUTINE)filter_inter_thread,
-          ti[i], 0, &(od->dwThreadIdArray[i]));
-        if (!(od->hThreadArray[i])) {
-          return CANNOT_CREATE_THREAD;
-        }
-        #endif
       }
-      #ifndef WIN32
       /*
-      free the pthread attribute memory
+      start the threads and wait for all of them to have finished
       */
-      pthread_attr_destroy(&thread_attr);
-      /*
-      wait for all threads to have finished
-      */
-      for (i = 0; i < n_threads; ++i) {
-        od->error_code = pthread_join(od->thread_id[i],
-          &(od->thread_result[i]));
-        if (od->error_code) {
-          return CANNOT_JOIN_THREAD;
-        }
-      }
-      #else
-      WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-      for (i = 0; i < n_threads; ++i) {
-        CloseHandle(od->hThreadArray[i]);
+      result = run_workers(od, "filter_inter", n_threads, (void *)filter_inter_thread);
+      if (result) {
+        return result;
       }
-      #endif
       for (i = 0; (i < od->align.n_tasks)
         && (!(od->al.task_list[i]->code)); ++i);
       if (i != od->align.n_tasks) {
@@ -426,6 +331,11 @@ int filter(O3Data *od)
             O3_ERROR_STRING(&(od->task), temp_fd.name);
             return FL_CANNOT_READ_SDF_FILE;
           }
+          /*
+          filtered conformers are written as plain SDF, as
+          they may be used as template conformers by Pharao
+          alignments, which pass them to pharao as they are
+          */
           sprintf(sdf_fd.name, "%s%c%04d.sdf", od->align.filter_conf_dir,
             SEPARATOR, od->al.mol_info[template_object_num]->object_id);
           if (!(sdf_fd.handle = fopen(sdf_fd.name, "wb"))) {
@@ -481,6 +391,23 @@ int filter(O3Data *od)
 }
 
 
+int filter(O3Data *od)
+{
+  int result;
+  
+  
+  /*
+  the task queue is released whichever
+  way run_filter() returns
+  */
+  result = run_filter(od);
+  free_task_queue(od->mel.task_queue);
+  od->mel.task_queue = NULL;
+  
+  return result;
+}
+
+
 int filter_extract_split_phar_thread(void *pointer)
 {
   char buffer[BUF_LEN];
@@ -488,7 +415,6 @@ int filter_extract_split_phar_thread(void *pointer)
   int template_object_num;
   int template_num;
   int alloc_fail = 0;
-  int assigned = 0;
   int n_phar_conf;
   int next_conf;
   int n_conf;
@@ -499,65 +425,48 @@ int filter_extract_split_phar_thread(void *pointer)
   FileDescriptor temp_fd;
   FileDescriptor phar_conf_fd;
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(buffer, 0, BUF_LEN);
   memset(&prog_exe_info, 0, sizeof(ProgExeInfo));
   memset(&temp_fd, 0, sizeof(FileDescriptor));
   memset(&phar_conf_fd, 0, sizeof(FileDescriptor));
-  prog_exe_info.exedir = ti->od.align.pharao_exe_path;
+  prog_exe_info.exedir = ti->od->align.pharao_exe_path;
   if (!(prog_exe_info.proc_env = fill_env
-    (&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0))) {
+    (ti->od, babel_env, ti->od->align.pharao_exe_path, 0))) {
     alloc_fail = 1;
   }
   prog_exe_info.stdout_fd = &temp_fd;
   prog_exe_info.stderr_fd = &temp_fd;
   prog_exe_info.sep_proc_grp = 1;
   error = 0;
-  assigned = 1;
-  while ((!error) && assigned) {
-    template_num = 0;
-    assigned = 0;
-    while ((!assigned) && (template_num < ti->od.pel.numberlist[OBJECT_LIST]->size)) {
-      template_object_num = ti->od.pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
-      if (!(ti->od.al.mol_info[template_object_num]->done)) {
-        #ifndef WIN32
-        pthread_mutex_lock(ti->od.mel.mutex);
-        #else
-        WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-        #endif
-        if (!(ti->od.al.mol_info[template_object_num]->done)) {
-          ti->od.al.mol_info[template_object_num]->done = OBJECT_ASSIGNED;
-          assigned = 1;
-        }
-        #ifndef WIN32
-        pthread_mutex_unlock(ti->od.mel.mutex);
-        #else
-        ReleaseMutex(ti->od.mel.mutex);
-        #endif
-      }
-      if (!assigned) {
-        ++template_num;
-      }
-    }
-    if (!assigned)  {
+  while (!error) {
+    /*
+    each template is handed out exactly once by the
+    task queue, so its done flag is only touched by
+    the thread which claimed it
+    */
+    while (((template_num = claim_task(ti->od->mel.task_queue, 0)) != -1)
+      && ti->od->al.mol_info[ti->od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1]->done);
+    if (template_num == -1)  {
       break;
     }
-    template_object_num = ti->od.pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
-    ti->od.al.task_list[template_num]->code = 0;
-    ti->od.al.task_list[template_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
-    ti->od.al.task_list[template_num]->data[TEMPLATE_CONF_NUM] = -1;
+    template_object_num = ti->od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
+    ti->od->al.mol_info[template_object_num]->done = OBJECT_ASSIGNED;
+    ti->od->al.task_list[template_num]->code = 0;
+    ti->od->al.task_list[template_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
+    ti->od->al.task_list[template_num]->data[TEMPLATE_CONF_NUM] = -1;
     if (alloc_fail) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      ti->od.al.task_list[template_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      ti->od->al.task_list[template_num]->code = FL_OUT_OF_MEMORY;
       error = 1;
       continue;
     }
     sprintf(phar_conf_fd.name, "%s%c%04d.phar",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     phar_exist_ok = 0;
     if (fexist(phar_conf_fd.name)) {
       /*
@@ -566,9 +475,9 @@ int filter_extract_split_phar_thread(void *pointer)
       number of conformers in XXXX.sdf
       */
       if (!(phar_conf_fd.handle = fopen(phar_conf_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[template_num], phar_conf_fd.name);
-        ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+        O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[template_num], phar_conf_fd.name);
+        ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
         error = 1;
         continue;
       }
@@ -581,35 +490,35 @@ int filter_extract_split_phar_thread(void *pointer)
       }
       fclose(phar_conf_fd.handle);
       phar_conf_fd.handle = NULL;
-      phar_exist_ok = (n_phar_conf == ti->od.pel.conf_population
+      phar_exist_ok = (n_phar_conf == ti->od->pel.conf_population
         [TEMPLATE_DB]->pe[template_object_num]);
     }
     if (!phar_exist_ok) {
       sprintf(temp_fd.name, "%s%c%04d_phar_extract.log",
-        ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[template_object_num]->object_id);
+        ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[template_object_num]->object_id);
       sprintf(prog_exe_info.command_line,
         "%s -q %s %s -d %s%c%04d.sdf --dbType MOL -p %s",
-        ti->od.align.pharao_exe,
-        ((ti->od.align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
-        ((ti->od.align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
-        ti->od.align.template_conf_dir, SEPARATOR,
-        ti->od.al.mol_info[template_object_num]->object_id,
+        ti->od->align.pharao_exe,
+        ((ti->od->align.type & ALIGN_TOGGLE_HYBRID_BIT) ? "" : PHARAO_NO_HYBRID),
+        ((ti->od->align.type & ALIGN_TOGGLE_MERGE_BIT) ? PHARAO_MERGE : ""),
+        ti->od->align.template_conf_dir, SEPARATOR,
+        ti->od->al.mol_info[template_object_num]->object_id,
         phar_conf_fd.name);
-      pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[template_num]->code));
+      pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[template_num]->code));
       ext_program_wait(&prog_exe_info, pid);
       /*
       check if the Pharao computation was OK
       */
       if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[template_num], temp_fd.name);
-        ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+        O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[template_num], temp_fd.name);
+        ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
         error = 1;
       }
       else if (fgrep(temp_fd.handle, buffer, "Error")) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-        ti->od.al.task_list[template_num]->code = FL_PHARAO_ERROR;
+        O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+        ti->od->al.task_list[template_num]->code = FL_PHARAO_ERROR;
         error = 1;
       }
       if (temp_fd.handle) {
@@ -619,8 +528,8 @@ int filter_extract_split_phar_thread(void *pointer)
       remove(temp_fd.name);
     }
     sprintf(buffer, "%s%c%04d_phar_conf",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     if (!dexist(buffer)) {
       #ifndef WIN32
       result = mkdir(buffer, S_IRWXU | S_IRGRP | S_IROTH);
@@ -628,9 +537,9 @@ int filter_extract_split_phar_thread(void *pointer)
       result = mkdir(buffer);
       #endif
       if (result) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[template_num], buffer);
-        ti->od.al.task_list[template_num]->code = FL_CANNOT_CREATE_SCRDIR;
+        O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[template_num], buffer);
+        ti->od->al.task_list[template_num]->code = FL_CANNOT_CREATE_SCRDIR;
         error = 1;
         continue;
       }
@@ -640,12 +549,12 @@ int filter_extract_split_phar_thread(void *pointer)
     and put them in a XXXX_phar_conf folder inside template_conf_dir
     */
     sprintf(temp_fd.name, "%s%c%04d.phar",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[template_num], temp_fd.name);
-      ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[template_num], temp_fd.name);
+      ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
       error = 1;
       continue;
     }
@@ -664,34 +573,34 @@ int filter_extract_split_phar_thread(void *pointer)
         ++n_phar_conf;
         n_conf = 0;
         found = 0;
-        while (!(found = ((ti->od.al.phar_conf_list[n_conf]->object_num == template_object_num)
-          && (ti->od.al.phar_conf_list[n_conf]->conf_num == n_phar_conf)))) {
+        while (!(found = ((ti->od->al.phar_conf_list[n_conf]->object_num == template_object_num)
+          && (ti->od->al.phar_conf_list[n_conf]->conf_num == n_phar_conf)))) {
           ++n_conf;
         }
         if (!found) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[template_num], temp_fd.name);
-          ti->od.al.task_list[template_num]->code = FL_CANNOT_FIND_CONF;
+          O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[template_num], temp_fd.name);
+          ti->od->al.task_list[template_num]->code = FL_CANNOT_FIND_CONF;
           error = 1;
           continue;
         }
-        ti->od.al.phar_conf_list[n_conf]->n_phar_points = -2;
+        ti->od->al.phar_conf_list[n_conf]->n_phar_points = -2;
         sprintf(phar_conf_fd.name, "%s%c%04d_phar_conf%c%04d_%06d.phar",
-          ti->od.align.filter_conf_dir,
-          SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->align.filter_conf_dir,
+          SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
           n_phar_conf + 1);
         if (!(phar_conf_fd.handle = fopen(phar_conf_fd.name, "wb"))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[template_num], phar_conf_fd.name);
-          ti->od.al.task_list[template_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[template_num], phar_conf_fd.name);
+          ti->od->al.task_list[template_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
           error = 1;
           continue;
         }
       }
       fprintf(phar_conf_fd.handle, "%s\n", buffer);
       next_conf = (!strncmp(buffer, SDF_DELIMITER, 4));
-      ++(ti->od.al.phar_conf_list[n_conf]->n_phar_points);
+      ++(ti->od->al.phar_conf_list[n_conf]->n_phar_points);
     }
     if (phar_conf_fd.handle) {
       fclose(phar_conf_fd.handle);
@@ -701,11 +610,7 @@ int filter_extract_split_phar_thread(void *pointer)
   }
   free_proc_env(prog_exe_info.proc_env);
   
-  #ifndef WIN32
-  pthread_exit(pointer);
-  #else
   return 0;
-  #endif
 }
 
 
@@ -723,7 +628,6 @@ int filter_intra_thread(void *pointer)
   int delete_conf_num;
   int delete_file_ok = 0;
   int alloc_fail = 0;
-  int assigned = 0;
   int n_phar_conf;
   int n_deleted;
   int n_appended;
@@ -737,10 +641,10 @@ int filter_intra_thread(void *pointer)
   FileDescriptor filter_log_fd;
   FileDescriptor score_fd;
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(buffer, 0, BUF_LEN);
   memset(&prog_exe_info, 0, sizeof(ProgExeInfo));
   memset(&temp_fd, 0, sizeof(FileDescriptor));
@@ -748,58 +652,36 @@ int filter_intra_thread(void *pointer)
   memset(&multi_phar_conf_fd, 0, sizeof(FileDescriptor));
   memset(&filter_log_fd, 0, sizeof(FileDescriptor));
   memset(&score_fd, 0, sizeof(FileDescriptor));
-  prog_exe_info.exedir = ti->od.align.pharao_exe_path;
+  prog_exe_info.exedir = ti->od->align.pharao_exe_path;
   if (!(prog_exe_info.proc_env = fill_env
-    (&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0))) {
+    (ti->od, babel_env, ti->od->align.pharao_exe_path, 0))) {
     alloc_fail = 1;
   }
   prog_exe_info.stdout_fd = &temp_fd;
   prog_exe_info.stderr_fd = &temp_fd;
   prog_exe_info.sep_proc_grp = 1;
   error = 0;
-  assigned = 1;
-  while ((!error) && assigned) {
-    template_num = 0;
-    assigned = 0;
-    while ((!assigned) && (template_num < ti->od.pel.numberlist[OBJECT_LIST]->size)) {
-      template_object_num = ti->od.pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
-      if (!(ti->od.al.mol_info[template_object_num]->done)) {
-        #ifndef WIN32
-        pthread_mutex_lock(ti->od.mel.mutex);
-        #else
-        WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-        #endif
-        if (!(ti->od.al.mol_info[template_object_num]->done)) {
-          ti->od.al.mol_info[template_object_num]->done = OBJECT_ASSIGNED;
-          assigned = 1;
-        }
-        #ifndef WIN32
-        pthread_mutex_unlock(ti->od.mel.mutex);
-        #else
-        ReleaseMutex(ti->od.mel.mutex);
-        #endif
-      }
-      if (!assigned) {
-        ++template_num;
-      }
-    }
-    if (!assigned)  {
+  while (!error) {
+    while (((template_num = claim_task(ti->od->mel.task_queue, 0)) != -1)
+      && ti->od->al.mol_info[ti->od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1]->done);
+    if (template_num == -1)  {
       break;
     }
-    template_object_num = ti->od.pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
-    n_phar_conf = ti->od.pel.conf_population[TEMPLATE_DB]->pe[template_object_num];
-    ti->od.al.task_list[template_num]->code = 0;
-    ti->od.al.task_list[template_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
-    ti->od.al.task_list[template_num]->data[TEMPLATE_CONF_NUM] = -1;
+    template_object_num = ti->od->pel.numberlist[OBJECT_LIST]->pe[template_num] - 1;
+    ti->od->al.mol_info[template_object_num]->done = OBJECT_ASSIGNED;
+    n_phar_conf = ti->od->pel.conf_population[TEMPLATE_DB]->pe[template_object_num];
+    ti->od->al.task_list[template_num]->code = 0;
+    ti->od->al.task_list[template_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
+    ti->od->al.task_list[template_num]->data[TEMPLATE_CONF_NUM] = -1;
     if (alloc_fail) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      ti->od.al.task_list[template_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      ti->od->al.task_list[template_num]->code = FL_OUT_OF_MEMORY;
       error = 1;
       continue;
     }
     if (!(delete_list = malloc(n_phar_conf))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      ti->od.al.task_list[template_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      ti->od->al.task_list[template_num]->code = FL_OUT_OF_MEMORY;
       error = 1;
       continue;
     }
@@ -808,8 +690,8 @@ int filter_intra_thread(void *pointer)
     check if we are restarting a previous filtering operation
     */
     sprintf(filter_log_fd.name, "%s%c%04d_phar_conf%cfilter_intra.log",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id, SEPARATOR);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id, SEPARATOR);
     delete_file_ok = 0;
     n_deleted = 0;
     if ((filter_log_fd.handle = fopen(filter_log_fd.name, "rb"))) {
@@ -851,27 +733,27 @@ int filter_intra_thread(void *pointer)
       remove(filter_log_fd.name);
     }
     sprintf(temp_fd.name, "%s%c%04d_phar_compare.log",
-      ti->od.align.align_scratch, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.align_scratch, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     if (!(filter_log_fd.handle = fopen(filter_log_fd.name, "ab"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[template_num], filter_log_fd.name);
-      ti->od.al.task_list[template_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[template_num], filter_log_fd.name);
+      ti->od->al.task_list[template_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
       error = 1;
       continue;
     }
     sprintf(multi_phar_conf_fd.name, "%s%c%04d_multi_phar_conf.phar",
-      ti->od.align.align_scratch, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.align_scratch, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     sprintf(score_fd.name, "%s%c%04d_phar_compare.scores",
-      ti->od.align.align_scratch, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.align_scratch, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     while ((!error) && (last_conf_num < n_phar_conf)) {
       if (!delete_list[last_conf_num]) {
         sprintf(single_phar_conf_fd.name, "%s%c%04d_phar_conf%c%04d_%06d.phar",
-          ti->od.align.filter_conf_dir,
-          SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
+          ti->od->align.filter_conf_dir,
+          SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
           last_conf_num + 1);
         remove(multi_phar_conf_fd.name);
         for (i = 0, n_appended = 0; ((!error) && (i < n_phar_conf)); ++i) {
@@ -879,13 +761,13 @@ int filter_intra_thread(void *pointer)
             continue;
           }
           sprintf(buffer, "%s%c%04d_phar_conf%c%04d_%06d.phar",
-            ti->od.align.filter_conf_dir,
-            SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
-            SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id, i + 1);
+            ti->od->align.filter_conf_dir,
+            SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
+            SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id, i + 1);
           if (!fcopy(buffer, multi_phar_conf_fd.name, "ab")) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-            O3_ERROR_STRING(ti->od.al.task_list[template_num], multi_phar_conf_fd.name);
-            ti->od.al.task_list[template_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+            O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+            O3_ERROR_STRING(ti->od->al.task_list[template_num], multi_phar_conf_fd.name);
+            ti->od->al.task_list[template_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
             error = 1;
             continue;
           }
@@ -897,22 +779,22 @@ int filter_intra_thread(void *pointer)
         if (n_appended) {
           sprintf(prog_exe_info.command_line,
             "%s -q -r %s --refType PHAR -d %s --dbType PHAR -s %s",
-            ti->od.align.pharao_exe, single_phar_conf_fd.name,
+            ti->od->align.pharao_exe, single_phar_conf_fd.name,
             multi_phar_conf_fd.name, score_fd.name);
-          pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[template_num]->code));
+          pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[template_num]->code));
           ext_program_wait(&prog_exe_info, pid);
           /*
           check if the Pharao computation was OK
           */
           if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-            O3_ERROR_STRING(ti->od.al.task_list[template_num], temp_fd.name);
-            ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+            O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+            O3_ERROR_STRING(ti->od->al.task_list[template_num], temp_fd.name);
+            ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
             error = 1;
           }
           else if (fgrep(temp_fd.handle, buffer, "Error")) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-            ti->od.al.task_list[template_num]->code = FL_PHARAO_ERROR;
+            O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+            ti->od->al.task_list[template_num]->code = FL_PHARAO_ERROR;
             error = 1;
           }
           if (temp_fd.handle) {
@@ -927,9 +809,9 @@ int filter_intra_thread(void *pointer)
           check the Pharao scores
           */
           if (!(score_fd.handle = fopen(score_fd.name, "rb"))) {
-            O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-            O3_ERROR_STRING(ti->od.al.task_list[template_num], score_fd.name);
-            ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+            O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+            O3_ERROR_STRING(ti->od->al.task_list[template_num], score_fd.name);
+            ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
             error = 1;
             continue;
           }
@@ -942,18 +824,18 @@ int filter_intra_thread(void *pointer)
             if (i == n_phar_conf) {
               break;
             }
-            if (tanimoto > ti->od.align.level) {
+            if (tanimoto > ti->od->align.level) {
               delete_list[i] = 1;
               ++n_deleted;
               fprintf(filter_log_fd.handle, "%d\t%d\n",
-                ti->od.al.mol_info[template_object_num]->object_id, i + 1);
+                ti->od->al.mol_info[template_object_num]->object_id, i + 1);
             }
             ++i;
           }
           fclose(score_fd.handle);
         }
         fprintf(filter_log_fd.handle, "LAST_CHECKED\t%d\t%d\n",
-          ti->od.al.mol_info[template_object_num]->object_id, last_conf_num + 1);
+          ti->od->al.mol_info[template_object_num]->object_id, last_conf_num + 1);
         fflush(filter_log_fd.handle);
       }
       ++last_conf_num;
@@ -963,31 +845,31 @@ int filter_intra_thread(void *pointer)
       continue;
     }
     sprintf(multi_phar_conf_fd.name, "%s%c%04d.sdf",
-      ti->od.align.template_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.template_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     if (!(multi_phar_conf_fd.handle = fopen(multi_phar_conf_fd.name, "rb"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[template_num], multi_phar_conf_fd.name);
-      ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_SDF_FILE;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[template_num], multi_phar_conf_fd.name);
+      ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_SDF_FILE;
       error = 1;
       continue;
     }
     sprintf(single_phar_conf_fd.name, "%s%c%04d.sdf",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     if (!(single_phar_conf_fd.handle = fopen(single_phar_conf_fd.name, "wb"))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-      O3_ERROR_STRING(ti->od.al.task_list[template_num], single_phar_conf_fd.name);
-      ti->od.al.task_list[template_num]->code = FL_CANNOT_WRITE_SDF_FILE;
+      O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+      O3_ERROR_STRING(ti->od->al.task_list[template_num], single_phar_conf_fd.name);
+      ti->od->al.task_list[template_num]->code = FL_CANNOT_WRITE_SDF_FILE;
       error = 1;
       continue;
     }
     for (i = 0; i < n_phar_conf; ++i) {
       if (find_conformation_in_sdf(multi_phar_conf_fd.handle,
         (delete_list[i] ? NULL : single_phar_conf_fd.handle), 0)) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[template_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[template_num], multi_phar_conf_fd.name);
-        ti->od.al.task_list[template_num]->code = FL_CANNOT_READ_SDF_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[template_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[template_num], multi_phar_conf_fd.name);
+        ti->od->al.task_list[template_num]->code = FL_CANNOT_READ_SDF_FILE;
         error = 1;
         break;
       }
@@ -1006,21 +888,17 @@ int filter_intra_thread(void *pointer)
     fclose(single_phar_conf_fd.handle);
     remove(filter_log_fd.name);
     sprintf(buffer, "%s%c%04d.phar",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     remove(buffer);
     sprintf(buffer, "%s%c%04d_phar_conf",
-      ti->od.align.filter_conf_dir, SEPARATOR,
-      ti->od.al.mol_info[template_object_num]->object_id);
+      ti->od->align.filter_conf_dir, SEPARATOR,
+      ti->od->al.mol_info[template_object_num]->object_id);
     remove_recursive(buffer);
   }
   free_proc_env(prog_exe_info.proc_env);
   
-  #ifndef WIN32
-  pthread_exit(pointer);
-  #else
   return 0;
-  #endif
 }    
 
 
@@ -1051,11 +929,11 @@ int filter_inter_thread(void *pointer)
   FileDescriptor filter_log_fd;
   FileDescriptor score_fd;
   ProgExeInfo prog_exe_info;
-  ThreadInfo *ti;
+  WorkerInfo *ti;
   
   
-  ti = (ThreadInfo *)pointer;
-  ti->od.al.task_list[ti->thread_num]->code = 0;
+  ti = (WorkerInfo *)pointer;
+  ti->od->al.task_list[ti->thread_num]->code = 0;
   memset(buffer, 0, BUF_LEN);
   memset(&prog_exe_info, 0, sizeof(ProgExeInfo));
   memset(&temp_fd, 0, sizeof(FileDescriptor));
@@ -1063,16 +941,12 @@ int filter_inter_thread(void *pointer)
   memset(&multi_phar_conf_fd, 0, sizeof(FileDescriptor));
   memset(&filter_log_fd, 0, sizeof(FileDescriptor));
   memset(&score_fd, 0, sizeof(FileDescriptor));
-  prog_exe_info.exedir = ti->od.align.pharao_exe_path;
+  prog_exe_info.exedir = ti->od->align.pharao_exe_path;
   if (!(prog_exe_info.proc_env = fill_env
-    (&(ti->od), babel_env, ti->od.align.pharao_exe_path, 0))) {
-    O3_ERROR_LOCATE(ti->od.al.task_list[ti->thread_num]);
-    ti->od.al.task_list[ti->thread_num]->code = FL_OUT_OF_MEMORY;
-    #ifndef WIN32
-    pthread_exit(pointer);
-    #else
+    (ti->od, babel_env, ti->od->align.pharao_exe_path, 0))) {
+    O3_ERROR_LOCATE(ti->od->al.task_list[ti->thread_num]);
+    ti->od->al.task_list[ti->thread_num]->code = FL_OUT_OF_MEMORY;
     return 0;
-    #endif
   }
   prog_exe_info.stdout_fd = &temp_fd;
   prog_exe_info.stderr_fd = &temp_fd;
@@ -1087,49 +961,49 @@ int filter_inter_thread(void *pointer)
   n_conf_overall = ti->data[DATA_N_CONF_OVERALL];
   j = 0;
   while ((j < n_conf_overall) && n_retained_conf) {
-    while (ti->od.al.phar_conf_list[j]->delete) {
+    while (ti->od->al.phar_conf_list[j]->delete) {
       ++j;
     }
     --n_retained_conf;
     ++j;
   }
-  template_object_num = ti->od.al.phar_conf_list[n_conf]->object_num;
-  template_conf_num = ti->od.al.phar_conf_list[n_conf]->conf_num;
-  ti->od.al.task_list[ti->thread_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
-  ti->od.al.task_list[ti->thread_num]->data[TEMPLATE_CONF_NUM] = template_conf_num;
+  template_object_num = ti->od->al.phar_conf_list[n_conf]->object_num;
+  template_conf_num = ti->od->al.phar_conf_list[n_conf]->conf_num;
+  ti->od->al.task_list[ti->thread_num]->data[TEMPLATE_OBJECT_NUM] = template_object_num;
+  ti->od->al.task_list[ti->thread_num]->data[TEMPLATE_CONF_NUM] = template_conf_num;
   sprintf(multi_phar_conf_fd.name, "%s%cmulti_phar_conf_t%02d.phar",
-    ti->od.align.align_scratch, SEPARATOR, ti->thread_num);
+    ti->od->align.align_scratch, SEPARATOR, ti->thread_num);
   sprintf(temp_fd.name, "%s%cmulti_phar_compare_t%02d.log",
-    ti->od.align.align_scratch, SEPARATOR, ti->thread_num);
+    ti->od->align.align_scratch, SEPARATOR, ti->thread_num);
   sprintf(score_fd.name, "%s%cphar_compare_t%02d.scores",
-    ti->od.align.align_scratch, SEPARATOR, ti->thread_num);
+    ti->od->align.align_scratch, SEPARATOR, ti->thread_num);
   sprintf(single_phar_conf_fd.name, "%s%c%04d_phar_conf%c%04d_%06d.phar",
-    ti->od.align.filter_conf_dir,
-    SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
-    SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
+    ti->od->align.filter_conf_dir,
+    SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
+    SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
     template_conf_num + 1);
   for (run = 0; (!error) && (run < n_runs); ++run) {
     remove(multi_phar_conf_fd.name);
     j_start = j;
     for (i = 0, n_appended = 0; (!error) && (j < n_conf_overall)
       && (i < (n_calc_per_run + ((run == (n_runs - 1)) ? n_calc_excess : 0))); ++i, ++j) {
-      while ((j < n_conf_overall) && (ti->od.al.phar_conf_list[j]->delete)) {
+      while ((j < n_conf_overall) && (ti->od->al.phar_conf_list[j]->delete)) {
         ++j;
       }
       if ((j == n_conf_overall) || (n_conf == j)) {
         continue;
       }
-      template_object_num = ti->od.al.phar_conf_list[j]->object_num;
-      template_conf_num = ti->od.al.phar_conf_list[j]->conf_num;
+      template_object_num = ti->od->al.phar_conf_list[j]->object_num;
+      template_conf_num = ti->od->al.phar_conf_list[j]->conf_num;
       sprintf(buffer, "%s%c%04d_phar_conf%c%04d_%06d.phar",
-        ti->od.align.filter_conf_dir,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
-        SEPARATOR, ti->od.al.mol_info[template_object_num]->object_id,
+        ti->od->align.filter_conf_dir,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
+        SEPARATOR, ti->od->al.mol_info[template_object_num]->object_id,
         template_conf_num + 1);
       if (!fcopy(buffer, multi_phar_conf_fd.name, "ab")) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[ti->thread_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[ti->thread_num], multi_phar_conf_fd.name);
-        ti->od.al.task_list[ti->thread_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[ti->thread_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[ti->thread_num], multi_phar_conf_fd.name);
+        ti->od->al.task_list[ti->thread_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
         error = 1;
         continue;
       }
@@ -1141,22 +1015,22 @@ int filter_inter_thread(void *pointer)
     if (n_appended) {
       sprintf(prog_exe_info.command_line,
         "%s -q -r %s --refType PHAR -d %s --dbType PHAR -s %s",
-        ti->od.align.pharao_exe, single_phar_conf_fd.name,
+        ti->od->align.pharao_exe, single_phar_conf_fd.name,
         multi_phar_conf_fd.name, score_fd.name);
-      pid = ext_program_exe(&prog_exe_info, &(ti->od.al.task_list[ti->thread_num]->code));
+      pid = ext_program_exe(&prog_exe_info, &(ti->od->al.task_list[ti->thread_num]->code));
       ext_program_wait(&prog_exe_info, pid);
       /*
       check if the Pharao computation was OK
       */
       if (!(temp_fd.handle = fopen(temp_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[ti->thread_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[ti->thread_num], temp_fd.name);
-        ti->od.al.task_list[ti->thread_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+        O3_ERROR_LOCATE(ti->od->al.task_list[ti->thread_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[ti->thread_num], temp_fd.name);
+        ti->od->al.task_list[ti->thread_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
         error = 1;
       }
       else if (fgrep(temp_fd.handle, buffer, "Error")) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[ti->thread_num]);
-        ti->od.al.task_list[ti->thread_num]->code = FL_PHARAO_ERROR;
+        O3_ERROR_LOCATE(ti->od->al.task_list[ti->thread_num]);
+        ti->od->al.task_list[ti->thread_num]->code = FL_PHARAO_ERROR;
         error = 1;
       }
       if (temp_fd.handle) {
@@ -1171,9 +1045,9 @@ int filter_inter_thread(void *pointer)
       check the Pharao scores
       */
       if (!(score_fd.handle = fopen(score_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[ti->thread_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[ti->thread_num], score_fd.name);
-        ti->od.al.task_list[ti->thread_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
+        O3_ERROR_LOCATE(ti->od->al.task_list[ti->thread_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[ti->thread_num], score_fd.name);
+        ti->od->al.task_list[ti->thread_num]->code = FL_CANNOT_READ_PHARAO_OUTPUT;
         error = 1;
         continue;
       }
@@ -1182,15 +1056,15 @@ int filter_inter_thread(void *pointer)
         sscanf(buffer, "%*s %*s %*s %*s %*s %*s %*s %*s %lf %lf %lf",
           &tanimoto, &tversky_ref, &tversky_db);
         while ((i < n_conf_overall)
-          && ((ti->od.al.phar_conf_list[i]->delete) || (i == n_conf))) {
+          && ((ti->od->al.phar_conf_list[i]->delete) || (i == n_conf))) {
           ++i;
         }
         if (i == n_conf_overall) {
           break;
         }
-        if ((tanimoto > ti->od.align.level)
-          || (tversky_db > ti->od.align.level)) {
-          ti->od.al.phar_conf_list[i]->delete = 1;
+        if ((tanimoto > ti->od->align.level)
+          || (tversky_db > ti->od->align.level)) {
+          ti->od->al.phar_conf_list[i]->delete = 1;
         }
         ++i;
       }
@@ -1199,9 +1073,5 @@ int filter_inter_thread(void *pointer)
   }
   free_proc_env(prog_exe_info.proc_env);
   
-  #ifndef WIN32
-  pthread_exit(pointer);
-  #else
   return 0;
-  #endif
 }    
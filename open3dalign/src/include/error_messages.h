@@ -135,7 +135,7 @@ char E_ERROR_IN_READING_SDF_FILE[] =
 char E_ERROR_IN_WRITING_SDF_FILE[] =
   "Cannot write SDF file \"%s\".\n%s";
 char E_ERROR_IN_READING_CONF_FILE[] =
-  "Cannot read SDF conformational database \"%s\".\n%s";
+  "Cannot read conformational database \"%s\".\n%s";
 char E_ERROR_IN_FINDING_CONF[] =
   "Cannot find required conformation in the "
   "SDF conformational database \"%s\".\n%s";
@@ -265,6 +265,8 @@ char ALIGN_FAILED[] =
   "ALIGN failed.\n";
 char COMPARE_FAILED[] =
   "COMPARE failed.\n";
+char CONF_DB_FAILED[] =
+  "CONF_DB failed.\n";
 char FILTER_FAILED[] =
   "FILTER failed.\n";
 char SET_FAILED[] =
@@ -262,6 +262,29 @@ O3KeywordData keyword_data[] =
         }
       }
     }
+  }, {
+    "conf_db",
+    {
+      {
+        O3_PARAM_DIRECTORY, "conf_dir", {
+          NULL
+        }
+      }, {
+        O3_PARAM_FILE, "file", {
+          NULL
+        }
+      }, {
+        O3_PARAM_STRING, "precision", {
+          "DOUBLE",
+          "SINGLE",
+          NULL
+        }
+      }, {  // this is the terminator
+        0, NULL, {
+          NULL
+        }
+      }
+    }
   }, {
     "dataset",
     {
@@ -50,6 +50,7 @@ E-mail: paolo.tosco@unito.it
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <time.h>
@@ -67,6 +68,7 @@ E-mail: paolo.tosco@unito.it
 #include <termios.h>
 #include <fnmatch.h>
 #include <sys/socket.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #else
@@ -106,6 +108,10 @@ E-mail: paolo.tosco@unito.it
 #include <sunperf.h>
 #endif
 #include <zlib.h>
+#if (defined HAVE_LIBZSTD) && (defined HAVE_ZSTD_H)
+#include <zstd.h>
+#define O3_HAVE_ZSTD
+#endif
 #ifdef HAVE_MINIZIP_ZIP_H
 #include <minizip/zip.h>
 #endif
@@ -125,6 +131,12 @@ E-mail: paolo.tosco@unito.it
 #ifndef INFINITY
 #define INFINITY      HUGE_VAL
 #endif
+#if (defined __GNUC__) && ((defined __x86_64__) || (defined __i386__))
+#define O3_AVX2_KERNELS
+#if (__GNUC__ >= 5) || (defined __clang__)
+#define O3_AVX512_KERNELS
+#endif
+#endif
 #define O3_ERROR_LOCATE(task)    (task)->line = __LINE__; \
           strcpy((task)->file, __FILE__); \
           strcpy((task)->func, __PRETTY_FUNCTION__)
@@ -276,6 +288,7 @@ E-mail: paolo.tosco@unito.it
 #define ERROR_IN_ALIGNMENT    441
 #define ERROR_MERGING_FILES    442
 #define CANNOT_READ_ORIGINAL_SDF  450
+#define CANNOT_WRITE_CONF_DB    451
 #define CANNOT_WRITE_ALIGNED_SDF  460
 #define CANNOT_WRITE_ROTOTRANSED_SDF  461
 #define N_ATOM_BOND_MISMATCH    470
@@ -331,6 +344,10 @@ E-mail: paolo.tosco@unito.it
 #define DATA_BEST_OBJECT_NUM    1
 #define DATA_N_CONF      0
 #define DATA_N_CONF_OVERALL    1
+#define DATA_N_STARTS      0
+#define DATA_N_PRUNED_STARTS    1
+#define DATA_N_PRUNED_THRESHOLDS  2
+#define DATA_N_STOLEN_TASKS    3
 #define DELETED_CONF      1
 #define DELETE_CANDIDATE_CONF    2
 #define TEMPLATE_DB      0
@@ -527,7 +544,7 @@ E-mail: paolo.tosco@unito.it
 #define MAX_NAME_LEN      32
 #define MAX_FUNC_LEN      64
 #define MAX_VAR_BUF      2
-#define MAX_THREADS      32
+#define MAX_THREADS      1024
 #define MAX_BONDS      10
 #define MAX_FF_N      2
 #define MAX_FF_PARM      4
@@ -573,10 +590,56 @@ E-mail: paolo.tosco@unito.it
 #define MAX_CONF_PER_PHARAO_RUN    1000
 #define SDM_THRESHOLD_START    0.7
 #define SDM_THRESHOLD_STEP    0.3
+#define SDM_CELL_SIZE      (SDM_THRESHOLD_START + 2.0 * SDM_THRESHOLD_STEP)
+#define MAX_CELLS_PER_ATOM    8
+#define CELL_LIST_MARGIN    1.0e-06
+#define DIST_CACHE_DEFAULT_MB    256
+#define CONF_STORE_DEFAULT_MB    1024
+#define SDF_READER_MMAP    0
+#define SDF_READER_STDIO    1
+#define MOL_TEMPLATE_FIXED    0
+#define MOL_TEMPLATE_LINE    1
+#define SDF_IMPORT_MIN_CHUNK    1048576
+#define SDF_STREAM_NONE      0
+#define SDF_STREAM_GZIP      1
+#define SDF_STREAM_ZSTD      2
+#define SDF_STREAM_BLOCK_SIZE    1048576
+#define SDF_STREAM_GZIP_BUFFER    131072
+#define SDF_STREAM_GZIP_LEVEL    6
+#define SDF_STREAM_ZSTD_LEVEL    3
+#define SDF_STREAM_MAX_COMPRESSORS  2
+#define CONF_DB_MAGIC      "O3ACONF"
+#define CONF_DB_VERSION      1
+#define CONF_DB_ALIGN      64
+#define SCORE_INDEX_MAGIC    "O3AIDX"
+#define SCORE_INDEX_VERSION    2
+#define SCORE_INDEX_EXTENSION    ".idx"
+#define SCORE_INDEX_O3A      0
+#define SCORE_INDEX_PHARAO    1
+#define SDM_MEMO_SIZE      256
+#define SDM_MEMO_MAX_PROBES    8
+#define CACHE_LINE_SIZE      64
+#define TASK_QUEUE_STRIDE    (CACHE_LINE_SIZE / sizeof(long))
+#define TASK_DEQUE_STRIDE    (CACHE_LINE_SIZE / sizeof(uint64_t))
+#define MAX_POOL_PHASES      16
+#define ORDERED_WRITER_MAX_BUFFERED  268435456
+#define ARENA_ALIGN      16
+#define ARENA_HEADER_SIZE    ((sizeof(ArenaBlock) + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN)
+#define ARENA_BLOCK_SIZE    65536
+#define CONF_BATCH_SIZE    SIMD_WIDTH
+#define SHARD_RECORD      0
+#define SHARD_TASK      1
+#define SHARD_STATS      2
+#define SHARD_DONE      3
+#define SHARD_N_STATS      (MAX_DATA_FIELDS + 6)
+#define QCP_MAX_ITERATIONS    50
+#define QCP_THRESHOLD      1.0e-11
+#define QCP_DEGENERATE_THRESHOLD  1.0e-14
 #define ALIGN_GOLD_COEFFICIENT    1.2
 #define O3_SCORING_FUNCTION_ALPHA  5.0
 #define O3_SCORING_FUNCTION_BETA  0.5
 #define O3_CHARGE_COEFF      5.0
+#define SCORE_BOUND_SLACK    1.0e-09
 #define THRESHOLD_DIFF_DISTANCE    0.1
 #define THRESHOLD_SIMMETRY_COST    100
 #define GRID_TOLERANCE      0.0001
@@ -800,11 +863,19 @@ E-mail: paolo.tosco@unito.it
 #define DONT_USE_WEIGHTS    0
 #define USE_MMFF_WEIGHTS    1
 #define USE_CHARGE_WEIGHTS    2
+#define SUPERPOSE_QCP      0
+#define SUPERPOSE_DSYEV    1
+#define H_ELEMENT_CODE    'H'
+#define SIMD_NONE      0
+#define SIMD_AVX2      1
+#define SIMD_AVX512      2
+#define SIMD_WIDTH      8
 
 
 typedef struct CLIArgs CLIArgs;
 typedef struct O3Data O3Data;
 typedef struct ThreadInfo ThreadInfo;
+typedef struct WorkerInfo WorkerInfo;
 typedef struct GridInfo GridInfo;
 typedef struct CharMat CharMat;
 typedef struct IntMat IntMat;
@@ -842,6 +913,35 @@ typedef struct TemplateInfo TemplateInfo;
 typedef struct LAPInfo LAPInfo;
 typedef struct QMDInfo QMDInfo;
 typedef struct ConfInfo ConfInfo;
+typedef struct ConfBatch ConfBatch;
+typedef struct ConfStore ConfStore;
+typedef struct ConfDbHeader ConfDbHeader;
+typedef struct ConfDbObject ConfDbObject;
+typedef struct ConfDb ConfDb;
+typedef struct SdfReader SdfReader;
+typedef struct SdfImport SdfImport;
+typedef struct SdfImportRecord SdfImportRecord;
+typedef struct SdfStream SdfStream;
+typedef struct SdfStreamBlock SdfStreamBlock;
+typedef struct SdfCompressor SdfCompressor;
+typedef struct MolTemplate MolTemplate;
+typedef struct MolTemplateSet MolTemplateSet;
+typedef struct ScoreIndexHeader ScoreIndexHeader;
+typedef struct ScoreIndexEntry ScoreIndexEntry;
+typedef struct CellList CellList;
+typedef struct SDMMemo SDMMemo;
+typedef struct TaskQueue TaskQueue;
+typedef struct TaskCost TaskCost;
+typedef struct TaskScheduler TaskScheduler;
+typedef struct PoolPhaseStats PoolPhaseStats;
+typedef struct PoolThread PoolThread;
+typedef struct WorkerPool WorkerPool;
+typedef struct OrderedRecord OrderedRecord;
+typedef struct OrderedWriter OrderedWriter;
+typedef struct ShardMessage ShardMessage;
+typedef struct ArenaBlock ArenaBlock;
+typedef struct ArenaConf ArenaConf;
+typedef struct Arena Arena;
 typedef struct EnvList EnvList;
 typedef struct CationList CationList;
 typedef struct FFDSELInfo FFDSELInfo;
@@ -1041,6 +1141,8 @@ struct AlignInfo {
   int n_tasks;
   int max_iter;
   int max_fail;
+  int n_shards;
+  int compression;
   double level;
   double gold;
 };
@@ -1061,6 +1163,12 @@ struct LAPInfo {
   int *array[O3_MAX_SLOT];
   int **cost;
   double **diff;
+  double **h_cost;
+  double **charge_diff;
+  double **score_pref;
+  double *h_t;
+  double *h_sum;
+  double *score_buf;
 };
 
 struct NodeInfo {
@@ -1120,9 +1228,467 @@ struct ConfInfo {
   int n_conf;
   int n_atoms;
   int n_heavy_atoms;
+  int *heavy_atom;
+  int *heavy_index;
+  int *element;
   int **h;
   double *coord;
   double energy;
+  CellList *cell_list;
+  int dist_size;
+  int dist_valid;
+  double *dist;
+};
+
+struct ConfBatch {
+  int n_k;
+  int n_atoms;
+  int n_heavy_atoms;
+  int n_template_heavy_atoms;
+  int *heavy_atom;
+  double *coord;
+  double *dist;
+  double *h;
+  double *h_cost;
+};
+
+struct ConfStore {
+  char name[BUF_LEN];
+  int n_objects;
+  int mapped;
+  int *n_atoms;
+  int *n_conf;
+  size_t *offset;
+  size_t size;
+  double *coord;
+  ConfDb *db;
+  #ifdef WIN32
+  HANDLE hFile;
+  HANDLE hMapHandle;
+  #endif
+};
+
+/*
+binary conformational database: the header is followed
+by the object table, by the per-conformer index of byte
+offsets from the beginning of the file and by the
+coordinates themselves, stored in native byte order as
+float64 or float32 triplets; all sections are aligned
+to CONF_DB_ALIGN bytes so that the file can be mmap'ed
+*/
+struct ConfDbHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t coord_size;
+  uint32_t n_objects;
+  uint32_t reserved;
+  uint64_t n_confs;
+  uint64_t object_offset;
+  uint64_t index_offset;
+  uint64_t coord_offset;
+  uint64_t size;
+};
+
+struct ConfDbObject {
+  int32_t object_id;
+  int32_t n_atoms;
+  int32_t n_bonds;
+  int32_t n_conf;
+  uint64_t first_conf;
+};
+
+struct ConfDb {
+  char name[BUF_LEN];
+  char *base;
+  size_t size;
+  ConfDbHeader *header;
+  ConfDbObject *object;
+  ConfDbObject **sorted;
+  uint64_t *index;
+  #ifdef WIN32
+  HANDLE hFile;
+  HANDLE hMapHandle;
+  #endif
+};
+
+/*
+sidecar index of an aligned SDF file; it is only trusted
+if the size and modification time of the SDF file still
+match those recorded in the header
+*/
+struct ScoreIndexHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t score_type;
+  int32_t n_objects;
+  int32_t reserved;
+  int64_t sdf_size;
+  int64_t sdf_mtime;
+};
+
+/*
+offset is the position of a record in the decoded
+contents of the SDF file; in compressed files, the
+record lies in the gzip member or zstd frame which
+begins at member_offset in the file and at
+member_start in the decoded contents
+*/
+struct ScoreIndexEntry {
+  double score;
+  int64_t offset;
+  int64_t member_offset;
+  int64_t member_start;
+  int32_t best_template_id;
+  int32_t best_conf_num;
+  int32_t has_score;
+  int32_t reserved;
+};
+
+/*
+sequential reader of SDF conformational databases; either
+base points to the whole memory-mapped file and pos is the
+offset of the next record, or handle is a regular FILE
+*/
+struct SdfReader {
+  char *base;
+  size_t size;
+  size_t pos;
+  int inflated;
+  FILE *handle;
+  #ifdef WIN32
+  HANDLE hFile;
+  HANDLE hMapHandle;
+  #endif
+};
+
+/*
+a block of data to be written to an SdfStream,
+and its compressed counterpart
+*/
+struct SdfStreamBlock {
+  char *data;
+  size_t size;
+  char *out;
+  size_t out_size;
+  size_t max_out_size;
+  int compression;
+  int result;
+  int done;
+  SdfStreamBlock *next;
+};
+
+/*
+a fixed set of threads which compress SdfStream blocks
+queued by any number of streams; they are started once
+and stay idle between flushes
+*/
+struct SdfCompressor {
+  int n_threads;
+  int shutdown;
+  SdfStreamBlock *head;
+  SdfStreamBlock *tail;
+  #ifndef WIN32
+  pthread_mutex_t mutex;
+  pthread_cond_t work_cond;
+  pthread_cond_t done_cond;
+  pthread_t *thread_id;
+  #else
+  CRITICAL_SECTION mutex;
+  CONDITION_VARIABLE work_cond;
+  CONDITION_VARIABLE done_cond;
+  HANDLE *thread_handle;
+  #endif
+};
+
+/*
+a plain, gzip- or zstd-compressed SDF file; reads go
+through a buffer of decoded data which starts at
+offset in the decoded contents and never spans two
+gzip members or zstd frames: the current one starts
+at member_offset in the file (in_offset is that of
+the in buffer) and at member_start in the decoded
+contents. Writes go through n_blocks blocks which are
+compressed at once by the calling thread and
+compressor, each into a member whose file and
+decoded offsets are kept in member
+*/
+struct SdfStream {
+  int compression;
+  int writing;
+  int n_blocks;
+  int n_full;
+  int member_end;
+  int n_members;
+  int max_n_members;
+  int64_t offset;
+  int64_t in_offset;
+  int64_t member_offset;
+  int64_t member_start;
+  int64_t next_member_offset;
+  int64_t out_offset;
+  int64_t out_start;
+  int64_t *member;
+  size_t buf_pos;
+  size_t buf_len;
+  size_t in_pos;
+  size_t in_size;
+  size_t max_in_size;
+  char *buf;
+  char *in;
+  FILE *handle;
+  z_stream *gz_handle;
+  #ifdef O3_HAVE_ZSTD
+  ZSTD_DStream *zstd_handle;
+  #endif
+  SdfStreamBlock *block;
+  SdfCompressor *compressor;
+};
+
+/*
+an SDF file split into records which are accessed in
+place; offsets are relative to the beginning of the
+mapped file, and mol_size is the length of the MOL
+section of a record, i.e. up to and including "M  END"
+*/
+struct SdfImportRecord {
+  size_t offset;
+  size_t size;
+  size_t atom_offset;
+  size_t mol_size;
+  int n_atoms;
+  int n_bonds;
+  int sdf_version;
+  int result;
+};
+
+struct SdfImport {
+  char name[BUF_LEN];
+  char mol_dir[BUF_LEN];
+  int n_chunks;
+  int n_records;
+  int *chunk_n;
+  size_t **chunk_end;
+  SdfImportRecord *record;
+  SdfReader reader;
+};
+
+/*
+an object's MOL block held in memory with '\n' line
+endings; line_offset[i] is where the line of atom i
+begins (line_offset[n_atoms] is where the atom block
+ends), and fixed is set if all atom lines are V2000
+ones holding their three 10-character coordinate fields
+*/
+struct MolTemplate {
+  char *block;
+  size_t size;
+  size_t *line_offset;
+  int n_atoms;
+  int sdf_version;
+  int fixed;
+  int result;
+};
+
+struct MolTemplateSet {
+  char mol_dir[BUF_LEN];
+  int n_objects;
+  size_t max_size;
+  SdfImport *si;
+  MolTemplate *mol;
+};
+
+struct CellList {
+  int n_cells[3];
+  int max_cells;
+  int max_atoms;
+  int max_pairs;
+  int *cell_start;
+  int *cell_atom;
+  int *bucket;
+  AtomPair *accepted;
+  double origin[3];
+  double cell_size;
+};
+
+struct SDMMemo {
+  int generation;
+  int query_pairs;
+  int hits;
+  int misses;
+  unsigned int query_hash;
+  int *query;
+  int *slot_generation;
+  int *n_key;
+  int *n_pairs;
+  int *weight;
+  int *threshold_iter;
+  unsigned int *hash;
+  int **key;
+  AtomPair **sdm;
+  double *score;
+  double **coord;
+};
+
+struct TaskQueue {
+  int n_phases;
+  int n_tasks;
+  #ifndef WIN32
+  volatile long *next;
+  #else
+  volatile LONG *next;
+  #endif
+};
+
+struct TaskCost {
+  int task;
+  double cost;
+};
+
+struct TaskScheduler {
+  int max_n_workers;
+  int n_workers;
+  int n_tasks;
+  int *task;
+  #ifndef WIN32
+  volatile uint64_t *range;
+  #else
+  volatile LONGLONG *range;
+  #endif
+};
+
+struct PoolPhaseStats {
+  char name[MAX_NAME_LEN];
+  int n_runs;
+  int n_thread_runs;
+  double wall_time;
+  double busy_time;
+  double wait_time;
+  double max_wait_time;
+};
+
+struct PoolThread {
+  int index;
+  int generation;
+  double wait_time;
+  double busy_time;
+  WorkerPool *pool;
+  #ifndef WIN32
+  pthread_t thread_id;
+  #else
+  DWORD thread_id;
+  HANDLE thread_handle;
+  #endif
+};
+
+struct WorkerPool {
+  int n_threads;
+  int max_n_threads;
+  int n_cpus_online;
+  int pin;
+  int n_pinned;
+  int shutdown;
+  int generation;
+  int n_active;
+  int n_running;
+  int n_phases;
+  void *thread_func;
+  WorkerInfo **worker_info;
+  PoolThread **thread;
+  struct timeval dispatch_time;
+  PoolPhaseStats phase[MAX_POOL_PHASES];
+  #ifndef WIN32
+  pthread_mutex_t mutex;
+  pthread_cond_t start_cond;
+  pthread_cond_t done_cond;
+  #else
+  CRITICAL_SECTION mutex;
+  CONDITION_VARIABLE start_cond;
+  CONDITION_VARIABLE done_cond;
+  #endif
+};
+
+/*
+a record whose data was moved to the spill
+file of its writer is found at spill_offset
+*/
+struct OrderedRecord {
+  int group;
+  int slot;
+  int spilled;
+  int64_t spill_offset;
+  size_t size;
+  char *data;
+  FILE *handle;
+  OrderedRecord *next;
+};
+
+struct OrderedWriter {
+  int n_groups;
+  int n_slots;
+  int n_buffered;
+  int max_n_buffered;
+  int n_spilled;
+  int n_spilled_total;
+  size_t buffered_size;
+  size_t max_buffered_size;
+  int64_t spill_size;
+  FILE *spill;
+  int error_group;
+  int error_slot;
+  int forward_fd;
+  int running;
+  int shutdown;
+  int score_type;
+  int n_compressors;
+  int *next_slot;
+  int64_t *written;
+  char **name;
+  ScoreIndexEntry **entry;
+  SdfStream **stream;
+  SdfCompressor *compressor;
+  OrderedRecord ***pending;
+  OrderedRecord *head;
+  OrderedRecord *tail;
+  #ifndef WIN32
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t thread_id;
+  #else
+  CRITICAL_SECTION mutex;
+  CONDITION_VARIABLE cond;
+  DWORD thread_id;
+  HANDLE thread_handle;
+  #endif
+};
+
+struct ShardMessage {
+  int type;
+  int group;
+  int slot;
+  int code;
+  size_t size;
+};
+
+struct ArenaBlock {
+  size_t size;
+  size_t used;
+  ArenaBlock *next;
+};
+
+struct ArenaConf {
+  ConfInfo conf;
+  ArenaConf *next;
+};
+
+struct Arena {
+  size_t block_size;
+  size_t used;
+  size_t peak;
+  long n_allocs;
+  long n_blocks;
+  long n_resets;
+  ArenaBlock *head;
+  ArenaConf *conf_head;
 };
 
 struct PyMOLInfo {
@@ -1288,7 +1854,16 @@ struct MemList {
   #else
   HANDLE *mutex;
   #endif
+  TaskQueue *task_queue;
+  TaskScheduler *task_scheduler;
+  OrderedWriter *ordered_writer;
+  ConfStore *conf_store[2];
+  SdfImport *sdf_import[2];
+  MolTemplateSet *mol_template;
   ThreadInfo *thread_info[MAX_THREADS];
+  WorkerInfo **worker_info;
+  int n_workers;
+  WorkerPool *worker_pool;
   unsigned char *ffdsel_status;
   char *ffdsel_included;
   char *uvepls_included;
@@ -1537,12 +2112,38 @@ struct ThreadInfo {
   O3Data od_comp;
 };
 
+struct WorkerInfo {
+  int thread_num;
+  int n_calc;
+  int start;
+  int end;
+  int model_type;
+  int data[MAX_DATA_FIELDS];
+  TaskInfo task_info;
+  O3Data *od;
+  O3Data *od_comp;
+  #ifndef WIN32
+  pthread_t thread_id;
+  void *thread_result;
+  #else
+  DWORD thread_id;
+  HANDLE thread_handle;
+  #endif
+};
+
 
 void absolute_path(char *string);
 int add_to_list(IntPerm **list, int elem);
+void add_arena_stats(long n_allocs, long n_blocks, long n_resets, size_t peak);
+void add_sdm_memo_stats(int hits, int misses);
 int align_iterative(O3Data *od);
 int align_random(O3Data *od);
 int align(O3Data *od);
+void *arena_alloc(Arena *ar, size_t size);
+void **arena_alloc_array(Arena *ar, int n, size_t size);
+ConfInfo *arena_alloc_conf(Arena *ar, int n_atoms);
+int arena_alloc_conf_batch(Arena *ar, ConfBatch *cb, int max_n_atoms, int max_n_heavy_atoms);
+int arena_alloc_lap_info(Arena *ar, LAPInfo *li, int max_n_atoms);
 #ifndef WIN32
 void *align_atombased_thread(void *pointer);
 void *align_single_pharao_thread(void *pointer);
@@ -1555,18 +2156,26 @@ DWORD align_multi_pharao_thread(void *pointer);
 int alignment_exists(O3Data *od, FileDescriptor *sdf_fd);
 char **alloc_array(int n, int size);
 CharMat *alloc_char_matrix(CharMat *old_char_mat, int m, int n);
+Arena *alloc_arena(size_t block_size);
 ConfInfo *alloc_conf(int n_atoms);
+int alloc_conf_dist(ConfInfo *conf);
 int alloc_average_mat(O3Data *od, int model_type, int cv_type, int groups, int runs);
 int alloc_cv_sdep(O3Data *od, int pc_num, int runs);
 int alloc_file_descriptor(O3Data *od, int file_num);
 int *alloc_int_array(int *old_ptr, int places);
 IntMat *alloc_int_matrix(IntMat *old_int_mat, int m, int n);
 int alloc_lap_info(LAPInfo *li, int max_n_atoms);
+int alloc_sdm_memo(SDMMemo *memo, int max_n_heavy_atoms, int max_n_atoms);
+TaskQueue *alloc_task_queue(int n_phases, int n_tasks);
+TaskScheduler *alloc_task_scheduler(int max_n_workers, int n_tasks, double *cost);
 int alloc_object_attr(O3Data *od, int start);
+OrderedWriter *alloc_ordered_writer(int n_groups, int n_slots);
 int alloc_pls(O3Data *od, int x_vars, int pc_num, int model_type);
+SdfCompressor *alloc_sdf_compressor(int n_threads);
 int prepare_scrambling(O3Data *od);
 int alloc_threads(O3Data *od);
 int alloc_voronoi(O3Data *od, int places);
+int alloc_workers(O3Data *od);
 int alloc_x_var_array(O3Data *od, int num_fields);
 int alloc_y_var_array(O3Data *od);
 int autoscale_field(O3Data *od);
@@ -1576,6 +2185,8 @@ void average_y_var(O3Data *od);
 int bond_in_aromatic_ring(RingInfo **ring, int *a);
 int break_sdf_to_mol(O3Data *od, TaskInfo *task, FileDescriptor *from_fd, char *to_dir);
 int break_sdf_to_sdf(O3Data *od, TaskInfo *task, FileDescriptor *from_fd, char *to_dir);
+int build_cell_list(ConfInfo *conf, double cell_size);
+int build_score_index(char *sdf_name, int score_type);
 int calc_active_vars(O3Data *od, int model_type);
 void calc_conf_centroid(ConfInfo *conf, double *centroid);
 double calc_delta_ij(O3Data *od, DoubleMat *dispersion_mat, int i, int j);
@@ -1603,6 +2214,7 @@ int calc_y_values(O3Data *od, int options);
 int check_babel(O3Data *od, char *bin);
 int check_bond_type(AtomInfo **atom, int *tinker_types, int *a, int i, BondInfo *bond_info, int value);
 int check_conf_db(O3Data *od, char *conf_dir, int type, int *wrong_object_id, int *wrong_conf_num);
+int check_conf_db_file(O3Data *od, char *name, int type, int *wrong_object_num, int *wrong_conf_num);
 int check_define(O3Data *od, char *bin);
 int check_duplicate_parameter(int **max_vary, int *parameter);
 int check_file_pattern(FILE *handle, char *file_pattern, int object_num);
@@ -1611,7 +2223,12 @@ int check_mmap(O3Data *od, int field_num);
 int check_pharao(O3Data *od, char *bin);
 void *check_readline();
 int check_regex_name(char *regex_name, int n_regex);
+int claim_task(TaskQueue *tq, int phase);
+void close_conf_db(ConfDb *db);
+void close_sdf_reader(SdfReader *sr);
+int close_sdf_stream(SdfStream *ss);
 void close_files(O3Data *od, int from);
+int combine_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, int coeff, int options);
 int compare(O3Data *od, O3Data *od_comp, int type, int verbose);
 #ifndef WIN32
 void *compare_thread(void *pointer);
@@ -1629,12 +2246,43 @@ int compare_regex_data(const void *a, const void *b);
 int compare_score(const void *a, const void *b);
 int compare_template_score(const void *a, const void *b);
 int compare_seed_dist(const void *a, const void *b);
+int compare_task_cost(const void *a, const void *b);
+void compute_charge_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf);
+void compute_conf_batch_h(ConfBatch *cb);
+#ifdef O3_AVX2_KERNELS
+void compute_conf_batch_h_avx2(ConfBatch *cb);
+#endif
+#ifdef O3_AVX512_KERNELS
+void compute_conf_batch_h_avx512(ConfBatch *cb);
+#endif
+void compute_conf_batch_h_cost(ConfBatch *cb, ConfInfo *template_conf, int n_bins);
+#ifdef O3_AVX2_KERNELS
+void compute_conf_batch_h_cost_avx2(ConfBatch *cb, ConfInfo *template_conf, int n_bins);
+#endif
+#ifdef O3_AVX512_KERNELS
+void compute_conf_batch_h_cost_avx512(ConfBatch *cb, ConfInfo *template_conf, int n_bins);
+#endif
 void compute_conf_h(ConfInfo *conf);
+#ifdef O3_AVX2_KERNELS
+void compute_conf_h_avx2(ConfInfo *conf, double *cache);
+#endif
+#ifdef O3_AVX512_KERNELS
+void compute_conf_h_avx512(ConfInfo *conf, double *cache);
+#endif
 int compute_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, int n_bins, int coeff, int options);
+void compute_h_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, int n_bins);
+#ifdef O3_AVX2_KERNELS
+void compute_h_sum_avx2(int *template_h, double *moved_h_t, int stride, int n_moved, int n_bins, double *h_sum);
+#endif
+#ifdef O3_AVX512_KERNELS
+void compute_h_sum_avx512(int *template_h, double *moved_h_t, int stride, int n_moved, int n_bins, double *h_sum);
+#endif
 int convert_mol(O3Data *od, char *from_filename, char *to_filename, char *from_ext, char *to_ext, char *flags);
+int copy_aligned_files(O3Data *od, int template_object_num, int template_conf_num, char *error_filename);
 void copy_plane_to_buffer(O3Data *od, float *float_xy_mat, float *buf_float_xy_mat);
 int create_box(O3Data *od, GridInfo *temp_grid, double outgap, int from_file);
 int create_design_support_matrices(O3Data *od, DoubleMat *candidates_mat, int design_points);
+int create_worker_pool(O3Data *od, int pin);
 int cutoff(O3Data *od, int type, double cutoff);
 int cv(O3Data *od, int suggested_pc_num, int model_type, int cv_type, int groups, int runs);
 void double_mat_sort_clean_exit(DoubleVec **vec_in, DoubleVec **vec_short, DoubleVec **vec_temp, IntPerm *perm, int columns);
@@ -1646,7 +2294,10 @@ void double_mat_free(DoubleMat *double_mat);
 void double_vec_free(DoubleVec *double_vec);
 DoubleVec *double_vec_resize(DoubleVec *double_vec, int size);
 DoubleVec *double_vec_sort(DoubleVec *x, IntPerm *order);
+void deal_scheduled_tasks(TaskScheduler *ts, int n_workers);
 void determine_best_cpu_number(O3Data *od, char *parameter);
+void discard_ordered_record(OrderedRecord *rec);
+int detect_simd_level(void);
 int dexist(char *dirname);
 void double_mat_free(DoubleMat *double_mat);
 DoubleMat *double_mat_resize(DoubleMat *double_mat, int m, int n);
@@ -1654,6 +2305,7 @@ DoubleMat *double_mat_resize(DoubleMat *double_mat, int m, int n);
 void dsyev_(char *jobz, char *uplo, int *n, double *a, int *lda, double *w, double *work, int *lwork, int *info);
 #endif
 void elapsed_time(O3Data *od, struct timeval *start, struct timeval *end);
+int element_code(char *element);
 int energy(O3Data *od);
 #ifndef WIN32
 void *energy_thread(void *pointer);
@@ -1684,6 +2336,7 @@ int fill_numberlist(O3Data *od, int len, int type);
 int fill_tinker_bond_info(O3Data *od, FileDescriptor *inp_fd, AtomInfo **atom, BondList **bond_list, int object_num);
 int fill_tinker_types(AtomInfo **atom);
 int fill_thread_info(O3Data *od, int n_tasks);
+int fill_worker_info(O3Data *od, O3Data *od_comp, int n_tasks);
 int fill_x_matrix_pca(O3Data *od);
 int fill_x_matrix(O3Data *od, int model_type, int use_srd_groups);
 int fill_x_matrix_scrambled(O3Data *od);
@@ -1696,10 +2349,14 @@ int filter_extract_split_phar_thread(void *pointer);
 int filter_inter_thread(void *pointer);
 int filter_intra_thread(void *pointer);
 int filter_sol_vector(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, AtomPair *temp_sdm, AtomPair *sdm);
+int find_aligned_conformation(SdfStream *ss, char *sdf_name, int score_type, int object_num);
 int find_atom_type(O3Data *od, int nb_pos, AtomInfo *atom);
+ConfDbObject *find_conf_db_object(ConfDb *db, int object_id);
 int find_conformation_in_sdf(FILE *handle_in, FILE *handle_out, int conf_num);
+int find_sdf_stream_member(SdfStream *ss, int64_t offset, int64_t *member_offset, int64_t *member_start);
 int find_vary_speed(O3Data *od, char *name_list, int **max_vary, int **vary, int *field_num, int *object_num, VarCoord *varcoord);
 void fix_endianness(void *chunk, int chunk_len, int word_size, int swap_endianness);
+int flush_sdf_stream(SdfStream *ss);
 int fmove(char *filename1, char *filename2);
 void free_cv_groups(O3Data *od, int runs);
 void free_cv_sdep(O3Data *od);
@@ -1707,12 +2364,26 @@ void free_parallel_cv(O3Data *od, ThreadInfo **thread_info, int model_type, int
 void free_pls(O3Data *od);
 void free_array(void *array);
 void free_atom_array(O3Data *od);
+void free_cell_list(CellList *cl);
 void free_char_matrix(CharMat *char_mat);
+void free_arena(Arena *ar);
+void free_conf_store(ConfStore *cs);
 void free_conf(ConfInfo *conf);
+void free_conf_cache(ConfInfo *conf);
 void free_lap_info(LAPInfo *li);
+void free_sdm_memo(SDMMemo *memo);
+void free_sdf_compressor(SdfCompressor *sc);
+void free_sdf_import(SdfImport *si);
+void free_sdf_imports(O3Data *od);
+void free_task_queue(TaskQueue *tq);
+void free_task_scheduler(TaskScheduler *ts);
 void free_mem(O3Data *od);
+void free_mol_templates(O3Data *od);
 void free_node(NodeInfo *fnode, int **path, RingInfo **ring, int n_atoms);
+void free_ordered_writer(OrderedWriter *ow);
 void free_threads(O3Data *od);
+void free_worker_pool(O3Data *od);
+void free_workers(O3Data *od);
 void free_x_var_array(O3Data *od);
 void free_y_var_array(O3Data *od);
 char *get_basename_no_ext(char *filename);
@@ -1737,6 +2408,7 @@ int get_alignment_score(O3Data *od, FileDescriptor *fd, int object_num, double *
 char *get_args(O3Data *od, char *parameter_name);
 void get_attr_struct_ave(O3Data *od, int y_var, uint16_t attr, int *attr_struct_num, double *attr_value_ave);
 char *get_basename(char *filename);
+void get_conf_db_coord(ConfDb *db, ConfDbObject *object, int conf_num, double *coord);
 int get_current_time(char *time_string);
 int get_cv_coeff(O3Data *od, int cv_run, int y, int x, double *cv_coeff, int save_ram);
 int get_datafile_coord(O3Data *od, FileDescriptor *data_fd, int n_atom, int n_total_atoms, int *cube_word_size, double *data_coord, int datafile_type);
@@ -1750,6 +2422,18 @@ uint16_t get_object_attr(O3Data *od, int object_num, uint16_t attr);
 #ifdef WIN32
 BOOL GetOSDisplayString(LPTSTR pszOS, int *page_size);
 #endif
+void get_arena_stats(long *n_allocs, long *n_blocks, long *n_resets, size_t *peak);
+void get_sdm_memo_stats(int *hits, int *misses);
+double *get_store_conf(ConfStore *cs, int object_num, int conf_num);
+int get_score_index_entry(char *sdf_name, int score_type, int object_num, ScoreIndexEntry *entry);
+int get_sdf_file_compression(char *name);
+int get_sdf_import_coord(SdfImport *si, int object_num, int n_atoms, double *coord);
+char *get_sdf_line_end(char *p, char *end);
+int get_sdf_record_coord(int sdf_version, int n_atoms, char *atom_block, char *end, double *coord);
+int get_sdf_record_counts(char *start, char *end, MolInfo *info, char **atom_block);
+int get_sdf_stream_compression(char *name);
+char *get_sdf_stream_ext(int compression);
+int get_simd_level(void);
 void get_system_information(O3Data *od);
 int get_voronoi_buf(O3Data *od, int field_num, int x_var);
 int get_x_value(O3Data *od, int field_num, int object_num, int x_var, double *value, int flag);
@@ -1764,11 +2448,13 @@ int import_dependent(O3Data *od, char *name_list);
 int import_free_format(O3Data *od, char *name_list, int skip_header, int *n_values);
 int import_grid_ascii(O3Data *od, char *regex_name);
 int import_opendx(O3Data *od, char *regex_name);
+int import_sdf(O3Data *od, int slot, char *name);
 int import_grid_formatted_cube(O3Data *od, int mo);
 int import_grid_unformatted_cube(O3Data *od, int mo);
 int import_gridkont(O3Data *od, int replace_object_name);
 int import_grid_moe(O3Data *od, char *regex_name);
 int import_grid_molden(O3Data *od);
+int inflate_sdf_file(char *name, char **data, size_t *size);
 void init_cv_sdep(O3Data *od);
 void init_genrand(O3Data *od, unsigned long s);
 void init_pls(O3Data *od);
@@ -1778,10 +2464,12 @@ DoubleMat *int_perm_rows(IntPerm *perm, DoubleMat *double_mat1, DoubleMat *doubl
 DoubleVec *int_perm_vec(IntPerm *perm, DoubleVec *double_vec1, DoubleVec *double_vec2);
 int intlog2(int n);
 int is_aromatic_bond(BondList **bond_list, int a1, int a2);
+int is_conf_db(char *name);
 int is_in_list(IntPerm *list, int elem);
 int is_in_path(char *program, char *path_to_program);
 int join_aligned_files(O3Data *od, int done_array_pos, char *error_filename);
 int join_mol_to_sdf(O3Data *od, TaskInfo *task, FileDescriptor *to_fd, char *from_dir);
+int join_sdf_import(O3Data *od, int slot, FileDescriptor *to_fd);
 int join_thread_files(O3Data *od, ThreadInfo **thread_info);
 int k_exchange(O3Data *od, DoubleMat *dispersion_mat);
 void lap(LAPInfo *li, int dim);
@@ -1794,10 +2482,15 @@ DWORD lmo_cv_thread(void *pointer);
 DWORD loo_cv_thread(void *pointer);
 DWORD lto_cv_thread(void *pointer);
 #endif
+int load_conf_store(O3Data *od, char *conf_dir, int type);
+int map_sdf_file(SdfReader *sr, char *name);
 int load_dat(O3Data *od, int file_id, int options);
+int load_mol_templates(O3Data *od, char *mol_dir, SdfImport *si);
+int lookup_sdm_memo(SDMMemo *memo, AtomPair *sdm, int pairs, int weight, int threshold_iter);
 int machine_type();
 int match_grids(O3Data *od);
 int match_objects_with_datafile(O3Data *od, char *file_pattern, int datafile_type);
+void merge_worker_task_info(O3Data *od, int n_threads);
 #ifndef HAVE_MKDTEMP
 char *mkdtemp(char *tmpl);
 #endif
@@ -1805,6 +2498,8 @@ char *mkdtemp(char *tmpl);
 int mkstemp(char *tmpl);
 #endif
 int mol_to_sdf(O3Data *od, int object_num, double actual_value);
+int next_scheduled_task(TaskScheduler *ts, int worker, int *stolen);
+char *next_sdf_line(char *p, char *end);
 int nlevel(O3Data *od);
 char *o3_completion_generator(const char *text, int state);
 char **o3_completion_matches(const char *text, int start, int end);
@@ -1812,9 +2507,13 @@ char **o3_completion_matches(const char *text, int start, int end);
 void o3_compentry_free(void *mem);
 #endif
 char *o3_get_keyword(int *keyword_len);
+int open_conf_db(ConfDb *db, char *name);
+int open_sdf_reader(SdfReader *sr, char *name);
+SdfStream *open_sdf_stream(char *name, char *mode, SdfCompressor *compressor);
 int open_perm_dir(O3Data *od, char *root_dir, char *id_string, char *perm_dir_name);
 int open_temp_dir(O3Data *od, char *root_dir, char *id_string, char *temp_dir_name);
 int open_temp_file(O3Data *od, FileDescriptor *file_descriptor, char *id_string);
+OrderedRecord *open_ordered_record(int group, int slot);
 void overall_msd(AtomPair *sdm, int pairs, ConfInfo *moved_conf, ConfInfo *template_conf, double *heavy_msd);
 int parallel_cv(O3Data *od, int x_vars, int suggested_pc_num, int model_type, int cv_type, int groups, int runs);
 int parse_comma_hyphen_list_to_array(O3Data *od, char *list, int list_number);
@@ -1844,6 +2543,7 @@ void prepare_rototrans_matrix(double *rt_mat, double *t_mat1, double *t_mat2, do
 int prep_cosmo_input(O3Data *od, TaskInfo *task, AtomInfo **atom, int object_num);
 int prep_cs3d_input(O3Data *od);
 void prep_moe_grid_input(O3Data *od);
+void pack_conf_batch(ConfBatch *cb, int k, ConfInfo *conf, double *coord);
 int prep_molden_input(O3Data *od, int object_num);
 int prep_qm_input(O3Data *od, TaskInfo *task, AtomInfo **atom, int object_num);
 void prep_sybyl_input(O3Data *od);
@@ -1855,19 +2555,29 @@ void print_grid_coordinates(O3Data *od, GridInfo *grid_info);
 int print_pred_values(O3Data *od);
 void print_pls_scores(O3Data *od, int options);
 int print_variables(O3Data *od, int type);
+void print_arena_stats(O3Data *od);
+void print_conf_store_stats(O3Data *od, ConfStore *cs, char *db_name);
+void print_sdf_reader_stats(O3Data *od);
+void print_worker_pool_stats(O3Data *od);
 #ifndef WIN32
 void program_signal_handler(int signum);
 #else
 BOOL program_signal_handler(DWORD fdwCtrlType);
 #endif
 void pseudo_seed_coord(O3Data *od, int field_num, int *seed);
+int qcp_algorithm(double *z, double *eigenvalue, double *quat);
 int qmd(O3Data *od);
+void queue_ordered_record(OrderedWriter *ow, OrderedRecord *rec);
 #ifndef WIN32
 void *qmd_thread(void *pointer);
 #else
 DWORD qmd_thread(void *pointer);
 #endif
 int read_dx_header(O3Data *od, FileDescriptor *inp_fd, int object_num);
+int read_score_index(char *sdf_name, int score_type, int object_num, ScoreIndexEntry *entry);
+int read_sdf_conf(FILE *handle, MolInfo *mol_info, double *coord);
+int read_sdf_reader_conf(SdfReader *sr, MolInfo *mol_info, double *coord);
+int read_sdf_reader_counts(SdfReader *sr, MolInfo *info, int *found);
 void read_tinker_xyz_n_atoms_energy(char *line, int *n_atoms, double *energy);
 int realloc_x_var_array(O3Data *od, int old_object_num);
 int realloc_y_var_array(O3Data *od, int old_object_num);
@@ -1881,35 +2591,70 @@ int remove_from_list(IntPerm **list, int elem);
 void remove_newline(char *string);
 int remove_object(O3Data *od);
 void remove_recursive(char *filename);
+void remove_score_index(char *sdf_name);
 void remove_temp_files(char *basename);
 int remove_with_prefix(char *temp_dir_string, char *prefix);
 int remove_x_vars(O3Data *od, uint16_t attr);
 int remove_y_vars(O3Data *od);
 int replace_coord(int sdf_version, char *buffer, double *coord);
 void replace_orig_y(O3Data *od);
+void reset_sdm_memo(SDMMemo *memo);
+void reset_arena(Arena *ar);
+void reset_arena_stats(void);
+void reset_sdm_memo_stats(void);
+void reset_sdf_reader_stats();
+void reset_task_queue(TaskQueue *tq);
 void reset_user_terminal(O3Data *od);
 void restore_orig_y(O3Data *od);
 int rms_algorithm(int options, AtomPair *sdm, int pairs, ConfInfo *moved_conf, ConfInfo *template_conf, ConfInfo *fitted_conf, double *rt_mat, double *heavy_msd, double *original_heavy_msd);
 int rms_algorithm_multi(O3Data *od, O3Data *od_comp, double *rt_mat, double *heavy_msd);
 int rototrans(O3Data *od, char *out_sdf_name, double *trans, double *rot);
+#ifndef WIN32
+int run_align_shards(O3Data *od, int n_shards, int n_threads, void *thread_func);
+#endif
+int run_workers(O3Data *od, char *phase_name, int n_threads, void *thread_func);
 int save_dat(O3Data *od, int file_id);
-double score_alignment(O3Data *od, ConfInfo *template_conf, ConfInfo *fitted_conf, AtomPair *sdm, int pairs);
+double score_alignment(LAPInfo *li, ConfInfo *template_conf, ConfInfo *fitted_conf, AtomPair *sdm, int pairs);
+double score_alignment_bound(LAPInfo *li, ConfInfo *template_conf, ConfInfo *moved_conf);
+void scan_score_index_record(char *data, size_t size, int score_type, ScoreIndexEntry *entry);
+#ifdef O3_AVX2_KERNELS
+double score_sum_avx2(double *pref, double *dist, int n);
+#endif
+#ifdef O3_AVX512_KERNELS
+double score_sum_avx512(double *pref, double *dist, int n);
+#endif
 int scramble(O3Data *od, int pc_num);
 int sdcut(O3Data *od, double threshold);
 int sdm_algorithm(AtomPair *sdm, ConfInfo *moved_conf, ConfInfo *template_conf, char **used, int options, double threshold);
+char *sdf_stream_gets(char *data, int len, SdfStream *ss);
+int sdf_stream_printf(SdfStream *ss, char *format, ...);
+int seek_sdf_stream(SdfStream *ss, int64_t offset);
+int seek_sdf_stream_member(SdfStream *ss, int64_t member_offset, int64_t member_start, int64_t offset);
 int send_jmol_command(O3Data *od, char *command);
+#ifndef WIN32
+int send_shard_message(int fd, int type, int group, int slot, int code, void *data, size_t size);
+#endif
 int set_sel_included_bit(O3Data *od, int use_srd_groups);
 void set_voronoi_buf(O3Data *od, int field_num, int x_var, int voronoi_num);
 int srd(O3Data *od, int pc_num, int seed_num, int type, int collapse, double critical_distance, double collapse_distance);
+void store_sdm_memo(SDMMemo *memo, int weight, int threshold_iter, double score, AtomPair *sdm, int pairs, ConfInfo *fitted_conf);
 int store_weights_loadings(O3Data *od);
 int set(O3Data *od, int type, uint16_t attr, int state, int verbose);
+void set_conf_atoms(ConfInfo *conf, AtomInfo **atom, int n_atoms);
+void set_conf_store_limit(int mb);
+void set_dist_cache_limit(int mb);
 void set_field_attr(O3Data *od, int field_num, uint16_t attr, int onoff);
 void set_field_weight(O3Data *od, double weight);
 void set_grid_point(O3Data *od, float *float_xy_mat, VarCoord *varcoord, double value);
 void set_nice_value(O3Data *od, int nice_value);
+int set_ordered_writer_name(OrderedWriter *ow, int group, char *name);
 void set_object_attr(O3Data *od, int object_num, uint16_t attr, int onoff);
 int set_object_weight(O3Data *od, double weight, int list_type, int options);
 void set_random_seed(O3Data *od, unsigned long seed);
+void set_mol_template_writer(int type);
+int set_simd_level(int level);
+void set_sdf_reader(int type);
+void set_superpose_kernel(int kernel);
 int set_x_value(O3Data *od, int field_num, int object_num, int x_var, double value);
 int set_x_value_unbuffered(O3Data *od, int field_num, int object_num, int x_var, double value);
 void set_x_var_attr(O3Data *od, int field_num, int x_var, uint16_t attr, int onoff);
@@ -1918,11 +2663,16 @@ void set_y_value(O3Data *od, int object_num, int y_var, double value);
 void set_y_var_attr(O3Data *od, int y_var, uint16_t attr, int onoff);
 void set_y_var_buf(O3Data *od, int y_var, int buf_num, double value);
 void set_y_var_weight(O3Data *od, double weight);
+void shard_task_scheduler(TaskScheduler *ts, int shard, int n_shards);
+int skip_sdf_stream_records(SdfStream *ss, int n_records);
 void slash_to_backslash(char *string);
 double squared_euclidean_distance(double *coord1, double *coord2);
 void string_to_lowercase(char *string);
 int stddev_x_var(O3Data *od, int field_num);
 void stddev_y_var(O3Data *od);
+int start_ordered_writer(OrderedWriter *ow);
+int stop_ordered_writer(OrderedWriter *ow);
+void submit_ordered_record(OrderedWriter *ow, OrderedRecord *rec);
 #ifndef HAVE_STRTOK_R
 char *strtok_r(char *s1, const char *s2, char **lasts);
 #endif
@@ -1931,6 +2681,8 @@ int superpose_conf_syst(ConfInfo *moved_conf, ConfInfo *template_conf, ConfInfo
 void sync_field_mmap(O3Data *od);
 int exe_shell_cmd(O3Data *od, char *command, char *exedir, char *shell);
 int tanimoto(O3Data *od, int ref_struct);
+int64_t tell_sdf_stream(SdfStream *ss);
+void tell_sdf_stream_member(SdfStream *ss, int64_t *member_offset, int64_t *member_start);
 void tee_error(O3Data *od, int run_type, int overall_line_num, char *fmt, ...);
 void tee_flush(O3Data *od);
 void tee_printf(O3Data *od, char *fmt, ...);
@@ -1944,6 +2696,7 @@ void trim_mean_center_matrix(O3Data *od, DoubleMat *large_mat, DoubleMat **mat,
   DoubleVec **mat_ave, int model_type, int active_object_num);
 void trim_mean_center_x_matrix_hp(O3Data *od, int model_type, int active_object_num, int run);
 void trim_mean_center_y_matrix_hp(O3Data *od, int active_object_num, int run);
+void unpack_conf_batch(ConfBatch *cb, int k, ConfInfo *conf, LAPInfo *li);
 int up_n_levels(char *path, int levels);
 int update_conf_ln_k(O3Data *od, int model_type, int pc_num, double *ln_k_rmsd, int conv_method);
 void update_field_object_attr(O3Data *od, int verbose);
@@ -1957,8 +2710,13 @@ void var_to_xyz(O3Data *od, int x_var, VarCoord *varcoord);
 void vertex_xyz(O3Data *od, FILE *handle, int x, int y, int z);
 int write_aligned_mol(O3Data *od, O3Data *od_comp, TaskInfo *task, ConfInfo *fitted_conf, int object_num);
 void write_ffd_design_matrix_col(O3Data *od, int first_element, int col, int decimal);
+int write_conf_db(O3Data *od, char *conf_dir, char *name, int coord_size, int *wrong_object_num, int *wrong_conf_num);
 int write_grid_plane(O3Data *od, FILE *plane_file, int z_plane, int interpolate, int swap_endianness, float *minVal, float *maxVal);
 int write_header(O3Data *od, int object_num, char *header, int format, int interpolate, int swap_endianness);
+int write_mol_template(MolTemplate *mt, double *coord, char *pose, FILE *handle);
+int write_score_index(char *sdf_name, int score_type, int n_objects, ScoreIndexEntry *entry);
+int write_sdf_import_mol(O3Data *od, int slot, char *mol_dir);
+int write_sdf_stream(SdfStream *ss, void *data, size_t size);
 int write_tinker_energy(FileDescriptor *fd, double energy);
 int write_tinker_xyz_bnd(O3Data *od, AtomInfo **atom, BondList **d_list, int n_atoms, int object_num, char *xyz_name, char *bnd_name);
 int x_var_buw(O3Data *od);
@@ -631,6 +631,13 @@ int main(int argc, char **argv)
 {
   char *temp_dir_string;
   char *save_ram_string;
+  char *superpose_string;
+  char *sdf_reader_string;
+  char *mol_template_string;
+  char *simd_string;
+  char *dist_cache_string;
+  char *conf_store_string;
+  char *pin_threads_string;
   char *n_cpus_string;
   char *nice_string;
   char *babel_path_string;
@@ -716,6 +723,10 @@ int main(int argc, char **argv)
   int result;
   int found;
   int nice_value;
+  int simd_level;
+  int pin_threads;
+  int dist_cache_mb = DIST_CACHE_DEFAULT_MB;
+  int conf_store_mb = CONF_STORE_DEFAULT_MB;
   O3Data od;
   CLIArgs cli_args;
   #ifndef WIN32
@@ -1623,6 +1634,78 @@ int main(int argc, char **argv)
     tee_printf(&od, "Page files will be used to "
       "minimize physical RAM usage.\n\n"); 
   }
+  superpose_string = getenv("O3_SUPERPOSE");
+  if (superpose_string && (!strncasecmp(superpose_string, "dsyev", 5))) {
+    set_superpose_kernel(SUPERPOSE_DSYEV);
+    tee_printf(&od, "LAPACK dsyev will be used instead of the "
+      "closed-form QCP kernel for superpositions.\n\n");
+  }
+  dist_cache_string = getenv("O3_DIST_CACHE_MB");
+  if (dist_cache_string) {
+    sscanf(dist_cache_string, "%d", &dist_cache_mb);
+    if (dist_cache_mb < 0) {
+      dist_cache_mb = 0;
+    }
+    set_dist_cache_limit(dist_cache_mb);
+    if (dist_cache_mb) {
+      tee_printf(&od, "Up to %d MB will be used to cache "
+        "intra-molecular distance matrices.\n\n", dist_cache_mb);
+    }
+    else {
+      tee_printf(&od, "Intra-molecular distance matrices "
+        "will not be cached.\n\n");
+    }
+  }
+  conf_store_string = getenv("O3_CONF_STORE_MB");
+  if (conf_store_string) {
+    sscanf(conf_store_string, "%d", &conf_store_mb);
+    if (conf_store_mb < 0) {
+      conf_store_mb = 0;
+    }
+    set_conf_store_limit(conf_store_mb);
+    tee_printf(&od, "Conformational databases larger than %d MB will be "
+      "kept in memory-mapped page files.\n\n", conf_store_mb);
+  }
+  sdf_reader_string = getenv("O3_SDF_READER");
+  if (sdf_reader_string && (!strncasecmp(sdf_reader_string, "stdio", 5))) {
+    set_sdf_reader(SDF_READER_STDIO);
+    tee_printf(&od, "Conformational databases will be read line by line "
+      "instead of through memory-mapped files.\n\n");
+  }
+  mol_template_string = getenv("O3_MOL_TEMPLATE");
+  if (mol_template_string && (!strncasecmp(mol_template_string, "line", 4))) {
+    set_mol_template_writer(MOL_TEMPLATE_LINE);
+    tee_printf(&od, "Aligned poses will be written line by line "
+      "instead of from MOL templates.\n\n");
+  }
+  simd_string = getenv("O3_SIMD");
+  if (simd_string) {
+    if (!strncasecmp(simd_string, "avx512", 6)) {
+      simd_level = set_simd_level(SIMD_AVX512);
+    }
+    else if (!strncasecmp(simd_string, "avx2", 4)) {
+      simd_level = set_simd_level(SIMD_AVX2);
+    }
+    else {
+      simd_level = set_simd_level(SIMD_NONE);
+    }
+    tee_printf(&od, "%s kernels will be used to compare "
+      "atomic distance histograms.\n\n", ((simd_level == SIMD_AVX512) ? "AVX-512"
+      : ((simd_level == SIMD_AVX2) ? "AVX2" : "Scalar")));
+  }
+  pin_threads_string = getenv("O3_PIN_THREADS");
+  pin_threads = (pin_threads_string && (!strncasecmp(pin_threads_string, "y", 1)));
+  /*
+  worker threads are created once for the whole
+  session and reused by all parallel phases
+  */
+  if (create_worker_pool(&od, pin_threads)) {
+    tee_printf(&od, "Cannot create a persistent worker thread pool; "
+      "threads will be created by each command.\n\n");
+  }
+  else if (pin_threads) {
+    tee_printf(&od, "Worker threads will be pinned to CPUs.\n\n");
+  }
   tee_flush(&od);
   if (!get_current_time(current_time)) {
     tee_printf(&od, "Job started on %s\n", current_time);
@@ -1647,6 +1730,7 @@ int main(int argc, char **argv)
   }
   if (!result) {
     result = parse_input(&od, od.in, cli_args.prompt);
+    print_worker_pool_stats(&od);
     if (!get_current_time(current_time)) {
       tee_printf(&od, "\n\n"
         "Job finished on %s\n", current_time);
@@ -1712,6 +1796,7 @@ int main(int argc, char **argv)
     }
     #endif
   }
+  free_worker_pool(&od);
   free_mem(&od);
   #ifndef HAVE_EDITLINE_FUNCTIONALITY
   if (dl_handle) {
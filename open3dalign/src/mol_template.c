@@ -0,0 +1,373 @@
+/*
+
+mol_template.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+#define MOL_TEMPLATE_COORD_WIDTH    10
+
+
+static int mol_template_writer = MOL_TEMPLATE_FIXED;
+
+
+void set_mol_template_writer(int type)
+{
+  mol_template_writer = type;
+}
+
+
+static int build_mol_template(MolTemplate *mt, char *data, size_t size, int n_atoms)
+{
+  int i;
+  char *line;
+  char *line_end;
+  char *end;
+  char *atom_block;
+  size_t j;
+  MolInfo temp_mol_info;
+  
+  
+  /*
+  line endings are normalized to '\n' as they were
+  when MOL files were copied line by line; then the
+  offset of each atom line is recorded once for all
+  */
+  if (!size) {
+    return PREMATURE_EOF;
+  }
+  if (!(mt->block = (char *)malloc(size + 1))) {
+    return OUT_OF_MEMORY;
+  }
+  for (j = 0, mt->size = 0; j < size; ++j) {
+    if ((data[j] == '\r') && (((j + 1) == size) || (data[j + 1] == '\n'))) {
+      continue;
+    }
+    mt->block[mt->size] = data[j];
+    ++(mt->size);
+  }
+  if ((!(mt->size)) || (mt->block[mt->size - 1] != '\n')) {
+    mt->block[mt->size] = '\n';
+    ++(mt->size);
+  }
+  end = mt->block + mt->size;
+  memset(&temp_mol_info, 0, sizeof(MolInfo));
+  if (get_sdf_record_counts(mt->block, end, &temp_mol_info, &atom_block)) {
+    return PREMATURE_EOF;
+  }
+  if (!(mt->line_offset = (size_t *)malloc((n_atoms + 1) * sizeof(size_t)))) {
+    return OUT_OF_MEMORY;
+  }
+  mt->n_atoms = n_atoms;
+  mt->sdf_version = temp_mol_info.sdf_version;
+  mt->fixed = (mt->sdf_version == V2000);
+  for (i = 0, line = atom_block; i < n_atoms; ++i, line = next_sdf_line(line, end)) {
+    if (line >= end) {
+      return PREMATURE_EOF;
+    }
+    line_end = get_sdf_line_end(line, end);
+    if ((line_end - line) < (3 * MOL_TEMPLATE_COORD_WIDTH)) {
+      mt->fixed = 0;
+    }
+    mt->line_offset[i] = (size_t)(line - mt->block);
+  }
+  mt->line_offset[n_atoms] = (size_t)(line - mt->block);
+  
+  return 0;
+}
+
+
+#ifndef WIN32
+static void *mol_template_thread(void *pointer)
+#else
+static DWORD mol_template_thread(void *pointer)
+#endif
+{
+  int object_num;
+  MolTemplateSet *ms;
+  char name[BUF_LEN];
+  MolTemplate *mt;
+  SdfImportRecord *rec;
+  SdfReader sr;
+  WorkerInfo *wi;
+  
+  
+  /*
+  templates are taken in place from the imported
+  candidate file if there is one, otherwise each
+  MOL file is mapped, copied and unmapped
+  */
+  wi = (WorkerInfo *)pointer;
+  ms = wi->od->mel.mol_template;
+  for (object_num = wi->start; object_num <= wi->end; ++object_num) {
+    mt = &(ms->mol[object_num]);
+    if (ms->si) {
+      rec = &(ms->si->record[object_num]);
+      mt->result = build_mol_template(mt, ms->si->reader.base + rec->offset,
+        rec->mol_size, wi->od->al.mol_info[object_num]->n_atoms);
+      continue;
+    }
+    sprintf(name, "%s%c%04d.mol", ms->mol_dir, SEPARATOR,
+      wi->od->al.mol_info[object_num]->object_id);
+    if (map_sdf_file(&sr, name)) {
+      mt->result = FL_CANNOT_READ_MOL_FILE;
+      continue;
+    }
+    mt->result = build_mol_template(mt, sr.base, sr.size,
+      wi->od->al.mol_info[object_num]->n_atoms);
+    close_sdf_reader(&sr);
+  }
+  
+  #ifndef WIN32
+  return pointer;
+  #else
+  return 0;
+  #endif
+}
+
+
+int load_mol_templates(O3Data *od, char *mol_dir, SdfImport *si)
+{
+  char name[BUF_LEN];
+  int i;
+  int n_threads;
+  int result;
+  MolTemplateSet *ms;
+  WorkerInfo wi;
+  
+  
+  /*
+  each object's MOL block is loaded once, so that
+  aligned poses can be written with no file access;
+  if no workers were allocated, templates are
+  loaded by the calling thread
+  */
+  free_mol_templates(od);
+  if (!(ms = (MolTemplateSet *)malloc(sizeof(MolTemplateSet)))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  memset(ms, 0, sizeof(MolTemplateSet));
+  od->mel.mol_template = ms;
+  ms->n_objects = od->grid.object_num;
+  ms->si = si;
+  strcpy(ms->mol_dir, mol_dir);
+  if (!(ms->mol = (MolTemplate *)calloc(ms->n_objects, sizeof(MolTemplate)))) {
+    O3_ERROR_LOCATE(&(od->task));
+    free_mol_templates(od);
+    return OUT_OF_MEMORY;
+  }
+  if (od->mel.worker_info) {
+    n_threads = fill_worker_info(od, NULL, ms->n_objects);
+    if ((result = run_workers(od, "mol_template", n_threads, (void *)mol_template_thread))) {
+      O3_ERROR_LOCATE(&(od->task));
+      free_mol_templates(od);
+      return result;
+    }
+  }
+  else {
+    memset(&wi, 0, sizeof(WorkerInfo));
+    wi.od = od;
+    wi.start = 0;
+    wi.end = ms->n_objects - 1;
+    mol_template_thread(&wi);
+  }
+  for (i = 0; i < ms->n_objects; ++i) {
+    if ((result = ms->mol[i].result)) {
+      O3_ERROR_LOCATE(&(od->task));
+      if (result != OUT_OF_MEMORY) {
+        if (si) {
+          O3_ERROR_STRING(&(od->task), si->name);
+          result = FL_CANNOT_READ_SDF_FILE;
+        }
+        else {
+          sprintf(name, "%s%c%04d.mol", mol_dir, SEPARATOR,
+            od->al.mol_info[i]->object_id);
+          O3_ERROR_STRING(&(od->task), name);
+          result = FL_CANNOT_READ_MOL_FILE;
+        }
+      }
+      free_mol_templates(od);
+      return result;
+    }
+    if (ms->mol[i].size > ms->max_size) {
+      ms->max_size = ms->mol[i].size;
+    }
+  }
+  
+  return 0;
+}
+
+
+void free_mol_templates(O3Data *od)
+{
+  int i;
+  MolTemplateSet *ms;
+  
+  
+  if (!(ms = od->mel.mol_template)) {
+    return;
+  }
+  if (ms->mol) {
+    for (i = 0; i < ms->n_objects; ++i) {
+      if (ms->mol[i].block) {
+        free(ms->mol[i].block);
+      }
+      if (ms->mol[i].line_offset) {
+        free(ms->mol[i].line_offset);
+      }
+    }
+    free(ms->mol);
+  }
+  free(ms);
+  od->mel.mol_template = NULL;
+}
+
+
+static int format_mol_coord(char *field, double value)
+{
+  char temp[BUF_LEN];
+  int i;
+  int j;
+  long n;
+  double scaled;
+  
+  
+  /*
+  same output as "%10.4lf", without the locale and
+  format parsing overhead of printf(); values close
+  to a rounding midpoint are left to sprintf() so
+  that rounding is bit-identical, while values
+  which do not fit in the field are refused
+  */
+  if (!((value > -9999.99995) && (value < 99999.99995))) {
+    return 1;
+  }
+  scaled = fabs(value) * 10000.0;
+  if (fabs(scaled - floor(scaled) - 0.5) < 1.0e-06) {
+    sprintf(temp, "%10.4lf", value);
+    memcpy(field, temp, MOL_TEMPLATE_COORD_WIDTH);
+    return 0;
+  }
+  n = (long)floor(scaled + 0.5);
+  i = MOL_TEMPLATE_COORD_WIDTH - 1;
+  for (j = 0; j < 4; ++j, --i) {
+    field[i] = (char)('0' + (n % 10));
+    n /= 10;
+  }
+  field[i] = '.';
+  --i;
+  do {
+    field[i] = (char)('0' + (n % 10));
+    n /= 10;
+    --i;
+  } while (n);
+  if (signbit(value)) {
+    field[i] = '-';
+    --i;
+  }
+  for (; i >= 0; --i) {
+    field[i] = ' ';
+  }
+  
+  return 0;
+}
+
+
+int write_mol_template(MolTemplate *mt, double *coord, char *pose, FILE *handle)
+{
+  char buffer[BUF_LEN];
+  char *line;
+  char *line_end;
+  char *atom_end;
+  char *end;
+  int i;
+  int x;
+  int fits;
+  size_t len;
+  
+  
+  /*
+  V2000 poses are a copy of the template with the
+  coordinate fields overwritten, written to handle
+  with a single call; pose must be able to hold
+  the largest template. V3000 atom lines, and
+  V2000 ones whose coordinates do not fit in their
+  fields, are rewritten line by line instead, as
+  all atom lines are with MOL_TEMPLATE_LINE
+  */
+  if (mt->fixed && (mol_template_writer == MOL_TEMPLATE_FIXED)) {
+    memcpy(pose, mt->block, mt->size);
+    for (i = 0, fits = 1; fits && (i < mt->n_atoms); ++i) {
+      for (x = 0; fits && (x < 3); ++x) {
+        fits = (!format_mol_coord(&pose[mt->line_offset[i]
+          + x * MOL_TEMPLATE_COORD_WIDTH], coord[i * 3 + x]));
+      }
+    }
+    if (fits) {
+      return ((fwrite(pose, 1, mt->size, handle) == mt->size) ? 0 : CANNOT_WRITE_TEMP_FILE);
+    }
+  }
+  end = mt->block + mt->size;
+  atom_end = mt->block + mt->line_offset[mt->n_atoms];
+  if (fwrite(mt->block, 1, mt->line_offset[0], handle) != mt->line_offset[0]) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  for (i = 0; i < mt->n_atoms; ++i) {
+    line = mt->block + mt->line_offset[i];
+    line_end = get_sdf_line_end(line, end);
+    len = (size_t)(line_end - line);
+    if (len > (BUF_LEN - 2)) {
+      len = BUF_LEN - 2;
+    }
+    memcpy(buffer, line, len);
+    buffer[len] = '\0';
+    remove_newline(buffer);
+    if (replace_coord(mt->sdf_version, buffer, &coord[i * 3])) {
+      return PREMATURE_EOF;
+    }
+    if (fprintf(handle, "%s\n", buffer) < 0) {
+      return CANNOT_WRITE_TEMP_FILE;
+    }
+  }
+  if (fwrite(atom_end, 1, (size_t)(end - atom_end), handle) != (size_t)(end - atom_end)) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  
+  return 0;
+}
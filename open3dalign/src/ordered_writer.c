@@ -0,0 +1,665 @@
+/*
+
+ordered_writer.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+
+OrderedWriter *alloc_ordered_writer(int n_groups, int n_slots)
+{
+  OrderedWriter *ow;
+  
+  
+  /*
+  records are grouped by output file (one per template
+  conformation) and ordered by slot (the candidate object)
+  within each group; a group's reorder buffer is only
+  allocated once its first record arrives
+  */
+  if (!(ow = (OrderedWriter *)malloc(sizeof(OrderedWriter)))) {
+    return NULL;
+  }
+  memset(ow, 0, sizeof(OrderedWriter));
+  ow->n_groups = n_groups;
+  ow->n_slots = n_slots;
+  ow->error_group = -1;
+  ow->error_slot = -1;
+  ow->forward_fd = -1;
+  ow->max_buffered_size = ORDERED_WRITER_MAX_BUFFERED;
+  ow->next_slot = (int *)calloc(n_groups + 1, sizeof(int));
+  ow->name = (char **)calloc(n_groups + 1, sizeof(char *));
+  ow->pending = (OrderedRecord ***)calloc(n_groups + 1, sizeof(OrderedRecord **));
+  ow->written = (int64_t *)calloc(n_groups + 1, sizeof(int64_t));
+  ow->entry = (ScoreIndexEntry **)calloc(n_groups + 1, sizeof(ScoreIndexEntry *));
+  ow->stream = (SdfStream **)calloc(n_groups + 1, sizeof(SdfStream *));
+  if (!(ow->next_slot) || !(ow->name) || !(ow->pending)
+    || !(ow->written) || !(ow->entry) || !(ow->stream)) {
+    free_ordered_writer(ow);
+    return NULL;
+  }
+  #ifndef WIN32
+  pthread_mutex_init(&(ow->mutex), NULL);
+  pthread_cond_init(&(ow->cond), NULL);
+  #else
+  InitializeCriticalSection(&(ow->mutex));
+  InitializeConditionVariable(&(ow->cond));
+  #endif
+  
+  return ow;
+}
+
+
+void free_ordered_writer(OrderedWriter *ow)
+{
+  int i;
+  int j;
+  OrderedRecord *rec;
+  
+  
+  if (!ow) {
+    return;
+  }
+  while ((rec = ow->head)) {
+    ow->head = rec->next;
+    discard_ordered_record(rec);
+  }
+  if (ow->pending) {
+    for (i = 0; i < ow->n_groups; ++i) {
+      if (ow->pending[i]) {
+        for (j = 0; j < ow->n_slots; ++j) {
+          discard_ordered_record(ow->pending[i][j]);
+        }
+        free(ow->pending[i]);
+      }
+    }
+    free(ow->pending);
+  }
+  if (ow->entry) {
+    for (i = 0; i < ow->n_groups; ++i) {
+      if (ow->entry[i]) {
+        free(ow->entry[i]);
+      }
+    }
+    free(ow->entry);
+  }
+  if (ow->stream) {
+    for (i = 0; i < ow->n_groups; ++i) {
+      close_sdf_stream(ow->stream[i]);
+    }
+    free(ow->stream);
+  }
+  free_sdf_compressor(ow->compressor);
+  if (ow->spill) {
+    fclose(ow->spill);
+  }
+  if (ow->written) {
+    free(ow->written);
+  }
+  if (ow->name) {
+    for (i = 0; i < ow->n_groups; ++i) {
+      if (ow->name[i]) {
+        free(ow->name[i]);
+      }
+    }
+    free(ow->name);
+  }
+  if (ow->next_slot) {
+    free(ow->next_slot);
+    #ifndef WIN32
+    pthread_cond_destroy(&(ow->cond));
+    pthread_mutex_destroy(&(ow->mutex));
+    #else
+    DeleteCriticalSection(&(ow->mutex));
+    #endif
+  }
+  free(ow);
+}
+
+
+int set_ordered_writer_name(OrderedWriter *ow, int group, char *name)
+{
+  if (ow->name[group]) {
+    free(ow->name[group]);
+  }
+  if (!(ow->name[group] = strdup(name))) {
+    return OUT_OF_MEMORY;
+  }
+  
+  return 0;
+}
+
+
+OrderedRecord *open_ordered_record(int group, int slot)
+{
+  OrderedRecord *rec;
+  
+  
+  /*
+  a record is written through a regular FILE pointer;
+  where available, this is an in-memory stream, so
+  no scratch file is involved at all
+  */
+  if (!(rec = (OrderedRecord *)malloc(sizeof(OrderedRecord)))) {
+    return NULL;
+  }
+  memset(rec, 0, sizeof(OrderedRecord));
+  rec->group = group;
+  rec->slot = slot;
+  #ifdef HAVE_OPEN_MEMSTREAM
+  rec->handle = open_memstream(&(rec->data), &(rec->size));
+  #else
+  rec->handle = tmpfile();
+  #endif
+  if (!(rec->handle)) {
+    free(rec);
+    return NULL;
+  }
+  
+  return rec;
+}
+
+
+void discard_ordered_record(OrderedRecord *rec)
+{
+  if (!rec) {
+    return;
+  }
+  if (rec->handle) {
+    fclose(rec->handle);
+  }
+  if (rec->data) {
+    free(rec->data);
+  }
+  free(rec);
+}
+
+
+void submit_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  #ifndef HAVE_OPEN_MEMSTREAM
+  long size;
+  #endif
+  
+  
+  /*
+  collect the record contents in the calling thread,
+  then queue it for the writer thread; a record whose
+  contents could not be collected is queued all the
+  same with no data, and the writer flags its group
+  */
+  #ifdef HAVE_OPEN_MEMSTREAM
+  if (fclose(rec->handle) && rec->data) {
+    free(rec->data);
+    rec->data = NULL;
+  }
+  rec->handle = NULL;
+  #else
+  if ((!fflush(rec->handle)) && ((size = ftell(rec->handle)) >= 0)
+    && (rec->data = (char *)malloc(size + 1))) {
+    rewind(rec->handle);
+    rec->size = fread(rec->data, 1, size, rec->handle);
+    if (rec->size != (size_t)size) {
+      free(rec->data);
+      rec->data = NULL;
+    }
+  }
+  fclose(rec->handle);
+  rec->handle = NULL;
+  #endif
+  queue_ordered_record(ow, rec);
+}
+
+
+void queue_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  /*
+  queue a record whose contents were
+  already collected for the writer thread
+  */
+  rec->next = NULL;
+  #ifndef WIN32
+  pthread_mutex_lock(&(ow->mutex));
+  #else
+  EnterCriticalSection(&(ow->mutex));
+  #endif
+  if (ow->tail) {
+    ow->tail->next = rec;
+  }
+  else {
+    ow->head = rec;
+  }
+  ow->tail = rec;
+  #ifndef WIN32
+  pthread_cond_signal(&(ow->cond));
+  pthread_mutex_unlock(&(ow->mutex));
+  #else
+  WakeConditionVariable(&(ow->cond));
+  LeaveCriticalSection(&(ow->mutex));
+  #endif
+}
+
+
+static void unbuffer_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  /*
+  the record leaves the reorder buffer; once no
+  spilled record is left, the spill file is reused
+  from its beginning
+  */
+  --(ow->n_buffered);
+  if (rec->spilled) {
+    --(ow->n_spilled);
+    if (!(ow->n_spilled)) {
+      ow->spill_size = 0;
+    }
+  }
+  else if (rec->data) {
+    ow->buffered_size -= rec->size;
+  }
+}
+
+
+static void spill_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  /*
+  move the data of a buffered record to the spill
+  file; if this cannot be created or written, the
+  record simply stays in memory
+  */
+  if ((!(ow->spill)) && (!(ow->spill = tmpfile()))) {
+    return;
+  }
+  if (fseek(ow->spill, (long)(ow->spill_size), SEEK_SET)
+    || (fwrite(rec->data, 1, rec->size, ow->spill) != rec->size)) {
+    return;
+  }
+  rec->spill_offset = ow->spill_size;
+  rec->spilled = 1;
+  ow->spill_size += (int64_t)(rec->size);
+  ow->buffered_size -= rec->size;
+  ++(ow->n_spilled);
+  ++(ow->n_spilled_total);
+  free(rec->data);
+  rec->data = NULL;
+}
+
+
+static void load_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  /*
+  read back the data of a spilled record; if this
+  fails, data is left NULL and the group is flagged
+  */
+  if (!(rec->data = (char *)malloc(rec->size + 1))) {
+    return;
+  }
+  if (fseek(ow->spill, (long)(rec->spill_offset), SEEK_SET)
+    || (fread(rec->data, 1, rec->size, ow->spill) != rec->size)) {
+    free(rec->data);
+    rec->data = NULL;
+  }
+}
+
+
+static void set_ordered_writer_error(OrderedWriter *ow, int group, int slot)
+{
+  int j;
+  
+  
+  /*
+  the group is given up: its buffered records
+  are dropped and later ones will be ignored
+  */
+  if (ow->error_group == -1) {
+    ow->error_group = group;
+    ow->error_slot = slot;
+  }
+  ow->next_slot[group] = -1;
+  if (ow->pending[group]) {
+    for (j = 0; j < ow->n_slots; ++j) {
+      if (ow->pending[group][j]) {
+        unbuffer_ordered_record(ow, ow->pending[group][j]);
+        discard_ordered_record(ow->pending[group][j]);
+      }
+    }
+    free(ow->pending[group]);
+    ow->pending[group] = NULL;
+  }
+  if (ow->entry[group]) {
+    free(ow->entry[group]);
+    ow->entry[group] = NULL;
+  }
+  if (ow->stream[group]) {
+    close_sdf_stream(ow->stream[group]);
+    ow->stream[group] = NULL;
+  }
+}
+
+
+static void flush_ordered_group(OrderedWriter *ow, int group)
+{
+  int slot;
+  int result;
+  OrderedRecord *rec;
+  SdfStream *stream;
+  
+  
+  /*
+  write the longest run of consecutive records
+  starting from the next expected slot; the file
+  of each group is opened with its first record
+  and kept open until the group is complete, so
+  that compressed files are made of full-sized
+  gzip members or zstd frames; the score index
+  entry of each record is filled from its
+  in-memory contents on the way out
+  */
+  while (((slot = ow->next_slot[group]) != -1) && (slot < ow->n_slots)
+    && (rec = ow->pending[group][slot])) {
+    ow->pending[group][slot] = NULL;
+    unbuffer_ordered_record(ow, rec);
+    if (rec->spilled) {
+      load_ordered_record(ow, rec);
+    }
+    if (!(ow->stream[group])) {
+      if (!(ow->name[group]) || !(ow->stream[group] = open_sdf_stream
+        (ow->name[group], "wb", ow->compressor))) {
+        discard_ordered_record(rec);
+        set_ordered_writer_error(ow, group, slot);
+        return;
+      }
+      ow->written[group] = 0;
+      remove_score_index(ow->name[group]);
+    }
+    if ((!(rec->data)) || write_sdf_stream(ow->stream[group], rec->data, rec->size)) {
+      discard_ordered_record(rec);
+      set_ordered_writer_error(ow, group, slot);
+      return;
+    }
+    if (ow->entry[group]) {
+      scan_score_index_record(rec->data, rec->size,
+        ow->score_type, &(ow->entry[group][slot]));
+      ow->entry[group][slot].offset = ow->written[group];
+    }
+    ow->written[group] += (int64_t)(rec->size);
+    discard_ordered_record(rec);
+    ++(ow->next_slot[group]);
+  }
+  if (ow->next_slot[group] == ow->n_slots) {
+    if (ow->stream[group]) {
+      stream = ow->stream[group];
+      ow->stream[group] = NULL;
+      /*
+      once all data has been flushed, the index
+      entries get the offsets of the gzip member
+      or zstd frame which holds their record
+      */
+      if ((!(result = flush_sdf_stream(stream))) && ow->entry[group]) {
+        for (slot = 0; (slot < ow->n_slots) && (!find_sdf_stream_member(stream,
+          ow->entry[group][slot].offset, &(ow->entry[group][slot].member_offset),
+          &(ow->entry[group][slot].member_start))); ++slot);
+        if (slot < ow->n_slots) {
+          free(ow->entry[group]);
+          ow->entry[group] = NULL;
+        }
+      }
+      if (close_sdf_stream(stream) || result) {
+        set_ordered_writer_error(ow, group, ow->n_slots - 1);
+      }
+    }
+    /*
+    the index is not essential: if it cannot be
+    written, readers fall back to scanning the file
+    */
+    if ((ow->next_slot[group] != -1) && ow->entry[group]) {
+      write_score_index(ow->name[group], ow->score_type,
+        ow->n_slots, ow->entry[group]);
+    }
+    if (ow->entry[group]) {
+      free(ow->entry[group]);
+      ow->entry[group] = NULL;
+    }
+    if (ow->pending[group]) {
+      free(ow->pending[group]);
+      ow->pending[group] = NULL;
+    }
+  }
+}
+
+
+static void place_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  int group;
+  
+  
+  group = rec->group;
+  if (ow->next_slot[group] == -1) {
+    discard_ordered_record(rec);
+    return;
+  }
+  if (!(ow->pending[group])) {
+    if (!(ow->pending[group] = (OrderedRecord **)
+      calloc(ow->n_slots, sizeof(OrderedRecord *)))) {
+      set_ordered_writer_error(ow, group, rec->slot);
+      discard_ordered_record(rec);
+      return;
+    }
+    /*
+    a group whose index entries cannot be allocated
+    is still written, just without an index
+    */
+    ow->entry[group] = (ScoreIndexEntry *)
+      calloc(ow->n_slots + 1, sizeof(ScoreIndexEntry));
+  }
+  ow->pending[group][rec->slot] = rec;
+  ++(ow->n_buffered);
+  if (ow->n_buffered > ow->max_n_buffered) {
+    ow->max_n_buffered = ow->n_buffered;
+  }
+  if (rec->data) {
+    ow->buffered_size += rec->size;
+  }
+  /*
+  records which cannot be written yet are kept
+  in memory up to max_buffered_size bytes overall,
+  then further ones are spilled to disk
+  */
+  if (rec->slot == ow->next_slot[group]) {
+    flush_ordered_group(ow, group);
+  }
+  else if (rec->data && (ow->buffered_size > ow->max_buffered_size)) {
+    spill_ordered_record(ow, rec);
+  }
+}
+
+
+#ifndef WIN32
+static void forward_ordered_record(OrderedWriter *ow, OrderedRecord *rec)
+{
+  /*
+  in an alignment shard process, records are not
+  written to file but sent to the coordinator,
+  which places them in its own reorder buffer
+  */
+  if ((!(rec->data)) || send_shard_message(ow->forward_fd,
+    SHARD_RECORD, rec->group, rec->slot, 0, rec->data, rec->size)) {
+    if (ow->error_group == -1) {
+      ow->error_group = rec->group;
+      ow->error_slot = rec->slot;
+    }
+  }
+  discard_ordered_record(rec);
+}
+#endif
+
+
+#ifndef WIN32
+static void *ordered_writer_thread(void *pointer)
+#else
+static DWORD ordered_writer_thread(void *pointer)
+#endif
+{
+  int i;
+  OrderedRecord *rec;
+  OrderedRecord *next;
+  OrderedWriter *ow;
+  
+  
+  ow = (OrderedWriter *)pointer;
+  #ifndef WIN32
+  pthread_mutex_lock(&(ow->mutex));
+  #else
+  EnterCriticalSection(&(ow->mutex));
+  #endif
+  while (1) {
+    while ((!(ow->head)) && (!(ow->shutdown))) {
+      #ifndef WIN32
+      pthread_cond_wait(&(ow->cond), &(ow->mutex));
+      #else
+      SleepConditionVariableCS(&(ow->cond), &(ow->mutex), INFINITE);
+      #endif
+    }
+    if (!(rec = ow->head)) {
+      break;
+    }
+    /*
+    take the whole queue at once, then write
+    without holding the lock
+    */
+    ow->head = NULL;
+    ow->tail = NULL;
+    #ifndef WIN32
+    pthread_mutex_unlock(&(ow->mutex));
+    #else
+    LeaveCriticalSection(&(ow->mutex));
+    #endif
+    while (rec) {
+      next = rec->next;
+      #ifndef WIN32
+      if (ow->forward_fd != -1) {
+        forward_ordered_record(ow, rec);
+        rec = next;
+        continue;
+      }
+      #endif
+      place_ordered_record(ow, rec);
+      rec = next;
+    }
+    #ifndef WIN32
+    pthread_mutex_lock(&(ow->mutex));
+    #else
+    EnterCriticalSection(&(ow->mutex));
+    #endif
+  }
+  #ifndef WIN32
+  pthread_mutex_unlock(&(ow->mutex));
+  #else
+  LeaveCriticalSection(&(ow->mutex));
+  #endif
+  for (i = 0; i < ow->n_groups; ++i) {
+    if (ow->stream[i]) {
+      close_sdf_stream(ow->stream[i]);
+      ow->stream[i] = NULL;
+    }
+  }
+  
+  #ifndef WIN32
+  return NULL;
+  #else
+  return 0;
+  #endif
+}
+
+
+int start_ordered_writer(OrderedWriter *ow)
+{
+  /*
+  if the compressor threads cannot be started,
+  the writer thread compresses on its own
+  */
+  if (ow->n_compressors && (ow->forward_fd == -1)) {
+    ow->compressor = alloc_sdf_compressor(ow->n_compressors);
+  }
+  #ifndef WIN32
+  if (pthread_create(&(ow->thread_id), NULL, ordered_writer_thread, ow)) {
+    return CANNOT_CREATE_THREAD;
+  }
+  #else
+  if (!(ow->thread_handle = CreateThread(NULL, 0,
+    (LPTHREAD_START_ROUTINE)ordered_writer_thread, ow, 0, &(ow->thread_id)))) {
+    return CANNOT_CREATE_THREAD;
+  }
+  #endif
+  ow->running = 1;
+  
+  return 0;
+}
+
+
+int stop_ordered_writer(OrderedWriter *ow)
+{
+  /*
+  wait for all queued records to be written;
+  returns 0 if every group was either completed
+  or never started, 1 otherwise
+  */
+  if (ow->running) {
+    #ifndef WIN32
+    pthread_mutex_lock(&(ow->mutex));
+    ow->shutdown = 1;
+    pthread_cond_signal(&(ow->cond));
+    pthread_mutex_unlock(&(ow->mutex));
+    pthread_join(ow->thread_id, NULL);
+    #else
+    EnterCriticalSection(&(ow->mutex));
+    ow->shutdown = 1;
+    WakeConditionVariable(&(ow->cond));
+    LeaveCriticalSection(&(ow->mutex));
+    WaitForSingleObject(ow->thread_handle, INFINITE);
+    CloseHandle(ow->thread_handle);
+    #endif
+    ow->running = 0;
+  }
+  free_sdf_compressor(ow->compressor);
+  ow->compressor = NULL;
+  
+  return (ow->error_group != -1);
+}
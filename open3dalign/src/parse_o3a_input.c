@@ -2164,7 +2164,7 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
         result = qmd(od);
         gettimeofday(&end, NULL);
         elapsed_time(od, &start, &end);
-        free_threads(od);
+        free_workers(od);
         switch (result) {
           case OUT_OF_MEMORY:
           tee_error(od, run_type, overall_line_num,
@@ -2555,7 +2555,7 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
         result = energy(od);
         gettimeofday(&end, NULL);
         elapsed_time(od, &start, &end);
-        free_threads(od);
+        free_workers(od);
         switch (result) {
           case OUT_OF_MEMORY:
           tee_error(od, run_type, overall_line_num,
@@ -2844,7 +2844,7 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
         gettimeofday(&end, NULL);
         elapsed_time(od, &start, &end);
         len = 0;
-        free_threads(od);
+        free_workers(od);
         switch (result) {
           case OUT_OF_MEMORY:
           tee_error(od, run_type, overall_line_num,
@@ -3009,6 +3009,7 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
         continue;
       }
       od->align.type = ALIGN_ATOMBASED_BIT;
+      od->align.compression = SDF_STREAM_NONE;
       if ((parameter = get_args(od, "type"))) {
         if ((!strncasecmp(parameter, "phar", 4))
           || (!strncasecmp(parameter, "mix", 3))) {
@@ -3111,6 +3112,56 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
             continue;
           }
         }
+        od->align.n_shards = 1;
+        if ((parameter = get_args(od, "shards"))) {
+          sscanf(parameter, "%d", &(od->align.n_shards));
+          if (od->align.n_shards < 1) {
+            tee_error(od, run_type, overall_line_num,
+              E_POSITIVE_NUMBER, "shards parameter", ALIGN_FAILED);
+            fail = !(run_type & INTERACTIVE_RUN);
+            continue;
+          }
+        }
+        if ((parameter = get_args(od, "compress"))) {
+          if (!strncasecmp(parameter, "gz", 2)) {
+            od->align.compression = SDF_STREAM_GZIP;
+          }
+          else if (!strncasecmp(parameter, "zst", 3)) {
+            #ifdef O3_HAVE_ZSTD
+            od->align.compression = SDF_STREAM_ZSTD;
+            #else
+            tee_error(od, run_type, overall_line_num,
+              "Open3DALIGN was built without zstd support.\n%s",
+              ALIGN_FAILED);
+            fail = !(run_type & INTERACTIVE_RUN);
+            continue;
+            #endif
+          }
+          else if (strncasecmp(parameter, "none", 4)) {
+            tee_error(od, run_type, overall_line_num,
+              "The only allowed values for the \"compress\" "
+              "parameter are \"NONE\", \"GZIP\" and \"ZSTD\".\n%s",
+              ALIGN_FAILED);
+            fail = !(run_type & INTERACTIVE_RUN);
+            continue;
+          }
+          /*
+          Pharao poses and iterative template files are
+          read back through FILE pointers or by the
+          pharao executable, so they are always written
+          uncompressed; the same holds for qmd and filter
+          conformer files, which compress does not affect
+          */
+          if (od->align.compression && (od->align.type
+            & (ALIGN_PHARAO_BIT | ALIGN_ITERATIVE_TEMPLATE_BIT))) {
+            tee_error(od, run_type, overall_line_num,
+              "Compressed output is only available for "
+              "ATOM and MIXED alignments with SINGLE "
+              "or MULTIPLE templates.\n%s", ALIGN_FAILED);
+            fail = !(run_type & INTERACTIVE_RUN);
+            continue;
+          }
+        }
         if ((parameter = get_args(od, "print_rmsd"))) {
           if (!strncasecmp(parameter, "y", 1)) {
             od->align.type |= ALIGN_PRINT_RMSD_BIT;
@@ -3322,10 +3373,23 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
               return PARSE_INPUT_ERROR;
             }
             conf_dir = (i ? od->align.candidate_conf_dir : od->align.template_conf_dir);
-            if ((!conf_dir[0]) || (!dexist(conf_dir))) {
+            if ((!conf_dir[0]) || ((!dexist(conf_dir)) && (!is_conf_db(conf_dir)))) {
               fail = 1;
               break;
             }
+            /*
+            PHARAO reads SDF conformational databases
+            by itself, hence binary ones can only be
+            used for atom-based alignments
+            */
+            if ((od->align.type & (ALIGN_PHARAO_BIT | ALIGN_MIXED_BIT))
+              && is_conf_db(conf_dir)) {
+              tee_error(od, run_type, overall_line_num,
+                "Binary conformational databases such as \"%s\" "
+                "can only be used with \"type=ATOM\".\n%s",
+                conf_dir, ALIGN_FAILED);
+              return PARSE_INPUT_ERROR;
+            }
             result = check_conf_db(od, conf_dir, (i ? CANDIDATE_DB : TEMPLATE_DB),
               &wrong_object_num, &wrong_conf_num);
             if (result) {
@@ -3342,6 +3406,13 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
                   od->task.string, ALIGN_FAILED);
                 return PARSE_INPUT_ERROR;
 
+                case WRONG_DATA_FORMAT:
+                tee_error(od, run_type, overall_line_num, 
+                  E_FILE_CORRUPTED_OR_IN_WRONG_FORMAT,
+                  "binary conformational database",
+                  od->task.string, ALIGN_FAILED);
+                return PARSE_INPUT_ERROR;
+
                 case N_ATOM_BOND_MISMATCH:
                 tee_error(od, run_type, overall_line_num,
                   E_CONF_DB_ATOM_BONDS_NOT_MATCHING,
@@ -3454,7 +3525,7 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
           result = align_random(od);
         }
         else {
-          if (alloc_threads(od)) {
+          if (alloc_workers(od)) {
             tee_error(od, run_type, overall_line_num,
               E_OUT_OF_MEMORY, ALIGN_FAILED);
             O3_ERROR_PRINT(&(od->task));
@@ -3465,7 +3536,9 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
         gettimeofday(&end, NULL);
         elapsed_time(od, &start, &end);
         len = 0;
-        free_threads(od);
+        free_sdf_imports(od);
+        free_mol_templates(od);
+        free_workers(od);
         switch (result) {
           case OUT_OF_MEMORY:
           tee_error(od, run_type, overall_line_num,
@@ -3863,7 +3936,7 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
           return PARSE_INPUT_ERROR;
         }
         result = compare(od, &od_comp, type, VERBOSE_BIT);
-        free_threads(od);
+        free_workers(od);
         switch (result) {
           case OUT_OF_MEMORY:
           tee_error(od, run_type, overall_line_num,
@@ -3961,6 +4034,121 @@ int parse_input(O3Data *od, FILE *input_stream, int run_type)
         remove_recursive(od_comp.field.mol_dir);
       }
     }
+    else if (!strcasecmp(arg->me[0], "conf_db")) {
+      gettimeofday(&start, NULL);
+      if (!(od->valid & SDF_BIT)) {
+        tee_error(od, run_type, overall_line_num,
+          E_IMPORT_MOLFILE_FIRST, CONF_DB_FAILED);
+        fail = !(run_type & INTERACTIVE_RUN);
+        continue;
+      }
+      /*
+      convert a directory of SDF conformational databases
+      into a single indexed binary file, which can be
+      supplied to ALIGN as conf_dir, template_conf_dir
+      or candidate_conf_dir
+      */
+      memset(file_basename, 0, BUF_LEN);
+      if (od->qmd.qmd_dir[0]) {
+        strcpy(file_basename, od->qmd.qmd_dir);
+      }
+      if ((parameter = get_args(od, "conf_dir"))) {
+        strcpy(file_basename, parameter);
+      }
+      if (!(file_basename[0])) {
+        tee_error(od, run_type, overall_line_num,
+          "Please supply the \"conf_dir\" parameter.\n%s",
+          CONF_DB_FAILED);
+        fail = !(run_type & INTERACTIVE_RUN);
+        continue;
+      }
+      absolute_path(file_basename);
+      if (!(parameter = get_args(od, "file"))) {
+        tee_error(od, run_type, overall_line_num, "Please specify a file "
+          "where the binary conformational database should be saved.\n%s",
+          CONF_DB_FAILED);
+        fail = !(run_type & INTERACTIVE_RUN);
+        continue;
+      }
+      memset(od->file[ASCII_IN]->name, 0, BUF_LEN);
+      strcpy(od->file[ASCII_IN]->name, parameter);
+      absolute_path(od->file[ASCII_IN]->name);
+      type = sizeof(double);
+      if ((parameter = get_args(od, "precision"))) {
+        if (!strncasecmp(parameter, "single", 6)) {
+          type = sizeof(float);
+        }
+        else if (strncasecmp(parameter, "double", 6)) {
+          tee_error(od, run_type, overall_line_num,
+            "The only allowed values for the \"precision\" "
+            "parameter are \"DOUBLE\" and \"SINGLE\".\n%s",
+            CONF_DB_FAILED);
+          fail = !(run_type & INTERACTIVE_RUN);
+          continue;
+        }
+      }
+      if (!(run_type & DRY_RUN)) {
+        if (!dexist(file_basename)) {
+          tee_error(od, run_type, overall_line_num,
+            E_DIR_NOT_EXISTING, file_basename, CONF_DB_FAILED);
+          fail = !(run_type & INTERACTIVE_RUN);
+          continue;
+        }
+        ++command;
+        tee_printf(od, M_TOOL_INVOKE, nesting, command, "CONF_DB", line_orig);
+        tee_flush(od);
+        reset_sdf_reader_stats();
+        result = write_conf_db(od, file_basename, od->file[ASCII_IN]->name,
+          type, &wrong_object_num, &wrong_conf_num);
+        gettimeofday(&end, NULL);
+        elapsed_time(od, &start, &end);
+        switch (result) {
+          case OUT_OF_MEMORY:
+          tee_error(od, run_type, overall_line_num,
+            E_OUT_OF_MEMORY, CONF_DB_FAILED);
+          return PARSE_INPUT_ERROR;
+
+          case CANNOT_READ_ORIGINAL_SDF:
+          tee_error(od, run_type, overall_line_num, 
+            E_ERROR_IN_READING_CONF_FILE,
+            od->task.string, CONF_DB_FAILED);
+          return PARSE_INPUT_ERROR;
+
+          case PREMATURE_EOF:
+          tee_error(od, run_type, overall_line_num, 
+            E_FILE_CORRUPTED_OR_IN_WRONG_FORMAT, "SDF",
+            od->task.string, CONF_DB_FAILED);
+          return PARSE_INPUT_ERROR;
+
+          case N_ATOM_BOND_MISMATCH:
+          tee_error(od, run_type, overall_line_num,
+            E_CONF_DB_ATOM_BONDS_NOT_MATCHING,
+            wrong_object_num + 1, od->task.string,
+            wrong_conf_num, CONF_DB_FAILED);
+          return PARSE_INPUT_ERROR;
+
+          case CANNOT_WRITE_CONF_DB:
+          tee_error(od, run_type, overall_line_num,
+            E_FILE_CANNOT_BE_OPENED_FOR_WRITING,
+            od->task.string, CONF_DB_FAILED);
+          return PARSE_INPUT_ERROR;
+        }
+        for (i = 0, j = 0, len = 0; i < od->grid.object_num; ++i) {
+          if (od->pel.conf_population[ANY_DB]->pe[i]) {
+            ++j;
+            len += od->pel.conf_population[ANY_DB]->pe[i];
+          }
+        }
+        tee_printf(od, "%d conformers of %d objects were stored as %s "
+          "precision coordinates in the binary conformational database:\n%s\n",
+          len, j, ((type == sizeof(float)) ? "single" : "double"),
+          od->file[ASCII_IN]->name);
+        print_sdf_reader_stats(od);
+        tee_printf(od, "\n");
+        tee_printf(od, M_TOOL_SUCCESS, nesting, command, "CONF_DB");
+        tee_flush(od);
+      }
+    }
     else if ((!strcasecmp(arg->me[0], "cd"))
       || (!strcasecmp(arg->me[0], "chdir"))) {
       memset(file_basename, 0, BUF_LEN);
@@ -48,13 +48,10 @@ int qmd(O3Data *od)
 {
   int i;
   int n_threads;
-  #ifndef WIN32
-  pthread_attr_t thread_attr;
-  #endif
-  ThreadInfo **ti;
+  int result;
 
 
-  if (alloc_threads(od)) {
+  if (alloc_workers(od)) {
     return OUT_OF_MEMORY;
   }
   if (!(od->al.task_list = (TaskInfo **)
@@ -69,6 +66,9 @@ int qmd(O3Data *od)
   for (i = 0; i < od->grid.object_num ; ++i) {
     od->al.mol_info[i]->done = 0;
   }
+  if (!(od->mel.task_queue = alloc_task_queue(1, od->grid.object_num))) {
+    return OUT_OF_MEMORY;
+  }
   set_random_seed(od, od->random_seed);
   for (i = 0; i < od->qmd.runs; ++i) {
     od->mel.random_seed_array[i] = (unsigned long)
@@ -76,57 +76,29 @@ int qmd(O3Data *od)
   }
   #ifndef WIN32
   pthread_mutex_init(od->mel.mutex, NULL);
-  pthread_attr_init(&thread_attr);
-  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
   #else
   if (!(*(od->mel.mutex) = CreateMutex(NULL, FALSE, NULL))) {
     return CANNOT_CREATE_THREAD;
   }
   #endif  
-  n_threads = fill_thread_info(od, od->grid.object_num);
-  ti = od->mel.thread_info;
-  for (i = 0; i < n_threads; ++i) {
-    /*
-    create the i-th thread
-    */
-    #ifndef WIN32
-    od->error_code = pthread_create(&(od->thread_id[i]),
-      &thread_attr, (void *(*)(void *))qmd_thread, ti[i]);
-    if (od->error_code) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #else
-    od->hThreadArray[i] = CreateThread(NULL, 0,
-      (LPTHREAD_START_ROUTINE)qmd_thread,
-      ti[i], 0, &(od->dwThreadIdArray[i]));
-    if (!(od->hThreadArray[i])) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #endif
-  }
-  #ifndef WIN32
-  /*
-  free the pthread attribute memory
-  */
-  pthread_attr_destroy(&thread_attr);
+  n_threads = fill_worker_info(od, NULL, od->grid.object_num);
   /*
-  wait for all threads to have finished
+  start the threads and wait for all of them to have finished
   */
-  for (i = 0; i < n_threads; ++i) {
-    od->error_code = pthread_join(od->thread_id[i],
-      &(od->thread_result[i]));
-    if (od->error_code) {
-      return CANNOT_JOIN_THREAD;
-    }
-  }
+  reset_arena_stats();
+  result = run_workers(od, "qmd", n_threads, (void *)qmd_thread);
+  #ifndef WIN32
   pthread_mutex_destroy(od->mel.mutex);
   #else
-  WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-  for (i = 0; i < n_threads; ++i) {
-    CloseHandle(od->hThreadArray[i]);
-  }
   CloseHandle(*(od->mel.mutex));
   #endif
+  if (result) {
+    O3_ERROR_LOCATE(&(od->task));
+    return result;
+  }
+  print_arena_stats(od);
+  free_task_queue(od->mel.task_queue);
+  od->mel.task_queue = NULL;
   free(od->mel.random_seed_array);
   od->mel.random_seed_array = NULL;
   
@@ -167,7 +139,7 @@ DWORD qmd_thread(void *pointer)
   int alloc_fail = 0;
   int restart = 0;
   int maybe_restart = 0;
-  int assigned = 1;
+  int **h;
   double heavy_msd_lap = 0.0;
   double heavy_msd_syst = 0.0;
   double min_heavy_msd = 0.0;
@@ -182,12 +154,14 @@ DWORD qmd_thread(void *pointer)
   ConfInfo *conf[O3_MAX_CONF] = { NULL, NULL, NULL, NULL };
   ConfInfo **conf_array = NULL;
   ConfInfo *fitted_conf = NULL;
-  ThreadInfo *ti;
+  Arena *arena = NULL;
+  Arena *task_arena = NULL;
+  WorkerInfo *ti;
   FileDescriptor mol_fd;
   FileDescriptor inp_fd;
 
 
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(&mol_fd, 0, sizeof(FileDescriptor));
   memset(&inp_fd, 0, sizeof(FileDescriptor));
   memset(buffer, 0, BUF_LEN);
@@ -197,88 +171,76 @@ DWORD qmd_thread(void *pointer)
   /*
   allocate memory for AtomInfo structure array
   */
-  if (!(atom = (AtomInfo **)alloc_array(ti->od.field.max_n_atoms + 1, sizeof(AtomInfo)))) {
+  if (!(atom = (AtomInfo **)alloc_array(ti->od->field.max_n_atoms + 1, sizeof(AtomInfo)))) {
     alloc_fail = 1;
   }
-  if (!(bond_list = (BondList **)alloc_array(ti->od.field.max_n_bonds + 1, sizeof(BondList)))) {
+  if (!(bond_list = (BondList **)alloc_array(ti->od->field.max_n_bonds + 1, sizeof(BondList)))) {
     alloc_fail = 1;
   }
-  if ((conf_array = (ConfInfo **)malloc((ti->od.qmd.runs + 2) * sizeof(ConfInfo *)))) {
-    memset(conf_array, 0, (ti->od.qmd.runs + 2) * sizeof(ConfInfo *));
-  }
-  else {
-    alloc_fail = 1;
-  }
-  if (alloc_lap_info(&li, ti->od.field.max_n_atoms)) {
+  /*
+  scratch structures which live as long as the thread
+  are carved from one arena; conformations and H
+  histograms found while processing an object are
+  carved from another one, which is reset per object
+  */
+  if ((!(arena = alloc_arena(ARENA_BLOCK_SIZE)))
+    || (!(task_arena = alloc_arena(ARENA_BLOCK_SIZE)))) {
     alloc_fail = 1;
   }
-  for (i = 0; i < O3_MAX_SDM; ++i) {
-    if ((sdm[i] = (AtomPair *)malloc(square(ti->od.field.max_n_atoms) * sizeof(AtomPair)))) {
-      memset(sdm[i], 0, square(ti->od.field.max_n_atoms) * sizeof(AtomPair));
-    }
-    else {
-      alloc_fail = 1;
-    }
-  }
-  for (i = 0; i < 2; ++i) {
-    if (!(used[i] = malloc(ti->od.field.max_n_atoms))) {
+  if (arena) {
+    if (!(conf_array = (ConfInfo **)arena_alloc(arena,
+      (ti->od->qmd.runs + 2) * sizeof(ConfInfo *)))) {
       alloc_fail = 1;
     }
-  }
-  for (i = 0; i < O3_MAX_CONF; ++i) {
-    if (!(conf[i] = alloc_conf(ti->od.field.max_n_atoms))) {
+    if (arena_alloc_lap_info(arena, &li, ti->od->field.max_n_atoms)) {
       alloc_fail = 1;
     }
-  }
-  while (assigned) {
-    object_num = 0;
-    assigned = 0;
-    while ((!assigned) && (object_num < ti->od.grid.object_num)) {
-      if (!(ti->od.al.mol_info[object_num]->done)) {
-        #ifndef WIN32
-        pthread_mutex_lock(ti->od.mel.mutex);
-        #else
-        WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-        #endif
-        if (!(ti->od.al.mol_info[object_num]->done)) {
-          ti->od.al.mol_info[object_num]->done = 1;
-          assigned = 1;
-        }
-        #ifndef WIN32
-        pthread_mutex_unlock(ti->od.mel.mutex);
-        #else
-        ReleaseMutex(ti->od.mel.mutex);
-        #endif
+    for (i = 0; i < O3_MAX_SDM; ++i) {
+      if (!(sdm[i] = (AtomPair *)arena_alloc(arena,
+        square(ti->od->field.max_n_atoms) * sizeof(AtomPair)))) {
+        alloc_fail = 1;
       }
-      if (!assigned) {
-        ++object_num;
+    }
+    for (i = 0; i < 2; ++i) {
+      if (!(used[i] = (char *)arena_alloc(arena, ti->od->field.max_n_atoms))) {
+        alloc_fail = 1;
       }
     }
-    if (!assigned)  {
-      break;
+    for (i = 0; i < O3_MAX_CONF; ++i) {
+      if (!(conf[i] = arena_alloc_conf(arena, ti->od->field.max_n_atoms))) {
+        alloc_fail = 1;
+      }
     }
+  }
+  while ((object_num = claim_task(ti->od->mel.task_queue, 0)) != -1) {
+    ti->od->al.mol_info[object_num]->done = 1;
     if (alloc_fail) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-      ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+      ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
       continue;
     }
-    if ((ti->od.al.task_list[object_num]->code =
-      fill_atom_info(&(ti->od), ti->od.al.task_list[object_num],
+    /*
+    whatever was left over by the previous object,
+    also after an error, is released at once
+    */
+    reset_arena(task_arena);
+    memset(conf_array, 0, (ti->od->qmd.runs + 2) * sizeof(ConfInfo *));
+    conf[O3_CURR]->h = NULL;
+    if ((ti->od->al.task_list[object_num]->code =
+      fill_atom_info(ti->od, ti->od->al.task_list[object_num],
         atom, bond_list, object_num, O3_MMFF94))) {
       continue;
     }
-    if ((ti->od.al.task_list[object_num]->code = fill_tinker_types(atom))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
+    if ((ti->od->al.task_list[object_num]->code = fill_tinker_types(atom))) {
+      O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
       continue;
     }
-    n_atoms = ti->od.al.mol_info[object_num]->n_atoms;
+    n_atoms = ti->od->al.mol_info[object_num]->n_atoms;
     for (i = 0; i < O3_MAX_CONF; ++i) {
-      conf[i]->atom = atom;
-      conf[i]->n_atoms = n_atoms;
-      conf[i]->n_heavy_atoms = ti->od.al.mol_info[object_num]->n_heavy_atoms;
+      set_conf_atoms(conf[i], atom, n_atoms);
     }
-    sprintf(work_dir, "%s%c%04d", ti->od.qmd.qmd_dir, SEPARATOR,
-      ti->od.al.mol_info[object_num]->object_id);
+    sprintf(work_dir, "%s%c%04d", ti->od->qmd.qmd_dir, SEPARATOR,
+      ti->od->al.mol_info[object_num]->object_id);
     sprintf(buffer, "%s.sdf", work_dir);
     /*
     if we are restarting a run, the %04d.sdf file might already exist
@@ -300,38 +262,38 @@ DWORD qmd_thread(void *pointer)
       result = mkdir(work_dir);
       #endif
       if (result) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], work_dir);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_CREATE_SCRDIR;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], work_dir);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_CREATE_SCRDIR;
         continue;
       }
     }
     /*
     prepare the initial XYZ geometry
     */
-    sprintf(buffer, "%s%c%04d%c%04d.xyz", ti->od.qmd.qmd_dir, SEPARATOR,
-      ti->od.al.mol_info[object_num]->object_id, SEPARATOR,
-      ti->od.al.mol_info[object_num]->object_id);
-    sprintf(buffer2, "%s%c%04d%c%04d.bnd", ti->od.qmd.qmd_dir, SEPARATOR,
-      ti->od.al.mol_info[object_num]->object_id, SEPARATOR,
-      ti->od.al.mol_info[object_num]->object_id);
-    ti->od.al.task_list[object_num]->code = write_tinker_xyz_bnd
-      (&(ti->od), atom, bond_list, n_atoms, object_num, buffer, buffer2);
-    if (ti->od.al.task_list[object_num]->code) {
+    sprintf(buffer, "%s%c%04d%c%04d.xyz", ti->od->qmd.qmd_dir, SEPARATOR,
+      ti->od->al.mol_info[object_num]->object_id, SEPARATOR,
+      ti->od->al.mol_info[object_num]->object_id);
+    sprintf(buffer2, "%s%c%04d%c%04d.bnd", ti->od->qmd.qmd_dir, SEPARATOR,
+      ti->od->al.mol_info[object_num]->object_id, SEPARATOR,
+      ti->od->al.mol_info[object_num]->object_id);
+    ti->od->al.task_list[object_num]->code = write_tinker_xyz_bnd
+      (ti->od, atom, bond_list, n_atoms, object_num, buffer, buffer2);
+    if (ti->od->al.task_list[object_num]->code) {
       continue;
     }
     run = 0;
     restart = 0;
     if (maybe_restart) {
-      for (restart = 1; restart && (run <= ti->od.qmd.runs); ++run) {
+      for (restart = 1; restart && (run <= ti->od->qmd.runs); ++run) {
         /*
         check all existing XYZ files; as soon as a malformed one is found,
         exit the loop
         directly from scratch
         */
-        sprintf(inp_fd.name, "%s%c%04d%c%04d_%06d.xyz", ti->od.qmd.qmd_dir, SEPARATOR,
-           ti->od.al.mol_info[object_num]->object_id, SEPARATOR,
-           ti->od.al.mol_info[object_num]->object_id, run);
+        sprintf(inp_fd.name, "%s%c%04d%c%04d_%06d.xyz", ti->od->qmd.qmd_dir, SEPARATOR,
+           ti->od->al.mol_info[object_num]->object_id, SEPARATOR,
+           ti->od->al.mol_info[object_num]->object_id, run);
         /*
         if the file already exists, check that it is not malformed
         if it is ok, skip ahead
@@ -359,23 +321,23 @@ DWORD qmd_thread(void *pointer)
       if (restart < 2) {
         restart = -1;
       }
-      for (run = restart + 1; maybe_restart && (run < ti->od.qmd.runs); ++run) {
+      for (run = restart + 1; maybe_restart && (run < ti->od->qmd.runs); ++run) {
         /*
         removed all files eventually created during previous runs
         which are malformed or not needed anymore
         */
         sprintf(buffer,
-          "%s%c%04d%c%04d_%06d.xyz", ti->od.qmd.qmd_dir,
-          SEPARATOR, ti->od.al.mol_info[object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[object_num]->object_id, run);
+          "%s%c%04d%c%04d_%06d.xyz", ti->od->qmd.qmd_dir,
+          SEPARATOR, ti->od->al.mol_info[object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[object_num]->object_id, run);
         remove(buffer);
-        sprintf(buffer, "%s%c%04d%c%04d_%06d.001", ti->od.qmd.qmd_dir, SEPARATOR,
-          ti->od.al.mol_info[object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[object_num]->object_id, run - 1);
+        sprintf(buffer, "%s%c%04d%c%04d_%06d.001", ti->od->qmd.qmd_dir, SEPARATOR,
+          ti->od->al.mol_info[object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[object_num]->object_id, run - 1);
         remove(buffer);
-        sprintf(buffer, "%s%c%04d%c%04d_%06d.dyn", ti->od.qmd.qmd_dir, SEPARATOR,
-          ti->od.al.mol_info[object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[object_num]->object_id, run - 1);
+        sprintf(buffer, "%s%c%04d%c%04d_%06d.dyn", ti->od->qmd.qmd_dir, SEPARATOR,
+          ti->od->al.mol_info[object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[object_num]->object_id, run - 1);
         remove(buffer);
       }
     }
@@ -388,31 +350,31 @@ DWORD qmd_thread(void *pointer)
       */
       restart = run + 1;
     }
-    for (run = 0, n_conf = 0; (!(ti->od.al.task_list[object_num]->code))
-      && (run <= ti->od.qmd.runs); ++run) {
-      sprintf(buffer2, "%04d_%06d.xyz", ti->od.al.mol_info[object_num]->object_id, run);
+    for (run = 0, n_conf = 0; (!(ti->od->al.task_list[object_num]->code))
+      && (run <= ti->od->qmd.runs); ++run) {
+      sprintf(buffer2, "%04d_%06d.xyz", ti->od->al.mol_info[object_num]->object_id, run);
       if (run > restart) {
         if (!run) {
           /*
           if this is the first run, the starting geometry has to be optimized
           */
-          sprintf(buffer, "%04d.xyz", ti->od.al.mol_info[object_num]->object_id);
+          sprintf(buffer, "%04d.xyz", ti->od->al.mol_info[object_num]->object_id);
         }
         else {
           /*
           otherwise MD is carried out on the previous optimized geometry,
           then the last geometry of the MD trajectory is optimized
           */
-          sprintf(buffer, "%04d_%06d.xyz", ti->od.al.mol_info[object_num]->object_id, run - 1);
-          if ((ti->od.al.task_list[object_num]->code = tinker_dynamic
-            (&(ti->od), work_dir, buffer, object_num, run,
-            ti->od.mel.random_seed_array[run - 1]))) {
+          sprintf(buffer, "%04d_%06d.xyz", ti->od->al.mol_info[object_num]->object_id, run - 1);
+          if ((ti->od->al.task_list[object_num]->code = tinker_dynamic
+            (ti->od, work_dir, buffer, object_num, run,
+            ti->od->mel.random_seed_array[run - 1]))) {
             continue;
           }
-          sprintf(buffer, "%04d_%06d.001", ti->od.al.mol_info[object_num]->object_id, run - 1);
+          sprintf(buffer, "%04d_%06d.001", ti->od->al.mol_info[object_num]->object_id, run - 1);
         }
-        if ((ti->od.al.task_list[object_num]->code = tinker_minimize
-          (&(ti->od), work_dir, buffer, buffer2, object_num, run))) {
+        if ((ti->od->al.task_list[object_num]->code = tinker_minimize
+          (ti->od, work_dir, buffer, buffer2, object_num, run))) {
           continue;
         }
         if (!run) {
@@ -421,29 +383,29 @@ DWORD qmd_thread(void *pointer)
         /*
         the raw MD geometry can be removed
         */
-        sprintf(buffer, "%s%c%04d%c%04d_%06d.001", ti->od.qmd.qmd_dir, SEPARATOR,
-          ti->od.al.mol_info[object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[object_num]->object_id, run - 1);
+        sprintf(buffer, "%s%c%04d%c%04d_%06d.001", ti->od->qmd.qmd_dir, SEPARATOR,
+          ti->od->al.mol_info[object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[object_num]->object_id, run - 1);
         remove(buffer);
         /*
         as well as the .dyn file
         */
-        sprintf(buffer, "%s%c%04d%c%04d_%06d.dyn", ti->od.qmd.qmd_dir, SEPARATOR,
-          ti->od.al.mol_info[object_num]->object_id,
-          SEPARATOR, ti->od.al.mol_info[object_num]->object_id, run - 1);
+        sprintf(buffer, "%s%c%04d%c%04d_%06d.dyn", ti->od->qmd.qmd_dir, SEPARATOR,
+          ti->od->al.mol_info[object_num]->object_id,
+          SEPARATOR, ti->od->al.mol_info[object_num]->object_id, run - 1);
         remove(buffer);
       }
       /*
       open the optimized geometry
       */
       sprintf(inp_fd.name,
-        "%s%c%04d%c%04d_%06d.xyz", ti->od.qmd.qmd_dir,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id, run);
+        "%s%c%04d%c%04d_%06d.xyz", ti->od->qmd.qmd_dir,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id, run);
       if (!(inp_fd.handle = fopen(inp_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], inp_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_TEMP_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], inp_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_TEMP_FILE;
         continue;
       }
       j = 0;
@@ -458,7 +420,7 @@ DWORD qmd_thread(void *pointer)
           j = 1;
           if (n != n_atoms) {
             n = 0;
-            ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
+            ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
             break;
           }
           n = 0;
@@ -475,20 +437,25 @@ DWORD qmd_thread(void *pointer)
       fclose(inp_fd.handle);
       inp_fd.handle = NULL;
       if (n != n_atoms) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], inp_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], inp_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
         continue;
       }
-      if (!(conf[O3_CURR]->h = (int **)alloc_array(conf[O3_CURR]->n_heavy_atoms, MAX_H_BINS * sizeof(int)))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      /*
+      the histogram of a conformation which was
+      discarded in the previous run is recycled
+      */
+      if ((!(conf[O3_CURR]->h)) && (!(conf[O3_CURR]->h = (int **)arena_alloc_array
+        (task_arena, conf[O3_CURR]->n_heavy_atoms, MAX_H_BINS * sizeof(int))))) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
         continue;
       }
       compute_conf_h(conf[O3_CURR]);
       min_heavy_msd = MAX_CUTOFF;
       min_pos = 0;
-      user_msd = square(ti->od.qmd.rmsd);
+      user_msd = square(ti->od->qmd.rmsd);
       i = 0;
       /*
       both superposition techniques are attempted;
@@ -524,9 +491,9 @@ DWORD qmd_thread(void *pointer)
         /*
         this conformation is new: let's store it
         */
-        if (!(conf_array[n_conf] = alloc_conf(n_atoms))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+        if (!(conf_array[n_conf] = arena_alloc_conf(task_arena, n_atoms))) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
           break;
         }
         n = n_conf;
@@ -540,13 +507,14 @@ DWORD qmd_thread(void *pointer)
         n = min_pos;
       }
       if (n != -1) {
-        conf_array[n]->n_atoms = n_atoms;
-        conf_array[n]->n_heavy_atoms = conf[O3_CURR]->n_heavy_atoms;
-        conf_array[n]->atom = atom;
-        if (conf_array[n]->h) {
-          free_array(conf_array[n]->h);
-        }
+        set_conf_atoms(conf_array[n], atom, n_atoms);
+        /*
+        histograms are swapped, so that the one being
+        replaced can be recycled by the next conformation
+        */
+        h = conf_array[n]->h;
         conf_array[n]->h = conf[O3_CURR]->h;
+        conf[O3_CURR]->h = h;
         conf_array[n]->energy = energy;
         conf_array[n]->n_conf = n + 1;
         cblas_dcopy(n_atoms * 3, conf[O3_CURR]->coord, 1, conf_array[n]->coord, 1);
@@ -562,61 +530,56 @@ DWORD qmd_thread(void *pointer)
         i = 1;
         while (i < n_conf) {
           energy = conf_array[i]->energy - glob_min;
-          if (energy > ti->od.qmd.range) {
+          if (energy > ti->od->qmd.range) {
             break;
           }
           ++i;
         }
         if (i < n_conf) {
+          /*
+          dropped conformations are
+          released with the task arena
+          */
           for (j = i; j < n_conf; ++j) {
-            free_array(conf_array[j]->h);
-            conf_array[j]->h = NULL;
-            free_conf(conf_array[j]);
             conf_array[j] = NULL;
           }
           n_conf = i;
         }
       }
-      else if (conf[O3_CURR]->h) {
-        free_array(conf[O3_CURR]->h);
-        conf[O3_CURR]->h = NULL;
-      }
     }
-    if (ti->od.qmd.options & QMD_KEEP_INITIAL) {
+    if (ti->od->qmd.options & QMD_KEEP_INITIAL) {
       /*
       after all runs have been carried out, eventually
       the starting conformation is added to the conformational
       array, its energy is computed, and the array is sorted
       once again by increasing energy
       */
-      if (!(conf_array[n_conf] = alloc_conf(n_atoms))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      if (!(conf_array[n_conf] = arena_alloc_conf(task_arena, n_atoms))) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
         continue;
       }
-      if (!(conf_array[n_conf]->h = (int **)alloc_array
-        (conf[O3_CURR]->n_heavy_atoms, MAX_H_BINS * sizeof(int)))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      if (!(conf_array[n_conf]->h = (int **)arena_alloc_array
+        (task_arena, conf[O3_CURR]->n_heavy_atoms, MAX_H_BINS * sizeof(int)))) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
         continue;
       }
       compute_conf_h(conf_array[n_conf]);
-      conf_array[n_conf]->n_atoms = n_atoms;
-      conf_array[n_conf]->n_heavy_atoms = conf[O3_CURR]->n_heavy_atoms;
-      conf_array[n_conf]->atom = atom;
-      sprintf(buffer, "%04d.xyz", ti->od.al.mol_info[object_num]->object_id);
-      ti->od.al.task_list[object_num]->code = tinker_analyze
-        (&(ti->od), work_dir, buffer, object_num, -1);
-      if (ti->od.al.task_list[object_num]->code) {
+      set_conf_atoms(conf_array[n_conf], atom, n_atoms);
+      sprintf(buffer, "%04d.xyz", ti->od->al.mol_info[object_num]->object_id);
+      ti->od->al.task_list[object_num]->code = tinker_analyze
+        (ti->od, work_dir, buffer, object_num, -1);
+      if (ti->od->al.task_list[object_num]->code) {
         continue;
       }
-      sprintf(inp_fd.name, "%s%c%04d%c%04d.xyz", ti->od.qmd.qmd_dir,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id);
+      sprintf(inp_fd.name, "%s%c%04d%c%04d.xyz", ti->od->qmd.qmd_dir,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id);
       if (!(inp_fd.handle = fopen(inp_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], inp_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_TEMP_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], inp_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_TEMP_FILE;
         continue;
       }
       n = 0;
@@ -626,13 +589,13 @@ DWORD qmd_thread(void *pointer)
       }
       if (n != n_atoms) {
         energy = 0.0;
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], inp_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], inp_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
       }
       fclose(inp_fd.handle);
       inp_fd.handle = NULL;
-      if (ti->od.al.task_list[object_num]->code) {
+      if (ti->od->al.task_list[object_num]->code) {
         continue;
       }
       conf_array[n_conf]->energy = energy;
@@ -643,7 +606,7 @@ DWORD qmd_thread(void *pointer)
       ++n_conf;
       qsort(conf_array, n_conf, sizeof(ConfInfo *), compare_conf_energy);
     }
-    if (!(ti->od.al.task_list[object_num]->code)) {
+    if (!(ti->od->al.task_list[object_num]->code)) {
       /*
       finally, each conformation is aligned onto the global minimum
       using the method which yields the lowest RMSD
@@ -659,27 +622,34 @@ DWORD qmd_thread(void *pointer)
           ? conf[O3_FITTED_LAP] : conf[O3_FITTED_SYST]);
         cblas_dcopy(n_atoms * 3, fitted_conf->coord, 1, conf_array[i]->coord, 1);
       }
-      sprintf(mol_fd.name, "%s%c%04d.mol", ti->od.field.mol_dir,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id);
+      sprintf(mol_fd.name, "%s%c%04d.mol", ti->od->field.mol_dir,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id);
       if (!(mol_fd.handle = fopen(mol_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
         continue;
       }
-      sprintf(inp_fd.name, "%s%c%04d.sdf", ti->od.qmd.qmd_dir, SEPARATOR,
-        ti->od.al.mol_info[object_num]->object_id);
+      /*
+      conformer files stay plain SDF: besides the
+      conformer store, which would decode them, they
+      are read through FILE pointers by Pharao-based
+      alignments and by filter, and handed over as
+      they are to the pharao executable
+      */
+      sprintf(inp_fd.name, "%s%c%04d.sdf", ti->od->qmd.qmd_dir, SEPARATOR,
+        ti->od->al.mol_info[object_num]->object_id);
       if (!(inp_fd.handle = fopen(inp_fd.name, "wb+"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], inp_fd.name);
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], inp_fd.name);
         fclose(mol_fd.handle);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
         continue;
       }
       if (conf_array[0]) {
         glob_min = conf_array[0]->energy;
       }
-      for (i = 0; (!(ti->od.al.task_list[object_num]->code)) && (i < n_conf); ++i) {
+      for (i = 0; (!(ti->od->al.task_list[object_num]->code)) && (i < n_conf); ++i) {
         /*
         SDF header is written
         */
@@ -687,12 +657,12 @@ DWORD qmd_thread(void *pointer)
           "%04d_%06d\n"
           "  %-18s3D\n"
           "%04d_%06d\n",
-          ti->od.al.mol_info[object_num]->object_id, i + 1,
-          PACKAGE_NAME, ti->od.al.mol_info[object_num]->object_id, i + 1);
+          ti->od->al.mol_info[object_num]->object_id, i + 1,
+          PACKAGE_NAME, ti->od->al.mol_info[object_num]->object_id, i + 1);
         if (find_conformation_in_sdf(mol_fd.handle, inp_fd.handle, SKIP_MOL_NAME)) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-          ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+          ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
           continue;
         }
         atom_num = 0;
@@ -704,7 +674,7 @@ DWORD qmd_thread(void *pointer)
             coordinates from the original MOL file
             are replaced by those of the current conformation
             */
-            if (replace_coord(ti->od.al.mol_info[object_num]->sdf_version,
+            if (replace_coord(ti->od->al.mol_info[object_num]->sdf_version,
               buffer, &(conf_array[i]->coord[atom_num * 3]))) {
               break;
             }
@@ -713,9 +683,9 @@ DWORD qmd_thread(void *pointer)
           fprintf(inp_fd.handle, "%s\n", buffer);
         }
         if (atom_num < n_atoms) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-          ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+          ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
           continue;
         }
         /*
@@ -726,52 +696,29 @@ DWORD qmd_thread(void *pointer)
           "%.4lf\n\n"
           ">  <DELTA>\n"
           "%.4lf\n\n"
-          SDF_DELIMITER "\n", ((ti->od.qmd.options & QMD_GBSA) ? "GBSA " : ""),
+          SDF_DELIMITER "\n", ((ti->od->qmd.options & QMD_GBSA) ? "GBSA " : ""),
           conf_array[i]->energy, conf_array[i]->energy - glob_min);
         rewind(mol_fd.handle);
       }
       fclose(inp_fd.handle);
       fclose(mol_fd.handle);
     }
-    i = 0;
-    while (conf_array[i]) {
-      free_array(conf_array[i]->h);
-      conf_array[i]->h = NULL;
-      free_conf(conf_array[i]);
-      conf_array[i] = NULL;
-      ++i;
-    }
-    if ((!(ti->od.al.task_list[object_num]->code)) && (ti->od.qmd.options & QMD_REMOVE_FOLDER)) {
+    if ((!(ti->od->al.task_list[object_num]->code)) && (ti->od->qmd.options & QMD_REMOVE_FOLDER)) {
       /*
       remove folder with intermediate XYZ files if the user wants so
       */
-      sprintf(buffer, "%s%c%04d", ti->od.qmd.qmd_dir, SEPARATOR,
-        ti->od.al.mol_info[object_num]->object_id);
+      sprintf(buffer, "%s%c%04d", ti->od->qmd.qmd_dir, SEPARATOR,
+        ti->od->al.mol_info[object_num]->object_id);
       remove_recursive(buffer);
     }
   }
   free_array(atom);
   free_array(bond_list);
-  free_lap_info(&li);
-  for (i = 0; i < O3_MAX_SDM; ++i) {
-    if (sdm[i]) {
-      free(sdm[i]);
-    }
-  }
-  for (i = 0; i < 2; ++i) {
-    if (used[i]) {
-      free(used[i]);
-    }
-  }
-  if (conf_array) {
-    free(conf_array);
-  }
-  for (i = 0; i < O3_MAX_CONF; ++i) {
-    free_conf(conf[i]);
-  }
+  free_arena(task_arena);
+  free_arena(arena);
 
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
@@ -783,13 +730,9 @@ int energy(O3Data *od)
   int i;
   int result = 0;
   int n_threads;
-  #ifndef WIN32
-  pthread_attr_t thread_attr;
-  #endif
-  ThreadInfo **ti;
 
 
-  if (alloc_threads(od)) {
+  if (alloc_workers(od)) {
     return OUT_OF_MEMORY;
   }
   if (!(od->al.task_list = (TaskInfo **)
@@ -799,59 +742,34 @@ int energy(O3Data *od)
   for (i = 0; i < od->grid.object_num ; ++i) {
     od->al.mol_info[i]->done = 0;
   }
+  if (!(od->mel.task_queue = alloc_task_queue(1, od->grid.object_num))) {
+    return OUT_OF_MEMORY;
+  }
   #ifndef WIN32
   pthread_mutex_init(od->mel.mutex, NULL);
-  pthread_attr_init(&thread_attr);
-  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
   #else
   if (!(*(od->mel.mutex) = CreateMutex(NULL, FALSE, NULL))) {
     return CANNOT_CREATE_THREAD;
   }
   #endif  
-  n_threads = fill_thread_info(od, od->grid.object_num);
-  ti = od->mel.thread_info;
-  for (i = 0; i < n_threads; ++i) {
-    /*
-    create the i-th thread
-    */
-    #ifndef WIN32
-    od->error_code = pthread_create(&(od->thread_id[i]),
-      &thread_attr, (void *(*)(void *))energy_thread, ti[i]);
-    if (od->error_code) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #else
-    od->hThreadArray[i] = CreateThread(NULL, 0,
-      (LPTHREAD_START_ROUTINE)energy_thread,
-      ti[i], 0, &(od->dwThreadIdArray[i]));
-    if (!(od->hThreadArray[i])) {
-      return CANNOT_CREATE_THREAD;
-    }
-    #endif
-  }
-  #ifndef WIN32
+  n_threads = fill_worker_info(od, NULL, od->grid.object_num);
   /*
-  free the pthread attribute memory
+  start the threads and wait for all of them to have finished
   */
-  pthread_attr_destroy(&thread_attr);
-  /*
-  wait for all threads to have finished
-  */
-  for (i = 0; i < n_threads; ++i) {
-    od->error_code = pthread_join(od->thread_id[i],
-      &(od->thread_result[i]));
-    if (od->error_code) {
-      return CANNOT_JOIN_THREAD;
-    }
-  }
+  reset_arena_stats();
+  result = run_workers(od, "energy", n_threads, (void *)energy_thread);
+  #ifndef WIN32
   pthread_mutex_destroy(od->mel.mutex);
   #else
-  WaitForMultipleObjects(n_threads, od->hThreadArray, TRUE, INFINITE);
-  for (i = 0; i < n_threads; ++i) {
-    CloseHandle(od->hThreadArray[i]);
-  }
   CloseHandle(*(od->mel.mutex));
   #endif
+  if (result) {
+    O3_ERROR_LOCATE(&(od->task));
+    return result;
+  }
+  print_arena_stats(od);
+  free_task_queue(od->mel.task_queue);
+  od->mel.task_queue = NULL;
   if (!(od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)) {
     for (i = 0, result = 1; result && (i < od->grid.object_num); ++i) {
       sprintf(od->qmd.src, "%s%c%04d.sdf", od->align.align_scratch,
@@ -885,10 +803,10 @@ DWORD energy_thread(void *pointer)
   int n_atoms = 0;
   int alloc_fail = 0;
   int alloc_new_conf = 0;
-  int assigned = 1;
   int minimize = 0;
   int min_pos = 0;
   int pairs = 0;
+  int **h;
   double heavy_msd_lap = 0.0;
   double heavy_msd_syst = 0.0;
   double original_heavy_msd_lap = 0.0;
@@ -905,85 +823,71 @@ DWORD energy_thread(void *pointer)
   ConfInfo *conf[O3_MAX_CONF] = { NULL, NULL, NULL, NULL };
   ConfInfo **conf_array = NULL;
   ConfInfo *fitted_conf = NULL;
-  ThreadInfo *ti;
+  Arena *arena = NULL;
+  Arena *task_arena = NULL;
+  WorkerInfo *ti;
   FileDescriptor sdf_fd;
   FileDescriptor mol_fd;
 
 
-  ti = (ThreadInfo *)pointer;
+  ti = (WorkerInfo *)pointer;
   memset(&sdf_fd, 0, sizeof(FileDescriptor));
   memset(&mol_fd, 0, sizeof(FileDescriptor));
   memset(buffer, 0, BUF_LEN);
   memset(buffer2, 0, BUF_LEN);
-  minimize = (strcmp(ti->od.qmd.minimizer, TINKER_ANALYZE_EXE) ? 1 : 0);
+  minimize = (strcmp(ti->od->qmd.minimizer, TINKER_ANALYZE_EXE) ? 1 : 0);
   /*
   allocate memory for AtomInfo structure array
   */
-  if (!(atom = (AtomInfo **)alloc_array(ti->od.field.max_n_atoms + 1, sizeof(AtomInfo)))) {
+  if (!(atom = (AtomInfo **)alloc_array(ti->od->field.max_n_atoms + 1, sizeof(AtomInfo)))) {
+    alloc_fail = 1;
+  }
+  if (!(bond_list = (BondList **)alloc_array(ti->od->field.max_n_bonds + 1, sizeof(BondList)))) {
     alloc_fail = 1;
   }
-  if (!(bond_list = (BondList **)alloc_array(ti->od.field.max_n_bonds + 1, sizeof(BondList)))) {
+  /*
+  as in qmd_thread(), thread-wide scratch structures
+  and per-object conformations come from two arenas
+  */
+  if ((!(arena = alloc_arena(ARENA_BLOCK_SIZE)))
+    || (!(task_arena = alloc_arena(ARENA_BLOCK_SIZE)))) {
     alloc_fail = 1;
   }
-  for (i = 0; i < O3_MAX_CONF; ++i) {
-    if (!(conf[i] = alloc_conf(ti->od.field.max_n_atoms))) {
+  for (i = 0; arena && (i < O3_MAX_CONF); ++i) {
+    if (!(conf[i] = arena_alloc_conf(arena, ti->od->field.max_n_atoms))) {
       alloc_fail = 1;
     }
   }
-  if ((ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
-    && (ti->od.qmd.options & (QMD_ALIGN | QMD_REMOVE_DUPLICATES))) {
-    if (alloc_lap_info(&li, ti->od.field.max_n_atoms)) {
+  if (arena && (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+    && (ti->od->qmd.options & (QMD_ALIGN | QMD_REMOVE_DUPLICATES))) {
+    if (arena_alloc_lap_info(arena, &li, ti->od->field.max_n_atoms)) {
       alloc_fail = 1;
     }
     for (i = 0; i < O3_MAX_SDM; ++i) {
-      if ((sdm[i] = (AtomPair *)malloc(square(ti->od.field.max_n_atoms) * sizeof(AtomPair)))) {
-        memset(sdm[i], 0, square(ti->od.field.max_n_atoms) * sizeof(AtomPair));
-      }
-      else {
+      if (!(sdm[i] = (AtomPair *)arena_alloc(arena,
+        square(ti->od->field.max_n_atoms) * sizeof(AtomPair)))) {
         alloc_fail = 1;
       }
     }
     for (i = 0; i < 2; ++i) {
-      if (!(used[i] = malloc(ti->od.field.max_n_atoms))) {
+      if (!(used[i] = (char *)arena_alloc(arena, ti->od->field.max_n_atoms))) {
         alloc_fail = 1;
       }
     }
   }
-  while (assigned) {
-    object_num = 0;
-    assigned = 0;
-    while ((!assigned) && (object_num < ti->od.grid.object_num)) {
-      if (!(ti->od.al.mol_info[object_num]->done)) {
-        #ifndef WIN32
-        pthread_mutex_lock(ti->od.mel.mutex);
-        #else
-        WaitForSingleObject(ti->od.mel.mutex, INFINITE);
-        #endif
-        if (!(ti->od.al.mol_info[object_num]->done)) {
-          ti->od.al.mol_info[object_num]->done = 1;
-          assigned = 1;
-        }
-        #ifndef WIN32
-        pthread_mutex_unlock(ti->od.mel.mutex);
-        #else
-        ReleaseMutex(ti->od.mel.mutex);
-        #endif
-      }
-      if (!assigned) {
-        ++object_num;
-      }
-    }
-    if (!assigned)  {
-      break;
-    }
+  while ((object_num = claim_task(ti->od->mel.task_queue, 0)) != -1) {
+    ti->od->al.mol_info[object_num]->done = 1;
     if (alloc_fail) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-      ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+      ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
       continue;
     }
-    if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-      sprintf(sdf_fd.name, "%s%c%04d.sdf", ti->od.qmd.src,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id);
+    reset_arena(task_arena);
+    conf_array = NULL;
+    conf[O3_CURR]->h = NULL;
+    if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+      sprintf(sdf_fd.name, "%s%c%04d.sdf", ti->od->qmd.src,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id);
       /*
       if this object is missing, no harm
       */
@@ -991,44 +895,46 @@ DWORD energy_thread(void *pointer)
         continue;
       }
     }
-    if ((ti->od.al.task_list[object_num]->code =
-      fill_atom_info(&(ti->od), ti->od.al.task_list[object_num],
+    if ((ti->od->al.task_list[object_num]->code =
+      fill_atom_info(ti->od, ti->od->al.task_list[object_num],
         atom, bond_list, object_num, O3_MMFF94))) {
       continue;
     }
-    if ((ti->od.al.task_list[object_num]->code = fill_tinker_types(atom))) {
-      O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
+    if ((ti->od->al.task_list[object_num]->code = fill_tinker_types(atom))) {
+      O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
       continue;
     }
-    n_atoms = ti->od.al.mol_info[object_num]->n_atoms;
+    n_atoms = ti->od->al.mol_info[object_num]->n_atoms;
     /*
     prepare the .bnd file
     */
-    sprintf(buffer, "%s%c%04d.bnd", ti->od.align.align_scratch, SEPARATOR,
-      ti->od.al.mol_info[object_num]->object_id);
-    ti->od.al.task_list[object_num]->code = write_tinker_xyz_bnd
-      (&(ti->od), atom, bond_list, n_atoms, object_num, NULL, buffer);
-    if (ti->od.al.task_list[object_num]->code) {
+    sprintf(buffer, "%s%c%04d.bnd", ti->od->align.align_scratch, SEPARATOR,
+      ti->od->al.mol_info[object_num]->object_id);
+    ti->od->al.task_list[object_num]->code = write_tinker_xyz_bnd
+      (ti->od, atom, bond_list, n_atoms, object_num, NULL, buffer);
+    if (ti->od->al.task_list[object_num]->code) {
       continue;
     }
     for (i = 0; i < O3_MAX_CONF; ++i) {
-      conf[i]->atom = atom;
-      conf[i]->n_atoms = n_atoms;
-      conf[i]->n_heavy_atoms = ti->od.al.mol_info[object_num]->n_heavy_atoms;
+      set_conf_atoms(conf[i], atom, n_atoms);
     }
-    if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-      conf_max = ti->od.pel.conf_population[ANY_DB]->pe[object_num];
-      if ((conf_array = (ConfInfo **)realloc(conf_array,
-        ((conf_max + 1) * sizeof(ConfInfo *))))) {
-        memset(conf_array, 0, (conf_max + 1) * sizeof(ConfInfo *));
+    if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+      conf_max = ti->od->pel.conf_population[ANY_DB]->pe[object_num];
+      if (!(conf_array = (ConfInfo **)arena_alloc(task_arena,
+        (conf_max + 1) * sizeof(ConfInfo *)))) {
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+        fclose(sdf_fd.handle);
+        sdf_fd.handle = NULL;
+        continue;
       }
     }
     for (conf_num = 0, n_conf = 0; conf_num < conf_max; ++conf_num) {
-      if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+      if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
         if (find_conformation_in_sdf(sdf_fd.handle, NULL, 0)) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[object_num], sdf_fd.name);
-          ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_SDF_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[object_num], sdf_fd.name);
+          ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_SDF_FILE;
           continue;
         }
         atom_num = 0;
@@ -1044,9 +950,9 @@ DWORD energy_thread(void *pointer)
           ++atom_num;
         }
         if (atom_num < n_atoms) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[object_num], sdf_fd.name);
-          ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_SDF_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[object_num], sdf_fd.name);
+          ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_SDF_FILE;
           continue;
         }
         while (fgets(buffer, BUF_LEN, sdf_fd.handle)
@@ -1055,11 +961,11 @@ DWORD energy_thread(void *pointer)
       /*
       prepare the XYZ geometry
       */
-      sprintf(buffer, "%s%c%04d_%06d.xyz", ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[object_num]->object_id, conf_num + 1);
-      ti->od.al.task_list[object_num]->code = write_tinker_xyz_bnd
-        (&(ti->od), atom, bond_list, n_atoms, object_num, buffer, NULL);
-      if (ti->od.al.task_list[object_num]->code) {
+      sprintf(buffer, "%s%c%04d_%06d.xyz", ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[object_num]->object_id, conf_num + 1);
+      ti->od->al.task_list[object_num]->code = write_tinker_xyz_bnd
+        (ti->od, atom, bond_list, n_atoms, object_num, buffer, NULL);
+      if (ti->od->al.task_list[object_num]->code) {
         continue;
       }
       /*
@@ -1067,30 +973,30 @@ DWORD energy_thread(void *pointer)
       */
       if (minimize) {
         sprintf(buffer, "%04d_%06d.xyz",
-          ti->od.al.mol_info[object_num]->object_id, conf_num + 1);
+          ti->od->al.mol_info[object_num]->object_id, conf_num + 1);
         sprintf(buffer2, "%04d_%06d_min.xyz",
-          ti->od.al.mol_info[object_num]->object_id, conf_num + 1);
+          ti->od->al.mol_info[object_num]->object_id, conf_num + 1);
       }
       else {
         sprintf(buffer2, "%04d_%06d.xyz",
-          ti->od.al.mol_info[object_num]->object_id, conf_num + 1);
+          ti->od->al.mol_info[object_num]->object_id, conf_num + 1);
       }
-      ti->od.al.task_list[object_num]->code = (minimize
-        ? tinker_minimize(&(ti->od), ti->od.align.align_scratch,
+      ti->od->al.task_list[object_num]->code = (minimize
+        ? tinker_minimize(ti->od, ti->od->align.align_scratch,
         buffer, mol_fd.name, object_num, conf_num + 1)
-        : tinker_analyze(&(ti->od), ti->od.align.align_scratch,
+        : tinker_analyze(ti->od, ti->od->align.align_scratch,
         buffer2, object_num, conf_num + 1));
-      if (ti->od.al.task_list[object_num]->code) {
+      if (ti->od->al.task_list[object_num]->code) {
         continue;
       }
       /*
       open the optimized (or analyzed) geometry
       */
-      sprintf(mol_fd.name, "%s%c%s", ti->od.align.align_scratch, SEPARATOR, buffer2);
+      sprintf(mol_fd.name, "%s%c%s", ti->od->align.align_scratch, SEPARATOR, buffer2);
       if (!(mol_fd.handle = fopen(mol_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_TEMP_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_TEMP_FILE;
         continue;
       }
       j = 0;
@@ -1105,7 +1011,7 @@ DWORD energy_thread(void *pointer)
           j = 1;
           if (n != n_atoms) {
             n = 0;
-            ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
+            ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
             break;
           }
           n = 0;
@@ -1122,33 +1028,33 @@ DWORD energy_thread(void *pointer)
       fclose(mol_fd.handle);
       remove(mol_fd.name);
       if (minimize) {
-        sprintf(mol_fd.name, "%s%c%s", ti->od.align.align_scratch, SEPARATOR, buffer2);
+        sprintf(mol_fd.name, "%s%c%s", ti->od->align.align_scratch, SEPARATOR, buffer2);
         remove(mol_fd.name);
       }
       if (n != n_atoms) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_OUT_FILE;
         continue;
       }
-      if (!(ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)) {
+      if (!(ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)) {
         continue;
       }
-      if (ti->od.qmd.options & (QMD_ALIGN | QMD_REMOVE_DUPLICATES)) {
-        if (!(conf[O3_CURR]->h = (int **)alloc_array
-          (conf[O3_CURR]->n_heavy_atoms, MAX_H_BINS * sizeof(int)))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+      if (ti->od->qmd.options & (QMD_ALIGN | QMD_REMOVE_DUPLICATES)) {
+        if ((!(conf[O3_CURR]->h)) && (!(conf[O3_CURR]->h = (int **)arena_alloc_array
+          (task_arena, conf[O3_CURR]->n_heavy_atoms, MAX_H_BINS * sizeof(int))))) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
           continue;
         }
         compute_conf_h(conf[O3_CURR]);
       }
       n = n_conf;
       alloc_new_conf = 1;
-      if (ti->od.qmd.options & QMD_REMOVE_DUPLICATES) {
+      if (ti->od->qmd.options & QMD_REMOVE_DUPLICATES) {
         min_heavy_msd = MAX_CUTOFF;
         min_pos = 0;
-        user_msd = square(ti->od.qmd.rmsd);
+        user_msd = square(ti->od->qmd.rmsd);
         i = 0;
         /*
         both superposition techniques are attempted;
@@ -1163,7 +1069,7 @@ DWORD energy_thread(void *pointer)
             conf[O3_PROGRESS], conf[O3_CAND], sdm[0], sdm[1], sdm[2], 
             used, rt_mat, ANGLE_STEP, &heavy_msd_syst,
             &original_heavy_msd_syst, &pairs);
-          if (ti->od.qmd.options & QMD_DONT_SUPERPOSE) {
+          if (ti->od->qmd.options & QMD_DONT_SUPERPOSE) {
             heavy_msd_syst = original_heavy_msd_syst;
           }
           if ((min_heavy_msd - heavy_msd_syst) > MSD_THRESHOLD) {
@@ -1178,7 +1084,7 @@ DWORD energy_thread(void *pointer)
             conf[O3_PROGRESS], sdm[0], sdm[1],
             used, rt_mat, &heavy_msd_lap,
             &original_heavy_msd_lap, &pairs);
-          if (ti->od.qmd.options & QMD_DONT_SUPERPOSE) {
+          if (ti->od->qmd.options & QMD_DONT_SUPERPOSE) {
             heavy_msd_lap = original_heavy_msd_lap;
           }
           if ((min_heavy_msd - heavy_msd_lap) > MSD_THRESHOLD) {
@@ -1205,21 +1111,22 @@ DWORD energy_thread(void *pointer)
         }
       }
       if (alloc_new_conf) {
-        if (!(conf_array[n_conf] = alloc_conf(n_atoms))) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          ti->od.al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
+        if (!(conf_array[n_conf] = arena_alloc_conf(task_arena, n_atoms))) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          ti->od->al.task_list[object_num]->code = FL_OUT_OF_MEMORY;
           break;
         }
         ++n_conf;
       }
       if (n != -1) {
-        conf_array[n]->n_atoms = n_atoms;
-        conf_array[n]->n_heavy_atoms = conf[O3_CURR]->n_heavy_atoms;
-        conf_array[n]->atom = atom;
-        if (conf_array[n]->h) {
-          free_array(conf_array[n]->h);
-        }
+        set_conf_atoms(conf_array[n], atom, n_atoms);
+        /*
+        histograms are swapped, so that the one being
+        replaced can be recycled by the next conformation
+        */
+        h = conf_array[n]->h;
         conf_array[n]->h = conf[O3_CURR]->h;
+        conf[O3_CURR]->h = h;
         conf_array[n]->energy = energy;
         conf_array[n]->n_conf = n + 1;
         cblas_dcopy(n_atoms * 3, conf[O3_CURR]->coord, 1, conf_array[n]->coord, 1);
@@ -1235,34 +1142,31 @@ DWORD energy_thread(void *pointer)
         i = 1;
         while (i < n_conf) {
           energy = conf_array[i]->energy - glob_min;
-          if (energy > ti->od.qmd.range) {
+          if (energy > ti->od->qmd.range) {
             break;
           }
           ++i;
         }
         if (i < n_conf) {
+          /*
+          dropped conformations are
+          released with the task arena
+          */
           for (j = i; j < n_conf; ++j) {
-            free_array(conf_array[j]->h);
-            conf_array[j]->h = NULL;
-            free_conf(conf_array[j]);
             conf_array[j] = NULL;
           }
           n_conf = i;
         }
       }
-      else if (conf[O3_CURR]->h) {
-        free_array(conf[O3_CURR]->h);
-        conf[O3_CURR]->h = NULL;
-      }
     }
     if (sdf_fd.handle) {
       fclose(sdf_fd.handle);
       sdf_fd.handle = NULL;
       conf_max = n_conf;
     }
-    if (!(ti->od.al.task_list[object_num]->code)) {
-      if ((ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
-        && (ti->od.qmd.options & QMD_ALIGN)) {
+    if (!(ti->od->al.task_list[object_num]->code)) {
+      if ((ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+        && (ti->od->qmd.options & QMD_ALIGN)) {
         /*
         finally, if the user wants so,
         each conformation is aligned onto the global minimum
@@ -1280,45 +1184,45 @@ DWORD energy_thread(void *pointer)
           cblas_dcopy(n_atoms * 3, fitted_conf->coord, 1, conf_array[i]->coord, 1);
         }
       }
-      sprintf(mol_fd.name, "%s%c%04d.mol", ti->od.field.mol_dir,
-        SEPARATOR, ti->od.al.mol_info[object_num]->object_id);
+      sprintf(mol_fd.name, "%s%c%04d.mol", ti->od->field.mol_dir,
+        SEPARATOR, ti->od->al.mol_info[object_num]->object_id);
       if (!(mol_fd.handle = fopen(mol_fd.name, "rb"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
         continue;
       }
       sprintf(sdf_fd.name, "%s%c%04d.sdf",
-        (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
-        ? ti->od.qmd.dest : ti->od.align.align_scratch, SEPARATOR,
-        ti->od.al.mol_info[object_num]->object_id);
+        (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+        ? ti->od->qmd.dest : ti->od->align.align_scratch, SEPARATOR,
+        ti->od->al.mol_info[object_num]->object_id);
       if (!(sdf_fd.handle = fopen(sdf_fd.name, "wb+"))) {
-        O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-        O3_ERROR_STRING(ti->od.al.task_list[object_num], sdf_fd.name);
+        O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+        O3_ERROR_STRING(ti->od->al.task_list[object_num], sdf_fd.name);
         fclose(mol_fd.handle);
-        ti->od.al.task_list[object_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
+        ti->od->al.task_list[object_num]->code = FL_CANNOT_WRITE_TEMP_FILE;
         continue;
       }
-      if ((ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) && conf_array[0]) {
+      if ((ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) && conf_array[0]) {
         glob_min = conf_array[0]->energy;
       }
-      for (i = 0; (!(ti->od.al.task_list[object_num]->code)) && (i < conf_max); ++i) {
+      for (i = 0; (!(ti->od->al.task_list[object_num]->code)) && (i < conf_max); ++i) {
         /*
         SDF header is written
         */
-        if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
+        if (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
           fprintf(sdf_fd.handle,
             "%04d_%06d\n"
             "  %-18s3D\n"
             "%04d_%06d\n",
-            ti->od.al.mol_info[object_num]->object_id, i + 1,
-            PACKAGE_NAME, ti->od.al.mol_info[object_num]->object_id, i + 1);
+            ti->od->al.mol_info[object_num]->object_id, i + 1,
+            PACKAGE_NAME, ti->od->al.mol_info[object_num]->object_id, i + 1);
         }
         if (find_conformation_in_sdf(mol_fd.handle, sdf_fd.handle,
-          (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) ? SKIP_MOL_NAME : 0)) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-          ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
+          (ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT) ? SKIP_MOL_NAME : 0)) {
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+          ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
           continue;
         }
         atom_num = 0;
@@ -1330,8 +1234,8 @@ DWORD energy_thread(void *pointer)
             coordinates from the original MOL file
             are replaced by those of the current conformation
             */
-            if (replace_coord(ti->od.al.mol_info[object_num]->sdf_version,
-              buffer, &(((ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
+            if (replace_coord(ti->od->al.mol_info[object_num]->sdf_version,
+              buffer, &(((ti->od->align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
               ? conf_array[i] : conf[O3_CURR])->coord[atom_num * 3]))) {
               break;
             }
@@ -1340,9 +1244,9 @@ DWORD energy_thread(void *pointer)
           fprintf(sdf_fd.handle, "%s\n", buffer);
         }
         if (atom_num < n_atoms) {
-          O3_ERROR_LOCATE(ti->od.al.task_list[object_num]);
-          O3_ERROR_STRING(ti->od.al.task_list[object_num], mol_fd.name);
-          ti->od.al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
+          O3_ERROR_LOCATE(ti->od->al.task_list[object_num]);
+          O3_ERROR_STRING(ti->od->al.task_list[object_num], mol_fd.name);
+          ti->od->al.task_list[object_num]->code = FL_CANNOT_READ_MOL_FILE;
           continue;
         }
         /*
@@ -1353,51 +1257,21 @@ DWORD energy_thread(void *pointer)
           "%.4lf\n\n"
           ">  <DELTA>\n"
           "%.4lf\n\n"
-          SDF_DELIMITER "\n", ((ti->od.qmd.options & QMD_GBSA) ? "GBSA " : ""),
+          SDF_DELIMITER "\n", ((ti->od->qmd.options & QMD_GBSA) ? "GBSA " : ""),
           conf_array[i]->energy, conf_array[i]->energy - glob_min);
         rewind(mol_fd.handle);
       }
       fclose(sdf_fd.handle);
       fclose(mol_fd.handle);
     }
-    i = 0;
-    while ((ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT)
-      && conf_array[i]) {
-      if (ti->od.qmd.options & (QMD_ALIGN | QMD_REMOVE_DUPLICATES)) {
-        free_array(conf_array[i]->h);
-        conf_array[i]->h = NULL;
-      }
-      free_conf(conf_array[i]);
-      conf_array[i] = NULL;
-      ++i;
-    }
   }
   free_array(atom);
   free_array(bond_list);
-  if (conf_array) {
-    free(conf_array);
-  }
-  for (i = 0; i < O3_MAX_CONF; ++i) {
-    free_conf(conf[i]);
-  }
-  if (ti->od.align.type & ALIGN_MULTICONF_CANDIDATE_BIT) {
-    if (ti->od.qmd.options & (QMD_ALIGN | QMD_REMOVE_DUPLICATES)) {
-      free_lap_info(&li);
-      for (i = 0; i < O3_MAX_SDM; ++i) {
-        if (sdm[i]) {
-          free(sdm[i]);
-        }
-      }
-      for (i = 0; i < 2; ++i) {
-        if (used[i]) {
-          free(used[i]);
-        }
-      }
-    }
-  }
+  free_arena(task_arena);
+  free_arena(arena);
 
   #ifndef WIN32
-  pthread_exit(pointer);
+  return pointer;
   #else
   return 0;
   #endif
@@ -0,0 +1,320 @@
+/*
+
+score_index.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+#define SCORE_INDEX_NO_TAG    0
+#define SCORE_INDEX_SCORE_TAG    1
+#define SCORE_INDEX_TEMPLATE_TAG  2
+#define SCORE_INDEX_CONF_TAG    3
+
+
+static void init_score_index_entry(ScoreIndexEntry *entry, SdfStream *ss)
+{
+  memset(entry, 0, sizeof(ScoreIndexEntry));
+  if (ss) {
+    entry->offset = tell_sdf_stream(ss);
+    tell_sdf_stream_member(ss, &(entry->member_offset), &(entry->member_start));
+  }
+}
+
+
+static void parse_score_index_line(char *line, int score_type, int *tag, ScoreIndexEntry *entry)
+{
+  /*
+  the value of an SDF data item is on the line
+  following its ">  <NAME>" header
+  */
+  switch (*tag) {
+    case SCORE_INDEX_SCORE_TAG:
+    entry->has_score = (sscanf(line, "%lf", &(entry->score)) == 1);
+    break;
+    
+    case SCORE_INDEX_TEMPLATE_TAG:
+    sscanf(line, "%d", &(entry->best_template_id));
+    break;
+    
+    case SCORE_INDEX_CONF_TAG:
+    sscanf(line, "%d", &(entry->best_conf_num));
+    break;
+  }
+  if (*tag != SCORE_INDEX_NO_TAG) {
+    *tag = SCORE_INDEX_NO_TAG;
+    return;
+  }
+  if (line[0] != '>') {
+    return;
+  }
+  if (strstr(line, ((score_type == SCORE_INDEX_PHARAO)
+    ? "<PHARAO_TANIMOTO>" : "<O3A_SCORE>"))) {
+    *tag = SCORE_INDEX_SCORE_TAG;
+  }
+  else if (strstr(line, "<BEST_TEMPLATE_ID>")) {
+    *tag = SCORE_INDEX_TEMPLATE_TAG;
+  }
+  else if (strstr(line, "<BEST_CANDIDATE_CONF>")) {
+    *tag = SCORE_INDEX_CONF_TAG;
+  }
+}
+
+
+void scan_score_index_record(char *data, size_t size, int score_type, ScoreIndexEntry *entry)
+{
+  char buffer[BUF_LEN];
+  int tag;
+  size_t i;
+  size_t len;
+  
+  
+  /*
+  fill entry from an SDF record held in memory;
+  its offsets are left for the caller to set
+  */
+  init_score_index_entry(entry, NULL);
+  tag = SCORE_INDEX_NO_TAG;
+  for (i = 0; i < size; i += len) {
+    for (len = 0; ((i + len) < size) && (data[i + len] != '\n'); ++len);
+    if ((i + len) < size) {
+      ++len;
+    }
+    if (!strncmp(&data[i], SDF_DELIMITER, 4)) {
+      break;
+    }
+    memcpy(buffer, &data[i], ((len < BUF_LEN) ? len : BUF_LEN - 1));
+    buffer[((len < BUF_LEN) ? len : BUF_LEN - 1)] = '\0';
+    parse_score_index_line(buffer, score_type, &tag, entry);
+  }
+}
+
+
+int write_score_index(char *sdf_name, int score_type, int n_objects, ScoreIndexEntry *entry)
+{
+  int result = 0;
+  struct stat sdf_stat;
+  ScoreIndexHeader header;
+  FileDescriptor idx_fd;
+  
+  
+  /*
+  to be called once the SDF file has been
+  closed, so that its size and modification
+  time are final
+  */
+  memset(&header, 0, sizeof(ScoreIndexHeader));
+  memset(&idx_fd, 0, sizeof(FileDescriptor));
+  sprintf(idx_fd.name, "%s"SCORE_INDEX_EXTENSION, sdf_name);
+  if (stat(sdf_name, &sdf_stat)) {
+    remove(idx_fd.name);
+    return CANNOT_READ_TEMP_FILE;
+  }
+  memcpy(header.magic, SCORE_INDEX_MAGIC, sizeof(SCORE_INDEX_MAGIC));
+  header.version = SCORE_INDEX_VERSION;
+  header.score_type = score_type;
+  header.n_objects = n_objects;
+  header.sdf_size = (int64_t)(sdf_stat.st_size);
+  header.sdf_mtime = (int64_t)(sdf_stat.st_mtime);
+  if (!(idx_fd.handle = fopen(idx_fd.name, "wb"))) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  if ((fwrite(&header, sizeof(ScoreIndexHeader), 1, idx_fd.handle) != 1)
+    || (fwrite(entry, sizeof(ScoreIndexEntry), n_objects, idx_fd.handle) != (size_t)n_objects)) {
+    result = CANNOT_WRITE_TEMP_FILE;
+  }
+  if (fclose(idx_fd.handle)) {
+    result = CANNOT_WRITE_TEMP_FILE;
+  }
+  if (result) {
+    remove(idx_fd.name);
+  }
+  
+  return result;
+}
+
+
+void remove_score_index(char *sdf_name)
+{
+  char idx_name[BUF_LEN];
+  
+  
+  sprintf(idx_name, "%s"SCORE_INDEX_EXTENSION, sdf_name);
+  remove(idx_name);
+}
+
+
+int build_score_index(char *sdf_name, int score_type)
+{
+  char buffer[BUF_LEN];
+  int n;
+  int max_n;
+  int tag;
+  int result;
+  ScoreIndexEntry *entry = NULL;
+  ScoreIndexEntry *temp_entry;
+  ScoreIndexEntry next_entry;
+  SdfStream *ss;
+  
+  
+  /*
+  scan an aligned SDF file once and index all
+  of its records; a trailing incomplete record
+  is not indexed. Offsets of compressed files
+  refer to their decoded contents, and come with
+  those of the member which holds each record
+  */
+  if (!(ss = open_sdf_stream(sdf_name, "rb", NULL))) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  n = 0;
+  max_n = 0;
+  tag = SCORE_INDEX_NO_TAG;
+  memset(buffer, 0, BUF_LEN);
+  init_score_index_entry(&next_entry, ss);
+  while (sdf_stream_gets(buffer, BUF_LEN, ss)) {
+    if (n == max_n) {
+      max_n = (max_n ? max_n * 2 : 64);
+      if (!(temp_entry = (ScoreIndexEntry *)realloc(entry, (max_n + 1) * sizeof(ScoreIndexEntry)))) {
+        close_sdf_stream(ss);
+        if (entry) {
+          free(entry);
+        }
+        return OUT_OF_MEMORY;
+      }
+      entry = temp_entry;
+      memcpy(&entry[n], &next_entry, sizeof(ScoreIndexEntry));
+    }
+    if (!strncmp(buffer, SDF_DELIMITER, 4)) {
+      ++n;
+      tag = SCORE_INDEX_NO_TAG;
+      init_score_index_entry(&next_entry, ss);
+      if (n < max_n) {
+        memcpy(&entry[n], &next_entry, sizeof(ScoreIndexEntry));
+      }
+      continue;
+    }
+    parse_score_index_line(buffer, score_type, &tag, &entry[n]);
+  }
+  close_sdf_stream(ss);
+  result = write_score_index(sdf_name, score_type, n, entry);
+  if (entry) {
+    free(entry);
+  }
+  
+  return result;
+}
+
+
+int read_score_index(char *sdf_name, int score_type, int object_num, ScoreIndexEntry *entry)
+{
+  int result = 0;
+  struct stat sdf_stat;
+  ScoreIndexHeader header;
+  FileDescriptor idx_fd;
+  
+  
+  /*
+  read the index entry of object_num in constant time;
+  returns CANNOT_READ_TEMP_FILE if the index is missing,
+  stale, or was built for another score type
+  */
+  memset(&idx_fd, 0, sizeof(FileDescriptor));
+  sprintf(idx_fd.name, "%s"SCORE_INDEX_EXTENSION, sdf_name);
+  if (stat(sdf_name, &sdf_stat) || (!(idx_fd.handle = fopen(idx_fd.name, "rb")))) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  if ((fread(&header, sizeof(ScoreIndexHeader), 1, idx_fd.handle) != 1)
+    || memcmp(header.magic, SCORE_INDEX_MAGIC, sizeof(SCORE_INDEX_MAGIC))
+    || (header.version != SCORE_INDEX_VERSION)
+    || (header.score_type != (uint32_t)score_type)
+    || (header.sdf_size != (int64_t)(sdf_stat.st_size))
+    || (header.sdf_mtime != (int64_t)(sdf_stat.st_mtime))
+    || (object_num < 0) || (object_num >= header.n_objects)
+    || fseek(idx_fd.handle, (long)(sizeof(ScoreIndexHeader)
+    + object_num * sizeof(ScoreIndexEntry)), SEEK_SET)
+    || (fread(entry, sizeof(ScoreIndexEntry), 1, idx_fd.handle) != 1)) {
+    result = CANNOT_READ_TEMP_FILE;
+  }
+  fclose(idx_fd.handle);
+  
+  return result;
+}
+
+
+int get_score_index_entry(char *sdf_name, int score_type, int object_num, ScoreIndexEntry *entry)
+{
+  /*
+  a missing or stale index is rebuilt with
+  a single pass over the SDF file, so that
+  further lookups need no text scanning
+  */
+  if (!read_score_index(sdf_name, score_type, object_num, entry)) {
+    return 0;
+  }
+  if (build_score_index(sdf_name, score_type)) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  
+  return read_score_index(sdf_name, score_type, object_num, entry);
+}
+
+
+int find_aligned_conformation(SdfStream *ss, char *sdf_name, int score_type, int object_num)
+{
+  ScoreIndexEntry entry;
+  
+  
+  /*
+  move ss to the beginning of the record of
+  object_num, straight away if the SDF file
+  has a valid index (decoding at most the
+  member which holds the record, if the file
+  is compressed), otherwise by skipping the
+  records which come before it
+  */
+  if ((!get_score_index_entry(sdf_name, score_type, object_num, &entry))
+    && (!seek_sdf_stream_member(ss, entry.member_offset,
+    entry.member_start, entry.offset))) {
+    return 0;
+  }
+  if (seek_sdf_stream(ss, 0)) {
+    return PREMATURE_EOF;
+  }
+  
+  return skip_sdf_stream_records(ss, object_num);
+}
@@ -0,0 +1,470 @@
+/*
+
+sdf_import.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+#define SDF_IMPORT_SLOT    0
+
+
+static int is_sdf_delimiter(SdfReader *sr, char *q)
+{
+  return (((q == sr->base) || (q[-1] == '\n'))
+    && ((size_t)(sr->base + sr->size - q) >= 4)
+    && (!strncmp(q, SDF_DELIMITER, 4)));
+}
+
+
+#ifndef WIN32
+static void *sdf_import_scan_thread(void *pointer)
+#else
+static DWORD sdf_import_scan_thread(void *pointer)
+#endif
+{
+  char *q;
+  char *chunk_end;
+  char *file_end;
+  int chunk;
+  int max_n;
+  size_t *temp_end;
+  SdfImport *si;
+  WorkerInfo *wi;
+  
+  
+  /*
+  a record belongs to the chunk where its "$$$$" line
+  starts; chunks are cut at arbitrary byte offsets,
+  since whether a '$' begins a line can always be
+  told by looking at the byte before it
+  */
+  wi = (WorkerInfo *)pointer;
+  si = wi->od->mel.sdf_import[wi->data[SDF_IMPORT_SLOT]];
+  file_end = si->reader.base + si->reader.size;
+  for (chunk = wi->start; chunk <= wi->end; ++chunk) {
+    q = si->reader.base + (size_t)((double)(si->reader.size) * (double)chunk / (double)(si->n_chunks));
+    chunk_end = si->reader.base + (size_t)((double)(si->reader.size)
+      * (double)(chunk + 1) / (double)(si->n_chunks));
+    if (chunk == (si->n_chunks - 1)) {
+      chunk_end = file_end;
+    }
+    max_n = 0;
+    while ((q < chunk_end) && (q = (char *)memchr(q, '$', chunk_end - q))) {
+      if (is_sdf_delimiter(&(si->reader), q)) {
+        if (si->chunk_n[chunk] == max_n) {
+          max_n = (max_n ? max_n * 2 : 256);
+          if (!(temp_end = (size_t *)realloc(si->chunk_end[chunk], max_n * sizeof(size_t)))) {
+            si->chunk_n[chunk] = -1;
+            break;
+          }
+          si->chunk_end[chunk] = temp_end;
+        }
+        q = next_sdf_line(q, file_end);
+        si->chunk_end[chunk][si->chunk_n[chunk]] = (size_t)(q - si->reader.base);
+        ++(si->chunk_n[chunk]);
+        continue;
+      }
+      ++q;
+    }
+  }
+  
+  #ifndef WIN32
+  return pointer;
+  #else
+  return 0;
+  #endif
+}
+
+
+#ifndef WIN32
+static void *sdf_import_check_thread(void *pointer)
+#else
+static DWORD sdf_import_check_thread(void *pointer)
+#endif
+{
+  char *start;
+  char *end;
+  char *line;
+  char *atom_block;
+  int object_num;
+  MolInfo temp_mol_info;
+  SdfImport *si;
+  SdfImportRecord *rec;
+  WorkerInfo *wi;
+  
+  
+  /*
+  parse the counts of each record, locate its atom
+  block and the end of its MOL section ("M  END"
+  or, failing that, the first data item)
+  */
+  wi = (WorkerInfo *)pointer;
+  si = wi->od->mel.sdf_import[wi->data[SDF_IMPORT_SLOT]];
+  memset(&temp_mol_info, 0, sizeof(MolInfo));
+  for (object_num = wi->start; object_num <= wi->end; ++object_num) {
+    rec = &(si->record[object_num]);
+    start = si->reader.base + rec->offset;
+    end = start + rec->size;
+    if ((rec->result = get_sdf_record_counts(start, end, &temp_mol_info, &atom_block))) {
+      continue;
+    }
+    rec->n_atoms = temp_mol_info.n_atoms;
+    rec->n_bonds = temp_mol_info.n_bonds;
+    rec->sdf_version = temp_mol_info.sdf_version;
+    rec->atom_offset = (size_t)(atom_block - si->reader.base);
+    for (line = atom_block; line < end; line = next_sdf_line(line, end)) {
+      if (((end - line) >= 6) && (!strncmp(line, "M  END", 6))) {
+        line = next_sdf_line(line, end);
+        break;
+      }
+      if ((line[0] == '>') || (((end - line) >= 4)
+        && (!strncmp(line, SDF_DELIMITER, 4)))) {
+        break;
+      }
+    }
+    rec->mol_size = (size_t)(line - start);
+  }
+  
+  #ifndef WIN32
+  return pointer;
+  #else
+  return 0;
+  #endif
+}
+
+
+#ifndef WIN32
+static void *sdf_import_mol_thread(void *pointer)
+#else
+static DWORD sdf_import_mol_thread(void *pointer)
+#endif
+{
+  int object_num;
+  SdfImport *si;
+  SdfImportRecord *rec;
+  FileDescriptor mol_fd;
+  WorkerInfo *wi;
+  
+  
+  wi = (WorkerInfo *)pointer;
+  si = wi->od->mel.sdf_import[wi->data[SDF_IMPORT_SLOT]];
+  memset(&mol_fd, 0, sizeof(FileDescriptor));
+  for (object_num = wi->start; object_num <= wi->end; ++object_num) {
+    rec = &(si->record[object_num]);
+    sprintf(mol_fd.name, "%s%c%04d.mol", si->mol_dir, SEPARATOR,
+      wi->od->al.mol_info[object_num]->object_id);
+    if (!(mol_fd.handle = fopen(mol_fd.name, "wb"))) {
+      rec->result = CANNOT_WRITE_TEMP_FILE;
+      continue;
+    }
+    if (fwrite(si->reader.base + rec->offset, 1, rec->mol_size, mol_fd.handle) != rec->mol_size) {
+      rec->result = CANNOT_WRITE_TEMP_FILE;
+    }
+    if (fclose(mol_fd.handle)) {
+      rec->result = CANNOT_WRITE_TEMP_FILE;
+    }
+  }
+  
+  #ifndef WIN32
+  return pointer;
+  #else
+  return 0;
+  #endif
+}
+
+
+static int run_sdf_import_workers(O3Data *od, int slot, char *phase_name, int n_tasks, void *thread_func)
+{
+  int i;
+  int n_threads;
+  
+  
+  n_threads = fill_worker_info(od, NULL, n_tasks);
+  for (i = 0; i < n_threads; ++i) {
+    od->mel.worker_info[i]->data[SDF_IMPORT_SLOT] = slot;
+  }
+  
+  return run_workers(od, phase_name, n_threads, thread_func);
+}
+
+
+void free_sdf_import(SdfImport *si)
+{
+  int i;
+  
+  
+  if (!si) {
+    return;
+  }
+  close_sdf_reader(&(si->reader));
+  if (si->chunk_end) {
+    for (i = 0; i < si->n_chunks; ++i) {
+      if (si->chunk_end[i]) {
+        free(si->chunk_end[i]);
+      }
+    }
+    free(si->chunk_end);
+  }
+  if (si->chunk_n) {
+    free(si->chunk_n);
+  }
+  if (si->record) {
+    free(si->record);
+  }
+  free(si);
+}
+
+
+void free_sdf_imports(O3Data *od)
+{
+  int i;
+  
+  
+  for (i = 0; i < 2; ++i) {
+    if (od->mel.sdf_import[i]) {
+      free_sdf_import(od->mel.sdf_import[i]);
+      od->mel.sdf_import[i] = NULL;
+    }
+  }
+}
+
+
+int import_sdf(O3Data *od, int slot, char *name)
+{
+  char *p;
+  char *file_end;
+  int i;
+  int j;
+  int n;
+  int result;
+  size_t offset;
+  SdfImport *si;
+  
+  
+  /*
+  the SDF file is memory-mapped and split into as many
+  chunks as there are threads; record boundaries are
+  found in each chunk concurrently, then records are
+  validated against the currently loaded objects, again
+  on all threads. Records are then accessed in place
+  */
+  if (od->mel.sdf_import[slot]) {
+    free_sdf_import(od->mel.sdf_import[slot]);
+    od->mel.sdf_import[slot] = NULL;
+  }
+  if (strlen(name) >= BUF_LEN) {
+    O3_ERROR_LOCATE(&(od->task));
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if (!(si = (SdfImport *)malloc(sizeof(SdfImport)))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  memset(si, 0, sizeof(SdfImport));
+  od->mel.sdf_import[slot] = si;
+  strncpy(si->name, name, BUF_LEN - 1);
+  if (map_sdf_file(&(si->reader), name)) {
+    O3_ERROR_LOCATE(&(od->task));
+    O3_ERROR_STRING(&(od->task), name);
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  si->n_chunks = od->mel.n_workers;
+  if ((si->reader.size / SDF_IMPORT_MIN_CHUNK) < (size_t)(si->n_chunks)) {
+    si->n_chunks = (int)(si->reader.size / SDF_IMPORT_MIN_CHUNK);
+  }
+  if (si->n_chunks < 1) {
+    si->n_chunks = 1;
+  }
+  si->chunk_n = (int *)calloc(si->n_chunks, sizeof(int));
+  si->chunk_end = (size_t **)calloc(si->n_chunks, sizeof(size_t *));
+  if ((!(si->chunk_n)) || (!(si->chunk_end))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  if ((result = run_sdf_import_workers(od, slot,
+    "sdf_import", si->n_chunks, (void *)sdf_import_scan_thread))) {
+    return result;
+  }
+  for (i = 0, n = 0; i < si->n_chunks; ++i) {
+    if (si->chunk_n[i] == -1) {
+      O3_ERROR_LOCATE(&(od->task));
+      return OUT_OF_MEMORY;
+    }
+    n += si->chunk_n[i];
+  }
+  /*
+  a trailing record with no "$$$$" line is kept
+  unless only blank space follows the last one
+  */
+  offset = 0;
+  if (n) {
+    for (i = si->n_chunks - 1; !(si->chunk_n[i]); --i);
+    offset = si->chunk_end[i][si->chunk_n[i] - 1];
+  }
+  file_end = si->reader.base + si->reader.size;
+  for (p = si->reader.base + offset; (p < file_end) && isspace((int)(*p)); ++p);
+  if (p < file_end) {
+    ++n;
+  }
+  if (n != od->grid.object_num) {
+    O3_ERROR_LOCATE(&(od->task));
+    O3_ERROR_STRING(&(od->task), name);
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if (!(si->record = (SdfImportRecord *)calloc(n + 1, sizeof(SdfImportRecord)))) {
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  si->n_records = n;
+  for (i = 0, n = 0, offset = 0; i < si->n_chunks; ++i) {
+    for (j = 0; j < si->chunk_n[i]; ++j, ++n) {
+      si->record[n].offset = offset;
+      si->record[n].size = si->chunk_end[i][j] - offset;
+      offset = si->chunk_end[i][j];
+    }
+  }
+  if (n < si->n_records) {
+    si->record[n].offset = offset;
+    si->record[n].size = si->reader.size - offset;
+  }
+  if ((result = run_sdf_import_workers(od, slot,
+    "sdf_import", si->n_records, (void *)sdf_import_check_thread))) {
+    return result;
+  }
+  for (i = 0; i < si->n_records; ++i) {
+    if (si->record[i].result
+      || (si->record[i].n_atoms != od->al.mol_info[i]->n_atoms)
+      || (si->record[i].n_bonds != od->al.mol_info[i]->n_bonds)) {
+      O3_ERROR_LOCATE(&(od->task));
+      O3_ERROR_STRING(&(od->task), name);
+      return CANNOT_READ_ORIGINAL_SDF;
+    }
+  }
+  
+  return 0;
+}
+
+
+int write_sdf_import_mol(O3Data *od, int slot, char *mol_dir)
+{
+  int i;
+  int result;
+  SdfImport *si;
+  
+  
+  /*
+  per-object MOL files are only needed by external
+  programs (Pharao); they are written concurrently
+  straight from the mapped SDF file
+  */
+  si = od->mel.sdf_import[slot];
+  if (strlen(mol_dir) >= BUF_LEN) {
+    O3_ERROR_LOCATE(&(od->task));
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  strncpy(si->mol_dir, mol_dir, BUF_LEN - 1);
+  if ((result = run_sdf_import_workers(od, slot,
+    "sdf_import", si->n_records, (void *)sdf_import_mol_thread))) {
+    return result;
+  }
+  for (i = 0; i < si->n_records; ++i) {
+    if (si->record[i].result) {
+      O3_ERROR_LOCATE(&(od->task));
+      sprintf(od->task.string, "%s%c%04d.mol", mol_dir,
+        SEPARATOR, od->al.mol_info[i]->object_id);
+      return si->record[i].result;
+    }
+  }
+  
+  return 0;
+}
+
+
+int get_sdf_import_coord(SdfImport *si, int object_num, int n_atoms, double *coord)
+{
+  SdfImportRecord *rec;
+  
+  
+  rec = &(si->record[object_num]);
+  
+  return get_sdf_record_coord(rec->sdf_version, n_atoms,
+    si->reader.base + rec->atom_offset,
+    si->reader.base + rec->offset + rec->size, coord);
+}
+
+
+int join_sdf_import(O3Data *od, int slot, FileDescriptor *to_fd)
+{
+  int i;
+  int result = 0;
+  SdfImport *si;
+  SdfImportRecord *rec;
+  
+  
+  /*
+  same as join_mol_to_sdf(), but records are taken
+  in place from the imported file rather than from
+  MOL files
+  */
+  si = od->mel.sdf_import[slot];
+  if (!(to_fd->handle = fopen(to_fd->name, "wb"))) {
+    O3_ERROR_LOCATE(&(od->task));
+    O3_ERROR_STRING(&(od->task), to_fd->name);
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  for (i = 0; (!result) && (i < si->n_records); ++i) {
+    rec = &(si->record[i]);
+    if (fwrite(si->reader.base + rec->offset, 1, rec->mol_size, to_fd->handle) != rec->mol_size) {
+      result = CANNOT_WRITE_TEMP_FILE;
+    }
+    if (rec->mol_size && (si->reader.base[rec->offset + rec->mol_size - 1] != '\n')) {
+      fprintf(to_fd->handle, "\n");
+    }
+    fprintf(to_fd->handle, SDF_DELIMITER"\n");
+  }
+  if (fclose(to_fd->handle)) {
+    result = CANNOT_WRITE_TEMP_FILE;
+  }
+  to_fd->handle = NULL;
+  if (result) {
+    O3_ERROR_LOCATE(&(od->task));
+    O3_ERROR_STRING(&(od->task), to_fd->name);
+  }
+  
+  return result;
+}
@@ -0,0 +1,588 @@
+/*
+
+sdf_reader.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+
+static int sdf_reader_type = SDF_READER_MMAP;
+static double sdf_reader_bytes = 0.0;
+static double sdf_reader_seconds = 0.0;
+
+/*
+powers of ten which are exactly representable as doubles
+*/
+static const double sdf_pow10[] = {
+  1.0e0, 1.0e1, 1.0e2, 1.0e3, 1.0e4, 1.0e5, 1.0e6, 1.0e7,
+  1.0e8, 1.0e9, 1.0e10, 1.0e11, 1.0e12, 1.0e13, 1.0e14, 1.0e15,
+  1.0e16, 1.0e17, 1.0e18, 1.0e19, 1.0e20, 1.0e21, 1.0e22
+};
+
+
+void set_sdf_reader(int type)
+{
+  sdf_reader_type = type;
+}
+
+
+void reset_sdf_reader_stats()
+{
+  sdf_reader_bytes = 0.0;
+  sdf_reader_seconds = 0.0;
+}
+
+
+void print_sdf_reader_stats(O3Data *od)
+{
+  double mb;
+  
+  
+  if (sdf_reader_bytes <= 0.0) {
+    return;
+  }
+  mb = sdf_reader_bytes / 1048576.0;
+  tee_printf(od, "%.1f MB of SDF text were parsed at %.1f MB/s "
+    "by the %s SDF reader.\n", mb, ((sdf_reader_seconds > 0.0)
+    ? mb / sdf_reader_seconds : 0.0), ((sdf_reader_type == SDF_READER_STDIO)
+    ? "line-buffered" : "memory-mapped"));
+}
+
+
+static void add_sdf_reader_stats(struct timeval *start, double bytes)
+{
+  struct timeval end;
+  
+  
+  gettimeofday(&end, NULL);
+  sdf_reader_bytes += bytes;
+  sdf_reader_seconds += (double)(end.tv_sec - start->tv_sec)
+    + (double)(end.tv_usec - start->tv_usec) * 1.0e-06;
+}
+
+
+char *next_sdf_line(char *p, char *end)
+{
+  char *nl;
+  
+  
+  nl = (char *)memchr(p, '\n', end - p);
+  
+  return (nl ? nl + 1 : end);
+}
+
+
+char *get_sdf_line_end(char *p, char *end)
+{
+  char *nl;
+  
+  
+  nl = (char *)memchr(p, '\n', end - p);
+  
+  return (nl ? nl : end);
+}
+
+
+static int parse_sdf_int(char **p, char *end)
+{
+  int sign = 1;
+  int value = 0;
+  char *q;
+  
+  
+  q = *p;
+  while ((q < end) && ((*q == ' ') || (*q == '\t'))) {
+    ++q;
+  }
+  if ((q < end) && ((*q == '-') || (*q == '+'))) {
+    sign = ((*q == '-') ? -1 : 1);
+    ++q;
+  }
+  while ((q < end) && (*q >= '0') && (*q <= '9')) {
+    value = value * 10 + (*q - '0');
+    ++q;
+  }
+  *p = q;
+  
+  return sign * value;
+}
+
+
+static double parse_sdf_double(char **p, char *end)
+{
+  int n_digits = 0;
+  int exponent = 0;
+  int exp_value;
+  int negative = 0;
+  int exp_negative = 0;
+  uint64_t mantissa = 0;
+  double value;
+  char *q;
+  
+  
+  /*
+  the decimal point is always '.' in SDF files whatever
+  the locale; up to 19 significant digits are collected
+  into an integer mantissa, which for the usual %10.4f
+  fields is then scaled by an exactly representable
+  power of ten, yielding a correctly rounded result
+  */
+  q = *p;
+  while ((q < end) && ((*q == ' ') || (*q == '\t'))) {
+    ++q;
+  }
+  if ((q < end) && ((*q == '-') || (*q == '+'))) {
+    negative = (*q == '-');
+    ++q;
+  }
+  while ((q < end) && (*q >= '0') && (*q <= '9')) {
+    if (n_digits < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*q - '0');
+      if (mantissa) {
+        ++n_digits;
+      }
+    }
+    else {
+      ++exponent;
+    }
+    ++q;
+  }
+  if ((q < end) && (*q == '.')) {
+    ++q;
+    while ((q < end) && (*q >= '0') && (*q <= '9')) {
+      if (n_digits < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*q - '0');
+        if (mantissa) {
+          ++n_digits;
+        }
+        --exponent;
+      }
+      ++q;
+    }
+  }
+  if ((q < end) && ((*q == 'e') || (*q == 'E'))) {
+    ++q;
+    if ((q < end) && ((*q == '-') || (*q == '+'))) {
+      exp_negative = (*q == '-');
+      ++q;
+    }
+    exp_value = 0;
+    while ((q < end) && (*q >= '0') && (*q <= '9')) {
+      if (exp_value < 10000) {
+        exp_value = exp_value * 10 + (*q - '0');
+      }
+      ++q;
+    }
+    exponent += (exp_negative ? -exp_value : exp_value);
+  }
+  *p = q;
+  value = (double)mantissa;
+  if ((exponent >= -22) && (exponent <= 22) && (mantissa < ((uint64_t)1 << 53))) {
+    value = ((exponent < 0) ? value / sdf_pow10[-exponent] : value * sdf_pow10[exponent]);
+  }
+  else if (mantissa) {
+    value *= pow(10.0, (double)exponent);
+  }
+  
+  return (negative ? -value : value);
+}
+
+
+static void skip_sdf_token(char **p, char *end)
+{
+  char *q;
+  
+  
+  q = *p;
+  while ((q < end) && ((*q == ' ') || (*q == '\t'))) {
+    ++q;
+  }
+  while ((q < end) && (*q != ' ') && (*q != '\t')) {
+    ++q;
+  }
+  *p = q;
+}
+
+
+static int find_sdf_record(SdfReader *sr, char **start, char **end)
+{
+  char *p;
+  char *q;
+  char *file_end;
+  
+  
+  /*
+  record boundaries are located with memchr(), which
+  is vectorized in most C libraries; '$' is very rare
+  in SDF files, so only a handful of candidates need
+  to be checked for being a "$$$$" line
+  */
+  p = sr->base + sr->pos;
+  file_end = sr->base + sr->size;
+  for (q = p; (q < file_end) && isspace((int)(*q)); ++q);
+  if (q == file_end) {
+    sr->pos = sr->size;
+    return 0;
+  }
+  q = p;
+  *end = file_end;
+  while ((q < file_end) && (q = (char *)memchr(q, '$', file_end - q))) {
+    if (((q == p) || (q[-1] == '\n')) && ((file_end - q) >= 4)
+      && (!strncmp(q, SDF_DELIMITER, 4))) {
+      *end = next_sdf_line(q, file_end);
+      break;
+    }
+    ++q;
+  }
+  *start = p;
+  sr->pos = *end - sr->base;
+  
+  return 1;
+}
+
+
+int get_sdf_record_counts(char *start, char *end, MolInfo *info, char **atom_block)
+{
+  int i;
+  char *line;
+  char *line_end;
+  char *q;
+  
+  
+  /*
+  V2000 counts are in fixed-format columns of the
+  fourth line; V3000 counts are in the CTAB block,
+  and the atom block begins after "BEGIN ATOM"
+  */
+  line = start;
+  for (i = 0; (line < end) && (i < 3); ++i) {
+    line = next_sdf_line(line, end);
+  }
+  if (line >= end) {
+    return PREMATURE_EOF;
+  }
+  line_end = get_sdf_line_end(line, end);
+  if ((line_end - line) < 6) {
+    return PREMATURE_EOF;
+  }
+  info->sdf_version = V2000;
+  for (q = line; (line_end - q) >= 5; ++q) {
+    if (!strncmp(q, "V3000", 5)) {
+      info->sdf_version = V3000;
+      break;
+    }
+  }
+  if (info->sdf_version == V2000) {
+    q = line;
+    info->n_atoms = parse_sdf_int(&q, line + 3);
+    q = line + 3;
+    info->n_bonds = parse_sdf_int(&q, line + 6);
+    *atom_block = next_sdf_line(line, end);
+    return 0;
+  }
+  info->n_atoms = -1;
+  while ((line = next_sdf_line(line, end)) < end) {
+    line_end = get_sdf_line_end(line, end);
+    if (((line_end - line) >= 13) && (!strncmp(line, "M  V30 COUNTS", 13))) {
+      q = line + 13;
+      info->n_atoms = parse_sdf_int(&q, line_end);
+      info->n_bonds = parse_sdf_int(&q, line_end);
+    }
+    else if (((line_end - line) >= 17) && (!strncmp(line, "M  V30 BEGIN ATOM", 17))) {
+      *atom_block = next_sdf_line(line, end);
+      return ((info->n_atoms < 0) ? PREMATURE_EOF : 0);
+    }
+  }
+  
+  return PREMATURE_EOF;
+}
+
+
+int get_sdf_record_coord(int sdf_version, int n_atoms,
+  char *atom_block, char *end, double *coord)
+{
+  int i;
+  int k;
+  char *line;
+  char *line_end;
+  char *q;
+  
+  
+  /*
+  V2000 coordinates are 10-character fields starting
+  at columns 1, 11 and 21, which may touch each other;
+  V3000 ones are the third to fifth token after "M  V30"
+  */
+  for (i = 0, line = atom_block; i < n_atoms; ++i, line = next_sdf_line(line, end)) {
+    if (line >= end) {
+      return PREMATURE_EOF;
+    }
+    line_end = get_sdf_line_end(line, end);
+    if (sdf_version == V2000) {
+      if ((line_end - line) < 30) {
+        return PREMATURE_EOF;
+      }
+      for (k = 0; k < 3; ++k) {
+        q = line + k * 10;
+        coord[i * 3 + k] = parse_sdf_double(&q, line + k * 10 + 10);
+      }
+    }
+    else {
+      if (((line_end - line) < 6) || strncmp(line, "M  V30", 6)) {
+        return PREMATURE_EOF;
+      }
+      q = line + 6;
+      skip_sdf_token(&q, line_end);
+      skip_sdf_token(&q, line_end);
+      for (k = 0; k < 3; ++k) {
+        coord[i * 3 + k] = parse_sdf_double(&q, line_end);
+      }
+    }
+  }
+  
+  return 0;
+}
+
+
+int map_sdf_file(SdfReader *sr, char *name)
+{
+  #ifndef WIN32
+  int fd;
+  struct stat file_stat;
+  #else
+  LARGE_INTEGER file_size;
+  #endif
+  int compression;
+  
+  
+  /*
+  the file is mapped read-only as a whole; an empty
+  file is not mapped at all and simply has no records.
+  Compressed files cannot be mapped, so they are
+  decoded into memory instead
+  */
+  memset(sr, 0, sizeof(SdfReader));
+  if ((compression = get_sdf_file_compression(name)) == -1) {
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if (compression != SDF_STREAM_NONE) {
+    sr->inflated = 1;
+    return (inflate_sdf_file(name, &(sr->base), &(sr->size))
+      ? CANNOT_READ_ORIGINAL_SDF : 0);
+  }
+  #ifndef WIN32
+  if ((fd = open(name, O_RDONLY)) == -1) {
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if (fstat(fd, &file_stat)) {
+    close(fd);
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  sr->size = (size_t)(file_stat.st_size);
+  if (sr->size) {
+    sr->base = (char *)mmap(NULL, sr->size, PROT_READ, MAP_SHARED, fd, 0);
+    if ((void *)(sr->base) == MAP_FAILED) {
+      sr->base = NULL;
+      close(fd);
+      return CANNOT_READ_ORIGINAL_SDF;
+    }
+    madvise(sr->base, sr->size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+  #else
+  sr->hFile = CreateFile(name, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (sr->hFile == INVALID_HANDLE_VALUE) {
+    sr->hFile = NULL;
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  if (!GetFileSizeEx(sr->hFile, &file_size)) {
+    close_sdf_reader(sr);
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  sr->size = (size_t)(file_size.QuadPart);
+  if (sr->size && ((!(sr->hMapHandle = CreateFileMapping(sr->hFile, NULL, PAGE_READONLY, 0, 0, NULL)))
+    || (!(sr->base = (char *)MapViewOfFile(sr->hMapHandle, FILE_MAP_READ, 0, 0, 0))))) {
+    close_sdf_reader(sr);
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  #endif
+  
+  return 0;
+}
+
+
+int open_sdf_reader(SdfReader *sr, char *name)
+{
+  /*
+  the file is memory-mapped unless the
+  line-buffered reader was requested;
+  compressed files are always decoded
+  into memory
+  */
+  if ((sdf_reader_type == SDF_READER_STDIO)
+    && (get_sdf_file_compression(name) == SDF_STREAM_NONE)) {
+    memset(sr, 0, sizeof(SdfReader));
+    if (!(sr->handle = fopen(name, "rb"))) {
+      return CANNOT_READ_ORIGINAL_SDF;
+    }
+    return 0;
+  }
+  
+  return map_sdf_file(sr, name);
+}
+
+
+void close_sdf_reader(SdfReader *sr)
+{
+  if (sr->handle) {
+    fclose(sr->handle);
+  }
+  if (sr->inflated) {
+    if (sr->base) {
+      free(sr->base);
+    }
+    memset(sr, 0, sizeof(SdfReader));
+    return;
+  }
+  #ifndef WIN32
+  if (sr->base) {
+    munmap(sr->base, sr->size);
+  }
+  #else
+  if (sr->base) {
+    UnmapViewOfFile(sr->base);
+  }
+  if (sr->hMapHandle) {
+    CloseHandle(sr->hMapHandle);
+  }
+  if (sr->hFile) {
+    CloseHandle(sr->hFile);
+  }
+  #endif
+  memset(sr, 0, sizeof(SdfReader));
+}
+
+
+int read_sdf_reader_counts(SdfReader *sr, MolInfo *info, int *found)
+{
+  char buffer[BUF_LEN];
+  char *start;
+  char *end;
+  char *atom_block;
+  int line;
+  int result = 0;
+  long pos;
+  struct timeval start_time;
+  
+  
+  /*
+  read the atom and bond counts of the next record,
+  then move to the beginning of the following one;
+  *found is set to 0 if there are no more records
+  */
+  gettimeofday(&start_time, NULL);
+  *found = 0;
+  if (sr->handle) {
+    memset(buffer, 0, BUF_LEN);
+    pos = ftell(sr->handle);
+    line = 0;
+    while ((!(*found)) && fgets(buffer, BUF_LEN, sr->handle)) {
+      ++line;
+      buffer[BUF_LEN - 1] = '\0';
+      if (line == 4) {
+        *found = 1;
+        if (get_n_atoms_bonds(info, sr->handle, buffer)) {
+          result = PREMATURE_EOF;
+        }
+      }
+    }
+    line = 0;
+    while ((!result) && (!line) && fgets(buffer, BUF_LEN, sr->handle)) {
+      line = (!strncmp(buffer, SDF_DELIMITER, 4));
+    }
+    add_sdf_reader_stats(&start_time, (double)(ftell(sr->handle) - pos));
+    return result;
+  }
+  if (find_sdf_record(sr, &start, &end)) {
+    *found = 1;
+    result = get_sdf_record_counts(start, end, info, &atom_block);
+    add_sdf_reader_stats(&start_time, (double)(end - start));
+  }
+  
+  return result;
+}
+
+
+int read_sdf_reader_conf(SdfReader *sr, MolInfo *mol_info, double *coord)
+{
+  char *start;
+  char *end;
+  char *atom_block;
+  int result;
+  long pos;
+  struct timeval start_time;
+  MolInfo temp_mol_info;
+  
+  
+  /*
+  same as read_sdf_conf(); with the memory-mapped
+  reader, coordinates are parsed in place with no
+  intermediate line buffer
+  */
+  gettimeofday(&start_time, NULL);
+  if (sr->handle) {
+    pos = ftell(sr->handle);
+    result = read_sdf_conf(sr->handle, mol_info, coord);
+    add_sdf_reader_stats(&start_time, (double)(ftell(sr->handle) - pos));
+    return result;
+  }
+  if (!find_sdf_record(sr, &start, &end)) {
+    return PREMATURE_EOF;
+  }
+  memset(&temp_mol_info, 0, sizeof(MolInfo));
+  if (!(result = get_sdf_record_counts(start, end, &temp_mol_info, &atom_block))) {
+    result = get_sdf_record_coord(temp_mol_info.sdf_version,
+      mol_info->n_atoms, atom_block, end, coord);
+  }
+  add_sdf_reader_stats(&start_time, (double)(end - start));
+  
+  return result;
+}
@@ -0,0 +1,1049 @@
+/*
+
+sdf_stream.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+static unsigned char gzip_magic[] = { 0x1f, 0x8b };
+static unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+
+char *get_sdf_stream_ext(int compression)
+{
+  return ((compression == SDF_STREAM_GZIP) ? ".gz"
+    : ((compression == SDF_STREAM_ZSTD) ? ".zst" : ""));
+}
+
+
+int get_sdf_stream_compression(char *name)
+{
+  size_t len;
+  
+  
+  /*
+  files which are written are compressed
+  according to their extension
+  */
+  len = strlen(name);
+  if ((len > 3) && (!strcasecmp(&name[len - 3], ".gz"))) {
+    return SDF_STREAM_GZIP;
+  }
+  if ((len > 4) && (!strcasecmp(&name[len - 4], ".zst"))) {
+    return SDF_STREAM_ZSTD;
+  }
+  
+  return SDF_STREAM_NONE;
+}
+
+
+int get_sdf_file_compression(char *name)
+{
+  unsigned char magic[4];
+  size_t n;
+  FILE *handle;
+  
+  
+  /*
+  files which are read are recognized by
+  their magic number, whatever their name;
+  returns -1 if the file cannot be opened
+  */
+  if (!(handle = fopen(name, "rb"))) {
+    return -1;
+  }
+  n = fread(magic, 1, 4, handle);
+  fclose(handle);
+  if ((n >= 2) && (!memcmp(magic, gzip_magic, 2))) {
+    return SDF_STREAM_GZIP;
+  }
+  if ((n == 4) && (!memcmp(magic, zstd_magic, 4))) {
+    return SDF_STREAM_ZSTD;
+  }
+  
+  return SDF_STREAM_NONE;
+}
+
+
+static int compress_sdf_stream_block(SdfStreamBlock *block, int compression)
+{
+  #ifdef O3_HAVE_ZSTD
+  size_t n;
+  #endif
+  size_t max_out_size;
+  char *temp_out;
+  z_stream z;
+  
+  
+  /*
+  each block is compressed on its own into a
+  complete gzip member or zstd frame; both formats
+  allow them to be concatenated, so that the file
+  can be read back by any gzip or zstd decoder
+  */
+  block->out_size = 0;
+  if (compression == SDF_STREAM_GZIP) {
+    memset(&z, 0, sizeof(z_stream));
+    if (deflateInit2(&z, SDF_STREAM_GZIP_LEVEL, Z_DEFLATED,
+      MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+      return OUT_OF_MEMORY;
+    }
+    max_out_size = (size_t)deflateBound(&z, (uLong)(block->size));
+    if (max_out_size > block->max_out_size) {
+      if (!(temp_out = (char *)realloc(block->out, max_out_size))) {
+        deflateEnd(&z);
+        return OUT_OF_MEMORY;
+      }
+      block->out = temp_out;
+      block->max_out_size = max_out_size;
+    }
+    z.next_in = (Bytef *)(block->data);
+    z.avail_in = (uInt)(block->size);
+    z.next_out = (Bytef *)(block->out);
+    z.avail_out = (uInt)(block->max_out_size);
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END) {
+      deflateEnd(&z);
+      return CANNOT_WRITE_TEMP_FILE;
+    }
+    block->out_size = (size_t)(z.total_out);
+    deflateEnd(&z);
+    return 0;
+  }
+  #ifdef O3_HAVE_ZSTD
+  max_out_size = ZSTD_compressBound(block->size);
+  if (max_out_size > block->max_out_size) {
+    if (!(temp_out = (char *)realloc(block->out, max_out_size))) {
+      return OUT_OF_MEMORY;
+    }
+    block->out = temp_out;
+    block->max_out_size = max_out_size;
+  }
+  n = ZSTD_compress(block->out, block->max_out_size,
+    block->data, block->size, SDF_STREAM_ZSTD_LEVEL);
+  if (ZSTD_isError(n)) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  block->out_size = n;
+  
+  return 0;
+  #else
+  return CANNOT_WRITE_TEMP_FILE;
+  #endif
+}
+
+
+static SdfStreamBlock *pop_sdf_compressor_block(SdfCompressor *sc)
+{
+  SdfStreamBlock *block;
+  
+  
+  /*
+  to be called with sc->mutex held
+  */
+  if ((block = sc->head)) {
+    sc->head = block->next;
+    if (!(sc->head)) {
+      sc->tail = NULL;
+    }
+    block->next = NULL;
+  }
+  
+  return block;
+}
+
+
+static void run_sdf_compressor_block(SdfCompressor *sc, SdfStreamBlock *block)
+{
+  /*
+  to be called with sc->mutex held, which
+  is released while the block is compressed
+  */
+  #ifndef WIN32
+  pthread_mutex_unlock(&(sc->mutex));
+  #else
+  LeaveCriticalSection(&(sc->mutex));
+  #endif
+  block->result = compress_sdf_stream_block(block, block->compression);
+  #ifndef WIN32
+  pthread_mutex_lock(&(sc->mutex));
+  #else
+  EnterCriticalSection(&(sc->mutex));
+  #endif
+  block->done = 1;
+  #ifndef WIN32
+  pthread_cond_broadcast(&(sc->done_cond));
+  #else
+  WakeAllConditionVariable(&(sc->done_cond));
+  #endif
+}
+
+
+#ifndef WIN32
+static void *sdf_compressor_thread(void *pointer)
+#else
+static DWORD sdf_compressor_thread(void *pointer)
+#endif
+{
+  SdfStreamBlock *block;
+  SdfCompressor *sc;
+  
+  
+  sc = (SdfCompressor *)pointer;
+  #ifndef WIN32
+  pthread_mutex_lock(&(sc->mutex));
+  #else
+  EnterCriticalSection(&(sc->mutex));
+  #endif
+  while (1) {
+    while ((!(sc->head)) && (!(sc->shutdown))) {
+      #ifndef WIN32
+      pthread_cond_wait(&(sc->work_cond), &(sc->mutex));
+      #else
+      SleepConditionVariableCS(&(sc->work_cond), &(sc->mutex), INFINITE);
+      #endif
+    }
+    if (!(block = pop_sdf_compressor_block(sc))) {
+      break;
+    }
+    run_sdf_compressor_block(sc, block);
+  }
+  #ifndef WIN32
+  pthread_mutex_unlock(&(sc->mutex));
+  
+  return NULL;
+  #else
+  LeaveCriticalSection(&(sc->mutex));
+  
+  return 0;
+  #endif
+}
+
+
+SdfCompressor *alloc_sdf_compressor(int n_threads)
+{
+  int i;
+  SdfCompressor *sc;
+  
+  
+  /*
+  start up to n_threads compressor threads; if
+  fewer can be started, the streams which use
+  them compress more blocks by themselves
+  */
+  if (!(sc = (SdfCompressor *)malloc(sizeof(SdfCompressor)))) {
+    return NULL;
+  }
+  memset(sc, 0, sizeof(SdfCompressor));
+  if (n_threads < 1) {
+    n_threads = 1;
+  }
+  #ifndef WIN32
+  if (!(sc->thread_id = (pthread_t *)malloc(n_threads * sizeof(pthread_t)))) {
+    free(sc);
+    return NULL;
+  }
+  pthread_mutex_init(&(sc->mutex), NULL);
+  pthread_cond_init(&(sc->work_cond), NULL);
+  pthread_cond_init(&(sc->done_cond), NULL);
+  for (i = 0; (i < n_threads) && (!pthread_create
+    (&(sc->thread_id[i]), NULL, sdf_compressor_thread, sc)); ++i);
+  #else
+  if (!(sc->thread_handle = (HANDLE *)malloc(n_threads * sizeof(HANDLE)))) {
+    free(sc);
+    return NULL;
+  }
+  InitializeCriticalSection(&(sc->mutex));
+  InitializeConditionVariable(&(sc->work_cond));
+  InitializeConditionVariable(&(sc->done_cond));
+  for (i = 0; (i < n_threads) && (sc->thread_handle[i] = CreateThread(NULL, 0,
+    (LPTHREAD_START_ROUTINE)sdf_compressor_thread, sc, 0, NULL)); ++i);
+  #endif
+  sc->n_threads = i;
+  
+  return sc;
+}
+
+
+void free_sdf_compressor(SdfCompressor *sc)
+{
+  int i;
+  
+  
+  /*
+  all streams using sc must have been closed
+  */
+  if (!sc) {
+    return;
+  }
+  #ifndef WIN32
+  pthread_mutex_lock(&(sc->mutex));
+  sc->shutdown = 1;
+  pthread_cond_broadcast(&(sc->work_cond));
+  pthread_mutex_unlock(&(sc->mutex));
+  for (i = 0; i < sc->n_threads; ++i) {
+    pthread_join(sc->thread_id[i], NULL);
+  }
+  pthread_cond_destroy(&(sc->done_cond));
+  pthread_cond_destroy(&(sc->work_cond));
+  pthread_mutex_destroy(&(sc->mutex));
+  free(sc->thread_id);
+  #else
+  EnterCriticalSection(&(sc->mutex));
+  sc->shutdown = 1;
+  WakeAllConditionVariable(&(sc->work_cond));
+  LeaveCriticalSection(&(sc->mutex));
+  for (i = 0; i < sc->n_threads; ++i) {
+    WaitForSingleObject(sc->thread_handle[i], INFINITE);
+    CloseHandle(sc->thread_handle[i]);
+  }
+  DeleteCriticalSection(&(sc->mutex));
+  free(sc->thread_handle);
+  #endif
+  free(sc);
+}
+
+
+static void compress_sdf_stream_blocks(SdfStream *ss, int n)
+{
+  int i;
+  SdfStreamBlock *block;
+  SdfCompressor *sc;
+  
+  
+  /*
+  all filled blocks but the first are queued for the
+  compressor threads, the first one is compressed by
+  the calling thread; while waiting for the others,
+  the calling thread compresses any block still queued
+  */
+  for (i = 0; i < n; ++i) {
+    block = &(ss->block[i]);
+    block->compression = ss->compression;
+    block->result = 0;
+    block->done = 0;
+    block->next = NULL;
+  }
+  if ((!(sc = ss->compressor)) || (!(sc->n_threads))) {
+    for (i = 0; i < n; ++i) {
+      ss->block[i].result = compress_sdf_stream_block
+        (&(ss->block[i]), ss->compression);
+    }
+    return;
+  }
+  #ifndef WIN32
+  pthread_mutex_lock(&(sc->mutex));
+  #else
+  EnterCriticalSection(&(sc->mutex));
+  #endif
+  for (i = 1; i < n; ++i) {
+    block = &(ss->block[i]);
+    if (sc->tail) {
+      sc->tail->next = block;
+    }
+    else {
+      sc->head = block;
+    }
+    sc->tail = block;
+  }
+  #ifndef WIN32
+  pthread_cond_broadcast(&(sc->work_cond));
+  #else
+  WakeAllConditionVariable(&(sc->work_cond));
+  #endif
+  if (n) {
+    run_sdf_compressor_block(sc, &(ss->block[0]));
+  }
+  for (i = 1; i < n; ++i) {
+    while (!(ss->block[i].done)) {
+      if ((block = pop_sdf_compressor_block(sc))) {
+        run_sdf_compressor_block(sc, block);
+      }
+      else {
+        #ifndef WIN32
+        pthread_cond_wait(&(sc->done_cond), &(sc->mutex));
+        #else
+        SleepConditionVariableCS(&(sc->done_cond), &(sc->mutex), INFINITE);
+        #endif
+      }
+    }
+  }
+  #ifndef WIN32
+  pthread_mutex_unlock(&(sc->mutex));
+  #else
+  LeaveCriticalSection(&(sc->mutex));
+  #endif
+}
+
+
+static int add_sdf_stream_member(SdfStream *ss)
+{
+  int max_n_members;
+  int64_t *temp_member;
+  
+  
+  /*
+  record where the member about to be
+  written begins, in the file and in
+  the decoded contents
+  */
+  if (ss->n_members == ss->max_n_members) {
+    max_n_members = (ss->max_n_members ? ss->max_n_members * 2 : 64);
+    if (!(temp_member = (int64_t *)realloc(ss->member,
+      max_n_members * 2 * sizeof(int64_t)))) {
+      return OUT_OF_MEMORY;
+    }
+    ss->member = temp_member;
+    ss->max_n_members = max_n_members;
+  }
+  ss->member[ss->n_members * 2] = ss->out_offset;
+  ss->member[ss->n_members * 2 + 1] = ss->out_start;
+  ++(ss->n_members);
+  
+  return 0;
+}
+
+
+int flush_sdf_stream(SdfStream *ss)
+{
+  int i;
+  int n;
+  int result = 0;
+  SdfStreamBlock *block;
+  
+  
+  /*
+  filled blocks, and the one being filled, are
+  compressed at once, then written in order
+  */
+  n = ss->n_full + ((ss->n_full < ss->n_blocks)
+    && ss->block[ss->n_full].size ? 1 : 0);
+  if (ss->compression != SDF_STREAM_NONE) {
+    compress_sdf_stream_blocks(ss, n);
+  }
+  for (i = 0; i < n; ++i) {
+    block = &(ss->block[i]);
+    if ((!result) && (ss->compression != SDF_STREAM_NONE)) {
+      if ((!(result = block->result)) && (!(result = add_sdf_stream_member(ss)))) {
+        if (fwrite(block->out, 1, block->out_size, ss->handle) != block->out_size) {
+          result = CANNOT_WRITE_TEMP_FILE;
+        }
+        ss->out_offset += (int64_t)(block->out_size);
+      }
+    }
+    else if (!result) {
+      if (fwrite(block->data, 1, block->size, ss->handle) != block->size) {
+        result = CANNOT_WRITE_TEMP_FILE;
+      }
+      ss->out_offset += (int64_t)(block->size);
+    }
+    ss->out_start += (int64_t)(block->size);
+    block->size = 0;
+  }
+  ss->n_full = 0;
+  
+  return result;
+}
+
+
+static int read_sdf_stream_input(SdfStream *ss)
+{
+  /*
+  refill the buffer of compressed data once it has
+  been used up; returns the number of bytes available
+  */
+  if (ss->in_pos == ss->in_size) {
+    ss->in_offset += (int64_t)(ss->in_size);
+    ss->in_size = fread(ss->in, 1, ss->max_in_size, ss->handle);
+    ss->in_pos = 0;
+  }
+  
+  return (int)(ss->in_size - ss->in_pos);
+}
+
+
+static int decode_sdf_stream(SdfStream *ss)
+{
+  int z_result;
+  #ifdef O3_HAVE_ZSTD
+  size_t r;
+  size_t pos;
+  ZSTD_inBuffer input;
+  ZSTD_outBuffer output;
+  #endif
+  
+  
+  /*
+  decode into the read buffer until it is full, the
+  file is over or the current member ends; in the
+  latter case, member_end is set and the next member
+  begins at next_member_offset
+  */
+  if (ss->compression == SDF_STREAM_NONE) {
+    ss->buf_len = fread(ss->buf, 1, SDF_STREAM_BLOCK_SIZE, ss->handle);
+    return (ferror(ss->handle) ? -1 : 0);
+  }
+  if (ss->compression == SDF_STREAM_GZIP) {
+    ss->gz_handle->next_out = (Bytef *)(ss->buf);
+    ss->gz_handle->avail_out = SDF_STREAM_BLOCK_SIZE;
+    while (ss->gz_handle->avail_out && read_sdf_stream_input(ss)) {
+      ss->gz_handle->next_in = (Bytef *)&(ss->in[ss->in_pos]);
+      ss->gz_handle->avail_in = (uInt)(ss->in_size - ss->in_pos);
+      z_result = inflate(ss->gz_handle, Z_NO_FLUSH);
+      ss->in_pos = ss->in_size - (size_t)(ss->gz_handle->avail_in);
+      if (z_result == Z_STREAM_END) {
+        ss->member_end = 1;
+        ss->next_member_offset = ss->in_offset + (int64_t)(ss->in_pos);
+        inflateReset(ss->gz_handle);
+        break;
+      }
+      if ((z_result != Z_OK) && (z_result != Z_BUF_ERROR)) {
+        return -1;
+      }
+    }
+    ss->buf_len = SDF_STREAM_BLOCK_SIZE - (size_t)(ss->gz_handle->avail_out);
+    return 0;
+  }
+  #ifdef O3_HAVE_ZSTD
+  output.dst = ss->buf;
+  output.size = SDF_STREAM_BLOCK_SIZE;
+  output.pos = 0;
+  /*
+  at end of file the decoder is called once more
+  with no input, as it may still hold decoded data
+  */
+  while (output.pos < output.size) {
+    read_sdf_stream_input(ss);
+    input.src = ss->in;
+    input.size = ss->in_size;
+    input.pos = ss->in_pos;
+    pos = output.pos;
+    r = ZSTD_decompressStream(ss->zstd_handle, &output, &input);
+    ss->in_pos = input.pos;
+    if (ZSTD_isError(r)) {
+      return -1;
+    }
+    if (!r) {
+      ss->member_end = 1;
+      ss->next_member_offset = ss->in_offset + (int64_t)(ss->in_pos);
+      break;
+    }
+    if ((!(ss->in_size)) && (output.pos == pos)) {
+      break;
+    }
+  }
+  ss->buf_len = output.pos;
+  #endif
+  
+  return 0;
+}
+
+
+static int fill_sdf_stream(SdfStream *ss)
+{
+  /*
+  decode the next chunk of the file into the
+  read buffer; returns the number of bytes
+  decoded, 0 at end of file, -1 on error
+  */
+  do {
+    ss->offset += (int64_t)(ss->buf_len);
+    ss->buf_pos = 0;
+    ss->buf_len = 0;
+    if (ss->member_end) {
+      ss->member_end = 0;
+      ss->member_offset = ss->next_member_offset;
+      ss->member_start = ss->offset;
+    }
+    if (decode_sdf_stream(ss)) {
+      return -1;
+    }
+  } while ((!(ss->buf_len)) && ss->member_end);
+  
+  return (int)(ss->buf_len);
+}
+
+
+SdfStream *open_sdf_stream(char *name, char *mode, SdfCompressor *compressor)
+{
+  SdfStream *ss;
+  
+  
+  /*
+  SDF files are read transparently whether they are
+  plain, gzip- or zstd-compressed; when writing,
+  compression is chosen by the file extension and,
+  if a compressor is given, as many blocks as it has
+  threads plus one are compressed at once
+  */
+  if (!(ss = (SdfStream *)malloc(sizeof(SdfStream)))) {
+    return NULL;
+  }
+  memset(ss, 0, sizeof(SdfStream));
+  if (mode[0] == 'r') {
+    if ((ss->compression = get_sdf_file_compression(name)) == -1) {
+      free(ss);
+      return NULL;
+    }
+    if ((!(ss->buf = (char *)malloc(SDF_STREAM_BLOCK_SIZE)))
+      || (!(ss->handle = fopen(name, "rb")))) {
+      close_sdf_stream(ss);
+      return NULL;
+    }
+    if (ss->compression == SDF_STREAM_ZSTD) {
+      #ifdef O3_HAVE_ZSTD
+      ss->max_in_size = ZSTD_DStreamInSize();
+      if ((!(ss->in = (char *)malloc(ss->max_in_size)))
+        || (!(ss->zstd_handle = ZSTD_createDStream()))
+        || ZSTD_isError(ZSTD_initDStream(ss->zstd_handle))) {
+        close_sdf_stream(ss);
+        return NULL;
+      }
+      #else
+      close_sdf_stream(ss);
+      return NULL;
+      #endif
+    }
+    else if (ss->compression == SDF_STREAM_GZIP) {
+      /*
+      gzip members are decoded one at a time,
+      so that their offsets are known
+      */
+      ss->max_in_size = SDF_STREAM_GZIP_BUFFER;
+      if ((!(ss->in = (char *)malloc(ss->max_in_size)))
+        || (!(ss->gz_handle = (z_stream *)calloc(1, sizeof(z_stream))))) {
+        close_sdf_stream(ss);
+        return NULL;
+      }
+      if (inflateInit2(ss->gz_handle, MAX_WBITS + 16) != Z_OK) {
+        free(ss->gz_handle);
+        ss->gz_handle = NULL;
+        close_sdf_stream(ss);
+        return NULL;
+      }
+    }
+    return ss;
+  }
+  ss->writing = 1;
+  ss->compression = get_sdf_stream_compression(name);
+  #ifndef O3_HAVE_ZSTD
+  if (ss->compression == SDF_STREAM_ZSTD) {
+    free(ss);
+    return NULL;
+  }
+  #endif
+  if (ss->compression != SDF_STREAM_NONE) {
+    ss->compressor = compressor;
+  }
+  ss->n_blocks = (ss->compressor ? ss->compressor->n_threads + 1 : 1);
+  if ((!(ss->block = (SdfStreamBlock *)calloc(ss->n_blocks, sizeof(SdfStreamBlock))))
+    || (!(ss->handle = fopen(name, mode)))) {
+    close_sdf_stream(ss);
+    return NULL;
+  }
+  /*
+  when appending, member offsets in the file follow
+  the existing contents, while decoded offsets
+  refer to the data written from now on
+  */
+  if ((mode[0] == 'a') && ((fseek(ss->handle, 0, SEEK_END))
+    || ((ss->out_offset = (int64_t)ftell(ss->handle)) < 0))) {
+    close_sdf_stream(ss);
+    return NULL;
+  }
+  
+  return ss;
+}
+
+
+int close_sdf_stream(SdfStream *ss)
+{
+  int i;
+  int result = 0;
+  
+  
+  if (!ss) {
+    return 0;
+  }
+  if (ss->writing && ss->handle && ss->block) {
+    result = flush_sdf_stream(ss);
+  }
+  if (ss->handle && fclose(ss->handle)) {
+    result = CANNOT_WRITE_TEMP_FILE;
+  }
+  if (ss->gz_handle) {
+    inflateEnd(ss->gz_handle);
+    free(ss->gz_handle);
+  }
+  #ifdef O3_HAVE_ZSTD
+  if (ss->zstd_handle) {
+    ZSTD_freeDStream(ss->zstd_handle);
+  }
+  #endif
+  if (ss->block) {
+    for (i = 0; i < ss->n_blocks; ++i) {
+      if (ss->block[i].data) {
+        free(ss->block[i].data);
+      }
+      if (ss->block[i].out) {
+        free(ss->block[i].out);
+      }
+    }
+    free(ss->block);
+  }
+  if (ss->buf) {
+    free(ss->buf);
+  }
+  if (ss->in) {
+    free(ss->in);
+  }
+  if (ss->member) {
+    free(ss->member);
+  }
+  free(ss);
+  
+  return result;
+}
+
+
+int write_sdf_stream(SdfStream *ss, void *data, size_t size)
+{
+  size_t n;
+  char *p;
+  SdfStreamBlock *block;
+  
+  
+  /*
+  data is appended to the current block; once all
+  blocks are full, they are compressed and written.
+  Blocks are allocated on first use, as streams
+  which are reopened in append mode often only
+  receive a few records
+  */
+  p = (char *)data;
+  while (size) {
+    block = &(ss->block[ss->n_full]);
+    if ((!(block->data)) && (!(block->data = (char *)malloc(SDF_STREAM_BLOCK_SIZE)))) {
+      return OUT_OF_MEMORY;
+    }
+    n = SDF_STREAM_BLOCK_SIZE - block->size;
+    if (n > size) {
+      n = size;
+    }
+    memcpy(&(block->data[block->size]), p, n);
+    block->size += n;
+    p += n;
+    size -= n;
+    if (block->size == SDF_STREAM_BLOCK_SIZE) {
+      ++(ss->n_full);
+      if ((ss->n_full == ss->n_blocks) && flush_sdf_stream(ss)) {
+        return CANNOT_WRITE_TEMP_FILE;
+      }
+    }
+  }
+  
+  return 0;
+}
+
+
+int sdf_stream_printf(SdfStream *ss, char *format, ...)
+{
+  char buffer[BUF_LEN];
+  char *temp;
+  int n;
+  int result;
+  va_list arg;
+  
+  
+  va_start(arg, format);
+  n = vsnprintf(buffer, BUF_LEN, format, arg);
+  va_end(arg);
+  if (n < 0) {
+    return CANNOT_WRITE_TEMP_FILE;
+  }
+  if (n < BUF_LEN) {
+    return write_sdf_stream(ss, buffer, (size_t)n);
+  }
+  if (!(temp = (char *)malloc(n + 1))) {
+    return OUT_OF_MEMORY;
+  }
+  va_start(arg, format);
+  vsnprintf(temp, n + 1, format, arg);
+  va_end(arg);
+  result = write_sdf_stream(ss, temp, (size_t)n);
+  free(temp);
+  
+  return result;
+}
+
+
+char *sdf_stream_gets(char *data, int len, SdfStream *ss)
+{
+  int n;
+  size_t avail;
+  char *p;
+  
+  
+  /*
+  same as fgets(), on the decoded contents
+  */
+  n = 0;
+  p = NULL;
+  while ((!p) && (n < (len - 1))) {
+    if ((ss->buf_pos == ss->buf_len) && (fill_sdf_stream(ss) <= 0)) {
+      break;
+    }
+    avail = ss->buf_len - ss->buf_pos;
+    if (avail > (size_t)(len - 1 - n)) {
+      avail = (size_t)(len - 1 - n);
+    }
+    if ((p = (char *)memchr(&(ss->buf[ss->buf_pos]), '\n', avail))) {
+      avail = (size_t)(p - &(ss->buf[ss->buf_pos])) + 1;
+    }
+    memcpy(&data[n], &(ss->buf[ss->buf_pos]), avail);
+    n += (int)avail;
+    ss->buf_pos += avail;
+  }
+  if (!n) {
+    return NULL;
+  }
+  data[n] = '\0';
+  
+  return data;
+}
+
+
+int64_t tell_sdf_stream(SdfStream *ss)
+{
+  return (ss->offset + (int64_t)(ss->buf_pos));
+}
+
+
+void tell_sdf_stream_member(SdfStream *ss, int64_t *member_offset, int64_t *member_start)
+{
+  /*
+  the member which holds the current position; in
+  plain files, any position can be sought directly
+  */
+  if (ss->compression == SDF_STREAM_NONE) {
+    *member_offset = tell_sdf_stream(ss);
+    *member_start = *member_offset;
+  }
+  else if (ss->member_end && (ss->buf_pos == ss->buf_len)) {
+    *member_offset = ss->next_member_offset;
+    *member_start = ss->offset + (int64_t)(ss->buf_len);
+  }
+  else {
+    *member_offset = ss->member_offset;
+    *member_start = ss->member_start;
+  }
+}
+
+
+int find_sdf_stream_member(SdfStream *ss, int64_t offset, int64_t *member_offset, int64_t *member_start)
+{
+  int low;
+  int high;
+  int mid;
+  
+  
+  /*
+  the member of a stream being written which holds
+  offset; this must have been flushed already
+  */
+  if (ss->compression == SDF_STREAM_NONE) {
+    *member_offset = offset;
+    *member_start = offset;
+    return 0;
+  }
+  if ((!(ss->n_members)) || (offset < ss->member[1]) || (offset >= ss->out_start)) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  low = 0;
+  high = ss->n_members - 1;
+  while (low < high) {
+    mid = (low + high + 1) / 2;
+    if (ss->member[mid * 2 + 1] <= offset) {
+      low = mid;
+    }
+    else {
+      high = mid - 1;
+    }
+  }
+  *member_offset = ss->member[low * 2];
+  *member_start = ss->member[low * 2 + 1];
+  
+  return 0;
+}
+
+
+int seek_sdf_stream_member(SdfStream *ss, int64_t member_offset, int64_t member_start, int64_t offset)
+{
+  /*
+  move to offset in the decoded contents, starting
+  to decode from the member which begins at
+  member_offset in the file and at member_start
+  in the decoded contents; plain files are
+  positioned at offset straight away
+  */
+  if (ss->compression == SDF_STREAM_NONE) {
+    member_offset = offset;
+    member_start = offset;
+  }
+  if ((member_offset < 0) || (member_start > offset)
+    || fseek(ss->handle, (long)member_offset, SEEK_SET)) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  if (ss->gz_handle && (inflateReset(ss->gz_handle) != Z_OK)) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  #ifdef O3_HAVE_ZSTD
+  if (ss->zstd_handle && ZSTD_isError(ZSTD_initDStream(ss->zstd_handle))) {
+    return CANNOT_READ_TEMP_FILE;
+  }
+  #endif
+  ss->in_offset = member_offset;
+  ss->in_pos = 0;
+  ss->in_size = 0;
+  ss->member_offset = member_offset;
+  ss->member_start = member_start;
+  ss->member_end = 0;
+  ss->offset = member_start;
+  ss->buf_pos = 0;
+  ss->buf_len = 0;
+  while (offset > (ss->offset + (int64_t)(ss->buf_len))) {
+    if (fill_sdf_stream(ss) <= 0) {
+      return PREMATURE_EOF;
+    }
+  }
+  ss->buf_pos = (size_t)(offset - ss->offset);
+  
+  return 0;
+}
+
+
+int seek_sdf_stream(SdfStream *ss, int64_t offset)
+{
+  /*
+  offsets refer to the decoded contents; in compressed
+  files, moving forward means decoding and skipping
+  data, moving backward restarts from the beginning of
+  the current member, or of the file if offset lies
+  before it
+  */
+  if ((ss->compression == SDF_STREAM_NONE) || (offset < ss->member_start)) {
+    return seek_sdf_stream_member(ss, 0, 0, offset);
+  }
+  if (offset < ss->offset) {
+    return seek_sdf_stream_member(ss, ss->member_offset, ss->member_start, offset);
+  }
+  while (offset > (ss->offset + (int64_t)(ss->buf_len))) {
+    if (fill_sdf_stream(ss) <= 0) {
+      return PREMATURE_EOF;
+    }
+  }
+  ss->buf_pos = (size_t)(offset - ss->offset);
+  
+  return 0;
+}
+
+
+int skip_sdf_stream_records(SdfStream *ss, int n_records)
+{
+  char buffer[BUF_LEN];
+  int n;
+  
+  
+  /*
+  move past the next n_records "$$$$" lines
+  */
+  n = 0;
+  while ((n < n_records) && sdf_stream_gets(buffer, BUF_LEN, ss)) {
+    if (!strncmp(buffer, SDF_DELIMITER, 4)) {
+      ++n;
+    }
+  }
+  
+  return ((n == n_records) ? 0 : PREMATURE_EOF);
+}
+
+
+int inflate_sdf_file(char *name, char **data, size_t *size)
+{
+  int n;
+  size_t max_size;
+  char *temp;
+  SdfStream *ss;
+  
+  
+  /*
+  decode a whole compressed file into memory
+  */
+  *data = NULL;
+  *size = 0;
+  if (!(ss = open_sdf_stream(name, "rb", NULL))) {
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  max_size = 0;
+  while ((n = fill_sdf_stream(ss)) > 0) {
+    if ((*size + (size_t)n) > max_size) {
+      max_size = (max_size ? max_size * 2 : SDF_STREAM_BLOCK_SIZE);
+      if ((*size + (size_t)n) > max_size) {
+        max_size = *size + (size_t)n;
+      }
+      if (!(temp = (char *)realloc(*data, max_size))) {
+        close_sdf_stream(ss);
+        free(*data);
+        *data = NULL;
+        return OUT_OF_MEMORY;
+      }
+      *data = temp;
+    }
+    memcpy(&((*data)[*size]), ss->buf, (size_t)n);
+    *size += (size_t)n;
+  }
+  close_sdf_stream(ss);
+  if (n < 0) {
+    if (*data) {
+      free(*data);
+      *data = NULL;
+    }
+    return CANNOT_READ_ORIGINAL_SDF;
+  }
+  
+  return 0;
+}
@@ -0,0 +1,399 @@
+/*
+
+shard.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+#ifndef WIN32
+static int write_shard_data(int fd, void *data, size_t size)
+{
+  char *p;
+  ssize_t n;
+  
+  
+  p = (char *)data;
+  while (size) {
+    if ((n = write(fd, p, size)) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    size -= n;
+  }
+  
+  return 0;
+}
+
+
+static int read_shard_data(int fd, void *data, size_t size)
+{
+  char *p;
+  ssize_t n;
+  
+  
+  /*
+  end of file is an error as well, since messages
+  are never split across a shard exit
+  */
+  p = (char *)data;
+  while (size) {
+    if ((n = read(fd, p, size)) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return -1;
+    }
+    if (!n) {
+      return -1;
+    }
+    p += n;
+    size -= n;
+  }
+  
+  return 0;
+}
+
+
+int send_shard_message(int fd, int type, int group, int slot, int code, void *data, size_t size)
+{
+  ShardMessage msg;
+  
+  
+  /*
+  a shard has a single sender at any time (its ordered
+  writer thread while aligning, then its main thread),
+  so messages need no locking to stay contiguous
+  */
+  memset(&msg, 0, sizeof(ShardMessage));
+  msg.type = type;
+  msg.group = group;
+  msg.slot = slot;
+  msg.code = code;
+  msg.size = size;
+  if (write_shard_data(fd, &msg, sizeof(ShardMessage))) {
+    return -1;
+  }
+  if (size && write_shard_data(fd, data, size)) {
+    return -1;
+  }
+  
+  return 0;
+}
+
+
+static void run_align_shard(O3Data *od, int shard, int n_shards,
+  int fd, int n_threads, void *thread_func)
+{
+  int i;
+  int k;
+  int result;
+  int stats[SHARD_N_STATS];
+  long n_allocs;
+  long n_blocks;
+  long n_resets;
+  size_t peak;
+  OrderedWriter *ow;
+  OrderedWriter *parent_ow;
+  WorkerInfo **ti;
+  
+  
+  /*
+  this runs in the forked shard process: the worker
+  pool threads only exist in the coordinator, so
+  threads are started afresh; aligned poses are
+  forwarded to the coordinator by a local writer
+  */
+  ti = od->mel.worker_info;
+  od->mel.worker_pool = NULL;
+  parent_ow = od->mel.ordered_writer;
+  shard_task_scheduler(od->mel.task_scheduler, shard, n_shards);
+  deal_scheduled_tasks(od->mel.task_scheduler, n_threads);
+  if (!(ow = alloc_ordered_writer(parent_ow->n_groups, parent_ow->n_slots))) {
+    result = OUT_OF_MEMORY;
+  }
+  else {
+    ow->forward_fd = fd;
+    od->mel.ordered_writer = ow;
+    if (!(result = start_ordered_writer(ow))) {
+      result = run_workers(od, "align", n_threads, thread_func);
+      merge_worker_task_info(od, n_threads);
+      if (stop_ordered_writer(ow) && (!(od->al.task_list[ow->error_slot]->code))) {
+        O3_ERROR_LOCATE(od->al.task_list[ow->error_slot]);
+        O3_ERROR_STRING(od->al.task_list[ow->error_slot],
+          parent_ow->name[ow->error_group]);
+        od->al.task_list[ow->error_slot]->code = FL_CANNOT_WRITE_SDF_FILE;
+      }
+    }
+  }
+  if (!result) {
+    for (i = 0; i < od->align.n_tasks; ++i) {
+      if (od->al.task_list[i]->code) {
+        send_shard_message(fd, SHARD_TASK, -1, i, 0,
+          od->al.task_list[i], sizeof(TaskInfo));
+      }
+    }
+    memset(stats, 0, SHARD_N_STATS * sizeof(int));
+    for (i = 0; i < n_threads; ++i) {
+      for (k = 0; k < MAX_DATA_FIELDS; ++k) {
+        stats[k] += ti[i]->data[k];
+      }
+    }
+    get_sdm_memo_stats(&stats[MAX_DATA_FIELDS], &stats[MAX_DATA_FIELDS + 1]);
+    get_arena_stats(&n_allocs, &n_blocks, &n_resets, &peak);
+    stats[MAX_DATA_FIELDS + 2] = (int)n_allocs;
+    stats[MAX_DATA_FIELDS + 3] = (int)n_blocks;
+    stats[MAX_DATA_FIELDS + 4] = (int)n_resets;
+    stats[MAX_DATA_FIELDS + 5] = (int)(peak / 1024);
+    send_shard_message(fd, SHARD_STATS, -1, -1, 0, stats, SHARD_N_STATS * sizeof(int));
+  }
+  send_shard_message(fd, SHARD_DONE, -1, -1, result, NULL, 0);
+  close(fd);
+  /*
+  leave without flushing stdio buffers or running
+  exit handlers, which belong to the coordinator
+  */
+  _exit(0);
+}
+
+
+static int receive_shard_message(O3Data *od, int fd, int *done)
+{
+  int k;
+  int stats[SHARD_N_STATS];
+  ShardMessage msg;
+  OrderedRecord *rec;
+  TaskInfo task;
+  WorkerInfo **ti;
+  
+  
+  /*
+  returns -1 once the shard has closed its socket,
+  otherwise 0 or an error code
+  */
+  ti = od->mel.worker_info;
+  if (read_shard_data(fd, &msg, sizeof(ShardMessage))) {
+    return -1;
+  }
+  switch (msg.type) {
+    case SHARD_RECORD:
+    if ((msg.group < 0) || (msg.group >= od->mel.ordered_writer->n_groups)
+      || (msg.slot < 0) || (msg.slot >= od->mel.ordered_writer->n_slots)) {
+      return -1;
+    }
+    if (!(rec = (OrderedRecord *)malloc(sizeof(OrderedRecord)))) {
+      return OUT_OF_MEMORY;
+    }
+    memset(rec, 0, sizeof(OrderedRecord));
+    rec->group = msg.group;
+    rec->slot = msg.slot;
+    rec->size = msg.size;
+    if (!(rec->data = (char *)malloc(msg.size + 1))) {
+      free(rec);
+      return OUT_OF_MEMORY;
+    }
+    if (read_shard_data(fd, rec->data, msg.size)) {
+      discard_ordered_record(rec);
+      return -1;
+    }
+    queue_ordered_record(od->mel.ordered_writer, rec);
+    break;
+    
+    case SHARD_TASK:
+    if ((msg.size != sizeof(TaskInfo)) || read_shard_data(fd, &task, sizeof(TaskInfo))
+      || (msg.slot < 0) || (msg.slot >= od->align.n_tasks)) {
+      return -1;
+    }
+    if (!(od->al.task_list[msg.slot]->code)) {
+      memcpy(od->al.task_list[msg.slot], &task, sizeof(TaskInfo));
+    }
+    break;
+    
+    case SHARD_STATS:
+    if ((msg.size != (SHARD_N_STATS * sizeof(int)))
+      || read_shard_data(fd, stats, SHARD_N_STATS * sizeof(int))) {
+      return -1;
+    }
+    for (k = 0; k < MAX_DATA_FIELDS; ++k) {
+      ti[0]->data[k] += stats[k];
+    }
+    add_sdm_memo_stats(stats[MAX_DATA_FIELDS], stats[MAX_DATA_FIELDS + 1]);
+    add_arena_stats(stats[MAX_DATA_FIELDS + 2], stats[MAX_DATA_FIELDS + 3],
+      stats[MAX_DATA_FIELDS + 4], (size_t)(stats[MAX_DATA_FIELDS + 5]) * 1024);
+    break;
+    
+    case SHARD_DONE:
+    *done = 1;
+    return msg.code;
+    
+    default:
+    return -1;
+  }
+  
+  return 0;
+}
+
+
+int run_align_shards(O3Data *od, int n_shards, int n_threads, void *thread_func)
+{
+  int i;
+  int j;
+  int n_forked;
+  int n_open;
+  int result;
+  int status;
+  int sv[2];
+  int *done;
+  pid_t *pid;
+  struct pollfd *pfd;
+  
+  
+  /*
+  the cost-sorted (template conformation, candidate)
+  task list is split into n_shards interleaved shards,
+  each aligned by a forked process running n_threads
+  threads; this process acts as coordinator, feeding
+  the aligned poses it receives over local sockets
+  into its ordered writer, so the output files are
+  the same as for a single-process run
+  */
+  pid = (pid_t *)calloc(n_shards, sizeof(pid_t));
+  pfd = (struct pollfd *)calloc(n_shards, sizeof(struct pollfd));
+  done = (int *)calloc(n_shards, sizeof(int));
+  if (!pid || !pfd || !done) {
+    if (pid) {
+      free(pid);
+    }
+    if (pfd) {
+      free(pfd);
+    }
+    if (done) {
+      free(done);
+    }
+    O3_ERROR_LOCATE(&(od->task));
+    return OUT_OF_MEMORY;
+  }
+  /*
+  buffered output must not be inherited,
+  or it would be written once per shard
+  */
+  fflush(NULL);
+  result = 0;
+  for (n_forked = 0; n_forked < n_shards; ++n_forked) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv)) {
+      od->error_code = errno;
+      result = CANNOT_CREATE_THREAD;
+      break;
+    }
+    if ((pid[n_forked] = fork()) == -1) {
+      od->error_code = errno;
+      close(sv[0]);
+      close(sv[1]);
+      result = CANNOT_CREATE_THREAD;
+      break;
+    }
+    if (!pid[n_forked]) {
+      close(sv[0]);
+      for (j = 0; j < n_forked; ++j) {
+        close(pfd[j].fd);
+      }
+      run_align_shard(od, n_forked, n_shards, sv[1], n_threads, thread_func);
+    }
+    close(sv[1]);
+    pfd[n_forked].fd = sv[0];
+    pfd[n_forked].events = POLLIN;
+  }
+  if (!result) {
+    result = start_ordered_writer(od->mel.ordered_writer);
+  }
+  /*
+  merge messages from all shards as they arrive
+  */
+  n_open = n_forked;
+  while ((!result) && n_open) {
+    if (poll(pfd, n_forked, -1) == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      od->error_code = errno;
+      result = CANNOT_JOIN_THREAD;
+      break;
+    }
+    for (i = 0; (!result) && (i < n_forked); ++i) {
+      if ((pfd[i].fd == -1) || (!(pfd[i].revents))) {
+        continue;
+      }
+      if ((result = receive_shard_message(od, pfd[i].fd, &done[i])) == -1) {
+        close(pfd[i].fd);
+        pfd[i].fd = -1;
+        --n_open;
+        result = 0;
+      }
+    }
+  }
+  for (i = 0; i < n_forked; ++i) {
+    if (pfd[i].fd != -1) {
+      close(pfd[i].fd);
+    }
+    if (result) {
+      kill(pid[i], SIGTERM);
+    }
+  }
+  for (i = 0; i < n_forked; ++i) {
+    while ((waitpid(pid[i], &status, 0) == -1) && (errno == EINTR));
+    /*
+    a shard which died before reporting
+    completion has lost part of its tasks
+    */
+    if ((!result) && ((!done[i]) || (!WIFEXITED(status)) || WEXITSTATUS(status))) {
+      od->error_code = status;
+      result = CANNOT_JOIN_THREAD;
+    }
+  }
+  free(pid);
+  free(pfd);
+  free(done);
+  if (result) {
+    O3_ERROR_LOCATE(&(od->task));
+  }
+  
+  return result;
+}
+#endif
@@ -48,22 +48,25 @@ E-mail: paolo.tosco@unito.it
 #define UPPER_DIAG    'U'
 
 
+static int superpose_kernel = SUPERPOSE_QCP;
+
+
 void calc_conf_centroid(ConfInfo *conf, double *centroid)
 {
   int i;
+  int k;
   int x;
-  int n_heavy_atoms;
   
   
   memset(centroid, 0, 3 * sizeof(double));
-  for (x = 0; x < 3; ++x) {
-    for (i = 0, n_heavy_atoms = 0; i < conf->n_atoms; ++i) {
-      if (strcmp(conf->atom[i]->element, "H")) {
-        centroid[x] += conf->coord[i * 3 + x];
-        ++n_heavy_atoms;
-      }
+  for (k = 0; k < conf->n_heavy_atoms; ++k) {
+    i = conf->heavy_atom[k];
+    for (x = 0; x < 3; ++x) {
+      centroid[x] += conf->coord[i * 3 + x];
     }
-    centroid[x] /= (double)n_heavy_atoms;
+  }
+  for (x = 0; x < 3; ++x) {
+    centroid[x] /= (double)(conf->n_heavy_atoms);
   }
 }
 
@@ -84,6 +87,7 @@ int superpose_conf_lap(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_con
   double pairs_heavy_msd_temp;
   
   
+  build_cell_list(template_conf, SDM_THRESHOLD_START);
   compute_cost_matrix(li, moved_conf, template_conf, MAX_H_BINS, 0, MATCH_CONFORMERS_BIT);
   lap(li, template_conf->n_heavy_atoms);
   calc_conf_centroid(template_conf, template_centroid);
@@ -93,10 +97,10 @@ int superpose_conf_lap(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_con
     cblas_daxpy(3, -1.0, moved_centroid, 1, &(fitted_conf->coord[i * 3]), 1);
     cblas_daxpy(3, 1.0, template_centroid, 1, &(fitted_conf->coord[i * 3]), 1);
   }
-  *pairs = filter_sol_vector(li, fitted_conf, template_conf, temp_sdm, fitted_sdm);
+  *pairs = filter_sol_vector(li, moved_conf, template_conf, temp_sdm, fitted_sdm);
   if (*pairs < 3) {
     for (i = 0, *pairs = 0; i < template_conf->n_atoms; ++i) {
-      if (!strcmp(template_conf->atom[i]->element, "H")) {
+      if (template_conf->element[i] == H_ELEMENT_CODE) {
         continue;
       }
       fitted_sdm[i].a[0] = i;
@@ -193,6 +197,7 @@ int superpose_conf_syst(ConfInfo *moved_conf, ConfInfo *template_conf, ConfInfo
   
   
   *pairs = 0;
+  build_cell_list(template_conf, 2.0);
   /*
   find the centroids of the reference
   and candidate structures
@@ -292,45 +297,286 @@ int superpose_conf_syst(ConfInfo *moved_conf, ConfInfo *template_conf, ConfInfo
 }
 
 
-int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
-  ConfInfo *template_conf, ConfInfo *fitted_conf, double *rt_mat,
-  double *heavy_msd, double *original_heavy_msd)
+void set_superpose_kernel(int kernel)
+{
+  superpose_kernel = kernel;
+}
+
+
+static double det3(double *r0, double *r1, double *r2, int *col)
+{
+  return r0[col[0]] * (r1[col[1]] * r2[col[2]] - r1[col[2]] * r2[col[1]])
+    - r0[col[1]] * (r1[col[0]] * r2[col[2]] - r1[col[2]] * r2[col[0]])
+    + r0[col[2]] * (r1[col[0]] * r2[col[1]] - r1[col[1]] * r2[col[0]]);
+}
+
+
+int qcp_algorithm(double *z, double *eigenvalue, double *quat)
+{
+  int i;
+  int j;
+  int k;
+  int iter;
+  int best;
+  int row[3];
+  int col[3];
+  double a[4][4];
+  double a2[4][4];
+  double adj[4][4];
+  double shift;
+  double c0;
+  double c1;
+  double c2;
+  double p2;
+  double p3;
+  double x;
+  double x2;
+  double f;
+  double df;
+  double dx;
+  double norm;
+  double best_norm;
+  
+  
+  /*
+  z is the symmetric 4x4 quaternion matrix built by
+  rms_algorithm(); only its upper triangle (column-major)
+  is populated. The matrix is shifted by a quarter of its
+  trace, so that the characteristic polynomial of the
+  traceless matrix a = z - shift * I has no cubic term:
+  
+  x^4 + c2 * x^2 + c1 * x + c0 = 0
+  
+  with c2 = -tr(a^2) / 2, c1 = -tr(a^3) / 3, c0 = det(a).
+  z is positive semidefinite, hence -shift is a lower bound
+  to the smallest root, and Newton's method started from
+  there converges monotonically to it
+  */
+  for (j = 0, shift = 0.0; j < 4; ++j) {
+    for (i = 0; i <= j; ++i) {
+      a[i][j] = z[j * 4 + i];
+      a[j][i] = a[i][j];
+    }
+    shift += a[j][j];
+  }
+  shift /= 4.0;
+  if (shift < ALMOST_ZERO) {
+    /*
+    all pairs are already perfectly superimposed
+    */
+    *eigenvalue = 0.0;
+    memset(quat, 0, 4 * sizeof(double));
+    quat[0] = 1.0;
+    return 0;
+  }
+  for (i = 0; i < 4; ++i) {
+    a[i][i] -= shift;
+  }
+  for (i = 0, p2 = 0.0, p3 = 0.0; i < 4; ++i) {
+    for (j = 0; j < 4; ++j) {
+      for (k = 0, a2[i][j] = 0.0; k < 4; ++k) {
+        a2[i][j] += a[i][k] * a[k][j];
+      }
+    }
+    p2 += a2[i][i];
+  }
+  for (i = 0; i < 4; ++i) {
+    for (k = 0; k < 4; ++k) {
+      p3 += a2[i][k] * a[k][i];
+    }
+  }
+  c2 = -0.5 * p2;
+  c1 = -p3 / 3.0;
+  c0 = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * (a[2][2] * a[3][3] - a[2][3] * a[3][2])
+    - (a[0][0] * a[1][2] - a[0][2] * a[1][0]) * (a[2][1] * a[3][3] - a[2][3] * a[3][1])
+    + (a[0][0] * a[1][3] - a[0][3] * a[1][0]) * (a[2][1] * a[3][2] - a[2][2] * a[3][1])
+    + (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * (a[2][0] * a[3][3] - a[2][3] * a[3][0])
+    - (a[0][1] * a[1][3] - a[0][3] * a[1][1]) * (a[2][0] * a[3][2] - a[2][2] * a[3][0])
+    + (a[0][2] * a[1][3] - a[0][3] * a[1][2]) * (a[2][0] * a[3][1] - a[2][1] * a[3][0]);
+  x = -shift;
+  for (iter = 0; iter < QCP_MAX_ITERATIONS; ++iter) {
+    x2 = x * x;
+    f = (x2 + c2) * x2 + c1 * x + c0;
+    df = 4.0 * x2 * x + 2.0 * c2 * x + c1;
+    if (fabs(df) < ALMOST_ZERO) {
+      return FL_ABNORMAL_TERMINATION;
+    }
+    dx = f / df;
+    x -= dx;
+    if (fabs(dx) < (QCP_THRESHOLD * shift)) {
+      break;
+    }
+  }
+  if (iter == QCP_MAX_ITERATIONS) {
+    return FL_ABNORMAL_TERMINATION;
+  }
+  *eigenvalue = x + shift;
+  if (*eigenvalue < 0.0) {
+    *eigenvalue = 0.0;
+  }
+  /*
+  the eigenvector is proportional to any non-null
+  column of the adjugate of (a - x * I); the column
+  with the largest norm is the most accurate one
+  */
+  for (i = 0; i < 4; ++i) {
+    a[i][i] -= x;
+  }
+  for (i = 0; i < 4; ++i) {
+    for (j = 0, k = 0; j < 4; ++j) {
+      if (j != i) {
+        row[k] = j;
+        ++k;
+      }
+    }
+    for (j = 0; j <= i; ++j) {
+      for (k = 0, best = 0; k < 4; ++k) {
+        if (k != j) {
+          col[best] = k;
+          ++best;
+        }
+      }
+      adj[j][i] = (((i + j) % 2) ? -1.0 : 1.0)
+        * det3(a[row[0]], a[row[1]], a[row[2]], col);
+      adj[i][j] = adj[j][i];
+    }
+  }
+  for (j = 0, best = 0, best_norm = 0.0; j < 4; ++j) {
+    for (i = 0, norm = 0.0; i < 4; ++i) {
+      norm += square(adj[i][j]);
+    }
+    if (norm > best_norm) {
+      best_norm = norm;
+      best = j;
+    }
+  }
+  /*
+  if the smallest eigenvalue is (nearly) degenerate the
+  adjugate vanishes and the eigenvector cannot be
+  recovered this way; the caller should fall back to
+  a full diagonalization
+  */
+  if (best_norm < (QCP_DEGENERATE_THRESHOLD * square(shift * shift * shift))) {
+    return FL_ABNORMAL_TERMINATION;
+  }
+  best_norm = sqrt(best_norm);
+  for (i = 0; i < 4; ++i) {
+    quat[i] = adj[i][best] / best_norm;
+  }
+  
+  return 0;
+}
+
+
+static int dsyev_algorithm(double *z, double *eigenvalue, double *quat)
 {
-  extern char mmff_corr_matrix[99][99];
-  char corr;
   char jobz = EIGENVECTORS;
   char uplo = UPPER_DIAG;
-  int i;
-  int x;
   int n;
   int info = 0;
   #ifndef HAVE_LIBSUNPERF
   int lwork = WORK_SIZE;
   double work[WORK_SIZE];
   #endif
+  double d[4];
+  double ev[16];
+  
+  
+  #ifndef HAVE_LIBSUNPERF
+  memset(work, 0, WORK_SIZE);
+  #endif
+  memset(d, 0, 4 * sizeof(double));
+  memcpy(ev, z, 16 * sizeof(double));
+  n = 4;
+  #ifdef HAVE_LIBMKL
+  dsyev(&jobz, &uplo, &n, ev, &n, d, work, &lwork, &info);
+  #elif HAVE_LIBSUNPERF
+  dsyev(jobz, uplo, n, ev, n, d, &info);
+  #elif HAVE_LIBACCELERATE
+  dsyev_(&jobz, &uplo, &n, ev, &n, d, work, &lwork, &info);
+  #elif HAVE_LIBATLAS
+  dsyev_(&jobz, &uplo, &n, ev, &n, d, work, &lwork, &info);
+  #endif
+  if (info) {
+    return FL_ABNORMAL_TERMINATION;
+  }
+  *eigenvalue = d[0];
+  memcpy(quat, ev, 4 * sizeof(double));
+  
+  return 0;
+}
+
+
+static int superpose_quat(double *z, double *eigenvalue, double *quat)
+{
+  /*
+  use the closed-form kernel unless LAPACK was
+  explicitly requested; fall back to dsyev if
+  the closed-form kernel cannot cope with the
+  eigenvalue spectrum of z
+  */
+  if ((superpose_kernel == SUPERPOSE_QCP)
+    && (!qcp_algorithm(z, eigenvalue, quat))) {
+    return 0;
+  }
+  
+  return dsyev_algorithm(z, eigenvalue, quat);
+}
+
+
+static void quat_to_rt_mat(double *ev, double *t_mat1, double *t_mat2, double *rt_mat)
+{
+  double rt_mat2[RT_MAT_SIZE];
+  
+  
+  memset(rt_mat, 0, RT_MAT_SIZE * sizeof(double));
+  rt_mat[0]                   = square(ev[0]) + square(ev[1]) - square(ev[2]) - square(ev[3]);
+  rt_mat[1]                   = 2.0 * (ev[1] * ev[2] - ev[0] * ev[3]);
+  rt_mat[2]                   = 2.0 * (ev[1] * ev[3] + ev[0] * ev[2]);
+  rt_mat[RT_VEC_SIZE]         = 2.0 * (ev[1] * ev[2] + ev[0] * ev[3]);
+  rt_mat[RT_VEC_SIZE + 1]     = square(ev[0]) + square(ev[2]) - square(ev[1]) - square(ev[3]);
+  rt_mat[RT_VEC_SIZE + 2]     = 2.0 * (ev[2] * ev[3] - ev[0] * ev[1]);
+  rt_mat[RT_VEC_SIZE * 2]     = 2.0 * (ev[1] * ev[3] - ev[0] * ev[2]);
+  rt_mat[RT_VEC_SIZE * 2 + 1] = 2.0 * (ev[2] * ev[3] + ev[0] * ev[1]);
+  rt_mat[RT_VEC_SIZE * 2 + 2] = square(ev[0]) + square(ev[3]) - square(ev[1]) - square(ev[2]);
+  rt_mat[RT_VEC_SIZE * 3 + 3] = 1.0;
+  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
+    RT_VEC_SIZE, RT_VEC_SIZE, RT_VEC_SIZE,
+    1.0, t_mat2, RT_VEC_SIZE, rt_mat, RT_VEC_SIZE,
+    0.0, rt_mat2, RT_VEC_SIZE);
+  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
+    RT_VEC_SIZE, RT_VEC_SIZE, RT_VEC_SIZE,
+    1.0, rt_mat2, RT_VEC_SIZE, t_mat1, RT_VEC_SIZE,
+    0.0, rt_mat, RT_VEC_SIZE);
+}
+
+
+int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
+  ConfInfo *template_conf, ConfInfo *fitted_conf, double *rt_mat,
+  double *heavy_msd, double *original_heavy_msd)
+{
+  extern char mmff_corr_matrix[99][99];
+  char corr;
+  int i;
+  int x;
   double moved_pairs_centroid[3];
   double template_pairs_centroid[3];
-  double *ev;
+  double ev[4];
   double m[3];
   double p[3];
-  double d[4];
   double rt_mat1[RT_MAT_SIZE];
-  double rt_mat2[RT_MAT_SIZE];
   double t_mat1[RT_MAT_SIZE];
   double t_mat2[RT_MAT_SIZE];
   double t_vec1[RT_VEC_SIZE];
   double t_vec2[RT_VEC_SIZE];
   double z[16];
+  double eigenvalue;
   double min_weight;
   double sum_weight;
   double td;
   double md;
   
   
-  #ifndef HAVE_LIBSUNPERF
-  memset(work, 0, WORK_SIZE);
-  #endif
-  memset(d, 0, 4 * sizeof(double));
   memset(z, 0, 16 * sizeof(double));
   memset(moved_pairs_centroid, 0, 3 * sizeof(double));
   memset(template_pairs_centroid, 0, 3 * sizeof(double));
@@ -364,15 +610,6 @@ int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
     template_pairs_centroid[x] /= sum_weight;
     moved_pairs_centroid[x] /= sum_weight;
   }
-  memset(t_vec1, 0, RT_VEC_SIZE * sizeof(double));
-  t_vec1[3] = 1.0;
-  memset(t_mat1, 0, RT_MAT_SIZE * sizeof(double));
-  for (i = 0; i < RT_MAT_SIZE; i += 5) {
-    t_mat1[i] = 1.0;
-  }
-  memcpy(t_mat2, t_mat1, RT_MAT_SIZE * sizeof(double));
-  cblas_daxpy(3, -1.0, moved_pairs_centroid, 1, &t_mat1[3 * RT_VEC_SIZE], 1);
-  cblas_dcopy(3, template_pairs_centroid, 1, &t_mat2[3 * RT_VEC_SIZE], 1);
   /*
   find the best rotation matrix
   */
@@ -394,42 +631,9 @@ int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
     z[14] += (m[1] * m[2] - p[1] * p[2]);
     z[15] += (square(p[0]) + square(p[1]) + square(m[2]));
   }
-  n = 4;
-  #ifdef HAVE_LIBMKL
-  dsyev(&jobz, &uplo, &n, z, &n, d, work, &lwork, &info);
-  #elif HAVE_LIBSUNPERF
-  dsyev(jobz, uplo, n, z, n, d, &info);
-  #elif HAVE_LIBACCELERATE
-  dsyev_(&jobz, &uplo, &n, z, &n, d, work, &lwork, &info);
-  #elif HAVE_LIBATLAS
-  dsyev_(&jobz, &uplo, &n, z, &n, d, work, &lwork, &info);
-  #endif
-  if (info) {
+  if (superpose_quat(z, &eigenvalue, ev)) {
     return FL_ABNORMAL_TERMINATION;
   }
-  ev = z;
-  if (!rt_mat) {
-    rt_mat = rt_mat1;
-  }
-  memset(rt_mat, 0, RT_MAT_SIZE * sizeof(double));
-  rt_mat[0]                   = square(ev[0]) + square(ev[1]) - square(ev[2]) - square(ev[3]);
-  rt_mat[1]                   = 2.0 * (ev[1] * ev[2] - ev[0] * ev[3]);
-  rt_mat[2]                   = 2.0 * (ev[1] * ev[3] + ev[0] * ev[2]);
-  rt_mat[RT_VEC_SIZE]         = 2.0 * (ev[1] * ev[2] + ev[0] * ev[3]);
-  rt_mat[RT_VEC_SIZE + 1]     = square(ev[0]) + square(ev[2]) - square(ev[1]) - square(ev[3]);
-  rt_mat[RT_VEC_SIZE + 2]     = 2.0 * (ev[2] * ev[3] - ev[0] * ev[1]);
-  rt_mat[RT_VEC_SIZE * 2]     = 2.0 * (ev[1] * ev[3] - ev[0] * ev[2]);
-  rt_mat[RT_VEC_SIZE * 2 + 1] = 2.0 * (ev[2] * ev[3] + ev[0] * ev[1]);
-  rt_mat[RT_VEC_SIZE * 2 + 2] = square(ev[0]) + square(ev[3]) - square(ev[1]) - square(ev[2]);
-  rt_mat[RT_VEC_SIZE * 3 + 3] = 1.0;
-  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
-    RT_VEC_SIZE, RT_VEC_SIZE, RT_VEC_SIZE,
-    1.0, t_mat2, RT_VEC_SIZE, rt_mat, RT_VEC_SIZE,
-    0.0, rt_mat2, RT_VEC_SIZE);
-  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
-    RT_VEC_SIZE, RT_VEC_SIZE, RT_VEC_SIZE,
-    1.0, rt_mat2, RT_VEC_SIZE, t_mat1, RT_VEC_SIZE,
-    0.0, rt_mat, RT_VEC_SIZE);
   if (original_heavy_msd) {
     *original_heavy_msd = 0.0;
     for (i = 0; i < pairs; ++i) {
@@ -439,6 +643,20 @@ int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
     }
     *original_heavy_msd /= (double)pairs;
   }
+  *heavy_msd = safe_rint(eigenvalue / (double)pairs * 1.0e06) / 1.0e06;
+  memset(t_vec1, 0, RT_VEC_SIZE * sizeof(double));
+  t_vec1[3] = 1.0;
+  memset(t_mat1, 0, RT_MAT_SIZE * sizeof(double));
+  for (i = 0; i < RT_MAT_SIZE; i += 5) {
+    t_mat1[i] = 1.0;
+  }
+  memcpy(t_mat2, t_mat1, RT_MAT_SIZE * sizeof(double));
+  cblas_daxpy(3, -1.0, moved_pairs_centroid, 1, &t_mat1[3 * RT_VEC_SIZE], 1);
+  cblas_dcopy(3, template_pairs_centroid, 1, &t_mat2[3 * RT_VEC_SIZE], 1);
+  if (!rt_mat) {
+    rt_mat = rt_mat1;
+  }
+  quat_to_rt_mat(ev, t_mat1, t_mat2, rt_mat);
   for (i = 0; i < moved_conf->n_atoms; ++i) {
     /*
     apply the rotation/translation matrix to moved_conf coordinates
@@ -449,7 +667,6 @@ int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
       t_vec1, 1, 0.0, t_vec2, 1);
     cblas_dcopy(3, t_vec2, 1, &(fitted_conf->coord[i * 3]), 1);
   }
-  *heavy_msd = safe_rint(d[0] / (double)pairs * 1.0e06) / 1.0e06;
   
   return 0;
 }
@@ -457,36 +674,23 @@ int rms_algorithm(int coeff, AtomPair *sdm, int pairs, ConfInfo *moved_conf,
 
 int rms_algorithm_multi(O3Data *od, O3Data *od_comp, double *rt_mat, double *heavy_msd)
 {
-  char jobz = EIGENVECTORS;
-  char uplo = UPPER_DIAG;
   int i;
   int x;
-  int n;
   int object_num;
   int pairs;
   int overall_pairs;
-  int info = 0;
-  #ifndef HAVE_LIBSUNPERF
-  int lwork = WORK_SIZE;
-  double work[WORK_SIZE];
-  #endif
-  double *ev;
-  double rt_mat2[RT_MAT_SIZE];
   double t_mat1[RT_MAT_SIZE];
   double t_mat2[RT_MAT_SIZE];
   double moved_pairs_centroid[3];
   double template_pairs_centroid[3];
+  double ev[4];
   double m[3];
   double p[3];
-  double d[4];
   double z[16];
+  double eigenvalue;
   AtomPair *sdm = NULL;
   
   
-  #ifndef HAVE_LIBSUNPERF
-  memset(work, 0, WORK_SIZE);
-  #endif
-  memset(d, 0, 4 * sizeof(double));
   memset(z, 0, 16 * sizeof(double));
   memset(moved_pairs_centroid, 0, 3 * sizeof(double));
   memset(template_pairs_centroid, 0, 3 * sizeof(double));
@@ -511,13 +715,6 @@ int rms_algorithm_multi(O3Data *od, O3Data *od_comp, double *rt_mat, double *hea
     template_pairs_centroid[x] /= (double)overall_pairs;
     moved_pairs_centroid[x] /= (double)overall_pairs;
   }
-  memset(t_mat1, 0, RT_MAT_SIZE * sizeof(double));
-  for (i = 0; i < RT_MAT_SIZE; i += 5) {
-    t_mat1[i] = 1.0;
-  }
-  memcpy(t_mat2, t_mat1, RT_MAT_SIZE * sizeof(double));
-  cblas_daxpy(3, -1.0, moved_pairs_centroid, 1, &t_mat1[3 * RT_VEC_SIZE], 1);
-  cblas_dcopy(3, template_pairs_centroid, 1, &t_mat2[3 * RT_VEC_SIZE], 1);
   /*
   find the best rotation matrix
   */
@@ -543,60 +740,299 @@ int rms_algorithm_multi(O3Data *od, O3Data *od_comp, double *rt_mat, double *hea
       z[15] += (square(p[0]) + square(p[1]) + square(m[2]));
     }
   }
-  n = 4;
-  #ifdef HAVE_LIBMKL
-  dsyev(&jobz, &uplo, &n, z, &n, d, work, &lwork, &info);
-  #elif HAVE_LIBSUNPERF
-  dsyev(jobz, uplo, n, z, n, d, &info);
-  #elif HAVE_LIBACCELERATE
-  dsyev_(&jobz, &uplo, &n, z, &n, d, work, &lwork, &info);
-  #elif HAVE_LIBATLAS
-  dsyev_(&jobz, &uplo, &n, z, &n, d, work, &lwork, &info);
-  #endif
-  if (info) {
+  if (superpose_quat(z, &eigenvalue, ev)) {
     return FL_ABNORMAL_TERMINATION;
   }
-  ev = z;
-  memset(rt_mat, 0, RT_MAT_SIZE * sizeof(double));
-  rt_mat[0]                   = square(ev[0]) + square(ev[1]) - square(ev[2]) - square(ev[3]);
-  rt_mat[1]                   = 2.0 * (ev[1] * ev[2] - ev[0] * ev[3]);
-  rt_mat[2]                   = 2.0 * (ev[1] * ev[3] + ev[0] * ev[2]);
-  rt_mat[RT_VEC_SIZE]         = 2.0 * (ev[1] * ev[2] + ev[0] * ev[3]);
-  rt_mat[RT_VEC_SIZE + 1]     = square(ev[0]) + square(ev[2]) - square(ev[1]) - square(ev[3]);
-  rt_mat[RT_VEC_SIZE + 2]     = 2.0 * (ev[2] * ev[3] - ev[0] * ev[1]);
-  rt_mat[RT_VEC_SIZE * 2]     = 2.0 * (ev[1] * ev[3] - ev[0] * ev[2]);
-  rt_mat[RT_VEC_SIZE * 2 + 1] = 2.0 * (ev[2] * ev[3] + ev[0] * ev[1]);
-  rt_mat[RT_VEC_SIZE * 2 + 2] = square(ev[0]) + square(ev[3]) - square(ev[1]) - square(ev[2]);
-  rt_mat[RT_VEC_SIZE * 3 + 3] = 1.0;
-  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
-    RT_VEC_SIZE, RT_VEC_SIZE, RT_VEC_SIZE,
-    1.0, t_mat2, RT_VEC_SIZE, rt_mat, RT_VEC_SIZE,
-    0.0, rt_mat2, RT_VEC_SIZE);
-  cblas_dgemm(CblasColMajor, CblasNoTrans, CblasNoTrans,
-    RT_VEC_SIZE, RT_VEC_SIZE, RT_VEC_SIZE,
-    1.0, rt_mat2, RT_VEC_SIZE, t_mat1, RT_VEC_SIZE,
-    0.0, rt_mat, RT_VEC_SIZE);
-  *heavy_msd = safe_rint(d[0] / (double)overall_pairs * 1.0e06) / 1.0e06;
+  *heavy_msd = safe_rint(eigenvalue / (double)overall_pairs * 1.0e06) / 1.0e06;
+  memset(t_mat1, 0, RT_MAT_SIZE * sizeof(double));
+  for (i = 0; i < RT_MAT_SIZE; i += 5) {
+    t_mat1[i] = 1.0;
+  }
+  memcpy(t_mat2, t_mat1, RT_MAT_SIZE * sizeof(double));
+  cblas_daxpy(3, -1.0, moved_pairs_centroid, 1, &t_mat1[3 * RT_VEC_SIZE], 1);
+  cblas_dcopy(3, template_pairs_centroid, 1, &t_mat2[3 * RT_VEC_SIZE], 1);
+  quat_to_rt_mat(ev, t_mat1, t_mat2, rt_mat);
+  
+  return 0;
+}
+
+
+int build_cell_list(ConfInfo *conf, double cell_size)
+{
+  int i;
+  int k;
+  int x;
+  int cell;
+  int n_cells;
+  int c[3];
+  double max_coord[3];
+  CellList *cl;
+  
+  
+  /*
+  bin template heavy atoms into a regular grid of cubic
+  cells, so that sdm_algorithm() only needs to look at
+  the cells surrounding each candidate atom; the grid must
+  be rebuilt whenever conf coordinates change
+  */
+  if (!(conf->cell_list)) {
+    if (!(conf->cell_list = (CellList *)malloc(sizeof(CellList)))) {
+      return OUT_OF_MEMORY;
+    }
+    memset(conf->cell_list, 0, sizeof(CellList));
+  }
+  cl = conf->cell_list;
+  for (k = 0; k < conf->n_heavy_atoms; ++k) {
+    i = conf->heavy_atom[k];
+    for (x = 0; x < 3; ++x) {
+      if ((!k) || (conf->coord[i * 3 + x] < cl->origin[x])) {
+        cl->origin[x] = conf->coord[i * 3 + x];
+      }
+      if ((!k) || (conf->coord[i * 3 + x] > max_coord[x])) {
+        max_coord[x] = conf->coord[i * 3 + x];
+      }
+    }
+  }
+  if (!(conf->n_heavy_atoms)) {
+    memset(cl->origin, 0, 3 * sizeof(double));
+    memset(max_coord, 0, 3 * sizeof(double));
+  }
+  /*
+  cells are made slightly larger than requested, so that
+  a search within a distance equal to cell_size only needs
+  to visit adjacent cells; very sparse structures would need
+  a huge number of cells: in that case cells are made larger
+  */
+  cl->cell_size = cell_size * (1.0 + 2.0 * CELL_LIST_MARGIN);
+  while (1) {
+    for (x = 0; x < 3; ++x) {
+      cl->n_cells[x] = (int)((max_coord[x] - cl->origin[x]) / cl->cell_size) + 1;
+    }
+    if (((double)(cl->n_cells[0]) * (double)(cl->n_cells[1]) * (double)(cl->n_cells[2]))
+      <= (double)(MAX_CELLS_PER_ATOM * (conf->n_heavy_atoms + 1))) {
+      break;
+    }
+    cl->cell_size *= 2.0;
+  }
+  n_cells = cl->n_cells[0] * cl->n_cells[1] * cl->n_cells[2];
+  if ((n_cells + 1) > cl->max_cells) {
+    if (cl->cell_start) {
+      free(cl->cell_start);
+    }
+    if (!(cl->cell_start = (int *)malloc((n_cells + 1) * sizeof(int)))) {
+      free_cell_list(cl);
+      conf->cell_list = NULL;
+      return OUT_OF_MEMORY;
+    }
+    cl->max_cells = n_cells + 1;
+  }
+  if ((!(cl->accepted)) || (conf->n_heavy_atoms > cl->max_atoms)) {
+    if (cl->cell_atom) {
+      free(cl->cell_atom);
+    }
+    if (cl->accepted) {
+      free(cl->accepted);
+    }
+    cl->cell_atom = NULL;
+    cl->accepted = NULL;
+    if ((!(cl->cell_atom = (int *)malloc((conf->n_heavy_atoms + 1) * sizeof(int))))
+      || (!(cl->accepted = (AtomPair *)malloc((conf->n_heavy_atoms + 1) * sizeof(AtomPair))))) {
+      free_cell_list(cl);
+      conf->cell_list = NULL;
+      return OUT_OF_MEMORY;
+    }
+    cl->max_atoms = conf->n_heavy_atoms;
+  }
+  /*
+  counting sort of heavy atoms by cell; within
+  each cell atoms are kept in increasing order
+  */
+  memset(cl->cell_start, 0, (n_cells + 1) * sizeof(int));
+  for (k = 0; k < conf->n_heavy_atoms; ++k) {
+    i = conf->heavy_atom[k];
+    for (x = 0; x < 3; ++x) {
+      c[x] = (int)((conf->coord[i * 3 + x] - cl->origin[x]) / cl->cell_size);
+      if (c[x] >= cl->n_cells[x]) {
+        c[x] = cl->n_cells[x] - 1;
+      }
+    }
+    ++(cl->cell_start[(c[2] * cl->n_cells[1] + c[1]) * cl->n_cells[0] + c[0] + 1]);
+  }
+  for (cell = 0; cell < n_cells; ++cell) {
+    cl->cell_start[cell + 1] += cl->cell_start[cell];
+  }
+  for (k = 0; k < conf->n_heavy_atoms; ++k) {
+    i = conf->heavy_atom[k];
+    for (x = 0; x < 3; ++x) {
+      c[x] = (int)((conf->coord[i * 3 + x] - cl->origin[x]) / cl->cell_size);
+      if (c[x] >= cl->n_cells[x]) {
+        c[x] = cl->n_cells[x] - 1;
+      }
+    }
+    cell = (c[2] * cl->n_cells[1] + c[1]) * cl->n_cells[0] + c[0];
+    cl->cell_atom[cl->cell_start[cell]] = i;
+    ++(cl->cell_start[cell]);
+  }
+  for (cell = n_cells; cell > 0; --cell) {
+    cl->cell_start[cell] = cl->cell_start[cell - 1];
+  }
+  cl->cell_start[0] = 0;
   
   return 0;
 }
 
 
+static int compare_sdm_pair(const void *a, const void *b)
+{
+  const AtomPair *pa = (const AtomPair *)a;
+  const AtomPair *pb = (const AtomPair *)b;
+  
+  
+  /*
+  ties on distance are broken by template, then by
+  moved atom index, i.e. in pair generation order
+  */
+  if (pa->dist < pb->dist) {
+    return -1;
+  }
+  if (pa->dist > pb->dist) {
+    return 1;
+  }
+  if (pa->a[0] != pb->a[0]) {
+    return ((pa->a[0] < pb->a[0]) ? -1 : 1);
+  }
+  if (pa->a[1] != pb->a[1]) {
+    return ((pa->a[1] < pb->a[1]) ? -1 : 1);
+  }
+  
+  return 0;
+}
+
+
+static int select_sdm_pairs(AtomPair *sdm, int n, char **used, CellList *cl, double threshold)
+{
+  int i;
+  int j;
+  int k;
+  int b;
+  int n_buckets;
+  int n_bucket_pairs;
+  int pairs = 0;
+  int conflict = 0;
+  int *bucket_head;
+  int *bucket_next;
+  int *bucket_pairs;
+  
+  
+  if ((!cl) || (!(cl->accepted))) {
+    /*
+    no scratch space available: sort the whole SDM matrix
+    by increasing distances, then increase the number of
+    pairs which will be used by the rms_algorithm until an
+    atom which has been included in a previous pair is found
+    */
+    qsort(sdm, n, sizeof(AtomPair), compare_sdm_pair);
+    for (i = 0; i < n; ++i) {
+      if (used[0][sdm[i].a[0]] || used[1][sdm[i].a[1]]) {
+        break;
+      }
+      ++pairs;
+      used[0][sdm[i].a[0]] = 1;
+      used[1][sdm[i].a[1]] = 1;
+    }
+    return pairs;
+  }
+  /*
+  bucketed partial sort: pairs are distributed into n
+  buckets of equal width over [0, threshold^2), then
+  buckets are sorted and consumed in increasing order;
+  since only the leading pairs are ever used, buckets
+  beyond the first conflicting pair are never sorted
+  */
+  n_buckets = (n ? n : 1);
+  if ((n_buckets * 3) > cl->max_pairs) {
+    if (cl->bucket) {
+      free(cl->bucket);
+    }
+    if (!(cl->bucket = (int *)malloc(n_buckets * 3 * sizeof(int)))) {
+      cl->max_pairs = 0;
+      return select_sdm_pairs(sdm, n, used, NULL, threshold);
+    }
+    cl->max_pairs = n_buckets * 3;
+  }
+  bucket_head = cl->bucket;
+  bucket_next = &(cl->bucket[n_buckets]);
+  bucket_pairs = &(cl->bucket[n_buckets * 2]);
+  for (b = 0; b < n_buckets; ++b) {
+    bucket_head[b] = -1;
+  }
+  for (i = n - 1; i >= 0; --i) {
+    b = (int)(sdm[i].dist / square(threshold) * (double)n_buckets);
+    if (b >= n_buckets) {
+      b = n_buckets - 1;
+    }
+    if (b < 0) {
+      b = 0;
+    }
+    bucket_next[i] = bucket_head[b];
+    bucket_head[b] = i;
+  }
+  for (b = 0; (!conflict) && (b < n_buckets); ++b) {
+    for (i = bucket_head[b], n_bucket_pairs = 0; i != -1; i = bucket_next[i]) {
+      /*
+      insertion sort of the (usually very few)
+      pairs which fall into this bucket
+      */
+      for (j = n_bucket_pairs; (j > 0)
+        && (compare_sdm_pair(&sdm[bucket_pairs[j - 1]], &sdm[i]) > 0); --j) {
+        bucket_pairs[j] = bucket_pairs[j - 1];
+      }
+      bucket_pairs[j] = i;
+      ++n_bucket_pairs;
+    }
+    for (k = 0; k < n_bucket_pairs; ++k) {
+      i = bucket_pairs[k];
+      if (used[0][sdm[i].a[0]] || used[1][sdm[i].a[1]]) {
+        conflict = 1;
+        break;
+      }
+      used[0][sdm[i].a[0]] = 1;
+      used[1][sdm[i].a[1]] = 1;
+      memcpy(&(cl->accepted[pairs]), &sdm[i], sizeof(AtomPair));
+      ++pairs;
+    }
+  }
+  memcpy(sdm, cl->accepted, pairs * sizeof(AtomPair));
+  
+  return pairs;
+}
+
+
 int sdm_algorithm(AtomPair *sdm, ConfInfo *moved_conf, ConfInfo *template_conf, char **used, int options, double threshold)
 {
   int i;
   int j;
+  int k;
+  int l;
   int x;
   int n = 0;
-  int pairs = 0;
+  int range;
+  int cell;
+  int lo[3];
+  int hi[3];
+  int c[3];
   int largest_n_atoms;
   double dist = 0.0;
   double template_centroid[3];
   double moved_centroid[3];
   double coord1[3];
   double coord2[3];
+  double query[3];
+  CellList *cl;
   
   
+  memset(template_centroid, 0, 3 * sizeof(double));
+  memset(moved_centroid, 0, 3 * sizeof(double));
   if (options & CENTER_TO_ORIGIN_BIT) {
     calc_conf_centroid(template_conf, template_centroid);
     calc_conf_centroid(moved_conf, moved_centroid);
@@ -605,68 +1041,195 @@ int sdm_algorithm(AtomPair *sdm, ConfInfo *moved_conf, ConfInfo *template_conf,
     ? moved_conf->n_atoms : template_conf->n_atoms);
   memset(used[0], 0, largest_n_atoms);
   memset(used[1], 0, largest_n_atoms);
-  /*
-  loop over template_conf atoms
-  */
-  for (i = 0; i < template_conf->n_atoms; ++i) {
+  cl = template_conf->cell_list;
+  if (cl && cl->accepted) {
     /*
-    skip hydrogens
+    loop over moved_conf heavy atoms and look for
+    template_conf heavy atoms only in the surrounding
+    cells; the search box is slightly enlarged so that
+    no pair within threshold can be missed, while the
+    distance test itself is exactly the same as below
     */
-    if (!strcmp(template_conf->atom[i]->element, "H")) {
-      continue;
+    range = (int)ceil(threshold * (1.0 + CELL_LIST_MARGIN) / cl->cell_size);
+    for (l = 0; l < moved_conf->n_heavy_atoms; ++l) {
+      j = moved_conf->heavy_atom[l];
+      for (x = 0; x < 3; ++x) {
+        query[x] = moved_conf->coord[j * 3 + x] - moved_centroid[x] + template_centroid[x];
+        c[x] = (int)floor((query[x] - cl->origin[x]) / cl->cell_size);
+        lo[x] = ((c[x] - range) < 0) ? 0 : (c[x] - range);
+        hi[x] = ((c[x] + range) >= cl->n_cells[x]) ? (cl->n_cells[x] - 1) : (c[x] + range);
+      }
+      for (c[2] = lo[2]; c[2] <= hi[2]; ++c[2]) {
+        for (c[1] = lo[1]; c[1] <= hi[1]; ++c[1]) {
+          for (c[0] = lo[0]; c[0] <= hi[0]; ++c[0]) {
+            cell = (c[2] * cl->n_cells[1] + c[1]) * cl->n_cells[0] + c[0];
+            for (k = cl->cell_start[cell]; k < cl->cell_start[cell + 1]; ++k) {
+              i = cl->cell_atom[k];
+              if ((options & MATCH_ATOM_TYPES_BIT) && ((template_conf->atom[i]->atom_type !=
+                moved_conf->atom[j]->atom_type) || (template_conf->atom[i]->charge !=
+                moved_conf->atom[j]->charge))) {
+                continue;
+              }
+              for (x = 0; x < 3; ++x) {
+                coord1[x] = (double)(template_conf->coord[i * 3 + x])
+                  - ((options & CENTER_TO_ORIGIN_BIT) ? template_centroid[x] : 0.0);
+                coord2[x] = (double)(moved_conf->coord[j * 3 + x])
+                  - ((options & CENTER_TO_ORIGIN_BIT) ? moved_centroid[x] : 0.0);
+              }
+              dist = squared_euclidean_distance(coord1, coord2);
+              if (dist < square(threshold)) {
+                sdm[n].a[0] = i;
+                sdm[n].a[1] = j;
+                sdm[n].dist = dist;
+                ++n;
+              }
+            }
+          }
+        }
+      }
     }
+  }
+  else {
     /*
-    loop over moved_conf atoms
+    loop over template_conf heavy atoms
     */
-    for (j = 0; j < moved_conf->n_atoms; ++j) {
+    for (k = 0; k < template_conf->n_heavy_atoms; ++k) {
+      i = template_conf->heavy_atom[k];
       /*
-      skip hydrogens
+      loop over moved_conf heavy atoms
       */
-      if ((!strcmp(moved_conf->atom[j]->element, "H"))
-        || ((options & MATCH_ATOM_TYPES_BIT) && ((template_conf->atom[i]->atom_type !=
-        moved_conf->atom[j]->atom_type) || (template_conf->atom[i]->charge !=
-        moved_conf->atom[j]->charge)))) {
-        continue;
-      }
-      for (x = 0; x < 3; ++x) {
-        coord1[x] = (double)(template_conf->coord[i * 3 + x])
-          - ((options & CENTER_TO_ORIGIN_BIT) ? template_centroid[x] : 0.0);
-        coord2[x] = (double)(moved_conf->coord[j * 3 + x])
-          - ((options & CENTER_TO_ORIGIN_BIT) ? moved_centroid[x] : 0.0);
-      }
-      dist = squared_euclidean_distance(coord1, coord2);
-      /*
-      if the distance between these two atoms is lower
-      than threshold, then include this
-      pair in the SDM matrix
-      */
-      if (dist < square(threshold)) {
-        sdm[n].a[0] = i;
-        sdm[n].a[1] = j;
-        sdm[n].dist = dist;
-        ++n;
+      for (l = 0; l < moved_conf->n_heavy_atoms; ++l) {
+        j = moved_conf->heavy_atom[l];
+        if ((options & MATCH_ATOM_TYPES_BIT) && ((template_conf->atom[i]->atom_type !=
+          moved_conf->atom[j]->atom_type) || (template_conf->atom[i]->charge !=
+          moved_conf->atom[j]->charge))) {
+          continue;
+        }
+        for (x = 0; x < 3; ++x) {
+          coord1[x] = (double)(template_conf->coord[i * 3 + x])
+            - ((options & CENTER_TO_ORIGIN_BIT) ? template_centroid[x] : 0.0);
+          coord2[x] = (double)(moved_conf->coord[j * 3 + x])
+            - ((options & CENTER_TO_ORIGIN_BIT) ? moved_centroid[x] : 0.0);
+        }
+        dist = squared_euclidean_distance(coord1, coord2);
+        /*
+        if the distance between these two atoms is lower
+        than threshold, then include this
+        pair in the SDM matrix
+        */
+        if (dist < square(threshold)) {
+          sdm[n].a[0] = i;
+          sdm[n].a[1] = j;
+          sdm[n].dist = dist;
+          ++n;
+        }
       }
     }
   }
+  
+  return select_sdm_pairs(sdm, n, used, cl, threshold);
+}
+
+
+void reset_sdm_memo(SDMMemo *memo)
+{
+  /*
+  bumping the generation invalidates all slots
+  at once; the table is reset whenever a new
+  (template, candidate) conformation pair is started
+  */
+  ++(memo->generation);
+}
+
+
+int lookup_sdm_memo(SDMMemo *memo, AtomPair *sdm, int pairs, int weight, int threshold_iter)
+{
+  int i;
+  int j;
+  int a0;
+  int a1;
+  int slot;
+  int probe;
+  unsigned int hash;
+  
+  
   /*
-  sort the SDM matrix by increasing distances
+  the SDM pair set is turned into a canonical key
+  (pairs sorted by template atom, which is unique
+  within a pair set) so that the same set yields
+  the same key regardless of the distance ordering
   */
-  qsort(sdm, n, sizeof(AtomPair), compare_dist);
+  for (i = 0; i < pairs; ++i) {
+    a0 = sdm[i].a[0];
+    a1 = sdm[i].a[1];
+    for (j = i; (j > 0) && (memo->query[(j - 1) * 2] > a0); --j) {
+      memo->query[j * 2] = memo->query[(j - 1) * 2];
+      memo->query[j * 2 + 1] = memo->query[(j - 1) * 2 + 1];
+    }
+    memo->query[j * 2] = a0;
+    memo->query[j * 2 + 1] = a1;
+  }
   /*
-  increase the number of pairs which will be used
-  by the rms_algorithm until an atom which has been
-  included in a previous pair is found
+  FNV-1a hash of the key, the weight
+  and the SDM threshold
   */
-  for (i = 0; i < n; ++i) {
-    if (used[0][sdm[i].a[0]] || used[1][sdm[i].a[1]]) {
+  hash = 2166136261U;
+  hash = (hash ^ (unsigned int)weight) * 16777619U;
+  hash = (hash ^ (unsigned int)threshold_iter) * 16777619U;
+  for (i = 0; i < (pairs * 2); ++i) {
+    hash = (hash ^ (unsigned int)(memo->query[i])) * 16777619U;
+  }
+  memo->query_hash = hash;
+  memo->query_pairs = pairs;
+  for (probe = 0; probe < SDM_MEMO_MAX_PROBES; ++probe) {
+    slot = (int)((hash + (unsigned int)probe) % SDM_MEMO_SIZE);
+    if (memo->slot_generation[slot] != memo->generation) {
       break;
     }
-    ++pairs;
-    used[0][sdm[i].a[0]] = 1;
-    used[1][sdm[i].a[1]] = 1;
+    if ((memo->hash[slot] == hash) && (memo->n_key[slot] == pairs)
+      && (memo->weight[slot] == weight) && (memo->threshold_iter[slot] == threshold_iter)
+      && (!memcmp(memo->key[slot], memo->query, pairs * 2 * sizeof(int)))) {
+      ++(memo->hits);
+      return slot;
+    }
   }
+  ++(memo->misses);
   
-  return pairs;
+  return -1;
+}
+
+
+void store_sdm_memo(SDMMemo *memo, int weight, int threshold_iter, double score,
+  AtomPair *sdm, int pairs, ConfInfo *fitted_conf)
+{
+  int slot;
+  int probe;
+  
+  
+  /*
+  store the outcome of the refinement started from
+  the pair set last passed to lookup_sdm_memo();
+  if all probed slots are taken, the first one
+  is overwritten
+  */
+  slot = (int)(memo->query_hash % SDM_MEMO_SIZE);
+  for (probe = 0; probe < SDM_MEMO_MAX_PROBES; ++probe) {
+    if (memo->slot_generation[(int)((memo->query_hash + (unsigned int)probe) % SDM_MEMO_SIZE)]
+      != memo->generation) {
+      slot = (int)((memo->query_hash + (unsigned int)probe) % SDM_MEMO_SIZE);
+      break;
+    }
+  }
+  memo->slot_generation[slot] = memo->generation;
+  memo->hash[slot] = memo->query_hash;
+  memo->n_key[slot] = memo->query_pairs;
+  memo->weight[slot] = weight;
+  memo->threshold_iter[slot] = threshold_iter;
+  memcpy(memo->key[slot], memo->query, memo->query_pairs * 2 * sizeof(int));
+  memo->score[slot] = score;
+  memo->n_pairs[slot] = pairs;
+  memcpy(memo->sdm[slot], sdm, pairs * sizeof(AtomPair));
+  cblas_dcopy(fitted_conf->n_atoms * 3, fitted_conf->coord, 1, memo->coord[slot], 1);
 }
 
 
@@ -674,9 +1237,9 @@ void overall_msd(AtomPair *sdm, int pairs, ConfInfo *moved_conf, ConfInfo *templ
 {
   int i;
   int j;
+  int k;
   int x;
   int temp_match = 0;
-  int n_heavy_atoms;
   double coord1[3];
   double coord2[3];
   double dist = 0.0;
@@ -700,7 +1263,7 @@ void overall_msd(AtomPair *sdm, int pairs, ConfInfo *moved_conf, ConfInfo *templ
     cblas_dcopy(3, &(template_conf->coord[i * 3]), 1, coord1, 1);
     for (j = 0; j < moved_conf->n_atoms; ++j) {
       if ((template_conf->atom[i]->tinker_type != moved_conf->atom[j]->tinker_type)
-        || strcmp(template_conf->atom[i]->element, template_conf->atom[j]->element)) {
+        || (template_conf->element[i] != moved_conf->element[j])) {
         continue;
       }
       x = 0;
@@ -725,18 +1288,31 @@ void overall_msd(AtomPair *sdm, int pairs, ConfInfo *moved_conf, ConfInfo *templ
     template_conf->atom[i]->match = temp_match;
   }
   *heavy_msd = 0.0;
-  for (i = 0, n_heavy_atoms = 0; i < template_conf->n_atoms; ++i) {
-    if (!strcmp(template_conf->atom[i]->element, "H")) {
-      continue;
-    }
+  for (k = 0; k < template_conf->n_heavy_atoms; ++k) {
+    i = template_conf->heavy_atom[k];
     j = template_conf->atom[i]->match;
     cblas_dcopy(3, &(template_conf->coord[i * 3]), 1, coord1, 1);
     cblas_dcopy(3, &(moved_conf->coord[j * 3]), 1, coord2, 1);
     dist = squared_euclidean_distance(coord1, coord2);
     *heavy_msd += dist;
-    ++n_heavy_atoms;
   }
-  *heavy_msd = safe_rint(*heavy_msd / (double)n_heavy_atoms * 1.0e06) / 1.0e06;
+  *heavy_msd = safe_rint(*heavy_msd / (double)(template_conf->n_heavy_atoms) * 1.0e06) / 1.0e06;
+}
+
+
+static double heavy_atom_dist(ConfInfo *conf, int y, int z)
+{
+  if (y == z) {
+    return 0.0;
+  }
+  if (conf->dist_valid) {
+    return ((y > z) ? conf->dist[y * (y - 1) / 2 + z]
+      : conf->dist[z * (z - 1) / 2 + y]);
+  }
+  
+  return sqrt(squared_euclidean_distance
+    (&(conf->coord[conf->heavy_atom[y] * 3]),
+    &(conf->coord[conf->heavy_atom[z] * 3])));
 }
 
 
@@ -744,23 +1320,63 @@ void compute_conf_h(ConfInfo *conf)
 {
   int i;
   int y;
+  int z;
   int j;
-  int dist;
+  int bin;
+  double dist;
+  double *cache;
+  double *row;
   
   
-  for (i = 0, y = 0; i < conf->n_atoms; ++i) {
-    if (!strcmp(conf->atom[i]->element, "H")) {
-      continue;
-    }
+  /*
+  heavy atom distances are cached in a packed lower
+  triangle (row y holds distances from heavy atoms
+  0..y-1) as they are met while histogramming, since
+  compute_conf_h() is called whenever a conformation
+  gets new coordinates; filter_sol_vector() will then
+  reuse them across all coeff/options passes. If the
+  memory budget is exhausted the cache is simply left
+  invalid and distances are computed on the fly
+  */
+  conf->dist_valid = 0;
+  cache = (alloc_conf_dist(conf) ? NULL : conf->dist);
+  switch (get_simd_level()) {
+    #ifdef O3_AVX512_KERNELS
+    case SIMD_AVX512:
+    compute_conf_h_avx512(conf, cache);
+    conf->dist_valid = (cache != NULL);
+    return;
+    #endif
+    #ifdef O3_AVX2_KERNELS
+    case SIMD_AVX2:
+    compute_conf_h_avx2(conf, cache);
+    conf->dist_valid = (cache != NULL);
+    return;
+    #endif
+  }
+  for (y = 0; y < conf->n_heavy_atoms; ++y) {
+    i = conf->heavy_atom[y];
     memset(conf->h[y], 0, MAX_H_BINS * sizeof(int));
-    for (j = 0; j < conf->n_atoms; ++j) {
-      dist = (int)sqrt(squared_euclidean_distance(&(conf->coord[i * 3]), &(conf->coord[j * 3])));
-      if (dist < MAX_H_BINS) {
-        ++(conf->h[y][dist]);
+    row = (cache ? &cache[y * (y - 1) / 2] : NULL);
+    /*
+    heavy_atom is sorted by increasing atom index,
+    so z tracks the heavy atom index of j
+    */
+    for (j = 0, z = 0; j < conf->n_atoms; ++j) {
+      dist = sqrt(squared_euclidean_distance(&(conf->coord[i * 3]), &(conf->coord[j * 3])));
+      if ((z < conf->n_heavy_atoms) && (conf->heavy_atom[z] == j)) {
+        if (row && (z < y)) {
+          row[z] = dist;
+        }
+        ++z;
+      }
+      bin = (int)dist;
+      if (bin < MAX_H_BINS) {
+        ++(conf->h[y][bin]);
       }
     }
-    ++y;
   }
+  conf->dist_valid = (cache != NULL);
 }
 
 
@@ -1093,21 +1709,126 @@ void lap(LAPInfo *li, int dim)
 
 
 int compute_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, int n_bins, int coeff, int options)
+{
+  compute_h_cost_matrix(li, moved_conf, template_conf, n_bins);
+  
+  return combine_cost_matrix(li, moved_conf, template_conf, coeff, options);
+}
+
+
+void compute_h_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, int n_bins)
+{
+  int k;
+  int x;
+  int y;
+  int stride = 0;
+  int level;
+  double h_sum = 0.0;
+  
+  
+  /*
+  template_conf is on rows, moved_conf is on columns;
+  the terms which do not depend on coeff/options
+  (histogram distance and charge difference) are
+  computed here once per (template conformation,
+  candidate conformation) pair
+  */
+  level = get_simd_level();
+  if (level != SIMD_NONE) {
+    /*
+    vector kernels process several moved_conf atoms
+    at a time, so moved_conf histograms are transposed
+    (bin-major) and zero-padded to a multiple of SIMD_WIDTH
+    */
+    stride = (moved_conf->n_heavy_atoms + SIMD_WIDTH - 1) / SIMD_WIDTH * SIMD_WIDTH;
+    memset(li->h_t, 0, n_bins * stride * sizeof(double));
+    for (x = 0; x < moved_conf->n_heavy_atoms; ++x) {
+      for (k = 0; k < n_bins; ++k) {
+        li->h_t[k * stride + x] = (double)(moved_conf->h[x][k]);
+      }
+    }
+  }
+  for (y = 0; y < template_conf->n_heavy_atoms; ++y) {
+    switch (level) {
+      #ifdef O3_AVX512_KERNELS
+      case SIMD_AVX512:
+      compute_h_sum_avx512(template_conf->h[y], li->h_t,
+        stride, moved_conf->n_heavy_atoms, n_bins, li->h_sum);
+      break;
+      #endif
+      #ifdef O3_AVX2_KERNELS
+      case SIMD_AVX2:
+      compute_h_sum_avx2(template_conf->h[y], li->h_t,
+        stride, moved_conf->n_heavy_atoms, n_bins, li->h_sum);
+      break;
+      #endif
+    }
+    for (x = 0; x < moved_conf->n_heavy_atoms; ++x) {
+      if (level != SIMD_NONE) {
+        h_sum = li->h_sum[x];
+      }
+      else {
+        for (k = 0, h_sum = 0.0; k < n_bins; ++k) {
+          if (!(template_conf->h[y][k] + moved_conf->h[x][k])) {
+            continue;
+          }
+          h_sum += ((double)square(template_conf->h[y][k] - moved_conf->h[x][k])
+            / (double)(template_conf->h[y][k] + moved_conf->h[x][k]));
+        }
+      }
+      li->h_cost[y][x] = h_sum;
+    }
+  }
+  compute_charge_cost_matrix(li, moved_conf, template_conf);
+}
+
+
+void compute_charge_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf)
+{
+  int i;
+  int j;
+  int x;
+  int y;
+  
+  
+  /*
+  charge differences and score_alignment() prefactors
+  only depend on the atoms, not on their coordinates,
+  so they are shared by all conformations of a
+  (template, candidate) pair
+  */
+  for (y = 0; y < template_conf->n_heavy_atoms; ++y) {
+    i = template_conf->heavy_atom[y];
+    for (x = 0; x < moved_conf->n_heavy_atoms; ++x) {
+      j = moved_conf->heavy_atom[x];
+      li->charge_diff[y][x] = fabs(template_conf->atom[i]->charge - moved_conf->atom[j]->charge);
+      /*
+      charge-dependent prefactor of the score_alignment() term
+      */
+      li->score_pref[y][x] = O3_SCORING_FUNCTION_ALPHA
+        + (1.0 + O3_CHARGE_COEFF * fabs(template_conf->atom[i]->charge
+        + moved_conf->atom[j]->charge)) / (1.0 + li->charge_diff[y][x]);
+    }
+  }
+}
+
+
+int combine_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf, int coeff, int options)
 {
   extern char mmff_corr_matrix[99][99];
   char corr;
   int i;
   int j;
-  int k;
   int x;
   int y;
   int largest_n_heavy_atoms = 0;
   double c;
-  double h_sum = 0.0;
   
   
   /*
-  template_conf is on rows, moved_conf is on columns
+  build the LAP cost matrix for this coeff/options
+  combination out of the terms precomputed by
+  compute_h_cost_matrix()
   */
   largest_n_heavy_atoms = (template_conf->n_heavy_atoms > moved_conf->n_heavy_atoms)
     ? template_conf->n_heavy_atoms : moved_conf->n_heavy_atoms;
@@ -1117,36 +1838,23 @@ int compute_cost_matrix(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_co
     }
   }
   c = ((options & MATCH_ATOM_TYPES_BIT) ? 1.0 : 0.0);
-  for (i = 0, y = 0; i < template_conf->n_atoms; ++i) {
-    if (!strcmp(template_conf->atom[i]->element, "H")) {
-      continue;
-    }
-    for (j = 0, x = 0; j < moved_conf->n_atoms; ++j) {
-      if (!strcmp(moved_conf->atom[j]->element, "H")) {
-        continue;
-      }
-      for (k = 0, h_sum = 0.0; k < n_bins; ++k) {
-        if (!(template_conf->h[y][k] + moved_conf->h[x][k])) {
-          continue;
-        }
-        h_sum += ((double)square(template_conf->h[y][k] - moved_conf->h[x][k])
-          / (double)(template_conf->h[y][k] + moved_conf->h[x][k]));
-      }
+  for (y = 0; y < template_conf->n_heavy_atoms; ++y) {
+    i = template_conf->heavy_atom[y];
+    for (x = 0; x < moved_conf->n_heavy_atoms; ++x) {
+      j = moved_conf->heavy_atom[x];
       if (options & MATCH_CONFORMERS_BIT) {
-        if (fabs(template_conf->atom[i]->charge - moved_conf->atom[j]->charge) < ALMOST_ZERO) {
-          li->cost[y][x] = (int)safe_rint(h_sum * 1.0e03);
+        if (li->charge_diff[y][x] < ALMOST_ZERO) {
+          li->cost[y][x] = (int)safe_rint(li->h_cost[y][x] * 1.0e03);
         }
       }
       else {
         corr = mmff_corr_matrix[template_conf->atom[i]->atom_type - 1]
           [moved_conf->atom[j]->atom_type - 1];
-        li->cost[y][x] = (int)safe_rint(((double)coeff * CHARGE_WEIGHT * fabs
-          (template_conf->atom[i]->charge - moved_conf->atom[j]->charge) +
-          c * (double)(5 - coeff) * (double)corr + h_sum) * 1.0e03);
+        li->cost[y][x] = (int)safe_rint(((double)coeff * CHARGE_WEIGHT
+          * li->charge_diff[y][x] + c * (double)(5 - coeff)
+          * (double)corr + li->h_cost[y][x]) * 1.0e03);
       }
-      ++x;
     }
-    ++y;
   }
   
   return largest_n_heavy_atoms;
@@ -1157,9 +1865,7 @@ int filter_sol_vector(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf
 {
   int i;
   int j;
-  int k;
   int n;
-  int n_atoms;
   int n_equiv;
   ConfInfo *conf[2];
   
@@ -1179,6 +1885,23 @@ int filter_sol_vector(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf
     ++n_equiv;
   }
   /*
+  loop over n_equiv rows; diff is symmetric, so only
+  the lower triangle is computed. Distances are taken
+  from the per-conformation cache when available:
+  - the euclidean distance between atoms i,j is taken for template_conf
+  - the euclidean distance between the corresponding atoms is taken for moved_conf
+  - the absolute value of the difference between the two distances is
+    placed in diff[i][j] and diff[j][i]
+  */
+  for (i = 0; i < n_equiv; ++i) {
+    li->diff[i][i] = 0.0;
+    for (j = 0; j < i; ++j) {
+      li->diff[i][j] = fabs(heavy_atom_dist(template_conf, sdm[i].a[0], sdm[j].a[0])
+        - heavy_atom_dist(moved_conf, sdm[i].a[1], sdm[j].a[1]));
+      li->diff[j][i] = li->diff[i][j];
+    }
+  }
+  /*
   find out correspondences between heavy atom indexes
   in the original molecule and heavy atoms in the sdm matrix
   (the sdm matrix is rebuilt using original molecule
@@ -1186,44 +1909,7 @@ int filter_sol_vector(LAPInfo *li, ConfInfo *moved_conf, ConfInfo *template_conf
   */
   for (n = 0; n < 2; ++n) {
     for (i = 0; i < n_equiv; ++i) {
-      j = 0;
-      n_atoms = 0;
-      k = sdm[i].a[n];
-      while ((n_atoms < conf[n]->n_atoms) && (j <= k)) {
-        if (strcmp(conf[n]->atom[n_atoms]->element, "H")) {
-          ++j;
-          sdm[i].a[n] = n_atoms;
-        }
-        ++n_atoms;
-      }
-    }
-  }
-  /*
-  loop over n_equiv rows
-  */
-  for (i = 0; i < n_equiv; ++i) {
-    /*
-    initialize to 0 the i-th row of the diff matrix
-    */
-    memset(li->diff[i], 0, n_equiv * sizeof(double));
-    for (j = 0; j < n_equiv; ++j) {
-      /*
-      if i == j then the distance will be 0,
-      no need to spend time computing it
-      */
-      if (i == j) {
-        continue;
-      }
-      /*
-      - the euclidean distance between atoms i,j is computed for template_conf
-      - the euclidean distance between the corresponding atoms is computed for moved_conf
-      - the absolute value of the difference between the two distances is computed
-        and placed in diff[i][j]
-      */
-      li->diff[i][j] = fabs(sqrt(squared_euclidean_distance
-        (&(template_conf->coord[sdm[i].a[0] * 3]), &(template_conf->coord[sdm[j].a[0] * 3])))
-        - sqrt(squared_euclidean_distance
-        (&(moved_conf->coord[sdm[i].a[1] * 3]), &(moved_conf->coord[sdm[j].a[1] * 3]))));
+      sdm[i].a[n] = conf[n]->heavy_atom[sdm[i].a[n]];
     }
   }
   for (i = 0; i < n_equiv; ++i) {
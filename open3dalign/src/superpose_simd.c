@@ -0,0 +1,654 @@
+/*
+
+superpose_simd.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+
+
+#include <include/o3header.h>
+#ifdef O3_AVX2_KERNELS
+/*
+results must be bit-compatible with the scalar code,
+so multiplications and additions must not be fused
+*/
+#ifndef __clang__
+#pragma GCC optimize ("fp-contract=off")
+#endif
+#include <immintrin.h>
+#endif
+
+
+static int simd_level = -1;
+
+
+int detect_simd_level(void)
+{
+  int level = SIMD_NONE;
+  
+  
+  #ifdef O3_AVX2_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    level = SIMD_AVX2;
+  }
+  #ifdef O3_AVX512_KERNELS
+  if (__builtin_cpu_supports("avx512f")) {
+    level = SIMD_AVX512;
+  }
+  #endif
+  #endif
+  
+  return level;
+}
+
+
+int get_simd_level(void)
+{
+  if (simd_level == -1) {
+    simd_level = detect_simd_level();
+  }
+  
+  return simd_level;
+}
+
+
+int set_simd_level(int level)
+{
+  int max_level;
+  
+  
+  /*
+  never go beyond what the CPU supports
+  */
+  max_level = detect_simd_level();
+  simd_level = ((level > max_level) ? max_level : level);
+  
+  return simd_level;
+}
+
+
+#ifdef O3_AVX2_KERNELS
+/*
+distances are computed as ((dx^2 + dy^2) + dz^2),
+in the same order as squared_euclidean_distance(),
+then truncated to integer bins after sqrt(),
+which is correctly rounded both in scalar and
+vector registers; heavy atom distances are
+stored into cache, if not NULL, exactly as
+compute_conf_h() does
+*/
+__attribute__((target("avx2")))
+void compute_conf_h_avx2(ConfInfo *conf, double *cache)
+{
+  int i;
+  int j;
+  int k;
+  int y;
+  int z;
+  int bin[4];
+  double r;
+  double root[4];
+  double *coord;
+  double *row;
+  __m256d xi;
+  __m256d yi;
+  __m256d zi;
+  __m256d d;
+  __m256d dist;
+  __m128i ibin;
+  
+  
+  coord = conf->coord;
+  for (y = 0; y < conf->n_heavy_atoms; ++y) {
+    i = conf->heavy_atom[y];
+    memset(conf->h[y], 0, MAX_H_BINS * sizeof(int));
+    row = (cache ? &cache[y * (y - 1) / 2] : NULL);
+    xi = _mm256_set1_pd(coord[i * 3]);
+    yi = _mm256_set1_pd(coord[i * 3 + 1]);
+    zi = _mm256_set1_pd(coord[i * 3 + 2]);
+    for (j = 0, z = 0; (j + 4) <= conf->n_atoms; j += 4) {
+      d = _mm256_sub_pd(xi, _mm256_set_pd(coord[(j + 3) * 3],
+        coord[(j + 2) * 3], coord[(j + 1) * 3], coord[j * 3]));
+      dist = _mm256_mul_pd(d, d);
+      d = _mm256_sub_pd(yi, _mm256_set_pd(coord[(j + 3) * 3 + 1],
+        coord[(j + 2) * 3 + 1], coord[(j + 1) * 3 + 1], coord[j * 3 + 1]));
+      dist = _mm256_add_pd(dist, _mm256_mul_pd(d, d));
+      d = _mm256_sub_pd(zi, _mm256_set_pd(coord[(j + 3) * 3 + 2],
+        coord[(j + 2) * 3 + 2], coord[(j + 1) * 3 + 2], coord[j * 3 + 2]));
+      dist = _mm256_add_pd(dist, _mm256_mul_pd(d, d));
+      dist = _mm256_sqrt_pd(dist);
+      ibin = _mm256_cvttpd_epi32(dist);
+      _mm_storeu_si128((__m128i *)bin, ibin);
+      _mm256_storeu_pd(root, dist);
+      for (k = 0; k < 4; ++k) {
+        if (bin[k] < MAX_H_BINS) {
+          ++(conf->h[y][bin[k]]);
+        }
+        if ((z < conf->n_heavy_atoms) && (conf->heavy_atom[z] == (j + k))) {
+          if (row && (z < y)) {
+            row[z] = root[k];
+          }
+          ++z;
+        }
+      }
+    }
+    for (; j < conf->n_atoms; ++j) {
+      r = sqrt(squared_euclidean_distance(&coord[i * 3], &coord[j * 3]));
+      if ((z < conf->n_heavy_atoms) && (conf->heavy_atom[z] == j)) {
+        if (row && (z < y)) {
+          row[z] = r;
+        }
+        ++z;
+      }
+      k = (int)r;
+      if (k < MAX_H_BINS) {
+        ++(conf->h[y][k]);
+      }
+    }
+  }
+}
+
+
+/*
+h_sum[x] is accumulated over bins in increasing order
+for 4 moved_conf atoms at a time, exactly like the scalar
+loop does for one atom; empty bins contribute 0.0, which
+leaves the partial sum unchanged
+*/
+__attribute__((target("avx2")))
+void compute_h_sum_avx2(int *template_h, double *moved_h_t,
+  int stride, int n_moved, int n_bins, double *h_sum)
+{
+  int k;
+  int x;
+  __m256d zero;
+  __m256d one;
+  __m256d t;
+  __m256d m;
+  __m256d s;
+  __m256d d;
+  __m256d acc;
+  
+  
+  zero = _mm256_setzero_pd();
+  one = _mm256_set1_pd(1.0);
+  for (x = 0; x < n_moved; x += 4) {
+    acc = _mm256_setzero_pd();
+    for (k = 0; k < n_bins; ++k) {
+      t = _mm256_set1_pd((double)template_h[k]);
+      m = _mm256_loadu_pd(&moved_h_t[k * stride + x]);
+      s = _mm256_add_pd(t, m);
+      d = _mm256_sub_pd(t, m);
+      s = _mm256_blendv_pd(s, one, _mm256_cmp_pd(s, zero, _CMP_EQ_OQ));
+      acc = _mm256_add_pd(acc, _mm256_div_pd(_mm256_mul_pd(d, d), s));
+    }
+    _mm256_storeu_pd(&h_sum[x], acc);
+  }
+}
+
+
+/*
+exp(x) for x <= 0: x = n * ln2 + r, |r| <= ln2 / 2,
+exp(r) is evaluated by a degree-12 Taylor polynomial
+(relative error below 1.0e-15) and 2^n is built
+directly in the exponent bits; arguments below
+EXP_MIN_ARG underflow to 0.0
+*/
+#define EXP_MIN_ARG    -708.0
+#define EXP_LOG2E    1.4426950408889634
+#define EXP_LN2_HI    6.93147180369123816490e-01
+#define EXP_LN2_LO    1.90821492927058770002e-10
+static const double exp_coeff[13] = {
+  1.0, 1.0, 1.0 / 2.0, 1.0 / 6.0, 1.0 / 24.0, 1.0 / 120.0,
+  1.0 / 720.0, 1.0 / 5040.0, 1.0 / 40320.0, 1.0 / 362880.0,
+  1.0 / 3628800.0, 1.0 / 39916800.0, 1.0 / 479001600.0
+};
+
+
+__attribute__((target("avx2")))
+static __m256d exp_neg_avx2(__m256d x)
+{
+  int k;
+  __m256d n;
+  __m256d r;
+  __m256d p;
+  __m256d min_arg;
+  __m256d underflow;
+  __m256i e;
+  
+  
+  min_arg = _mm256_set1_pd(EXP_MIN_ARG);
+  underflow = _mm256_cmp_pd(x, min_arg, _CMP_LT_OQ);
+  x = _mm256_max_pd(x, min_arg);
+  n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(EXP_LOG2E)),
+    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  r = _mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(EXP_LN2_HI)));
+  r = _mm256_sub_pd(r, _mm256_mul_pd(n, _mm256_set1_pd(EXP_LN2_LO)));
+  p = _mm256_set1_pd(exp_coeff[12]);
+  for (k = 11; k >= 0; --k) {
+    p = _mm256_add_pd(_mm256_mul_pd(p, r), _mm256_set1_pd(exp_coeff[k]));
+  }
+  e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+  e = _mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52);
+  p = _mm256_mul_pd(p, _mm256_castsi256_pd(e));
+  
+  return _mm256_andnot_pd(underflow, p);
+}
+
+
+/*
+sum of pref[i] * exp(-beta * dist[i]) over n
+(a multiple of 4) zero-padded elements
+*/
+__attribute__((target("avx2")))
+double score_sum_avx2(double *pref, double *dist, int n)
+{
+  int i;
+  double sum[4];
+  __m256d beta;
+  __m256d acc;
+  
+  
+  beta = _mm256_set1_pd(-O3_SCORING_FUNCTION_BETA);
+  acc = _mm256_setzero_pd();
+  for (i = 0; i < n; i += 4) {
+    acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_loadu_pd(&pref[i]),
+      exp_neg_avx2(_mm256_mul_pd(beta, _mm256_loadu_pd(&dist[i])))));
+  }
+  _mm256_storeu_pd(sum, acc);
+  
+  return ((sum[0] + sum[1]) + (sum[2] + sum[3]));
+}
+
+
+/*
+batch kernels: lanes hold the same atom (or bin) of
+different conformations, so coordinates are loaded
+with no shuffling; lanes beyond cb->n_k are computed
+but never counted nor read
+*/
+__attribute__((target("avx2")))
+void compute_conf_batch_h_avx2(ConfBatch *cb)
+{
+  int i;
+  int j;
+  int k;
+  int l;
+  int y;
+  int z;
+  int heavy;
+  int bin[4];
+  double *ci;
+  double *cj;
+  double *h;
+  __m256d xi;
+  __m256d yi;
+  __m256d zi;
+  __m256d d;
+  __m256d dist;
+  
+  
+  for (y = 0; y < cb->n_heavy_atoms; ++y) {
+    i = cb->heavy_atom[y];
+    h = &(cb->h[y * MAX_H_BINS * CONF_BATCH_SIZE]);
+    memset(h, 0, MAX_H_BINS * CONF_BATCH_SIZE * sizeof(double));
+    ci = &(cb->coord[i * 3 * CONF_BATCH_SIZE]);
+    for (k = 0; k < cb->n_k; k += 4) {
+      xi = _mm256_loadu_pd(&ci[k]);
+      yi = _mm256_loadu_pd(&ci[CONF_BATCH_SIZE + k]);
+      zi = _mm256_loadu_pd(&ci[2 * CONF_BATCH_SIZE + k]);
+      for (j = 0, z = 0; j < cb->n_atoms; ++j) {
+        cj = &(cb->coord[j * 3 * CONF_BATCH_SIZE]);
+        heavy = ((z < cb->n_heavy_atoms) && (cb->heavy_atom[z] == j));
+        d = _mm256_sub_pd(xi, _mm256_loadu_pd(&cj[k]));
+        dist = _mm256_mul_pd(d, d);
+        d = _mm256_sub_pd(yi, _mm256_loadu_pd(&cj[CONF_BATCH_SIZE + k]));
+        dist = _mm256_add_pd(dist, _mm256_mul_pd(d, d));
+        d = _mm256_sub_pd(zi, _mm256_loadu_pd(&cj[2 * CONF_BATCH_SIZE + k]));
+        dist = _mm256_sqrt_pd(_mm256_add_pd(dist, _mm256_mul_pd(d, d)));
+        if (heavy) {
+          if (z < y) {
+            _mm256_storeu_pd(&(cb->dist[(y * (y - 1) / 2 + z)
+              * CONF_BATCH_SIZE + k]), dist);
+          }
+          ++z;
+        }
+        _mm_storeu_si128((__m128i *)bin, _mm256_cvttpd_epi32(dist));
+        for (l = 0; (l < 4) && ((k + l) < cb->n_k); ++l) {
+          if (bin[l] < MAX_H_BINS) {
+            h[bin[l] * CONF_BATCH_SIZE + k + l] += 1.0;
+          }
+        }
+      }
+    }
+  }
+}
+
+
+__attribute__((target("avx2")))
+void compute_conf_batch_h_cost_avx2(ConfBatch *cb, ConfInfo *template_conf, int n_bins)
+{
+  int b;
+  int k;
+  int x;
+  int y;
+  double *h;
+  __m256d zero;
+  __m256d one;
+  __m256d t;
+  __m256d m;
+  __m256d s;
+  __m256d d;
+  __m256d acc;
+  
+  
+  zero = _mm256_setzero_pd();
+  one = _mm256_set1_pd(1.0);
+  for (y = 0; y < template_conf->n_heavy_atoms; ++y) {
+    for (x = 0; x < cb->n_heavy_atoms; ++x) {
+      h = &(cb->h[x * MAX_H_BINS * CONF_BATCH_SIZE]);
+      for (k = 0; k < cb->n_k; k += 4) {
+        acc = _mm256_setzero_pd();
+        for (b = 0; b < n_bins; ++b) {
+          t = _mm256_set1_pd((double)(template_conf->h[y][b]));
+          m = _mm256_loadu_pd(&h[b * CONF_BATCH_SIZE + k]);
+          s = _mm256_add_pd(t, m);
+          d = _mm256_sub_pd(t, m);
+          s = _mm256_blendv_pd(s, one, _mm256_cmp_pd(s, zero, _CMP_EQ_OQ));
+          acc = _mm256_add_pd(acc, _mm256_div_pd(_mm256_mul_pd(d, d), s));
+        }
+        _mm256_storeu_pd(&(cb->h_cost[(y * cb->n_heavy_atoms + x)
+          * CONF_BATCH_SIZE + k]), acc);
+      }
+    }
+  }
+}
+
+
+#ifdef O3_AVX512_KERNELS
+__attribute__((target("avx512f")))
+void compute_conf_h_avx512(ConfInfo *conf, double *cache)
+{
+  int i;
+  int j;
+  int k;
+  int y;
+  int z;
+  int bin[8];
+  double r;
+  double root[8];
+  double *coord;
+  double *row;
+  __m512i index;
+  __m512d xi;
+  __m512d yi;
+  __m512d zi;
+  __m512d d;
+  __m512d dist;
+  __m256i ibin;
+  
+  
+  coord = conf->coord;
+  index = _mm512_set_epi64(21, 18, 15, 12, 9, 6, 3, 0);
+  for (y = 0; y < conf->n_heavy_atoms; ++y) {
+    i = conf->heavy_atom[y];
+    memset(conf->h[y], 0, MAX_H_BINS * sizeof(int));
+    row = (cache ? &cache[y * (y - 1) / 2] : NULL);
+    xi = _mm512_set1_pd(coord[i * 3]);
+    yi = _mm512_set1_pd(coord[i * 3 + 1]);
+    zi = _mm512_set1_pd(coord[i * 3 + 2]);
+    for (j = 0, z = 0; (j + 8) <= conf->n_atoms; j += 8) {
+      d = _mm512_sub_pd(xi, _mm512_i64gather_pd(index, &coord[j * 3], 8));
+      dist = _mm512_mul_pd(d, d);
+      d = _mm512_sub_pd(yi, _mm512_i64gather_pd(index, &coord[j * 3 + 1], 8));
+      dist = _mm512_add_pd(dist, _mm512_mul_pd(d, d));
+      d = _mm512_sub_pd(zi, _mm512_i64gather_pd(index, &coord[j * 3 + 2], 8));
+      dist = _mm512_add_pd(dist, _mm512_mul_pd(d, d));
+      dist = _mm512_sqrt_pd(dist);
+      ibin = _mm512_cvttpd_epi32(dist);
+      _mm256_storeu_si256((__m256i *)bin, ibin);
+      _mm512_storeu_pd(root, dist);
+      for (k = 0; k < 8; ++k) {
+        if (bin[k] < MAX_H_BINS) {
+          ++(conf->h[y][bin[k]]);
+        }
+        if ((z < conf->n_heavy_atoms) && (conf->heavy_atom[z] == (j + k))) {
+          if (row && (z < y)) {
+            row[z] = root[k];
+          }
+          ++z;
+        }
+      }
+    }
+    for (; j < conf->n_atoms; ++j) {
+      r = sqrt(squared_euclidean_distance(&coord[i * 3], &coord[j * 3]));
+      if ((z < conf->n_heavy_atoms) && (conf->heavy_atom[z] == j)) {
+        if (row && (z < y)) {
+          row[z] = r;
+        }
+        ++z;
+      }
+      k = (int)r;
+      if (k < MAX_H_BINS) {
+        ++(conf->h[y][k]);
+      }
+    }
+  }
+}
+
+
+__attribute__((target("avx512f")))
+void compute_h_sum_avx512(int *template_h, double *moved_h_t,
+  int stride, int n_moved, int n_bins, double *h_sum)
+{
+  int k;
+  int x;
+  __mmask8 empty;
+  __m512d zero;
+  __m512d one;
+  __m512d t;
+  __m512d m;
+  __m512d s;
+  __m512d d;
+  __m512d acc;
+  
+  
+  zero = _mm512_setzero_pd();
+  one = _mm512_set1_pd(1.0);
+  for (x = 0; x < n_moved; x += 8) {
+    acc = _mm512_setzero_pd();
+    for (k = 0; k < n_bins; ++k) {
+      t = _mm512_set1_pd((double)template_h[k]);
+      m = _mm512_loadu_pd(&moved_h_t[k * stride + x]);
+      s = _mm512_add_pd(t, m);
+      d = _mm512_sub_pd(t, m);
+      empty = _mm512_cmp_pd_mask(s, zero, _CMP_EQ_OQ);
+      s = _mm512_mask_blend_pd(empty, s, one);
+      acc = _mm512_add_pd(acc, _mm512_div_pd(_mm512_mul_pd(d, d), s));
+    }
+    _mm512_storeu_pd(&h_sum[x], acc);
+  }
+}
+
+
+__attribute__((target("avx512f")))
+static __m512d exp_neg_avx512(__m512d x)
+{
+  int k;
+  __mmask8 underflow;
+  __m512d n;
+  __m512d r;
+  __m512d p;
+  __m512d min_arg;
+  __m512i e;
+  
+  
+  min_arg = _mm512_set1_pd(EXP_MIN_ARG);
+  underflow = _mm512_cmp_pd_mask(x, min_arg, _CMP_LT_OQ);
+  x = _mm512_max_pd(x, min_arg);
+  n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(EXP_LOG2E)),
+    _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+  r = _mm512_sub_pd(x, _mm512_mul_pd(n, _mm512_set1_pd(EXP_LN2_HI)));
+  r = _mm512_sub_pd(r, _mm512_mul_pd(n, _mm512_set1_pd(EXP_LN2_LO)));
+  p = _mm512_set1_pd(exp_coeff[12]);
+  for (k = 11; k >= 0; --k) {
+    p = _mm512_add_pd(_mm512_mul_pd(p, r), _mm512_set1_pd(exp_coeff[k]));
+  }
+  e = _mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(n));
+  e = _mm512_slli_epi64(_mm512_add_epi64(e, _mm512_set1_epi64(1023)), 52);
+  p = _mm512_mul_pd(p, _mm512_castsi512_pd(e));
+  
+  return _mm512_maskz_mov_pd((__mmask8)(~underflow), p);
+}
+
+
+__attribute__((target("avx512f")))
+double score_sum_avx512(double *pref, double *dist, int n)
+{
+  int i;
+  double sum[8];
+  __m512d beta;
+  __m512d acc;
+  
+  
+  beta = _mm512_set1_pd(-O3_SCORING_FUNCTION_BETA);
+  acc = _mm512_setzero_pd();
+  for (i = 0; i < n; i += 8) {
+    acc = _mm512_add_pd(acc, _mm512_mul_pd(_mm512_loadu_pd(&pref[i]),
+      exp_neg_avx512(_mm512_mul_pd(beta, _mm512_loadu_pd(&dist[i])))));
+  }
+  _mm512_storeu_pd(sum, acc);
+  
+  return (((sum[0] + sum[1]) + (sum[2] + sum[3]))
+    + ((sum[4] + sum[5]) + (sum[6] + sum[7])));
+}
+
+
+__attribute__((target("avx512f")))
+void compute_conf_batch_h_avx512(ConfBatch *cb)
+{
+  int i;
+  int j;
+  int l;
+  int y;
+  int z;
+  int heavy;
+  int bin[8];
+  double *ci;
+  double *cj;
+  double *h;
+  __m512d xi;
+  __m512d yi;
+  __m512d zi;
+  __m512d d;
+  __m512d dist;
+  
+  
+  for (y = 0; y < cb->n_heavy_atoms; ++y) {
+    i = cb->heavy_atom[y];
+    h = &(cb->h[y * MAX_H_BINS * CONF_BATCH_SIZE]);
+    memset(h, 0, MAX_H_BINS * CONF_BATCH_SIZE * sizeof(double));
+    ci = &(cb->coord[i * 3 * CONF_BATCH_SIZE]);
+    xi = _mm512_loadu_pd(ci);
+    yi = _mm512_loadu_pd(&ci[CONF_BATCH_SIZE]);
+    zi = _mm512_loadu_pd(&ci[2 * CONF_BATCH_SIZE]);
+    for (j = 0, z = 0; j < cb->n_atoms; ++j) {
+      cj = &(cb->coord[j * 3 * CONF_BATCH_SIZE]);
+      heavy = ((z < cb->n_heavy_atoms) && (cb->heavy_atom[z] == j));
+      d = _mm512_sub_pd(xi, _mm512_loadu_pd(cj));
+      dist = _mm512_mul_pd(d, d);
+      d = _mm512_sub_pd(yi, _mm512_loadu_pd(&cj[CONF_BATCH_SIZE]));
+      dist = _mm512_add_pd(dist, _mm512_mul_pd(d, d));
+      d = _mm512_sub_pd(zi, _mm512_loadu_pd(&cj[2 * CONF_BATCH_SIZE]));
+      dist = _mm512_sqrt_pd(_mm512_add_pd(dist, _mm512_mul_pd(d, d)));
+      if (heavy) {
+        if (z < y) {
+          _mm512_storeu_pd(&(cb->dist[(y * (y - 1) / 2 + z)
+            * CONF_BATCH_SIZE]), dist);
+        }
+        ++z;
+      }
+      _mm256_storeu_si256((__m256i *)bin, _mm512_cvttpd_epi32(dist));
+      for (l = 0; l < cb->n_k; ++l) {
+        if (bin[l] < MAX_H_BINS) {
+          h[bin[l] * CONF_BATCH_SIZE + l] += 1.0;
+        }
+      }
+    }
+  }
+}
+
+
+__attribute__((target("avx512f")))
+void compute_conf_batch_h_cost_avx512(ConfBatch *cb, ConfInfo *template_conf, int n_bins)
+{
+  int b;
+  int x;
+  int y;
+  double *h;
+  __mmask8 empty;
+  __m512d zero;
+  __m512d one;
+  __m512d t;
+  __m512d m;
+  __m512d s;
+  __m512d d;
+  __m512d acc;
+  
+  
+  zero = _mm512_setzero_pd();
+  one = _mm512_set1_pd(1.0);
+  for (y = 0; y < template_conf->n_heavy_atoms; ++y) {
+    for (x = 0; x < cb->n_heavy_atoms; ++x) {
+      h = &(cb->h[x * MAX_H_BINS * CONF_BATCH_SIZE]);
+      acc = _mm512_setzero_pd();
+      for (b = 0; b < n_bins; ++b) {
+        t = _mm512_set1_pd((double)(template_conf->h[y][b]));
+        m = _mm512_loadu_pd(&h[b * CONF_BATCH_SIZE]);
+        s = _mm512_add_pd(t, m);
+        d = _mm512_sub_pd(t, m);
+        empty = _mm512_cmp_pd_mask(s, zero, _CMP_EQ_OQ);
+        s = _mm512_mask_blend_pd(empty, s, one);
+        acc = _mm512_add_pd(acc, _mm512_div_pd(_mm512_mul_pd(d, d), s));
+      }
+      _mm512_storeu_pd(&(cb->h_cost[(y * cb->n_heavy_atoms + x)
+        * CONF_BATCH_SIZE]), acc);
+    }
+  }
+}
+#endif
+#endif
@@ -0,0 +1,335 @@
+/*
+
+task_queue.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#include <include/o3header.h>
+
+
+TaskQueue *alloc_task_queue(int n_phases, int n_tasks)
+{
+  TaskQueue *tq;
+  
+  
+  /*
+  each phase owns one counter, padded to a
+  full cache line so that threads claiming
+  tasks from different phases do not contend
+  */
+  if (!(tq = (TaskQueue *)malloc(sizeof(TaskQueue)))) {
+    return NULL;
+  }
+  memset(tq, 0, sizeof(TaskQueue));
+  tq->n_phases = n_phases;
+  tq->n_tasks = n_tasks;
+  if (!(tq->next = calloc(n_phases * TASK_QUEUE_STRIDE, sizeof(*(tq->next))))) {
+    free(tq);
+    return NULL;
+  }
+  
+  return tq;
+}
+
+
+void free_task_queue(TaskQueue *tq)
+{
+  if (tq) {
+    if (tq->next) {
+      free((void *)(tq->next));
+    }
+    free(tq);
+  }
+}
+
+
+void reset_task_queue(TaskQueue *tq)
+{
+  /*
+  only to be called while no thread
+  is claiming tasks from this queue
+  */
+  memset((void *)(tq->next), 0, tq->n_phases
+    * TASK_QUEUE_STRIDE * sizeof(*(tq->next)));
+}
+
+
+int claim_task(TaskQueue *tq, int phase)
+{
+  long task;
+  #ifndef WIN32
+  volatile long *next;
+  #else
+  volatile LONG *next;
+  #endif
+  
+  
+  /*
+  return the next unclaimed task of this phase,
+  or -1 if all tasks were already handed out;
+  the counter is read before being incremented
+  so that exhausted phases are not written to
+  over and over by threads moving past them
+  */
+  next = &(tq->next[phase * TASK_QUEUE_STRIDE]);
+  if (*next >= tq->n_tasks) {
+    return -1;
+  }
+  #ifndef WIN32
+  task = __sync_fetch_and_add(next, 1);
+  #else
+  task = InterlockedExchangeAdd(next, 1);
+  #endif
+  
+  return ((task < tq->n_tasks) ? (int)task : -1);
+}
+
+
+int compare_task_cost(const void *a, const void *b)
+{
+  TaskCost *tc1;
+  TaskCost *tc2;
+  
+  
+  /*
+  decreasing cost; ties are broken by task
+  number to keep scheduling deterministic
+  */
+  tc1 = (TaskCost *)a;
+  tc2 = (TaskCost *)b;
+  if (tc1->cost > tc2->cost) {
+    return -1;
+  }
+  if (tc1->cost < tc2->cost) {
+    return 1;
+  }
+  
+  return (tc1->task - tc2->task);
+}
+
+
+static int cas_task_range(TaskScheduler *ts, int worker,
+  uint64_t old_range, uint64_t new_range)
+{
+  #ifndef WIN32
+  return __sync_bool_compare_and_swap
+    (&(ts->range[worker * TASK_DEQUE_STRIDE]), old_range, new_range);
+  #else
+  return (InterlockedCompareExchange64(&(ts->range[worker * TASK_DEQUE_STRIDE]),
+    (LONGLONG)new_range, (LONGLONG)old_range) == (LONGLONG)old_range);
+  #endif
+}
+
+
+TaskScheduler *alloc_task_scheduler(int max_n_workers, int n_tasks, double *cost)
+{
+  int i;
+  int n;
+  TaskScheduler *ts;
+  TaskCost *tc;
+  
+  
+  /*
+  tasks with a negative cost need not be carried out;
+  the others are sorted by decreasing cost, so that
+  the most expensive ones are started first and the
+  cheapest ones can fill the gaps at the end of the run
+  */
+  if (!(ts = (TaskScheduler *)malloc(sizeof(TaskScheduler)))) {
+    return NULL;
+  }
+  memset(ts, 0, sizeof(TaskScheduler));
+  ts->max_n_workers = max_n_workers;
+  ts->task = (int *)malloc((n_tasks + 1) * sizeof(int));
+  ts->range = calloc(max_n_workers * TASK_DEQUE_STRIDE, sizeof(*(ts->range)));
+  tc = (TaskCost *)malloc((n_tasks + 1) * sizeof(TaskCost));
+  if (!(ts->task) || !(ts->range) || !tc) {
+    if (tc) {
+      free(tc);
+    }
+    free_task_scheduler(ts);
+    return NULL;
+  }
+  for (i = 0, n = 0; i < n_tasks; ++i) {
+    if (cost[i] < 0.0) {
+      continue;
+    }
+    tc[n].task = i;
+    tc[n].cost = cost[i];
+    ++n;
+  }
+  qsort(tc, n, sizeof(TaskCost), compare_task_cost);
+  for (i = 0; i < n; ++i) {
+    ts->task[i] = tc[i].task;
+  }
+  ts->n_tasks = n;
+  free(tc);
+  
+  return ts;
+}
+
+
+void free_task_scheduler(TaskScheduler *ts)
+{
+  if (ts) {
+    if (ts->task) {
+      free(ts->task);
+    }
+    if (ts->range) {
+      free((void *)(ts->range));
+    }
+    free(ts);
+  }
+}
+
+
+void shard_task_scheduler(TaskScheduler *ts, int shard, int n_shards)
+{
+  int i;
+  int n;
+  
+  
+  /*
+  keep only the tasks of one shard; these are taken
+  round-robin from the cost-sorted array, so that all
+  shards get a similar share of the overall cost and
+  each one is still sorted by decreasing cost
+  */
+  for (i = shard, n = 0; i < ts->n_tasks; i += n_shards, ++n) {
+    ts->task[n] = ts->task[i];
+  }
+  ts->n_tasks = n;
+}
+
+
+void deal_scheduled_tasks(TaskScheduler *ts, int n_workers)
+{
+  int i;
+  int j;
+  int n;
+  int start;
+  int *sorted;
+  
+  
+  /*
+  tasks are dealt round-robin in decreasing cost order,
+  so that each worker deque is itself sorted and holds
+  a similar share of the overall cost; each worker
+  owns a contiguous slice of the task array, whose
+  bounds are packed in a single 64-bit word (head in
+  the low half, tail in the high half) so that the
+  owner and thieves can update them with one CAS.
+  If the temporary array cannot be allocated, the
+  first worker gets all tasks and the others steal
+  */
+  if (n_workers > ts->max_n_workers) {
+    n_workers = ts->max_n_workers;
+  }
+  if (n_workers < 1) {
+    n_workers = 1;
+  }
+  ts->n_workers = n_workers;
+  memset((void *)(ts->range), 0, ts->max_n_workers
+    * TASK_DEQUE_STRIDE * sizeof(*(ts->range)));
+  if (!(sorted = (int *)malloc((ts->n_tasks + 1) * sizeof(int)))) {
+    ts->range[0] = (uint64_t)(ts->n_tasks) << 32;
+    return;
+  }
+  memcpy(sorted, ts->task, ts->n_tasks * sizeof(int));
+  for (i = 0, start = 0; i < n_workers; ++i) {
+    for (j = i, n = start; j < ts->n_tasks; j += n_workers, ++n) {
+      ts->task[n] = sorted[j];
+    }
+    ts->range[i * TASK_DEQUE_STRIDE] = (uint64_t)start | ((uint64_t)n << 32);
+    start = n;
+  }
+  free(sorted);
+}
+
+
+int next_scheduled_task(TaskScheduler *ts, int worker, int *stolen)
+{
+  int i;
+  int victim;
+  int left;
+  int most_left;
+  uint32_t head;
+  uint32_t tail;
+  uint64_t range;
+  
+  
+  /*
+  the owner pops the most expensive task left from
+  the head of its own deque; once this is empty,
+  it steals the cheapest task from the tail of the
+  deque which has the most tasks left
+  */
+  *stolen = 0;
+  while (worker < ts->n_workers) {
+    range = ts->range[worker * TASK_DEQUE_STRIDE];
+    head = (uint32_t)(range & 0xFFFFFFFF);
+    tail = (uint32_t)(range >> 32);
+    if (head >= tail) {
+      break;
+    }
+    if (cas_task_range(ts, worker, range,
+      (uint64_t)(head + 1) | ((uint64_t)tail << 32))) {
+      return ts->task[head];
+    }
+  }
+  while (1) {
+    for (i = 0, victim = -1, most_left = 0; i < ts->n_workers; ++i) {
+      range = ts->range[i * TASK_DEQUE_STRIDE];
+      left = (int)((uint32_t)(range >> 32)) - (int)((uint32_t)(range & 0xFFFFFFFF));
+      if (left > most_left) {
+        most_left = left;
+        victim = i;
+      }
+    }
+    if (victim == -1) {
+      return -1;
+    }
+    range = ts->range[victim * TASK_DEQUE_STRIDE];
+    head = (uint32_t)(range & 0xFFFFFFFF);
+    tail = (uint32_t)(range >> 32);
+    if ((head < tail) && cas_task_range(ts, victim, range,
+      (uint64_t)head | ((uint64_t)(tail - 1) << 32))) {
+      *stolen = (victim != worker);
+      return ts->task[tail - 1];
+    }
+  }
+}
+
@@ -0,0 +1,602 @@
+/*
+
+worker.c
+
+is part of
+
+Open3DALIGN
+-----------
+
+An open-source software aimed at unsupervised molecular alignment
+
+Copyright (C) 2010-2018 Paolo Tosco, Thomas Balle
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+
+For further information, please contact:
+
+Paolo Tosco, PhD
+Dipartimento di Scienza e Tecnologia del Farmaco
+Universita' degli Studi di Torino
+Via Pietro Giuria, 9
+10125 Torino (Italy)
+Phone:  +39 011 670 7680
+Mobile: +39 348 553 7206
+Fax:    +39 011 670 7687
+E-mail: paolo.tosco@unito.it
+
+*/
+#ifndef WIN32
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#endif
+#include <include/o3header.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+
+static double elapsed_seconds(struct timeval *start, struct timeval *end)
+{
+  return (double)(end->tv_sec - start->tv_sec)
+    + (double)(end->tv_usec - start->tv_usec) * 1.0e-06;
+}
+
+
+int alloc_workers(O3Data *od)
+{
+  /*
+  one small WorkerInfo per CPU; unlike ThreadInfo,
+  it does not embed a copy of O3Data, but points
+  to the caller's one, which threads treat as a
+  read-only run context; hence the number of
+  threads is only bounded by od->n_proc
+  */
+  free_workers(od);
+  od->mel.n_workers = ((od->n_proc > 0) ? od->n_proc : 1);
+  if (!(od->mel.worker_info = (WorkerInfo **)
+    alloc_array(od->mel.n_workers, sizeof(WorkerInfo)))) {
+    od->mel.n_workers = 0;
+    return OUT_OF_MEMORY;
+  }
+  
+  return 0;
+}
+
+
+void free_workers(O3Data *od)
+{
+  if (od->mel.worker_info) {
+    free_array(od->mel.worker_info);
+    od->mel.worker_info = NULL;
+  }
+  od->mel.n_workers = 0;
+}
+
+
+int fill_worker_info(O3Data *od, O3Data *od_comp, int n_tasks)
+{
+  int i;
+  int n_threads;
+  int n_calc_per_thread;
+  int n_calc_excess;
+  int start;
+  WorkerInfo **wi;
+  
+  
+  /*
+  split n_tasks in contiguous, nearly equal ranges,
+  one per thread; the number of threads used is
+  returned
+  */
+  wi = od->mel.worker_info;
+  n_threads = ((n_tasks < od->mel.n_workers) ? n_tasks : od->mel.n_workers);
+  if (n_threads < 1) {
+    return 0;
+  }
+  n_calc_per_thread = n_tasks / n_threads;
+  n_calc_excess = n_tasks % n_threads;
+  for (i = 0, start = 0; i < n_threads; ++i) {
+    memset(wi[i], 0, sizeof(WorkerInfo));
+    wi[i]->thread_num = i;
+    wi[i]->n_calc = n_calc_per_thread + ((i < n_calc_excess) ? 1 : 0);
+    wi[i]->start = start;
+    wi[i]->end = start + wi[i]->n_calc - 1;
+    wi[i]->od = od;
+    wi[i]->od_comp = od_comp;
+    start += wi[i]->n_calc;
+  }
+  
+  return n_threads;
+}
+
+
+static void pin_pool_thread(PoolThread *pt)
+{
+  #ifndef WIN32
+  #ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  cpu_set_t cpu_set;
+  #endif
+  #endif
+  
+  
+  /*
+  the i-th pool thread is bound to the
+  (i % n_cpus_online)-th CPU; pinning is
+  best-effort, failures are only counted
+  */
+  #ifndef WIN32
+  #ifdef HAVE_PTHREAD_SETAFFINITY_NP
+  CPU_ZERO(&cpu_set);
+  CPU_SET(pt->index % pt->pool->n_cpus_online, &cpu_set);
+  if (!pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpu_set)) {
+    ++(pt->pool->n_pinned);
+  }
+  #endif
+  #else
+  if (SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1
+    << (pt->index % pt->pool->n_cpus_online))) {
+    ++(pt->pool->n_pinned);
+  }
+  #endif
+}
+
+
+#ifndef WIN32
+static void *pool_thread(void *pointer)
+#else
+static DWORD pool_thread(void *pointer)
+#endif
+{
+  void *thread_func;
+  struct timeval start;
+  struct timeval end;
+  PoolThread *pt;
+  WorkerPool *pool;
+  WorkerInfo *wi;
+  
+  
+  pt = (PoolThread *)pointer;
+  pool = pt->pool;
+  #ifndef WIN32
+  pthread_mutex_lock(&(pool->mutex));
+  #else
+  EnterCriticalSection(&(pool->mutex));
+  #endif
+  if (pool->pin) {
+    pin_pool_thread(pt);
+  }
+  while (1) {
+    /*
+    sleep until a new phase is dispatched
+    or the pool is shut down
+    */
+    while ((!(pool->shutdown)) && (pt->generation == pool->generation)) {
+      #ifndef WIN32
+      pthread_cond_wait(&(pool->start_cond), &(pool->mutex));
+      #else
+      SleepConditionVariableCS(&(pool->start_cond), &(pool->mutex), INFINITE);
+      #endif
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    pt->generation = pool->generation;
+    if (pt->index >= pool->n_active) {
+      continue;
+    }
+    thread_func = pool->thread_func;
+    wi = pool->worker_info[pt->index];
+    #ifndef WIN32
+    pthread_mutex_unlock(&(pool->mutex));
+    #else
+    LeaveCriticalSection(&(pool->mutex));
+    #endif
+    gettimeofday(&start, NULL);
+    #ifndef WIN32
+    ((void *(*)(void *))thread_func)(wi);
+    #else
+    ((LPTHREAD_START_ROUTINE)thread_func)(wi);
+    #endif
+    gettimeofday(&end, NULL);
+    #ifndef WIN32
+    pthread_mutex_lock(&(pool->mutex));
+    #else
+    EnterCriticalSection(&(pool->mutex));
+    #endif
+    pt->wait_time = elapsed_seconds(&(pool->dispatch_time), &start);
+    pt->busy_time = elapsed_seconds(&start, &end);
+    --(pool->n_running);
+    if (!(pool->n_running)) {
+      #ifndef WIN32
+      pthread_cond_signal(&(pool->done_cond));
+      #else
+      WakeConditionVariable(&(pool->done_cond));
+      #endif
+    }
+  }
+  #ifndef WIN32
+  pthread_mutex_unlock(&(pool->mutex));
+  
+  return NULL;
+  #else
+  LeaveCriticalSection(&(pool->mutex));
+  
+  return 0;
+  #endif
+}
+
+
+static int grow_worker_pool(WorkerPool *pool, int n_threads)
+{
+  int max_n_threads;
+  PoolThread **thread;
+  PoolThread *pt;
+  #ifndef WIN32
+  pthread_attr_t thread_attr;
+  #endif
+  
+  
+  /*
+  must be called with no phase in flight; new
+  threads start from the current generation, so
+  they will only pick up the next dispatch
+  */
+  if (n_threads > pool->max_n_threads) {
+    max_n_threads = ((n_threads > 2 * pool->max_n_threads)
+      ? n_threads : 2 * pool->max_n_threads);
+    if (!(thread = (PoolThread **)realloc(pool->thread,
+      max_n_threads * sizeof(PoolThread *)))) {
+      return OUT_OF_MEMORY;
+    }
+    pool->thread = thread;
+    pool->max_n_threads = max_n_threads;
+  }
+  #ifndef WIN32
+  pthread_attr_init(&thread_attr);
+  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
+  #endif
+  while (pool->n_threads < n_threads) {
+    if (!(pt = (PoolThread *)malloc(sizeof(PoolThread)))) {
+      break;
+    }
+    memset(pt, 0, sizeof(PoolThread));
+    pt->index = pool->n_threads;
+    pt->generation = pool->generation;
+    pt->pool = pool;
+    #ifndef WIN32
+    if (pthread_create(&(pt->thread_id), &thread_attr, pool_thread, pt)) {
+      free(pt);
+      break;
+    }
+    #else
+    if (!(pt->thread_handle = CreateThread(NULL, 0,
+      (LPTHREAD_START_ROUTINE)pool_thread, pt, 0, &(pt->thread_id)))) {
+      free(pt);
+      break;
+    }
+    #endif
+    pool->thread[pool->n_threads] = pt;
+    ++(pool->n_threads);
+  }
+  #ifndef WIN32
+  pthread_attr_destroy(&thread_attr);
+  #endif
+  
+  return ((pool->n_threads < n_threads) ? CANNOT_CREATE_THREAD : 0);
+}
+
+
+int create_worker_pool(O3Data *od, int pin)
+{
+  int result;
+  WorkerPool *pool;
+  #ifdef WIN32
+  SYSTEM_INFO sys_info;
+  #endif
+  
+  
+  /*
+  the pool is created once per session; its threads
+  sleep between parallel phases and are reused by
+  run_workers() instead of being created and joined
+  by every command
+  */
+  if (!(pool = (WorkerPool *)malloc(sizeof(WorkerPool)))) {
+    return OUT_OF_MEMORY;
+  }
+  memset(pool, 0, sizeof(WorkerPool));
+  pool->pin = pin;
+  #ifndef WIN32
+  pool->n_cpus_online = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  pthread_mutex_init(&(pool->mutex), NULL);
+  pthread_cond_init(&(pool->start_cond), NULL);
+  pthread_cond_init(&(pool->done_cond), NULL);
+  #else
+  GetSystemInfo(&sys_info);
+  pool->n_cpus_online = (int)(sys_info.dwNumberOfProcessors);
+  if (pool->n_cpus_online > (int)(8 * sizeof(DWORD_PTR))) {
+    pool->n_cpus_online = (int)(8 * sizeof(DWORD_PTR));
+  }
+  InitializeCriticalSection(&(pool->mutex));
+  InitializeConditionVariable(&(pool->start_cond));
+  InitializeConditionVariable(&(pool->done_cond));
+  #endif
+  if (pool->n_cpus_online < 1) {
+    pool->n_cpus_online = 1;
+  }
+  od->mel.worker_pool = pool;
+  result = grow_worker_pool(pool, ((od->n_proc > 0) ? od->n_proc : 1));
+  if (result) {
+    free_worker_pool(od);
+  }
+  
+  return result;
+}
+
+
+void free_worker_pool(O3Data *od)
+{
+  int i;
+  WorkerPool *pool;
+  
+  
+  if (!(pool = od->mel.worker_pool)) {
+    return;
+  }
+  #ifndef WIN32
+  pthread_mutex_lock(&(pool->mutex));
+  pool->shutdown = 1;
+  pthread_cond_broadcast(&(pool->start_cond));
+  pthread_mutex_unlock(&(pool->mutex));
+  #else
+  EnterCriticalSection(&(pool->mutex));
+  pool->shutdown = 1;
+  WakeAllConditionVariable(&(pool->start_cond));
+  LeaveCriticalSection(&(pool->mutex));
+  #endif
+  for (i = 0; i < pool->n_threads; ++i) {
+    #ifndef WIN32
+    pthread_join(pool->thread[i]->thread_id, NULL);
+    #else
+    WaitForSingleObject(pool->thread[i]->thread_handle, INFINITE);
+    CloseHandle(pool->thread[i]->thread_handle);
+    #endif
+    free(pool->thread[i]);
+  }
+  #ifndef WIN32
+  pthread_cond_destroy(&(pool->done_cond));
+  pthread_cond_destroy(&(pool->start_cond));
+  pthread_mutex_destroy(&(pool->mutex));
+  #else
+  DeleteCriticalSection(&(pool->mutex));
+  #endif
+  if (pool->thread) {
+    free(pool->thread);
+  }
+  free(pool);
+  od->mel.worker_pool = NULL;
+}
+
+
+static void update_pool_phase_stats(WorkerPool *pool, char *phase_name, double wall_time)
+{
+  int i;
+  PoolPhaseStats *ps;
+  
+  
+  for (i = 0; (i < pool->n_phases)
+    && strncmp(pool->phase[i].name, phase_name, MAX_NAME_LEN - 1); ++i);
+  if (i == pool->n_phases) {
+    if (pool->n_phases == MAX_POOL_PHASES) {
+      return;
+    }
+    ++(pool->n_phases);
+    strncpy(pool->phase[i].name, phase_name, MAX_NAME_LEN - 1);
+  }
+  ps = &(pool->phase[i]);
+  ++(ps->n_runs);
+  ps->n_thread_runs += pool->n_active;
+  ps->wall_time += wall_time;
+  for (i = 0; i < pool->n_active; ++i) {
+    ps->busy_time += pool->thread[i]->busy_time;
+    ps->wait_time += pool->thread[i]->wait_time;
+    if (pool->thread[i]->wait_time > ps->max_wait_time) {
+      ps->max_wait_time = pool->thread[i]->wait_time;
+    }
+  }
+}
+
+
+static void run_worker_pool_batch(WorkerPool *pool, char *phase_name,
+  WorkerInfo **worker_info, int n_threads, void *thread_func)
+{
+  struct timeval end;
+  
+  
+  #ifndef WIN32
+  pthread_mutex_lock(&(pool->mutex));
+  #else
+  EnterCriticalSection(&(pool->mutex));
+  #endif
+  pool->thread_func = thread_func;
+  pool->worker_info = worker_info;
+  pool->n_active = n_threads;
+  pool->n_running = n_threads;
+  gettimeofday(&(pool->dispatch_time), NULL);
+  ++(pool->generation);
+  #ifndef WIN32
+  pthread_cond_broadcast(&(pool->start_cond));
+  while (pool->n_running) {
+    pthread_cond_wait(&(pool->done_cond), &(pool->mutex));
+  }
+  #else
+  WakeAllConditionVariable(&(pool->start_cond));
+  while (pool->n_running) {
+    SleepConditionVariableCS(&(pool->done_cond), &(pool->mutex), INFINITE);
+  }
+  #endif
+  gettimeofday(&end, NULL);
+  update_pool_phase_stats(pool, phase_name,
+    elapsed_seconds(&(pool->dispatch_time), &end));
+  #ifndef WIN32
+  pthread_mutex_unlock(&(pool->mutex));
+  #else
+  LeaveCriticalSection(&(pool->mutex));
+  #endif
+}
+
+
+static int dispatch_worker_pool(O3Data *od, char *phase_name, int n_threads, void *thread_func)
+{
+  int i;
+  int n_batch;
+  WorkerPool *pool;
+  
+  
+  pool = od->mel.worker_pool;
+  /*
+  "env n_cpus" may have raised the number of CPUs
+  since the pool was created; if the pool cannot
+  grow accordingly, the WorkerInfo slots are run
+  in batches on the threads it already has, which
+  is correct since slots do not wait for each other
+  */
+  if (grow_worker_pool(pool, n_threads)) {
+    if (!(pool->n_threads)) {
+      return CANNOT_CREATE_THREAD;
+    }
+    tee_printf(od, "Only %d out of %d threads could be started; "
+      "the %s phase will run them in batches.\n",
+      pool->n_threads, n_threads, phase_name);
+    tee_flush(od);
+  }
+  for (i = 0; i < n_threads; i += n_batch) {
+    n_batch = ((n_threads - i) < pool->n_threads) ? (n_threads - i) : pool->n_threads;
+    run_worker_pool_batch(pool, phase_name,
+      &(od->mel.worker_info[i]), n_batch, thread_func);
+  }
+  
+  return 0;
+}
+
+
+void print_worker_pool_stats(O3Data *od)
+{
+  int i;
+  WorkerPool *pool;
+  PoolPhaseStats *ps;
+  
+  
+  pool = od->mel.worker_pool;
+  if ((!pool) || (!(pool->n_phases))) {
+    return;
+  }
+  tee_printf(od, "\n"
+    "Worker pool: %d threads", pool->n_threads);
+  if (pool->pin) {
+    tee_printf(od, ", %d pinned to CPUs", pool->n_pinned);
+  }
+  tee_printf(od, "\n\n"
+    "%-16s%8s%10s%12s%12s%16s%16s\n"
+    "------------------------------------------------------------------------------------------\n",
+    "Phase", "Runs", "Threads", "Wall (s)", "Util (%)", "Mean wait (ms)", "Max wait (ms)");
+  for (i = 0; i < pool->n_phases; ++i) {
+    ps = &(pool->phase[i]);
+    /*
+    utilisation is the busy time summed over threads
+    divided by the thread time made available to the
+    phase; queue wait is the time elapsed between
+    dispatch and the moment a thread picked it up
+    */
+    tee_printf(od, "%-16s%8d%10.1lf%12.3lf%12.1lf%16.3lf%16.3lf\n",
+      ps->name, ps->n_runs, (double)(ps->n_thread_runs) / (double)(ps->n_runs),
+      ps->wall_time, ((ps->wall_time > 0.0) ? 100.0 * ps->busy_time
+      * (double)(ps->n_runs) / ((double)(ps->n_thread_runs) * ps->wall_time) : 0.0),
+      1000.0 * ps->wait_time / (double)(ps->n_thread_runs),
+      1000.0 * ps->max_wait_time);
+  }
+  tee_printf(od, "\n");
+  tee_flush(od);
+}
+
+
+int run_workers(O3Data *od, char *phase_name, int n_threads, void *thread_func)
+{
+  int i;
+  int result = 0;
+  WorkerInfo **wi;
+  #ifndef WIN32
+  pthread_attr_t thread_attr;
+  #endif
+  
+  
+  /*
+  run thread_func on n_threads WorkerInfo slots
+  and wait for all of them to have finished;
+  the session-wide pool is used when available,
+  otherwise threads are created for this phase
+  only and all those which could be started
+  are joined
+  */
+  if (n_threads < 1) {
+    return 0;
+  }
+  if (od->mel.worker_pool) {
+    return dispatch_worker_pool(od, phase_name, n_threads, thread_func);
+  }
+  wi = od->mel.worker_info;
+  #ifndef WIN32
+  pthread_attr_init(&thread_attr);
+  pthread_attr_setdetachstate(&thread_attr, PTHREAD_CREATE_JOINABLE);
+  for (i = 0; i < n_threads; ++i) {
+    od->error_code = pthread_create(&(wi[i]->thread_id),
+      &thread_attr, (void *(*)(void *))thread_func, wi[i]);
+    if (od->error_code) {
+      result = CANNOT_CREATE_THREAD;
+      break;
+    }
+  }
+  pthread_attr_destroy(&thread_attr);
+  n_threads = i;
+  for (i = 0; i < n_threads; ++i) {
+    if (pthread_join(wi[i]->thread_id, &(wi[i]->thread_result))
+      && (!result)) {
+      result = CANNOT_JOIN_THREAD;
+    }
+  }
+  #else
+  for (i = 0; i < n_threads; ++i) {
+    wi[i]->thread_handle = CreateThread(NULL, 0,
+      (LPTHREAD_START_ROUTINE)thread_func,
+      wi[i], 0, &(wi[i]->thread_id));
+    if (!(wi[i]->thread_handle)) {
+      result = CANNOT_CREATE_THREAD;
+      break;
+    }
+  }
+  n_threads = i;
+  /*
+  WaitForMultipleObjects() cannot wait for more
+  than MAXIMUM_WAIT_OBJECTS handles at once
+  */
+  for (i = 0; i < n_threads; ++i) {
+    WaitForSingleObject(wi[i]->thread_handle, INFINITE);
+    CloseHandle(wi[i]->thread_handle);
+  }
+  #endif
+  
+  return result;
+}
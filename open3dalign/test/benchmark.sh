@@ -0,0 +1,229 @@
+#!/usr/bin/env bash
+
+#
+# Usage:
+#
+# ./benchmark.sh [superpose|simd|threads|shards|sdf|compress]
+#
+# runs the atom-based single-conformation alignment
+# of the ace, ache, therm and thr datasets once for
+# each variant of the selected benchmark; timings
+# and RMSD values are printed on stdout
+#
+# superpose:	LAPACK dsyev vs closed-form QCP kernel
+#		(O3_SUPERPOSE environment variable)
+# simd:		scalar vs AVX2 vs AVX-512 kernels for
+#		distance histograms, cost matrices and
+#		alignment scoring (O3_SIMD environment
+#		variable)
+# threads:	scaling of the atom-based alignment from
+#		1 to 128 threads (env n_cpus keyword)
+# shards:	atom-based alignment split among 1 to 8
+#		local processes (align shards parameter)
+# sdf:		line-buffered vs memory-mapped reader of
+#		SDF conformational databases (O3_SDF_READER
+#		environment variable); each dataset is split
+#		into per-object databases holding 100 copies
+#		of each molecule, which are then converted
+#		by the conf_db keyword. Parsing throughput
+#		is reported in MB/s instead of RMSD
+# compress:	plain vs gzip vs zstd output of aligned
+#		poses (align compress parameter); the
+#		comparison against the original alignment
+#		is skipped and the size of the output
+#		directory is reported instead of RMSD
+#
+
+abrupt_exit()
+{
+	echo
+	echo "Benchmark aborted."
+	exit
+}
+
+
+trap abrupt_exit SIGTSTP SIGINT SIGTERM SIGKILL
+awk_exe=`which 2> /dev/null gawk | grep -v 'no gawk'`
+if [ -z  $awk_exe ]; then
+	awk_exe=`which 2> /dev/null awk | grep -v 'no awk'`
+fi
+if [ -z $awk_exe ]; then
+	echo "Cannot find AWK."
+	abrupt_exit
+	exit
+fi
+if [ -z $O3A_EXE ]; then
+	O3A_EXE=`which 2> /dev/null open3dalign | grep -v 'no open3dalign'`
+fi
+if [ -z $O3A_EXE ] || [ ! -e $O3A_EXE ]; then
+	echo "Cannot find open3dalign binary. Please set the O3A_EXE environment variable and resubmit."
+	abrupt_exit
+	exit
+fi
+
+if [ -z $1 ]; then
+	benchmark=superpose
+else
+	benchmark=$1
+fi
+if [ $benchmark = superpose ]; then
+	variant_var=O3_SUPERPOSE
+	variants="dsyev qcp"
+elif [ $benchmark = simd ]; then
+	variant_var=O3_SIMD
+	variants="none avx2 avx512"
+elif [ $benchmark = threads ]; then
+	variant_var=n_cpus
+	variants="1 2 4 8 16 32 64 128"
+elif [ $benchmark = shards ]; then
+	variant_var=shards
+	variants="1 2 4 8"
+elif [ $benchmark = sdf ]; then
+	variant_var=O3_SDF_READER
+	variants="stdio mmap"
+elif [ $benchmark = compress ]; then
+	variant_var=compress
+	variants="none gzip zstd"
+else
+	echo "Acceptable benchmarks are \"superpose\", \"simd\", \"threads\", \"shards\", \"sdf\" and \"compress\"."
+	abrupt_exit
+	exit
+fi
+
+datasets="ace ache therm thr"
+for variant in $variants; do
+	for dataset in $datasets; do
+		orig_inp=${dataset}/${dataset}_reproduce_orig_alignment_single.inp
+		inp=${dataset}/${dataset}_benchmark_${benchmark}_${variant}.inp
+		out=${dataset}/${dataset}_benchmark_${benchmark}_${variant}.out
+		align_dir=${dataset}_align_atom_benchmark_${benchmark}_${variant}
+		#
+		# keep only import, random and atom-based alignment
+		# and the comparison against the original alignment;
+		# results go to a per-variant directory; the
+		# thread and shard counts and the compression
+		# are set through the input file
+		#
+		if [ $benchmark = sdf ]; then
+			#
+			# import the dataset, then convert its
+			# conformational databases into a binary file
+			#
+			conf_dir=${dataset}/${dataset}_benchmark_sdf_conf
+			if [ ! -d $conf_dir ]; then
+				mkdir $conf_dir
+				$awk_exe -v dir=$conf_dir -v n_copies=100 '{
+					rec = rec $0 "\n"
+					if ($0 ~ /^\$\$\$\$/) {
+						++object
+						file = sprintf("%s/%04d.sdf", dir, object)
+						for (i = 0; i < n_copies; ++i) {
+							printf("%s", rec) > file
+						}
+						close(file)
+						rec = ""
+					}
+				}' < ${dataset}/${dataset}_3dqsar_canonical.sdf
+			fi
+			grep '^import' < $orig_inp > $inp
+			echo "conf_db conf_dir=${conf_dir} file=${dataset}/${dataset}_benchmark_sdf_${variant}.dat" >> $inp
+			rm -f ${dataset}/${dataset}_benchmark_sdf_${variant}.dat
+			eval "${variant_var}=${variant} $O3A_EXE -i $inp -o $out"
+			if (! grep 'Successful completion' < $out >& /dev/null); then
+				echo "Something went wrong during the benchmark run on the ${dataset} dataset."
+				echo "Please check ${out}, then resubmit."
+				abrupt_exit
+				exit
+			fi
+			continue
+		fi
+		if [ $benchmark = threads ]; then
+			echo "env n_cpus=${variant}" > $inp
+		else
+			rm -f $inp
+		fi
+		$awk_exe -v benchmark=$benchmark '{
+			if (sub(/\\$/, "")) {
+				line = line $0
+				next
+			}
+			line = line $0
+			if ((line ~ /^import/) || (line ~ /^align type=random/) ||
+				(line ~ /^align type=atom/) ||
+				((benchmark != "compress") && (line ~ /^compare/)
+				&& (line ~ /_align_atom_single/))) {
+				print line
+			}
+			line = ""
+		}' < $orig_inp \
+			| sed "s/${dataset}_align_atom_single/${align_dir}/g" > ${inp}.tmp
+		if [ $benchmark = shards ]; then
+			sed "s/^align type=atom/align type=atom shards=${variant}/" < ${inp}.tmp >> $inp
+		elif [ $benchmark = compress ]; then
+			sed "s/^align type=atom/align type=atom compress=${variant}/" < ${inp}.tmp >> $inp
+		else
+			cat ${inp}.tmp >> $inp
+		fi
+		rm -f ${inp}.tmp
+		rm -rf ${dataset}/${align_dir}
+		if [ $benchmark = threads ] || [ $benchmark = shards ] \
+			|| [ $benchmark = compress ]; then
+			$O3A_EXE -i $inp -o $out
+		else
+			eval "${variant_var}=${variant} $O3A_EXE -i $inp -o $out"
+		fi
+		if (! grep 'Successful completion' < $out >& /dev/null); then
+			echo "Something went wrong during the benchmark run on the ${dataset} dataset."
+			echo "Please check ${out}, then resubmit."
+			abrupt_exit
+			exit
+		fi
+	done
+done
+if [ $benchmark = sdf ]; then
+	elapsed_line=2
+else
+	elapsed_line=3
+fi
+echo
+echo "Benchmark: ${benchmark} (${variant_var})"
+echo "------------------------------"
+echo
+printf '%-24s' Dataset
+for variant in $variants; do
+	printf '%-16s' $variant
+done
+echo
+echo
+for dataset in $datasets; do
+	echo $dataset | tr '[:lower:]' '[:upper:]'
+	printf '%-24s' 'Time (s)'
+	for variant in $variants; do
+		out=${dataset}/${dataset}_benchmark_${benchmark}_${variant}.out
+		printf '%-16s' `grep Elapsed < $out | sed -n ${elapsed_line}p | awk '{print $3}'`
+	done
+	echo
+	if [ $benchmark = sdf ]; then
+		printf '%-24s' 'Throughput (MB/s)'
+		for variant in $variants; do
+			out=${dataset}/${dataset}_benchmark_${benchmark}_${variant}.out
+			printf '%-16s' `grep 'MB of SDF text were parsed' < $out | awk '{print $9}'`
+		done
+	elif [ $benchmark = compress ]; then
+		printf '%-24s' 'Output size (kB)'
+		for variant in $variants; do
+			align_dir=${dataset}_align_atom_benchmark_${benchmark}_${variant}
+			printf '%-16s' `du -sk ${dataset}/${align_dir} | awk '{print $1}'`
+		done
+	else
+		printf '%-24s' 'RMSD (angstrom)'
+		for variant in $variants; do
+			out=${dataset}/${dataset}_benchmark_${benchmark}_${variant}.out
+			printf '%-16s' `grep Average < $out | awk '{print $2}'`
+		done
+	fi
+	echo
+	echo
+done
+echo "Benchmark completed."
+echo
@@ -0,0 +1,391 @@
+#!/usr/bin/env bash
+
+#
+# Usage:
+#
+# ./regression.sh [simd|conf_db|score_index|mol_template|compress]
+#
+# runs the random and atom-based single-conformation
+# alignment of the ace, ache, therm and thr datasets
+# once for each variant of the selected check, then
+# verifies that the alternative code paths give the
+# same results as the reference one; the outcome is
+# printed on stdout, and the exit status is non-zero
+# if any check fails
+#
+# simd:		scalar vs AVX2 vs AVX-512 kernels for
+#		distance histograms, cost matrices and
+#		alignment scoring (O3_SIMD environment
+#		variable); random and aligned poses must be
+#		identical. The kernels actually used are
+#		printed, and variants which the CPU cannot
+#		run are skipped
+# conf_db:	multi-conformation candidates read from
+#		a directory of SDF conformational databases
+#		vs the binary file written from it by the
+#		conf_db keyword (align candidate_conf_dir
+#		parameter); random and aligned poses must
+#		be identical
+# score_index:	the best template file, whose records are
+#		picked from the files aligned on each
+#		template through their .idx score index,
+#		must be identical to the one obtained by
+#		a text parse of those files
+# mol_template:	poses written line by line vs from
+#		in-memory MOL templates (O3_MOL_TEMPLATE
+#		environment variable); random and aligned
+#		poses must be identical
+# compress:	plain vs gzip vs zstd output of aligned
+#		poses (align compress parameter); the
+#		decompressed files must be identical to
+#		the plain ones. The zstd variant is
+#		skipped if the zstd command is not found
+#
+
+abrupt_exit()
+{
+	echo
+	echo "Regression check aborted."
+	exit 1
+}
+
+# Run open3dalign on input file $1 with output file $2,
+# setting the environment variable assignment in $3
+run_o3a()
+{
+	eval "$3 $O3A_EXE -i $1 -o $2"
+	if (! grep 'Successful completion' < $2 >& /dev/null); then
+		echo "Something went wrong during the regression run on the ${dataset} dataset."
+		echo "Please check $2, then resubmit."
+		abrupt_exit
+	fi
+}
+
+# Keep only import, random and atom-based alignment from
+# the original input file of the current dataset into $1,
+# appending the ALIGN parameters in $2 to the atom-based
+# alignment; results go to per-variant directories
+make_atom_inp()
+{
+	$awk_exe -v params="$2" '{
+		if (sub(/\\$/, "")) {
+			line = line $0
+			next
+		}
+		line = line $0
+		if ((line ~ /^import/) || (line ~ /^align type=random/)) {
+			print line
+		}
+		else if (line ~ /^align type=atom/) {
+			print line params
+		}
+		line = ""
+	}' < ${dataset}/${dataset}_reproduce_orig_alignment_single.inp \
+		| sed -e "s/${dataset}_align_random/${random_dir}/g" \
+		-e "s/${dataset}_align_atom_single/${align_dir}/g" > $1
+}
+
+# Print the kernels used by the run whose output file is $1
+get_simd_kernels()
+{
+	grep 'kernels will be used' < $1 | $awk_exe '{print $1}'
+}
+
+# Value of the variant parameter for variant $1
+get_variant_value()
+{
+	if [ $check = conf_db ]; then
+		if [ $1 = dat ]; then
+			echo ${dataset}/${dataset}_regression_conf.dat
+		else
+			echo ${dataset}/${dataset}_regression_conf
+		fi
+	else
+		echo $1
+	fi
+}
+
+# Succeed if variant $1 could not be run as such on the
+# current dataset, in which case it is skipped
+is_skipped()
+{
+	out=${dataset}/${dataset}_regression_${check}_$1.out
+	if [ ! -e $out ]; then
+		return 0
+	fi
+	if [ $check = simd ]; then
+		kernels=`get_simd_kernels $out`
+		if ([ $1 = none ] && [ "$kernels" != Scalar ]) \
+			|| ([ $1 = avx2 ] && [ "$kernels" != AVX2 ]) \
+			|| ([ $1 = avx512 ] && [ "$kernels" != AVX-512 ]); then
+			return 0
+		fi
+	fi
+	return 1
+}
+
+# The SDF files in alignment directory $2 and in the
+# corresponding random alignment directory must be
+# byte-identical to those in reference directory $1
+# and in its random counterpart
+same_sdf_files()
+{
+	for dir in $1 `echo $1 | sed 's/_align_atom_/_align_random_/'`; do
+		other_dir=`echo $dir | sed "s/_${ref_variant}\$/_$3/"`
+		for ref_file in $dir/*.sdf; do
+			if (! cmp -s $ref_file $other_dir/`basename $ref_file`); then
+				return 1
+			fi
+		done
+	done
+	return 0
+}
+
+# The best template file in directory $2, whose records
+# are looked up through the score index of the files
+# aligned on each template, must be identical to the
+# one rebuilt here by a text parse of those files;
+# object IDs are taken to match object numbers, as
+# they do in the test datasets
+same_best_template()
+{
+	best_file=`ls 2> /dev/null $2/*_on_best_template.sdf`
+	if [ -z $best_file ]; then
+		return 1
+	fi
+	prefix=${best_file%_on_best_template.sdf}
+	$awk_exe -v prefix=$prefix '{
+		if ($0 ~ /^>  <BEST_TEMPLATE_ID>/) {
+			getline
+			template[n++] = $1
+		}
+	}
+	END {
+		for (k = 0; k < n; ++k) {
+			file = sprintf("%s_on_%04d.sdf", prefix, template[k])
+			while (n_read[file] <= k) {
+				while (((status = (getline line < file)) > 0) && (line !~ /^\$\$\$\$/)) {
+					if (n_read[file] == k) {
+						print line
+					}
+				}
+				if (status <= 0) {
+					exit 1
+				}
+				++n_read[file]
+			}
+			printf(">  <BEST_TEMPLATE_ID>\n%d\n\n$$$$\n", template[k])
+		}
+	}' < $best_file > ${prefix}_on_best_template_text_parse.txt
+	if [ $? != 0 ]; then
+		return 1
+	fi
+	cmp -s $best_file ${prefix}_on_best_template_text_parse.txt
+}
+
+# The SDF files in directory $2, compressed with the
+# method in $3, must decompress to files identical to
+# those in reference directory $1
+same_decompressed_files()
+{
+	if [ $3 = gzip ]; then
+		ext=.gz
+		decompress="gzip -dc"
+	else
+		ext=.zst
+		decompress="$zstd_exe -dcq"
+	fi
+	for ref_file in $1/*.sdf; do
+		file=$2/`basename $ref_file`$ext
+		if [ ! -e $file ]; then
+			return 1
+		fi
+		$decompress < $file | cmp -s - $ref_file
+		if [ $? != 0 ]; then
+			return 1
+		fi
+	done
+	return 0
+}
+
+
+trap abrupt_exit SIGTSTP SIGINT SIGTERM SIGKILL
+awk_exe=`which 2> /dev/null gawk | grep -v 'no gawk'`
+if [ -z  $awk_exe ]; then
+	awk_exe=`which 2> /dev/null awk | grep -v 'no awk'`
+fi
+if [ -z $awk_exe ]; then
+	echo "Cannot find AWK."
+	abrupt_exit
+fi
+if [ -z $O3A_EXE ]; then
+	O3A_EXE=`which 2> /dev/null open3dalign | grep -v 'no open3dalign'`
+fi
+if [ -z $O3A_EXE ] || [ ! -e $O3A_EXE ]; then
+	echo "Cannot find open3dalign binary. Please set the O3A_EXE environment variable and resubmit."
+	abrupt_exit
+fi
+
+#
+# each check sets the environment variable (O3_*) or
+# ALIGN parameter which selects its variants, the first
+# variant being the reference, and the function which
+# compares the results of the others with it; checks
+# without a variable compare each run with a reference
+# of their own
+#
+if [ -z $1 ]; then
+	check=simd
+else
+	check=$1
+fi
+extra_params=""
+if [ $check = simd ]; then
+	variant_var=O3_SIMD
+	variants="none avx2 avx512"
+	compare=same_sdf_files
+elif [ $check = conf_db ]; then
+	variant_var=candidate_conf_dir
+	variants="sdf dat"
+	extra_params=" candidate=multi"
+	compare=same_sdf_files
+elif [ $check = score_index ]; then
+	variant_var=""
+	variants="text_parse"
+	compare=same_best_template
+elif [ $check = mol_template ]; then
+	variant_var=O3_MOL_TEMPLATE
+	variants="line template"
+	compare=same_sdf_files
+elif [ $check = compress ]; then
+	variant_var=compress
+	variants="none gzip zstd"
+	compare=same_decompressed_files
+	zstd_exe=`which 2> /dev/null zstd | grep -v 'no zstd'`
+else
+	echo "Acceptable checks are \"simd\", \"conf_db\", \"score_index\","
+	echo "\"mol_template\" and \"compress\"."
+	abrupt_exit
+fi
+
+datasets="ace ache therm thr"
+if [ $check = conf_db ]; then
+	for dataset in $datasets; do
+		#
+		# each object gets a conformational database
+		# holding its original pose followed by two
+		# copies rotated through a cyclic permutation
+		# of the axes, which involves no rounding;
+		# the directory is then converted into a
+		# binary file
+		#
+		conf_dir=`get_variant_value sdf`
+		rm -rf $conf_dir
+		mkdir $conf_dir
+		$awk_exe -v dir=$conf_dir '{
+			rec[n++] = $0
+			if ($0 ~ /^\$\$\$\$/) {
+				++object
+				file = sprintf("%s/%04d.sdf", dir, object)
+				n_atoms = substr(rec[3], 1, 3) + 0
+				for (k = 0; k < 3; ++k) {
+					for (i = 0; i < n; ++i) {
+						line = rec[i]
+						if ((i >= 4) && (i < (4 + n_atoms))) {
+							for (x = 0; x < 3; ++x) {
+								c[x] = substr(line, 1 + 10 * x, 10)
+							}
+							line = c[k % 3] c[(k + 1) % 3] c[(k + 2) % 3] substr(line, 31)
+						}
+						print line > file
+					}
+				}
+				close(file)
+				n = 0
+			}
+		}' < ${dataset}/${dataset}_3dqsar_canonical.sdf
+		inp=${dataset}/${dataset}_regression_conf_db_convert.inp
+		out=${dataset}/${dataset}_regression_conf_db_convert.out
+		grep '^import' < ${dataset}/${dataset}_reproduce_orig_alignment_single.inp > $inp
+		echo "conf_db conf_dir=${conf_dir} file=`get_variant_value dat`" >> $inp
+		rm -f `get_variant_value dat`
+		run_o3a $inp $out ""
+	done
+fi
+for variant in $variants; do
+	for dataset in $datasets; do
+		inp=${dataset}/${dataset}_regression_${check}_${variant}.inp
+		out=${dataset}/${dataset}_regression_${check}_${variant}.out
+		random_dir=${dataset}_align_random_regression_${check}_${variant}
+		align_dir=${dataset}_align_atom_regression_${check}_${variant}
+		rm -rf $out ${dataset}/${random_dir} ${dataset}/${align_dir}
+		if [ $check = compress ] && [ $variant = zstd ] && [ -z $zstd_exe ]; then
+			continue
+		fi
+		if [ -z $variant_var ]; then
+			make_atom_inp $inp "$extra_params"
+			run_o3a $inp $out ""
+		elif [ ${variant_var:0:3} = O3_ ]; then
+			make_atom_inp $inp "$extra_params"
+			run_o3a $inp $out "${variant_var}=${variant}"
+		else
+			make_atom_inp $inp "${extra_params} ${variant_var}=`get_variant_value $variant`"
+			run_o3a $inp $out ""
+		fi
+	done
+done
+ref_variant=""
+if [ -n "$variant_var" ]; then
+	ref_variant=`echo $variants | $awk_exe '{print $1}'`
+fi
+failed=0
+echo
+echo "Regression check: ${check} (${variant_var:-no variants})"
+echo "------------------------------"
+echo
+if [ $check = simd ]; then
+	dataset=`echo $datasets | $awk_exe '{print $1}'`
+	for variant in $variants; do
+		printf '%-24s%s\n' "${variant_var}=${variant}" \
+			"`get_simd_kernels ${dataset}/${dataset}_regression_${check}_${variant}.out` kernels"
+	done
+	echo
+fi
+printf '%-24s' Dataset
+for variant in $variants; do
+	if [ $variant != "$ref_variant" ]; then
+		printf '%-16s' $variant
+	fi
+done
+echo
+echo
+for dataset in $datasets; do
+	printf '%-24s' `echo $dataset | tr '[:lower:]' '[:upper:]'`
+	ref_dir=${dataset}/${dataset}_align_atom_regression_${check}_${ref_variant}
+	for variant in $variants; do
+		if [ $variant = "$ref_variant" ]; then
+			continue
+		fi
+		if is_skipped $variant; then
+			printf '%-16s' skipped
+			continue
+		fi
+		dir=${dataset}/${dataset}_align_atom_regression_${check}_${variant}
+		$compare $ref_dir $dir $variant
+		if [ $? = 0 ]; then
+			printf '%-16s' passed
+		else
+			printf '%-16s' FAILED
+			failed=1
+		fi
+	done
+	echo
+done
+echo
+if [ $failed = 1 ]; then
+	echo "Regression check failed."
+	echo
+	exit 1
+fi
+echo "Regression check succeeded."
+echo